@@ -63,7 +63,7 @@ static int redisPollTick(redisAsyncContext *ac, double timeout) {
     /* local flags, won't get changed during callbacks */
     reading = e->reading;
     writing = e->writing;
-    if (!reading && !writing)
+    if (!reading && !writing && e->deadline == 0.0)
         return 0;
 
     pfd.fd = e->fd;
@@ -79,7 +79,10 @@ static int redisPollTick(redisAsyncContext *ac, double timeout) {
         itimeout = -1;
     }
 
-    ns = poll(&pfd, 1, itimeout);
+    /* only a timer is pending, e.g. while waiting to reconnect */
+    ns = 0;
+    if (reading || writing)
+        ns = poll(&pfd, 1, itimeout);
     if (ns < 0) {
         /* ignore the EINTR error */
         if (errno != EINTR)
@@ -32,6 +32,11 @@
 #include "alloc.h"
 #include <string.h>
 #include <stdlib.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "stats.h"
 
 hiredisAllocFuncs hiredisAllocFns = {
     .mallocFn = malloc,
@@ -88,3 +93,160 @@ void hi_free(void *ptr) {
 }
 
 #endif
+
+#ifndef _WIN32
+
+/* Objects sizes cached per thread. hiredis needs three. */
+#define OBJ_CACHE_SIZES 4
+
+typedef struct objCacheEntry {
+    struct objCacheEntry *next;
+} objCacheEntry;
+
+typedef struct objCacheList {
+    size_t size;            /* Size of the objects, 0 while unused */
+    size_t count;
+    objCacheEntry *head;
+} objCacheList;
+
+typedef struct objCache {
+    objCacheList lists[OBJ_CACHE_SIZES];
+    int registered;         /* Flushed when the thread exits */
+} objCache;
+
+static size_t objCacheLimit;
+static pthread_once_t objCacheKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t objCacheKey;
+static int objCacheKeyOk;
+static __thread objCache objCacheLocal;
+
+static void objCacheFlush(objCache *cache) {
+    objCacheEntry *e;
+    int i;
+
+    for (i = 0; i < OBJ_CACHE_SIZES; i++) {
+        while ((e = cache->lists[i].head) != NULL) {
+            cache->lists[i].head = e->next;
+            hi_free(e);
+        }
+        cache->lists[i].count = 0;
+    }
+    cache->registered = 0;
+}
+
+static void objCacheDestroy(void *cache) {
+    objCacheFlush(cache);
+}
+
+static void objCacheCreateKey(void) {
+    objCacheKeyOk = pthread_key_create(&objCacheKey, objCacheDestroy) == 0;
+}
+
+/* Have the cache of this thread flushed when it exits. */
+static int objCacheRegister(void) {
+    pthread_once(&objCacheKeyOnce, objCacheCreateKey);
+    if (!objCacheKeyOk || pthread_setspecific(objCacheKey, &objCacheLocal) != 0)
+        return 0;
+    objCacheLocal.registered = 1;
+    return 1;
+}
+
+static objCacheList *objCacheFind(size_t size) {
+    objCacheList *l;
+    int i;
+
+    for (i = 0; i < OBJ_CACHE_SIZES; i++) {
+        l = &objCacheLocal.lists[i];
+        if (l->size == size)
+            return l;
+        if (l->size == 0) {
+            l->size = size;
+            return l;
+        }
+    }
+    return NULL;
+}
+
+size_t hiredisSetObjectCacheLimit(size_t limit) {
+    size_t orig = redisStatLoad(&objCacheLimit);
+
+    redisStatStore(&objCacheLimit, limit);
+    return orig;
+}
+
+void hiredisFlushObjectCache(void) {
+    objCacheFlush(&objCacheLocal);
+}
+
+void *hi_obj_malloc(size_t size) {
+    objCacheList *l;
+    objCacheEntry *e;
+
+    if (redisStatLoad(&objCacheLimit) == 0 || (l = objCacheFind(size)) == NULL ||
+        (e = l->head) == NULL)
+        return hi_malloc(size);
+
+    l->head = e->next;
+    l->count--;
+    return e;
+}
+
+void *hi_obj_calloc(size_t size) {
+    objCacheList *l;
+    objCacheEntry *e;
+
+    if (redisStatLoad(&objCacheLimit) == 0 || (l = objCacheFind(size)) == NULL ||
+        (e = l->head) == NULL)
+        return hi_calloc(1, size);
+
+    l->head = e->next;
+    l->count--;
+    memset(e, 0, size);
+    return e;
+}
+
+void hi_obj_free(void *ptr, size_t size) {
+    size_t limit = redisStatLoad(&objCacheLimit);
+    objCacheEntry *e = ptr;
+    objCacheList *l;
+
+    if (ptr == NULL)
+        return;
+    if (limit == 0 || size < sizeof(*e) || (l = objCacheFind(size)) == NULL ||
+        l->count >= limit || (!objCacheLocal.registered && !objCacheRegister()))
+    {
+        hi_free(ptr);
+        return;
+    }
+
+    e->next = l->head;
+    l->head = e;
+    l->count++;
+}
+
+#else /* _WIN32 */
+
+/* The object cache relies on thread local storage and POSIX threads. */
+
+size_t hiredisSetObjectCacheLimit(size_t limit) {
+    (void)limit;
+    return 0;
+}
+
+void hiredisFlushObjectCache(void) {
+}
+
+void *hi_obj_malloc(size_t size) {
+    return hi_malloc(size);
+}
+
+void *hi_obj_calloc(size_t size) {
+    return hi_calloc(1, size);
+}
+
+void hi_obj_free(void *ptr, size_t size) {
+    (void)size;
+    hi_free(ptr);
+}
+
+#endif
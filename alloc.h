@@ -50,6 +50,18 @@ typedef struct hiredisAllocFuncs {
 hiredisAllocFuncs hiredisSetAllocators(hiredisAllocFuncs *ha);
 void hiredisResetAllocators(void);
 
+/* An allocator for the objects of one context or reader, such as its replies,
+ * instead of the process wide one. privdata is passed to every call, so it
+ * can be an arena, a jemalloc tcache or an accounting tag. freeFn is never
+ * called with NULL. */
+typedef struct hiredisAllocator {
+    void *(*mallocFn)(void *privdata, size_t size);
+    void *(*callocFn)(void *privdata, size_t nmemb, size_t size);
+    void *(*reallocFn)(void *privdata, void *ptr, size_t size);
+    void (*freeFn)(void *privdata, void *ptr);
+    void *privdata;
+} hiredisAllocator;
+
 #ifndef _WIN32
 
 /* Hiredis' configured allocator function pointer struct */
@@ -89,6 +101,46 @@ void hi_free(void *ptr);
 
 #endif
 
+/* Keep up to limit freed objects of each size per thread, for the small
+ * objects hiredis allocates and frees for every reply or command (reply
+ * objects, asynchronous callbacks and reader tasks), and reuse them rather
+ * than going through the allocators. 0, the default, disables the cache.
+ * Cached objects are released when their thread exits, or calls
+ * hiredisFlushObjectCache(), with the allocators set at that time: set them
+ * first. Returns the previous limit. Not available on Windows. */
+size_t hiredisSetObjectCacheLimit(size_t limit);
+void hiredisFlushObjectCache(void);
+
+/* Allocate and free such objects through the cache. Objects of a size are
+ * only reused for that size, which must be given again when freeing. */
+void *hi_obj_malloc(size_t size);
+void *hi_obj_calloc(size_t size);
+void hi_obj_free(void *ptr, size_t size);
+
+/* Allocate from a, or from the configured allocators if a is NULL. */
+static inline void *hi_malloc_from(const hiredisAllocator *a, size_t size) {
+    return a ? a->mallocFn(a->privdata, size) : hi_malloc(size);
+}
+
+static inline void *hi_calloc_from(const hiredisAllocator *a, size_t nmemb, size_t size) {
+    if (a == NULL)
+        return hi_calloc(nmemb, size);
+    if (SIZE_MAX / size < nmemb)
+        return NULL;
+    return a->callocFn(a->privdata, nmemb, size);
+}
+
+static inline void *hi_realloc_from(const hiredisAllocator *a, void *ptr, size_t size) {
+    return a ? a->reallocFn(a->privdata, ptr, size) : hi_realloc(ptr, size);
+}
+
+static inline void hi_free_from(const hiredisAllocator *a, void *ptr) {
+    if (a == NULL)
+        hi_free(ptr);
+    else if (ptr != NULL)
+        a->freeFn(a->privdata, ptr);
+}
+
 #ifdef __cplusplus
 }
 #endif
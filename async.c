@@ -39,10 +39,14 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
+#include <time.h>
 #include "async.h"
 #include "net.h"
 #include "dict.c"
 #include "sds.h"
+#include "stats.h"
+#include "trace.h"
 #include "win32.h"
 
 #include "async_private.h"
@@ -55,11 +59,60 @@
 /* Forward declarations of hiredis.c functions */
 int __redisAppendCommand(redisContext *c, const char *cmd, size_t len);
 void __redisSetError(redisContext *c, int type, const char *str);
+int __redisReopen(redisContext *c);
+
+/* Automatic reconnection states */
+#define REDIS_RECONNECT_IDLE 0       /* Connected, or connecting for the first time */
+#define REDIS_RECONNECT_WAITING 1    /* Waiting for the next attempt */
+#define REDIS_RECONNECT_CONNECTING 2 /* Attempt in progress */
+#define REDIS_RECONNECT_RESTORING 3  /* Connected, restoring the session state */
+
+struct redisAsyncReconnect {
+    redisAsyncReconnectOptions options;
+    int state;
+    int attempts; /* Failed attempts in a row */
+    uint32_t seed; /* State of the delay jitter generator */
+
+    /* Last session state commands, sent again on reconnection. */
+    sds auth;
+    sds hello;
+    sds select;
+
+    /* Commands to send again on reconnection. */
+    redisCallbackList replay;
+
+    /* Commands queued while reconnecting, set aside until the session state
+     * is restored. */
+    sds queuedbuf;
+    redisCallbackList queued;
+    int restoring; /* Session state replies still expected */
+};
+
+struct redisAsyncCache {
+    redisCache *cache;
+    int resp3;    /* The connection speaks RESP3 */
+    int tracking; /* The server tracks the keys read, the cache can be used */
+    int enabling; /* CLIENT TRACKING ON was sent, and not undone since */
+    int multi;    /* A transaction is open, replies are only QUEUED */
+    /* Bumped whenever the cache is flushed: replies to the commands sent
+     * before may belong to another database, and are not stored. */
+    unsigned long epoch;
+};
+
+/* Private data of a callback wrapped to keep a copy of its command: to send
+ * it again when the connection is lost before its reply (see
+ * redisAsyncReconnectOptions.replay), to remember the session state it sets,
+ * or to cache its reply. */
+typedef struct redisReplayData {
+    redisCallbackFn *fn;
+    void *privdata;
+    sds cmd;
+    unsigned long epoch; /* Cache epoch the command was sent in */
+} redisReplayData;
 
 /* Functions managing dictionary of callbacks for pub/sub. */
-static unsigned int callbackHash(const void *key) {
-    return dictGenHashFunction((const unsigned char *)key,
-                               sdslen((const sds)key));
+static size_t callbackKeyLength(const void *key) {
+    return sdslen((const sds)key);
 }
 
 static void *callbackValDup(void *privdata, const void *src) {
@@ -74,16 +127,6 @@ static void *callbackValDup(void *privdata, const void *src) {
     return dup;
 }
 
-static int callbackKeyCompare(void *privdata, const void *key1, const void *key2) {
-    int l1, l2;
-    ((void) privdata);
-
-    l1 = sdslen((const sds)key1);
-    l2 = sdslen((const sds)key2);
-    if (l1 != l2) return 0;
-    return memcmp(key1,key2,l1) == 0;
-}
-
 static void callbackKeyDestructor(void *privdata, void *key) {
     ((void) privdata);
     sdsfree((sds)key);
@@ -95,17 +138,45 @@ static void callbackValDestructor(void *privdata, void *val) {
 }
 
 static dictType callbackDict = {
-    callbackHash,
+    callbackKeyLength,
     NULL,
     callbackValDup,
-    callbackKeyCompare,
     callbackKeyDestructor,
     callbackValDestructor
 };
 
+/* Reply time histograms, by upper case command name. */
+static void latencyValDestructor(void *privdata, void *val) {
+    ((void) privdata);
+    redisHistogramFree(val);
+}
+
+static dictType latencyDict = {
+    callbackKeyLength,
+    NULL,
+    NULL,
+    callbackKeyDestructor,
+    latencyValDestructor
+};
+
+/* Monotonic time in microseconds. */
+static long long __redisAsyncMicros(void) {
+#ifndef _MSC_VER
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((long long)now.tv_sec * 1000000) + now.tv_nsec / 1000;
+#else
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (now.QuadPart / freq.QuadPart) * 1000000 +
+           (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#endif
+}
+
 static redisAsyncContext *redisAsyncInitialize(redisContext *c) {
     redisAsyncContext *ac;
-    dict *channels = NULL, *patterns = NULL;
+    dict *channels = NULL, *patterns = NULL, *schannels = NULL;
 
     channels = dictCreate(&callbackDict,NULL);
     if (channels == NULL)
@@ -115,11 +186,16 @@ static redisAsyncContext *redisAsyncInitialize(redisContext *c) {
     if (patterns == NULL)
         goto oom;
 
+    schannels = dictCreate(&callbackDict,NULL);
+    if (schannels == NULL)
+        goto oom;
+
     ac = hi_realloc(c,sizeof(redisAsyncContext));
     if (ac == NULL)
         goto oom;
 
     c = &(ac->c);
+    c->reader->stats = &c->stats.reader;
 
     /* The regular connect functions will always set the flag REDIS_CONNECTED.
      * For the async API, we want to wait until the first write event is
@@ -149,12 +225,19 @@ static redisAsyncContext *redisAsyncInitialize(redisContext *c) {
     ac->sub.replies.tail = NULL;
     ac->sub.channels = channels;
     ac->sub.patterns = patterns;
+    ac->sub.schannels = schannels;
     ac->sub.pending_unsubs = 0;
 
+    ac->message_cb = NULL;
+    ac->reconnect = NULL;
+    ac->cache = NULL;
+    ac->latency = NULL;
+
     return ac;
 oom:
     if (channels) dictRelease(channels);
     if (patterns) dictRelease(patterns);
+    if (schannels) dictRelease(schannels);
     return NULL;
 }
 
@@ -266,11 +349,15 @@ int redisAsyncSetDisconnectCallback(redisAsyncContext *ac, redisDisconnectCallba
 }
 
 /* Helper functions to push/shift callbacks */
-static int __redisPushCallback(redisCallbackList *list, redisCallback *source) {
+static int __redisPushCallback(redisAsyncContext *ac, redisCallbackList *list,
+                               redisCallback *source) {
     redisCallback *cb;
 
     /* Copy callback from stack to heap */
-    cb = hi_malloc(sizeof(*cb));
+    if (ac->c.allocator)
+        cb = hi_malloc_from(ac->c.allocator, sizeof(*cb));
+    else
+        cb = hi_obj_malloc(sizeof(*cb));
     if (cb == NULL)
         return REDIS_ERR_OOM;
 
@@ -285,10 +372,12 @@ static int __redisPushCallback(redisCallbackList *list, redisCallback *source) {
     if (list->tail != NULL)
         list->tail->next = cb;
     list->tail = cb;
+    redisStatIncr(&ac->c.stats.callbacks);
     return REDIS_OK;
 }
 
-static int __redisShiftCallback(redisCallbackList *list, redisCallback *target) {
+static int __redisShiftCallback(redisAsyncContext *ac, redisCallbackList *list,
+                                redisCallback *target) {
     redisCallback *cb = list->head;
     if (cb != NULL) {
         list->head = cb->next;
@@ -298,7 +387,11 @@ static int __redisShiftCallback(redisCallbackList *list, redisCallback *target)
         /* Copy callback from heap to stack */
         if (target != NULL)
             memcpy(target,cb,sizeof(*cb));
-        hi_free(cb);
+        if (ac->c.allocator)
+            hi_free_from(ac->c.allocator, cb);
+        else
+            hi_obj_free(cb, sizeof(*cb));
+        redisStatDecr(&ac->c.stats.callbacks);
         return REDIS_OK;
     }
     return REDIS_ERR;
@@ -307,9 +400,11 @@ static int __redisShiftCallback(redisCallbackList *list, redisCallback *target)
 static void __redisRunCallback(redisAsyncContext *ac, redisCallback *cb, redisReply *reply) {
     redisContext *c = &(ac->c);
     if (cb->fn != NULL) {
+        redisTrace3(callback__start, ac, (uintptr_t)cb->fn, reply);
         c->flags |= REDIS_IN_CALLBACK;
         cb->fn(ac,reply,cb->privdata);
         c->flags &= ~REDIS_IN_CALLBACK;
+        redisTrace2(callback__done, ac, (uintptr_t)cb->fn);
     }
 }
 
@@ -358,17 +453,911 @@ static void __redisRunDisconnectCallback(redisAsyncContext *ac, int status)
     }
 }
 
+static void __redisReplayCallback(redisAsyncContext *ac, void *reply, void *privdata) {
+    redisReplayData *data = privdata;
+
+    if (data->fn)
+        data->fn(ac,reply,data->privdata);
+    sdsfree(data->cmd);
+    hi_free(data);
+}
+
+/* Give the callback its original function back. */
+static void __redisReplayUnwrap(redisCallback *cb) {
+    redisReplayData *data = cb->privdata;
+
+    cb->fn = data->fn;
+    cb->privdata = data->privdata;
+    sdsfree(data->cmd);
+    hi_free(data);
+}
+
+static void __redisAsyncFree(redisAsyncContext *ac);
+static const char *nextArgument(const char *start, const char **str, size_t *len);
+
+static void __redisCacheHelloCallback(redisAsyncContext *ac, void *reply, void *privdata) {
+    redisReply *r = reply;
+    (void)privdata;
+
+    if (ac->cache)
+        ac->cache->resp3 = r != NULL && r->type == REDIS_REPLY_MAP;
+}
+
+static void __redisCacheTrackingCallback(redisAsyncContext *ac, void *reply, void *privdata) {
+    struct redisAsyncCache *ca = ac->cache;
+    redisReply *r = reply;
+    (void)privdata;
+
+    if (ca == NULL)
+        return;
+
+    /* Without RESP3, invalidation messages would never be received. Tracking
+     * may also have been turned off again by a command sent since. */
+    ca->tracking = ca->enabling && ca->resp3 && r != NULL && r->type == REDIS_REPLY_STATUS;
+    ca->enabling = 0;
+    if (!ca->tracking)
+        redisCacheFlush(ca->cache);
+}
+
+/* Format HELLO 3 followed by CLIENT TRACKING ON with the options of the
+ * cache. */
+static sds __redisCacheTrackingCommands(redisCache *cache) {
+    const redisCacheOptions *options = redisCacheGetOptions(cache);
+    const char *hello[] = {"HELLO", "3"};
+    size_t hellolen[] = {5, 1};
+    size_t argc = 0, i, *argvlen;
+    const char **argv;
+    sds cmd = NULL, tracking;
+
+    argv = hi_malloc((4 + 2 * options->nprefixes) * sizeof(*argv));
+    argvlen = hi_malloc((4 + 2 * options->nprefixes) * sizeof(*argvlen));
+    if (argv == NULL || argvlen == NULL)
+        goto done;
+
+    argv[argc++] = "CLIENT";
+    argv[argc++] = "TRACKING";
+    argv[argc++] = "ON";
+    if (options->bcast)
+        argv[argc++] = "BCAST";
+    for (i = 0; i < options->nprefixes; i++) {
+        argv[argc++] = "PREFIX";
+        argv[argc++] = options->prefixes[i];
+    }
+    for (i = 0; i < argc; i++)
+        argvlen[i] = strlen(argv[i]);
+
+    if (redisFormatSdsCommandArgv(&cmd,2,hello,hellolen) < 0) {
+        cmd = NULL;
+        goto done;
+    }
+    if (redisFormatSdsCommandArgv(&tracking,(int)argc,argv,argvlen) < 0) {
+        sdsfree(cmd);
+        cmd = NULL;
+        goto done;
+    }
+    cmd = sdscatsds(cmd,tracking);
+    sdsfree(tracking);
+
+done:
+    hi_free(argv);
+    hi_free(argvlen);
+    return cmd;
+}
+
+/* Queue the commands enabling tracking. */
+static int __redisAsyncCacheTrack(redisAsyncContext *ac) {
+    redisContext *c = &(ac->c);
+    redisCallback cb = {NULL, NULL, 0, 0, NULL, NULL, 0};
+    sds cmd;
+
+    cmd = __redisCacheTrackingCommands(ac->cache->cache);
+    if (cmd == NULL)
+        return REDIS_ERR;
+
+    __redisAppendCommand(c,cmd,sdslen(cmd));
+    sdsfree(cmd);
+    ac->cache->enabling = 1;
+    cb.fn = __redisCacheHelloCallback;
+    if (__redisPushCallback(ac,&ac->replies,&cb) != REDIS_OK)
+        return REDIS_ERR;
+    cb.fn = __redisCacheTrackingCallback;
+    return __redisPushCallback(ac,&ac->replies,&cb);
+}
+
+/* Forget everything once invalidation messages may have been missed. */
+static void __redisAsyncCacheReset(redisAsyncContext *ac) {
+    ac->cache->resp3 = 0;
+    ac->cache->tracking = 0;
+    ac->cache->enabling = 0;
+    ac->cache->multi = 0;
+    ac->cache->epoch++;
+    redisCacheFlush(ac->cache->cache);
+}
+
+static void __redisAsyncFreeCache(redisAsyncContext *ac) {
+    if (ac->cache == NULL)
+        return;
+    redisCacheFree(ac->cache->cache);
+    hi_free(ac->cache);
+    ac->cache = NULL;
+}
+
+int redisAsyncEnableCache(redisAsyncContext *ac, const redisCacheOptions *options) {
+    redisContext *c = &(ac->c);
+    struct redisAsyncCache *ca;
+
+    if (ac->cache || (c->flags & (REDIS_SUBSCRIBED | REDIS_MONITORING |
+                                  REDIS_DISCONNECTING | REDIS_FREEING)))
+        return REDIS_ERR;
+
+    ca = hi_calloc(1,sizeof(*ca));
+    if (ca == NULL)
+        return REDIS_ERR;
+    ca->cache = redisCacheCreate(options);
+    if (ca->cache == NULL) {
+        hi_free(ca);
+        return REDIS_ERR;
+    }
+    ac->cache = ca;
+
+    if (__redisAsyncCacheTrack(ac) != REDIS_OK) {
+        __redisSetError(c,REDIS_ERR_OOM,"Out of memory");
+        __redisAsyncCopyError(ac);
+        return REDIS_ERR;
+    }
+    if (!ac->reconnect || ac->reconnect->state != REDIS_RECONNECT_WAITING)
+        _EL_ADD_WRITE(ac);
+
+    return REDIS_OK;
+}
+
+redisCache *redisAsyncGetCache(redisAsyncContext *ac) {
+    return ac->cache ? ac->cache->cache : NULL;
+}
+
+void redisAsyncGetStats(const redisAsyncContext *ac, redisContextStats *stats) {
+    redisGetStats(&ac->c, stats);
+}
+
+int redisAsyncEnableLatency(redisAsyncContext *ac) {
+    if (ac->latency == NULL)
+        ac->latency = dictCreate(&latencyDict,NULL);
+    return ac->latency ? REDIS_OK : REDIS_ERR;
+}
+
+void redisAsyncLatencyForEach(redisAsyncContext *ac, redisLatencyFn *fn, void *privdata) {
+    dictIterator it;
+    dictEntry *de;
+
+    if (ac->latency == NULL)
+        return;
+    dictInitIterator(&it,ac->latency);
+    while ((de = dictNext(&it)) != NULL)
+        fn(dictGetEntryKey(de),dictGetEntryVal(de),privdata);
+    dictReleaseIterator(&it);
+}
+
+/* Upper case a command name into buf, which holds REDIS_LATENCY_NAME_SIZE
+ * bytes. Returns 0 if the name is too long to be a command. */
+#define REDIS_LATENCY_NAME_SIZE 64
+static size_t __redisLatencyName(char *buf, const char *name, size_t len) {
+    size_t i;
+
+    if (len >= REDIS_LATENCY_NAME_SIZE)
+        return 0;
+    for (i = 0; i < len; i++)
+        buf[i] = toupper((unsigned char)name[i]);
+    buf[len] = '\0';
+    return len;
+}
+
+const redisHistogram *redisAsyncGetLatency(redisAsyncContext *ac, const char *command) {
+    char buf[REDIS_LATENCY_NAME_SIZE];
+    dictEntry *de;
+    size_t len;
+
+    if (ac->latency == NULL ||
+        (len = __redisLatencyName(buf,command,strlen(command))) == 0)
+        return NULL;
+    de = dictFindBuf(ac->latency,buf,len);
+    return de ? dictGetEntryVal(de) : NULL;
+}
+
+void redisAsyncResetLatency(redisAsyncContext *ac) {
+    dictIterator it;
+    dictEntry *de;
+
+    if (ac->latency == NULL)
+        return;
+    dictInitIterator(&it,ac->latency);
+    while ((de = dictNext(&it)) != NULL)
+        redisHistogramReset(dictGetEntryVal(de));
+    dictReleaseIterator(&it);
+}
+
+/* Start timing a command, creating the histogram of its name if needed. */
+static int __redisLatencyStart(redisAsyncContext *ac, redisCallback *cb,
+                               const char *name, size_t namelen)
+{
+    char buf[REDIS_LATENCY_NAME_SIZE];
+    redisHistogram *h;
+    dictEntry *de;
+    sds key;
+    size_t len;
+
+    if ((len = __redisLatencyName(buf,name,namelen)) == 0)
+        return REDIS_OK;
+
+    de = dictFindBuf(ac->latency,buf,len);
+    if (de != NULL) {
+        h = dictGetEntryVal(de);
+    } else {
+        key = sdsnewlen(buf,len);
+        h = redisHistogramCreate();
+        if (key == NULL || h == NULL || dictReplace(ac->latency,key,h) != 1) {
+            sdsfree(key);
+            redisHistogramFree(h);
+            return REDIS_ERR;
+        }
+    }
+
+    cb->latency = h;
+    cb->queued = __redisAsyncMicros();
+    return REDIS_OK;
+}
+
+/* Record the reply time of a command, once. */
+static void __redisLatencyStop(redisCallback *cb) {
+    long long elapsed = __redisAsyncMicros() - cb->queued;
+
+    redisHistogramRecord(cb->latency,elapsed > 0 ? elapsed : 0);
+    cb->latency = NULL;
+}
+
+static void __redisCacheFillCallback(redisAsyncContext *ac, void *reply, void *privdata) {
+    struct redisAsyncCache *ca = ac->cache;
+    redisReplayData *data = privdata;
+    redisReply *r = reply;
+
+    /* Store it first, the callback may free it. redisCacheSet() rejects the
+     * replies that can't answer the command, such as errors. */
+    if (r != NULL && ca && ca->tracking && ca->epoch == data->epoch)
+        redisCacheSet(ca->cache,data->cmd,sdslen(data->cmd),r);
+
+    if (data->fn)
+        data->fn(ac,reply,data->privdata);
+    sdsfree(data->cmd);
+    hi_free(data);
+}
+
+/* Run the callback of a command answered from the cache, as if its reply had
+ * just been read. */
+static void __redisAsyncCacheHit(redisAsyncContext *ac, redisCallback *cb, redisReply *reply) {
+    redisContext *c = &(ac->c);
+    int nested = c->flags & REDIS_IN_CALLBACK;
+
+    if (cb->fn == NULL) {
+        freeReplyObject(reply);
+        return;
+    }
+
+    c->flags |= REDIS_IN_CALLBACK;
+    cb->fn(ac,reply,cb->privdata);
+    if (!nested)
+        c->flags &= ~REDIS_IN_CALLBACK;
+    if (!(c->flags & REDIS_NO_AUTO_FREE_REPLIES))
+        freeReplyObject(reply);
+
+    /* Disconnecting from a nested callback is taken care of by the outer
+     * one. */
+    if (!nested) {
+        if (c->flags & REDIS_FREEING)
+            __redisAsyncFree(ac);
+        else if (c->flags & REDIS_DISCONNECTING)
+            redisAsyncDisconnect(ac);
+    }
+}
+
+static int __redisIsCommand(const char *name, size_t len, const char *command) {
+    return strlen(command) == len && strncasecmp(name,command,len) == 0;
+}
+
+/* Follow the commands the cached replies depend on: the selected database,
+ * the tracking of the keys by the server, and transactions. The arguments
+ * start at args. */
+static void __redisAsyncCacheSession(redisAsyncContext *ac, const char *name,
+                                     size_t namelen, const char *args)
+{
+    struct redisAsyncCache *ca = ac->cache;
+    const char *arg;
+    size_t arglen;
+
+    if (__redisIsCommand(name,namelen,"multi")) {
+        ca->multi = 1;
+    } else if (__redisIsCommand(name,namelen,"exec") ||
+               __redisIsCommand(name,namelen,"discard")) {
+        ca->multi = 0;
+    } else if (__redisIsCommand(name,namelen,"select") ||
+               __redisIsCommand(name,namelen,"swapdb") ||
+               __redisIsCommand(name,namelen,"flushdb") ||
+               __redisIsCommand(name,namelen,"flushall") ||
+               __redisIsCommand(name,namelen,"move")) {
+        ca->epoch++;
+        redisCacheFlush(ca->cache);
+    } else if (__redisIsCommand(name,namelen,"reset") ||
+               __redisIsCommand(name,namelen,"hello") ||
+               (__redisIsCommand(name,namelen,"client") && args[0] == '$' &&
+                nextArgument(args,&arg,&arglen) != NULL &&
+                __redisIsCommand(arg,arglen,"tracking"))) {
+        /* Invalidations may stop: only __redisAsyncCacheTrack() enables the
+         * cache again. */
+        if (__redisIsCommand(name,namelen,"reset"))
+            ca->multi = 0;
+        ca->tracking = 0;
+        ca->enabling = 0;
+        ca->epoch++;
+        redisCacheFlush(ca->cache);
+    }
+}
+
+/* Answer a command from the cache when possible, or arrange for its reply to
+ * be cached. Returns 1 if it was answered, 0 if it must be sent, or -1 when
+ * out of memory. The name of the command and the start of its arguments are
+ * given as parsed by __redisAsyncQueueCommand(). */
+static int __redisAsyncCacheCommand(redisAsyncContext *ac, redisCallback *cb,
+                                    const char *name, size_t namelen, const char *args,
+                                    const char *cmd, size_t len)
+{
+    struct redisAsyncCache *ca = ac->cache;
+    redisContext *c = &(ac->c);
+    redisReplayData *data;
+    redisReply *reply;
+    const char *arg;
+    size_t arglen;
+
+    if (!(__redisIsCommand(name,namelen,"get") ||
+          __redisIsCommand(name,namelen,"hget") ||
+          __redisIsCommand(name,namelen,"hgetall")))
+    {
+        /* Most commands writing a key take it as first argument: don't serve
+         * it from the cache until the server confirmed the change. */
+        if (args[0] == '$' && nextArgument(args,&arg,&arglen) != NULL)
+            redisCacheInvalidate(ca->cache,arg,arglen);
+        __redisAsyncCacheSession(ac,name,namelen,args);
+        return 0;
+    }
+
+    /* Inside a transaction, reads must be queued by the server and their
+     * replies are only QUEUED. */
+    if (ca->multi)
+        return 0;
+
+    if (ca->tracking && (c->flags & REDIS_CONNECTED) && ac->replies.head == NULL &&
+        (reply = redisCacheGet(ca->cache,cmd,len)) != NULL)
+    {
+        __redisAsyncCacheHit(ac,cb,reply);
+        return 1;
+    }
+
+    data = hi_malloc(sizeof(*data));
+    if (data == NULL)
+        return -1;
+    data->cmd = sdsnewlen(cmd,len);
+    if (data->cmd == NULL) {
+        hi_free(data);
+        return -1;
+    }
+    data->fn = cb->fn;
+    data->privdata = cb->privdata;
+    data->epoch = ca->epoch;
+    cb->fn = __redisCacheFillCallback;
+    cb->privdata = data;
+    return 0;
+}
+
+/* Commands without side effects, that can be sent again when it is not known
+ * whether they were executed. */
+static int __redisIsReplayable(const char *name, size_t len) {
+    static const char *commands[] = {
+        "get", "mget", "getrange", "substr", "strlen", "lcs", "exists", "type",
+        "ttl", "pttl", "expiretime", "pexpiretime", "dump", "object",
+        "getbit", "bitcount", "bitpos", "pfcount",
+        "hget", "hmget", "hgetall", "hkeys", "hvals", "hlen", "hexists",
+        "hstrlen", "hrandfield", "hscan",
+        "lrange", "llen", "lindex", "lpos",
+        "smembers", "sismember", "smismember", "scard", "srandmember",
+        "sinter", "sunion", "sdiff", "sintercard", "sscan",
+        "zrange", "zrangebyscore", "zrangebylex", "zrevrange",
+        "zrevrangebyscore", "zrevrangebylex", "zscore", "zmscore", "zrank",
+        "zrevrank", "zcard", "zcount", "zlexcount", "zrandmember", "zinter",
+        "zunion", "zdiff", "zintercard", "zscan",
+        "xrange", "xrevrange", "xlen",
+        "geopos", "geodist", "geohash", "geosearch", "georadius_ro",
+        "georadiusbymember_ro", "sort_ro", "eval_ro", "evalsha_ro", "fcall_ro",
+        "ping", "echo", "time", "dbsize", "scan", "keys", "randomkey"
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(commands)/sizeof(*commands); i++) {
+        if (strlen(commands[i]) == len && strncasecmp(name,commands[i],len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* The last command of this kind setting the session state, or NULL when the
+ * command does not set it. */
+static sds *__redisReconnectState(struct redisAsyncReconnect *r, const char *name, size_t namelen) {
+    if (namelen == 4 && strncasecmp(name,"auth",4) == 0)
+        return &r->auth;
+    else if (namelen == 5 && strncasecmp(name,"hello",5) == 0)
+        return &r->hello;
+    else if (namelen == 6 && strncasecmp(name,"select",6) == 0)
+        return &r->select;
+    return NULL;
+}
+
+/* Remember the session state set by a command once the server accepted it:
+ * a command it rejected would only fail the next reconnections. */
+static void __redisReconnectSaveCallback(redisAsyncContext *ac, void *reply, void *privdata) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisReplayData *data = privdata;
+    redisReply *rr = reply;
+    const char *name;
+    size_t namelen;
+    sds *state;
+
+    if (r && rr != NULL && rr->type != REDIS_REPLY_ERROR &&
+        nextArgument(data->cmd,&name,&namelen) != NULL) {
+        state = __redisReconnectState(r,name,namelen);
+        if (state) {
+            sdsfree(*state);
+            *state = data->cmd;
+            data->cmd = NULL;
+        } else {
+            /* RESET */
+            sdsfree(r->auth);
+            sdsfree(r->hello);
+            sdsfree(r->select);
+            r->auth = r->hello = r->select = NULL;
+        }
+    }
+
+    if (data->fn)
+        data->fn(ac,reply,data->privdata);
+    sdsfree(data->cmd);
+    hi_free(data);
+}
+
+/* Keep track of what must be restored on reconnection when a command is
+ * sent: the session state it sets, and for commands that can be replayed, a
+ * copy of the command, held by wrapping its callback. */
+static int __redisReconnectTrack(redisAsyncContext *ac, const char *name, size_t namelen,
+                                 const char *cmd, size_t len, redisCallback *cb)
+{
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisCallbackFn *fn;
+    redisReplayData *data;
+
+    if (__redisReconnectState(r,name,namelen) != NULL ||
+        (namelen == 5 && strncasecmp(name,"reset",5) == 0))
+        fn = __redisReconnectSaveCallback;
+    else if (r->options.replay && __redisIsReplayable(name,namelen))
+        fn = __redisReplayCallback;
+    else
+        return REDIS_OK;
+
+    data = hi_malloc(sizeof(*data));
+    if (data == NULL)
+        return REDIS_ERR;
+    data->cmd = sdsnewlen(cmd,len);
+    if (data->cmd == NULL) {
+        hi_free(data);
+        return REDIS_ERR;
+    }
+    data->fn = cb->fn;
+    data->privdata = cb->privdata;
+    data->epoch = 0;
+    cb->fn = fn;
+    cb->privdata = data;
+    return REDIS_OK;
+}
+
+static void __redisAsyncFreeReconnect(redisAsyncContext *ac) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisCallback cb;
+
+    if (r == NULL)
+        return;
+
+    while (__redisShiftCallback(ac,&r->replay,&cb) == REDIS_OK)
+        __redisRunCallback(ac,&cb,NULL);
+
+    sdsfree(r->auth);
+    sdsfree(r->hello);
+    sdsfree(r->select);
+    sdsfree(r->queuedbuf);
+    hi_free(r);
+    ac->reconnect = NULL;
+}
+
+int redisAsyncSetReconnect(redisAsyncContext *ac, const redisAsyncReconnectOptions *options) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+
+    if (options == NULL) {
+        if (r && r->state != REDIS_RECONNECT_IDLE)
+            return REDIS_ERR;
+        __redisAsyncFreeReconnect(ac);
+        return REDIS_OK;
+    }
+
+    /* Only connections hiredis made itself can be made again. */
+    if (ac->c.connection_type != REDIS_CONN_TCP &&
+        ac->c.connection_type != REDIS_CONN_UNIX)
+        return REDIS_ERR;
+
+    if (r == NULL) {
+        r = hi_calloc(1,sizeof(*r));
+        if (r == NULL)
+            return REDIS_ERR;
+        r->seed = (uint32_t)(uintptr_t)ac ^ (uint32_t)time(NULL);
+        if (r->seed == 0)
+            r->seed = 1;
+        ac->reconnect = r;
+    }
+
+    r->options = *options;
+    if (!r->options.min_delay.tv_sec && !r->options.min_delay.tv_usec)
+        r->options.min_delay.tv_usec = 100000;
+    if (r->options.max_delay.tv_sec < r->options.min_delay.tv_sec ||
+        (r->options.max_delay.tv_sec == r->options.min_delay.tv_sec &&
+         r->options.max_delay.tv_usec < r->options.min_delay.tv_usec))
+        r->options.max_delay = r->options.min_delay;
+
+    return REDIS_OK;
+}
+
+/* Delay before the next attempt: exponential backoff with jitter. */
+static struct timeval __redisReconnectDelay(struct redisAsyncReconnect *r) {
+    long long min = r->options.min_delay.tv_sec * 1000000LL + r->options.min_delay.tv_usec;
+    long long max = r->options.max_delay.tv_sec * 1000000LL + r->options.max_delay.tv_usec;
+    long long delay = min;
+    struct timeval tv;
+    int i;
+
+    for (i = 0; i < r->attempts && delay < max; i++)
+        delay *= 2;
+    if (delay > max)
+        delay = max;
+
+    /* xorshift32 */
+    r->seed ^= r->seed << 13;
+    r->seed ^= r->seed >> 17;
+    r->seed ^= r->seed << 5;
+    delay = delay / 2 + (long long)(r->seed % (unsigned long long)(delay / 2 + 1));
+
+    tv.tv_sec = (long)(delay / 1000000);
+    tv.tv_usec = (long)(delay % 1000000);
+    return tv;
+}
+
+/* Forget the subscriptions being cancelled, whose confirmation is lost with
+ * the connection, and clear the bookkeeping of the others to subscribe again
+ * on the new connection. */
+static void __redisResetSubscriptions(redisAsyncContext *ac, dict *callbacks,
+                                      redisCallbackList *lost) {
+    dictIterator it;
+    dictEntry *de;
+    redisCallback *cb;
+
+    dictInitIterator(&it,callbacks);
+    while ((de = dictNext(&it)) != NULL) {
+        cb = dictGetEntryVal(de);
+        if (cb->unsubscribe_sent) {
+            __redisPushCallback(ac,lost,cb);
+            dictDelete(callbacks,dictGetEntryKey(de));
+            continue;
+        }
+        cb->pending_subs = 0;
+    }
+    dictReleaseIterator(&it);
+}
+
+/* Give up restoring the session state: put the commands queued while
+ * reconnecting back, to be sent after the next attempt. */
+static void __redisAsyncReconnectCancel(redisAsyncContext *ac) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisContext *c = &(ac->c);
+
+    if (r == NULL || r->state != REDIS_RECONNECT_RESTORING)
+        return;
+
+    /* Only the session state commands were sent. */
+    while (__redisShiftCallback(ac,&ac->replies,NULL) == REDIS_OK)
+        ;
+    sdsfree(c->obuf);
+    c->obuf = r->queuedbuf;
+    ac->replies = r->queued;
+    r->queuedbuf = NULL;
+    r->queued.head = r->queued.tail = NULL;
+    r->restoring = 0;
+    r->state = REDIS_RECONNECT_CONNECTING;
+}
+
+/* Take over a disconnection caused by an error, when the automatic
+ * reconnection is enabled. Returns REDIS_OK when a new attempt is scheduled,
+ * or REDIS_ERR for the context to be disconnected as usual. */
+static int __redisAsyncReconnectStart(redisAsyncContext *ac) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisContext *c = &(ac->c);
+    redisCallbackList lost = {NULL, NULL};
+    redisCallback cb;
+
+    /* Failing to restore the session state fails the attempt. */
+    __redisAsyncReconnectCancel(ac);
+
+    if (r == NULL || ac->ev.scheduleTimer == NULL ||
+        (c->flags & (REDIS_DISCONNECTING | REDIS_FREEING)))
+        return REDIS_ERR;
+
+    if (r->state == REDIS_RECONNECT_IDLE) {
+        /* Don't retry a connection that never succeeded. */
+        if (!(c->flags & REDIS_CONNECTED))
+            return REDIS_ERR;
+
+        /* Nothing is known of the commands in flight: keep the ones that
+         * can be sent again, fail the others. */
+        while (__redisShiftCallback(ac,&ac->replies,&cb) == REDIS_OK)
+            __redisPushCallback(ac,cb.fn == __redisReplayCallback ? &r->replay : &lost,&cb);
+        while (__redisShiftCallback(ac,&ac->sub.replies,&cb) == REDIS_OK)
+            __redisPushCallback(ac,cb.fn == __redisReplayCallback ? &r->replay : &lost,&cb);
+
+        __redisResetSubscriptions(ac,ac->sub.channels,&lost);
+        __redisResetSubscriptions(ac,ac->sub.patterns,&lost);
+        __redisResetSubscriptions(ac,ac->sub.schannels,&lost);
+        ac->sub.pending_unsubs = 0;
+        if (dictSize(ac->sub.channels) == 0 && dictSize(ac->sub.patterns) == 0 &&
+            dictSize(ac->sub.schannels) == 0)
+            c->flags &= ~REDIS_SUBSCRIBED;
+        c->flags &= ~REDIS_MONITORING;
+
+        sdsclear(c->obuf);
+        if (ac->cache)
+            __redisAsyncCacheReset(ac);
+    } else {
+        r->attempts++;
+    }
+
+    if (r->options.max_attempts > 0 && r->attempts >= r->options.max_attempts) {
+        /* Give up: the disconnect callback reports the last error. */
+        r->state = REDIS_RECONNECT_IDLE;
+        c->flags |= REDIS_CONNECTED;
+        return REDIS_ERR;
+    }
+
+    _EL_DEL_READ(ac);
+    _EL_DEL_WRITE(ac);
+    c->flags &= ~REDIS_CONNECTED;
+    c->err = 0;
+    c->errstr[0] = '\0';
+    __redisAsyncCopyError(ac);
+    r->state = REDIS_RECONNECT_WAITING;
+
+    while (__redisShiftCallback(ac,&lost,&cb) == REDIS_OK)
+        __redisRunCallback(ac,&cb,NULL);
+
+    /* A callback may have given up on the context. */
+    if (c->flags & (REDIS_DISCONNECTING | REDIS_FREEING)) {
+        __redisAsyncFree(ac);
+        return REDIS_OK;
+    }
+
+    ac->ev.scheduleTimer(ac->ev.data,__redisReconnectDelay(r));
+    return REDIS_OK;
+}
+
+static int __redisAsyncCommand(redisAsyncContext *ac, redisCallbackFn *fn, void *privdata, const char *cmd, size_t len);
+
+static void __redisAsyncResubscribe(redisAsyncContext *ac, dict *callbacks, const char *command) {
+    size_t count = dictSize(callbacks), i = 0;
+    redisCallback *cbs;
+    sds *names;
+    dictIterator it;
+    dictEntry *de;
+
+    if (count == 0)
+        return;
+
+    names = hi_calloc(count,sizeof(*names));
+    cbs = hi_calloc(count,sizeof(*cbs));
+    if (names == NULL || cbs == NULL)
+        goto done;
+
+    /* Subscribing updates the dictionary, so don't iterate it meanwhile. */
+    dictInitIterator(&it,callbacks);
+    while ((de = dictNext(&it)) != NULL && i < count) {
+        names[i] = sdsdup(dictGetEntryKey(de));
+        memcpy(&cbs[i++],dictGetEntryVal(de),sizeof(*cbs));
+    }
+    dictReleaseIterator(&it);
+
+    for (i = 0; i < count; i++) {
+        const char *argv[2];
+        size_t argvlen[2];
+        long long len;
+        sds cmd;
+
+        if (names[i] == NULL)
+            continue;
+        argv[0] = command;
+        argvlen[0] = strlen(command);
+        argv[1] = names[i];
+        argvlen[1] = sdslen(names[i]);
+        len = redisFormatSdsCommandArgv(&cmd,2,argv,argvlen);
+        if (len < 0)
+            continue;
+        __redisAsyncCommand(ac,cbs[i].fn,cbs[i].privdata,cmd,len);
+        sdsfree(cmd);
+    }
+
+done:
+    if (names) {
+        for (i = 0; i < count; i++)
+            sdsfree(names[i]);
+    }
+    hi_free(names);
+    hi_free(cbs);
+}
+
+/* Once the session state is restored, put the commands to replay and the
+ * subscriptions ahead of the commands queued while reconnecting. */
+static void __redisAsyncReconnectResume(redisAsyncContext *ac) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisContext *c = &(ac->c);
+    redisCallbackList queued = r->queued;
+    redisCallback cb;
+    sds queuedbuf = r->queuedbuf;
+
+    r->state = REDIS_RECONNECT_IDLE;
+    r->attempts = 0;
+    r->queuedbuf = NULL;
+    r->queued.head = r->queued.tail = NULL;
+
+    /* Cached replies may only be used once tracking is enabled again. */
+    if (ac->cache)
+        __redisAsyncCacheTrack(ac);
+
+    while (__redisShiftCallback(ac,&r->replay,&cb) == REDIS_OK) {
+        redisReplayData *data = cb.privdata;
+
+        if (__redisAppendCommand(c,data->cmd,sdslen(data->cmd)) != REDIS_OK ||
+            __redisPushCallback(ac,&ac->replies,&cb) != REDIS_OK)
+            __redisRunCallback(ac,&cb,NULL);
+    }
+
+    __redisAsyncResubscribe(ac,ac->sub.channels,"SUBSCRIBE");
+    __redisAsyncResubscribe(ac,ac->sub.patterns,"PSUBSCRIBE");
+    __redisAsyncResubscribe(ac,ac->sub.schannels,"SSUBSCRIBE");
+
+    c->obuf = sdscatsds(c->obuf,queuedbuf);
+    sdsfree(queuedbuf);
+    if (queued.head) {
+        if (ac->replies.tail)
+            ac->replies.tail->next = queued.head;
+        else
+            ac->replies.head = queued.head;
+        ac->replies.tail = queued.tail;
+    }
+
+    if (sdslen(c->obuf) > 0)
+        _EL_ADD_WRITE(ac);
+}
+
+/* A session state command sent on reconnection was answered: an error fails
+ * the attempt, see __redisAsyncReconnectRestored(). */
+static void __redisReconnectStateCallback(redisAsyncContext *ac, void *reply, void *privdata) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisReply *rr = reply;
+    (void)privdata;
+
+    if (r == NULL || r->state != REDIS_RECONNECT_RESTORING || rr == NULL)
+        return;
+
+    r->restoring--;
+    if (rr->type == REDIS_REPLY_ERROR)
+        __redisSetError(&(ac->c),REDIS_ERR_OTHER,rr->str);
+}
+
+/* Called after each reply while the session state is restored. Returns
+ * REDIS_ERR when the attempt failed and the context was disconnected. */
+static int __redisAsyncReconnectRestored(redisAsyncContext *ac) {
+    if (ac->c.err) {
+        __redisAsyncDisconnect(ac);
+        return REDIS_ERR;
+    }
+    if (ac->reconnect->restoring == 0)
+        __redisAsyncReconnectResume(ac);
+    return REDIS_OK;
+}
+
+/* Once a new connection is established, restore the session state first.
+ * Everything else waits for the server to accept it, see
+ * __redisAsyncReconnectResume(). */
+static void __redisAsyncReconnectDone(redisAsyncContext *ac) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisContext *c = &(ac->c);
+    redisCallback cb = {NULL, NULL, 0, 0, NULL, NULL, 0};
+    sds *state[3];
+    sds obuf;
+    int i;
+
+    /* Set aside what was queued meanwhile. */
+    obuf = sdsempty();
+    if (obuf == NULL) {
+        r->state = REDIS_RECONNECT_IDLE;
+        r->attempts = 0;
+        return;
+    }
+    r->queuedbuf = c->obuf;
+    r->queued = ac->replies;
+    c->obuf = obuf;
+    ac->replies.head = ac->replies.tail = NULL;
+    r->state = REDIS_RECONNECT_RESTORING;
+    r->restoring = 0;
+
+    state[0] = &r->auth;
+    state[1] = &r->hello;
+    state[2] = &r->select;
+    cb.fn = __redisReconnectStateCallback;
+    for (i = 0; i < 3; i++) {
+        if (*state[i] && __redisAppendCommand(c,*state[i],sdslen(*state[i])) == REDIS_OK &&
+            __redisPushCallback(ac,&ac->replies,&cb) == REDIS_OK)
+            r->restoring++;
+    }
+
+    if (r->restoring > 0)
+        _EL_ADD_WRITE(ac);
+    else
+        __redisAsyncReconnectResume(ac);
+}
+
+static void __redisAsyncReconnectAttempt(redisAsyncContext *ac) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisContext *c = &(ac->c);
+
+    r->state = REDIS_RECONNECT_CONNECTING;
+    if (__redisReopen(c) != REDIS_OK ||
+        (r->options.reconnect_cb && r->options.reconnect_cb(ac,r->options.privdata) != REDIS_OK))
+    {
+        if (c->err == 0)
+            __redisSetError(c,REDIS_ERR_OTHER,"Reconnect callback failed");
+        __redisAsyncDisconnect(ac);
+        return;
+    }
+
+    /* Connecting completes with the first write event. */
+    _EL_ADD_WRITE(ac);
+}
+
 /* Helper function to free the context. */
 static void __redisAsyncFree(redisAsyncContext *ac) {
     redisContext *c = &(ac->c);
     redisCallback cb;
     dictIterator it;
     dictEntry *de;
+    int connected;
+
+    /* The commands queued while reconnecting are pending as well. */
+    __redisAsyncReconnectCancel(ac);
+
+    /* A context waiting to reconnect is still considered connected. */
+    connected = (c->flags & REDIS_CONNECTED) ||
+                (ac->reconnect && ac->reconnect->state != REDIS_RECONNECT_IDLE);
 
     /* Execute pending callbacks with NULL reply. */
-    while (__redisShiftCallback(&ac->replies,&cb) == REDIS_OK)
+    while (__redisShiftCallback(ac,&ac->replies,&cb) == REDIS_OK)
         __redisRunCallback(ac,&cb,NULL);
-    while (__redisShiftCallback(&ac->sub.replies,&cb) == REDIS_OK)
+    while (__redisShiftCallback(ac,&ac->sub.replies,&cb) == REDIS_OK)
         __redisRunCallback(ac,&cb,NULL);
 
     /* Run subscription callbacks with NULL reply */
@@ -376,6 +1365,7 @@ static void __redisAsyncFree(redisAsyncContext *ac) {
         dictInitIterator(&it,ac->sub.channels);
         while ((de = dictNext(&it)) != NULL)
             __redisRunCallback(ac,dictGetEntryVal(de),NULL);
+        dictReleaseIterator(&it);
 
         dictRelease(ac->sub.channels);
     }
@@ -384,16 +1374,31 @@ static void __redisAsyncFree(redisAsyncContext *ac) {
         dictInitIterator(&it,ac->sub.patterns);
         while ((de = dictNext(&it)) != NULL)
             __redisRunCallback(ac,dictGetEntryVal(de),NULL);
+        dictReleaseIterator(&it);
 
         dictRelease(ac->sub.patterns);
     }
 
+    if (ac->sub.schannels) {
+        dictInitIterator(&it,ac->sub.schannels);
+        while ((de = dictNext(&it)) != NULL)
+            __redisRunCallback(ac,dictGetEntryVal(de),NULL);
+        dictReleaseIterator(&it);
+
+        dictRelease(ac->sub.schannels);
+    }
+
+    __redisAsyncFreeReconnect(ac);
+    __redisAsyncFreeCache(ac);
+    if (ac->latency)
+        dictRelease(ac->latency);
+
     /* Signal event lib to clean up */
     _EL_CLEANUP(ac);
 
     /* Execute disconnect callback. When redisAsyncFree() initiated destroying
      * this context, the status will always be REDIS_OK. */
-    if (c->flags & REDIS_CONNECTED) {
+    if (connected) {
         int status = ac->err == 0 ? REDIS_OK : REDIS_ERR;
         if (c->flags & REDIS_FREEING)
             status = REDIS_OK;
@@ -429,10 +1434,15 @@ void __redisAsyncDisconnect(redisAsyncContext *ac) {
 
     /* Make sure error is accessible if there is any */
     __redisAsyncCopyError(ac);
+    redisTrace2(disconnect, ac, ac->err);
+
+    /* Errors may be recovered from by reconnecting. */
+    if (ac->err && __redisAsyncReconnectStart(ac) == REDIS_OK)
+        return;
 
     if (ac->err == 0) {
         /* For clean disconnects, there should be no pending callbacks. */
-        int ret = __redisShiftCallback(&ac->replies,NULL);
+        int ret = __redisShiftCallback(ac,&ac->replies,NULL);
         assert(ret == REDIS_ERR);
     } else {
         /* Disconnection is caused by an error, make sure that pending
@@ -463,8 +1473,72 @@ void redisAsyncDisconnect(redisAsyncContext *ac) {
 
     /** unset the auto-free flag here, because disconnect undoes this */
     c->flags &= ~REDIS_NO_AUTO_FREE;
-    if (!(c->flags & REDIS_IN_CALLBACK) && ac->replies.head == NULL)
-        __redisAsyncDisconnect(ac);
+    if (!(c->flags & REDIS_IN_CALLBACK)) {
+        /* Queued commands can't be sent without a connection. */
+        if (ac->reconnect && ac->reconnect->state != REDIS_RECONNECT_IDLE)
+            __redisAsyncFree(ac);
+        else if (ac->replies.head == NULL)
+            __redisAsyncDisconnect(ac);
+    }
+}
+
+/* Kinds of pub/sub commands and replies, see __redisSubscribeKind(). */
+#define REDIS_SUBKIND_NONE 0
+#define REDIS_SUBKIND_MESSAGE 1
+#define REDIS_SUBKIND_SUBSCRIBE 2
+#define REDIS_SUBKIND_UNSUBSCRIBE 3
+
+/* Their variants, told apart by a 'p' or 's' prefix. */
+#define REDIS_SUBVARIANT_CHANNEL 0
+#define REDIS_SUBVARIANT_PATTERN 1
+#define REDIS_SUBVARIANT_SHARD 2
+
+static int __redisSubscribeKindOf(const char *str, size_t len) {
+    static const char *types[] = {
+        [7] = "message", [9] = "subscribe", [11] = "unsubscribe",
+    };
+    static const int kinds[] = {
+        [7] = REDIS_SUBKIND_MESSAGE, [9] = REDIS_SUBKIND_SUBSCRIBE,
+        [11] = REDIS_SUBKIND_UNSUBSCRIBE,
+    };
+
+    if (len >= sizeof(types)/sizeof(*types) || types[len] == NULL ||
+        strncasecmp(str, types[len], len) != 0)
+    {
+        return REDIS_SUBKIND_NONE;
+    }
+    return kinds[len];
+}
+
+/* Classify the name of a pub/sub command or reply type. The names have
+ * distinct lengths once the prefix of the variants is skipped, so a single
+ * comparison against the name of that length is enough. */
+static int __redisSubscribeKind(const char *str, size_t len, int *variant) {
+    int kind;
+
+    *variant = REDIS_SUBVARIANT_CHANNEL;
+    if ((kind = __redisSubscribeKindOf(str, len)) != REDIS_SUBKIND_NONE || len == 0)
+        return kind;
+
+    if (str[0] == 'p' || str[0] == 'P')
+        *variant = REDIS_SUBVARIANT_PATTERN;
+    else if (str[0] == 's' || str[0] == 'S')
+        *variant = REDIS_SUBVARIANT_SHARD;
+    else
+        return REDIS_SUBKIND_NONE;
+
+    if ((kind = __redisSubscribeKindOf(str + 1, len - 1)) == REDIS_SUBKIND_NONE)
+        *variant = REDIS_SUBVARIANT_CHANNEL;
+    return kind;
+}
+
+/* The subscription callbacks of a variant. */
+static dict *__redisSubscribeDict(redisAsyncContext *ac, int variant) {
+    if (variant == REDIS_SUBVARIANT_PATTERN)
+        return ac->sub.patterns;
+    else if (variant == REDIS_SUBVARIANT_SHARD)
+        return ac->sub.schannels;
+    return ac->sub.channels;
 }
 
 static int __redisGetSubscribeCallback(redisAsyncContext *ac, redisReply *reply, redisCallback *dstcb) {
@@ -472,9 +1546,7 @@ static int __redisGetSubscribeCallback(redisAsyncContext *ac, redisReply *reply,
     dict *callbacks;
     redisCallback *cb = NULL;
     dictEntry *de;
-    int pvariant;
-    char *stype;
-    sds sname = NULL;
+    int kind, variant;
 
     /* Match reply with the expected format of a pushed message.
      * The type and number of elements (3 to 4) are specified at:
@@ -482,35 +1554,29 @@ static int __redisGetSubscribeCallback(redisAsyncContext *ac, redisReply *reply,
     if ((reply->type == REDIS_REPLY_ARRAY && !(c->flags & REDIS_SUPPORTS_PUSH) && reply->elements >= 3) ||
         reply->type == REDIS_REPLY_PUSH) {
         assert(reply->element[0]->type == REDIS_REPLY_STRING);
-        stype = reply->element[0]->str;
-        pvariant = (tolower(stype[0]) == 'p') ? 1 : 0;
-
-        if (pvariant)
-            callbacks = ac->sub.patterns;
-        else
-            callbacks = ac->sub.channels;
+        kind = __redisSubscribeKind(reply->element[0]->str,
+                                    reply->element[0]->len, &variant);
+        callbacks = __redisSubscribeDict(ac,variant);
 
         /* Locate the right callback */
         if (reply->element[1]->type == REDIS_REPLY_STRING) {
-            sname = sdsnewlen(reply->element[1]->str,reply->element[1]->len);
-            if (sname == NULL) goto oom;
-
-            if ((de = dictFind(callbacks,sname)) != NULL) {
+            de = dictFindBuf(callbacks,reply->element[1]->str,reply->element[1]->len);
+            if (de != NULL) {
                 cb = dictGetEntryVal(de);
                 memcpy(dstcb,cb,sizeof(*dstcb));
             }
         }
 
         /* If this is an subscribe reply decrease pending counter. */
-        if (strcasecmp(stype+pvariant,"subscribe") == 0) {
+        if (kind == REDIS_SUBKIND_SUBSCRIBE) {
             assert(cb != NULL);
             cb->pending_subs -= 1;
 
-        } else if (strcasecmp(stype+pvariant,"unsubscribe") == 0) {
+        } else if (kind == REDIS_SUBKIND_UNSUBSCRIBE) {
             if (cb == NULL)
                 ac->sub.pending_unsubs -= 1;
             else if (cb->pending_subs == 0)
-                dictDelete(callbacks,sname);
+                dictDeleteBuf(callbacks,reply->element[1]->str,reply->element[1]->len);
 
             /* If this was the last unsubscribe message, revert to
              * non-subscribe mode. */
@@ -521,58 +1587,100 @@ static int __redisGetSubscribeCallback(redisAsyncContext *ac, redisReply *reply,
             if (reply->element[2]->integer == 0
                 && dictSize(ac->sub.channels) == 0
                 && dictSize(ac->sub.patterns) == 0
+                && dictSize(ac->sub.schannels) == 0
                 && ac->sub.pending_unsubs == 0) {
                 c->flags &= ~REDIS_SUBSCRIBED;
 
                 /* Move ongoing regular command callbacks. */
                 redisCallback cb;
-                while (__redisShiftCallback(&ac->sub.replies,&cb) == REDIS_OK) {
-                    __redisPushCallback(&ac->replies,&cb);
+                while (__redisShiftCallback(ac,&ac->sub.replies,&cb) == REDIS_OK) {
+                    __redisPushCallback(ac,&ac->replies,&cb);
                 }
             }
         }
-        sdsfree(sname);
     } else {
         /* Shift callback for pending command in subscribed context. */
-        __redisShiftCallback(&ac->sub.replies,dstcb);
+        __redisShiftCallback(ac,&ac->sub.replies,dstcb);
     }
     return REDIS_OK;
-oom:
-    __redisSetError(&(ac->c), REDIS_ERR_OOM, "Out of memory");
-    __redisAsyncCopyError(ac);
-    return REDIS_ERR;
+}
+
+/* Hand the next reply to the message callback when it is a "message",
+ * "pmessage" or "smessage", straight from the read buffer. Returns 1 when a
+ * message was consumed, -1 when more data is needed, and 0 when the reply
+ * must go through redisGetReply(). */
+static int __redisDeliverMessage(redisAsyncContext *ac) {
+    redisContext *c = &(ac->c);
+    redisPubSubMessage msg;
+    redisCallback *cb;
+    dictEntry *de;
+    int ret;
+
+    /* Arrays are only messages as long as the server doesn't push them. */
+    ret = redisReaderGetMessage(c->reader, (c->flags & REDIS_SUPPORTS_PUSH) != 0, &msg);
+    if (ret != 1)
+        return ret;
+
+    if (msg.pattern != NULL)
+        de = dictFindBuf(ac->sub.patterns, msg.pattern, msg.pattern_len);
+    else
+        de = dictFindBuf(msg.sharded ? ac->sub.schannels : ac->sub.channels,
+                         msg.channel, msg.channel_len);
+
+    /* Like with replies, messages nobody subscribed to are ignored. */
+    if (de != NULL) {
+        cb = dictGetEntryVal(de);
+        c->flags |= REDIS_IN_CALLBACK;
+        ac->message_cb(ac, &msg, cb->privdata);
+        c->flags &= ~REDIS_IN_CALLBACK;
+    }
+    return 1;
 }
 
 #define redisIsSpontaneousPushReply(r) \
     (redisIsPushReply(r) && !redisIsSubscribeReply(r))
 
 static int redisIsSubscribeReply(redisReply *reply) {
-    char *str;
-    size_t len, off;
+    int variant;
 
     /* We will always have at least one string with the subscribe/message type */
-    if (reply->elements < 1 || reply->element[0]->type != REDIS_REPLY_STRING ||
-        reply->element[0]->len < sizeof("message") - 1)
-    {
+    if (reply->elements < 1 || reply->element[0]->type != REDIS_REPLY_STRING)
         return 0;
-    }
-
-    /* Get the string/len moving past 'p' if needed */
-    off = tolower(reply->element[0]->str[0]) == 'p';
-    str = reply->element[0]->str + off;
-    len = reply->element[0]->len - off;
 
-    return !strncasecmp(str, "subscribe", len) ||
-           !strncasecmp(str, "message", len) ||
-           !strncasecmp(str, "unsubscribe", len);
+    return __redisSubscribeKind(reply->element[0]->str, reply->element[0]->len,
+                                &variant) != REDIS_SUBKIND_NONE;
 }
 
 void redisProcessCallbacks(redisAsyncContext *ac) {
     redisContext *c = &(ac->c);
     void *reply = NULL;
-    int status;
+    int status = REDIS_OK;
+
+    for (;;) {
+        /* Messages skip the reply objects when they have their own handler,
+         * and can't be the reply to a pending regular command. A message
+         * that is not complete yet is waited for rather than parsed as a
+         * reply in pieces. */
+        int message = 0;
+        if (ac->message_cb != NULL && (c->flags & REDIS_SUBSCRIBED) &&
+            ac->replies.head == NULL)
+        {
+            message = __redisDeliverMessage(ac);
+        }
+
+        if (message == 1) {
+            /* Proceed with free'ing when redisAsyncFree() was called. */
+            if (c->flags & REDIS_FREEING) {
+                __redisAsyncFree(ac);
+                return;
+            }
+            continue;
+        } else if (message == -1) {
+            reply = NULL;
+        } else if ((status = redisGetReply(c,&reply)) != REDIS_OK) {
+            break;
+        }
 
-    while((status = redisGetReply(c,&reply)) == REDIS_OK) {
         if (reply == NULL) {
             /* When the connection is being disconnected and there are
              * no more replies, this is the cue to really disconnect. */
@@ -594,6 +1702,8 @@ void redisProcessCallbacks(redisAsyncContext *ac) {
          * This allows existing code to be backward compatible and work in
          * either RESP2 or RESP3 mode. */
         if (redisIsSpontaneousPushReply(reply)) {
+            if (ac->cache)
+                redisCacheHandlePush(ac->cache->cache, reply);
             __redisRunPushCallback(ac, reply);
             c->reader->fn->freeObject(reply);
             continue;
@@ -601,8 +1711,8 @@ void redisProcessCallbacks(redisAsyncContext *ac) {
 
         /* Even if the context is subscribed, pending regular
          * callbacks will get a reply before pub/sub messages arrive. */
-        redisCallback cb = {NULL, NULL, 0, 0, NULL};
-        if (__redisShiftCallback(&ac->replies,&cb) != REDIS_OK) {
+        redisCallback cb = {NULL, NULL, 0, 0, NULL, NULL, 0};
+        if (__redisShiftCallback(ac,&ac->replies,&cb) != REDIS_OK) {
             /*
              * A spontaneous reply in a not-subscribed context can be the error
              * reply that is sent when a new connection exceeds the maximum
@@ -631,6 +1741,9 @@ void redisProcessCallbacks(redisAsyncContext *ac) {
                 __redisGetSubscribeCallback(ac,reply,&cb);
         }
 
+        if (cb.latency)
+            __redisLatencyStop(&cb);
+
         if (cb.fn != NULL) {
             __redisRunCallback(ac,&cb,reply);
             if (!(c->flags & REDIS_NO_AUTO_FREE_REPLIES)){
@@ -642,6 +1755,10 @@ void redisProcessCallbacks(redisAsyncContext *ac) {
                 __redisAsyncFree(ac);
                 return;
             }
+
+            if (ac->reconnect && ac->reconnect->state == REDIS_RECONNECT_RESTORING &&
+                __redisAsyncReconnectRestored(ac) != REDIS_OK)
+                return;
         } else {
             /* No callback for this reply. This can either be a NULL callback,
              * or there were no callbacks to begin with. Either way, don't
@@ -652,7 +1769,7 @@ void redisProcessCallbacks(redisAsyncContext *ac) {
 
         /* If in monitor mode, repush the callback */
         if (c->flags & REDIS_MONITORING) {
-            __redisPushCallback(&ac->replies,&cb);
+            __redisPushCallback(ac,&ac->replies,&cb);
         }
     }
 
@@ -662,7 +1779,15 @@ void redisProcessCallbacks(redisAsyncContext *ac) {
 }
 
 static void __redisAsyncHandleConnectFailure(redisAsyncContext *ac) {
-    __redisRunConnectCallback(ac, REDIS_ERR);
+    redisContext *c = &(ac->c);
+
+    /* A failed reconnection attempt only schedules the next one. */
+    if (ac->reconnect && ac->reconnect->state == REDIS_RECONNECT_CONNECTING) {
+        if (c->err == 0)
+            __redisSetError(c, REDIS_ERR_IO, "Reconnection failed");
+    } else {
+        __redisRunConnectCallback(ac, REDIS_ERR);
+    }
     __redisAsyncDisconnect(ac);
 }
 
@@ -692,6 +1817,8 @@ static int __redisAsyncHandleConnect(redisAsyncContext *ac) {
          * to delete the context here after callback return.
          */
         c->flags |= REDIS_CONNECTED;
+        if (ac->reconnect && ac->reconnect->state == REDIS_RECONNECT_CONNECTING)
+            __redisAsyncReconnectDone(ac);
         __redisRunConnectCallback(ac, REDIS_OK);
         if ((ac->c.flags & REDIS_DISCONNECTING)) {
             redisAsyncDisconnect(ac);
@@ -726,6 +1853,10 @@ void redisAsyncHandleRead(redisAsyncContext *ac) {
     /* must not be called from a callback */
     assert(!(c->flags & REDIS_IN_CALLBACK));
 
+    /* No connection until the next reconnection attempt. */
+    if (ac->reconnect && ac->reconnect->state == REDIS_RECONNECT_WAITING)
+        return;
+
     if (!(c->flags & REDIS_CONNECTED)) {
         /* Abort connect was not successful. */
         if (__redisAsyncHandleConnect(ac) != REDIS_OK)
@@ -761,6 +1892,10 @@ void redisAsyncHandleWrite(redisAsyncContext *ac) {
     /* must not be called from a callback */
     assert(!(c->flags & REDIS_IN_CALLBACK));
 
+    /* No connection until the next reconnection attempt. */
+    if (ac->reconnect && ac->reconnect->state == REDIS_RECONNECT_WAITING)
+        return;
+
     if (!(c->flags & REDIS_CONNECTED)) {
         /* Abort connect was not successful. */
         if (__redisAsyncHandleConnect(ac) != REDIS_OK)
@@ -779,6 +1914,19 @@ void redisAsyncHandleTimeout(redisAsyncContext *ac) {
     /* must not be called from a callback */
     assert(!(c->flags & REDIS_IN_CALLBACK));
 
+    redisTrace1(timeout, ac);
+    if (ac->reconnect && ac->reconnect->state == REDIS_RECONNECT_WAITING) {
+        /* Time for the next reconnection attempt. */
+        __redisAsyncReconnectAttempt(ac);
+        return;
+    } else if (ac->reconnect && ac->reconnect->state == REDIS_RECONNECT_CONNECTING &&
+               !(c->flags & REDIS_CONNECTED)) {
+        /* The attempt timed out, queued commands wait for the next one. */
+        __redisSetError(c, REDIS_ERR_TIMEOUT, "Timeout");
+        __redisAsyncDisconnect(ac);
+        return;
+    }
+
     if ((c->flags & REDIS_CONNECTED)) {
         if (ac->replies.head == NULL && ac->sub.replies.head == NULL) {
             /* Nothing to do - just an idle timeout */
@@ -801,7 +1949,7 @@ void redisAsyncHandleTimeout(redisAsyncContext *ac) {
         __redisRunConnectCallback(ac, REDIS_ERR);
     }
 
-    while (__redisShiftCallback(&ac->replies, &cb) == REDIS_OK) {
+    while (__redisShiftCallback(ac,&ac->replies, &cb) == REDIS_OK) {
         __redisRunCallback(ac, &cb, NULL);
     }
 
@@ -828,19 +1976,18 @@ static const char *nextArgument(const char *start, const char **str, size_t *len
     return p+2+(*len)+2;
 }
 
-/* Helper function for the redisAsyncCommand* family of functions. Writes a
- * formatted command to the output buffer and registers the provided callback
- * function with the context. */
-static int __redisAsyncCommand(redisAsyncContext *ac, redisCallbackFn *fn, void *privdata, const char *cmd, size_t len) {
+/* Writes a formatted command to the output buffer and registers the provided
+ * callback function with the context. */
+static int __redisAsyncQueueCommand(redisAsyncContext *ac, redisCallbackFn *fn, void *privdata, const char *cmd, size_t len) {
     redisContext *c = &(ac->c);
     redisCallback cb;
     struct dict *cbdict;
     dictIterator it;
     dictEntry *de;
     redisCallback *existcb;
-    int pvariant, hasnext;
-    const char *cstr, *astr;
-    size_t clen, alen;
+    int kind, variant, hasnext;
+    const char *cstr, *astr, *name;
+    size_t clen, alen, namelen;
     const char *p;
     sds sname;
     int ret;
@@ -853,59 +2000,53 @@ static int __redisAsyncCommand(redisAsyncContext *ac, redisCallbackFn *fn, void
     cb.privdata = privdata;
     cb.pending_subs = 1;
     cb.unsubscribe_sent = 0;
+    cb.latency = NULL;
+    cb.queued = 0;
 
     /* Find out which command will be appended. */
     p = nextArgument(cmd,&cstr,&clen);
     assert(p != NULL);
     hasnext = (p[0] == '$');
-    pvariant = (tolower(cstr[0]) == 'p') ? 1 : 0;
-    cstr += pvariant;
-    clen -= pvariant;
+    name = cstr;
+    namelen = clen;
+    kind = __redisSubscribeKind(cstr,clen,&variant);
 
-    if (hasnext && strncasecmp(cstr,"subscribe\r\n",11) == 0) {
+    if (hasnext && kind == REDIS_SUBKIND_SUBSCRIBE) {
         c->flags |= REDIS_SUBSCRIBED;
 
         /* Add every channel/pattern to the list of subscription callbacks. */
         while ((p = nextArgument(p,&astr,&alen)) != NULL) {
-            sname = sdsnewlen(astr,alen);
-            if (sname == NULL)
-                goto oom;
-
-            if (pvariant)
-                cbdict = ac->sub.patterns;
-            else
-                cbdict = ac->sub.channels;
-
-            de = dictFind(cbdict,sname);
+            cbdict = __redisSubscribeDict(ac,variant);
+            de = dictFindBuf(cbdict,astr,alen);
 
+            /* The new callback takes over an existing subscription. */
             if (de != NULL) {
                 existcb = dictGetEntryVal(de);
                 cb.pending_subs = existcb->pending_subs + 1;
+                memcpy(existcb,&cb,sizeof(*existcb));
+                continue;
             }
 
+            sname = sdsnewlen(astr,alen);
+            if (sname == NULL)
+                goto oom;
+
             ret = dictReplace(cbdict,sname,&cb);
 
             if (ret == 0) sdsfree(sname);
         }
-    } else if (strncasecmp(cstr,"unsubscribe\r\n",13) == 0) {
-        /* It is only useful to call (P)UNSUBSCRIBE when the context is
+    } else if (kind == REDIS_SUBKIND_UNSUBSCRIBE) {
+        /* It is only useful to call (P|S)UNSUBSCRIBE when the context is
          * subscribed to one or more channels or patterns. */
         if (!(c->flags & REDIS_SUBSCRIBED)) return REDIS_ERR;
 
-        if (pvariant)
-            cbdict = ac->sub.patterns;
-        else
-            cbdict = ac->sub.channels;
+        cbdict = __redisSubscribeDict(ac,variant);
 
         if (hasnext) {
             /* Send an unsubscribe with specific channels/patterns.
              * Bookkeeping the number of expected replies */
             while ((p = nextArgument(p,&astr,&alen)) != NULL) {
-                sname = sdsnewlen(astr,alen);
-                if (sname == NULL)
-                    goto oom;
-
-                de = dictFind(cbdict,sname);
+                de = dictFindBuf(cbdict,astr,alen);
                 if (de != NULL) {
                     existcb = dictGetEntryVal(de);
                     if (existcb->unsubscribe_sent == 0)
@@ -917,7 +2058,6 @@ static int __redisAsyncCommand(redisAsyncContext *ac, redisCallbackFn *fn, void
                     /* Not subscribed to, reply to be ignored */
                     ac->sub.pending_unsubs += 1;
                 }
-                sdsfree(sname);
             }
         } else {
             /* Send an unsubscribe without specific channels/patterns.
@@ -931,42 +2071,91 @@ static int __redisAsyncCommand(redisAsyncContext *ac, redisCallbackFn *fn, void
                     no_subs = 0;
                 }
             }
+            dictReleaseIterator(&it);
             /* Unsubscribing to all channels/patterns, where none is
              * subscribed to, results in a single reply to be ignored. */
             if (no_subs == 1)
                 ac->sub.pending_unsubs += 1;
         }
 
-        /* (P)UNSUBSCRIBE does not have its own response: every channel or
+        /* (P|S)UNSUBSCRIBE does not have its own response: every channel or
          * pattern that is unsubscribed will receive a message. This means we
          * should not append a callback function for this command. */
-    } else if (strncasecmp(cstr,"monitor\r\n",9) == 0) {
+    } else if (clen == 7 && strncasecmp(cstr,"monitor",7) == 0) {
         /* Set monitor flag and push callback */
         c->flags |= REDIS_MONITORING;
-        if (__redisPushCallback(&ac->replies,&cb) != REDIS_OK)
+        if (__redisPushCallback(ac,&ac->replies,&cb) != REDIS_OK)
             goto oom;
     } else {
+        if (ac->cache && !(c->flags & REDIS_SUBSCRIBED)) {
+            ret = __redisAsyncCacheCommand(ac,&cb,name,namelen,p,cmd,len);
+            if (ret == 1)
+                return REDIS_OK;
+            else if (ret == -1)
+                goto oom;
+        }
+
+        if (ac->latency &&
+            __redisLatencyStart(ac,&cb,name,namelen) != REDIS_OK)
+            goto oom;
+
+        if (ac->reconnect &&
+            __redisReconnectTrack(ac,name,namelen,cmd,len,&cb) != REDIS_OK)
+            goto oom;
+
         if (c->flags & REDIS_SUBSCRIBED) {
-            if (__redisPushCallback(&ac->sub.replies,&cb) != REDIS_OK)
+            if (__redisPushCallback(ac,&ac->sub.replies,&cb) != REDIS_OK)
                 goto oom;
         } else {
-            if (__redisPushCallback(&ac->replies,&cb) != REDIS_OK)
+            if (__redisPushCallback(ac,&ac->replies,&cb) != REDIS_OK)
                 goto oom;
         }
     }
 
     __redisAppendCommand(c,cmd,len);
 
-    /* Always schedule a write when the write buffer is non-empty */
-    _EL_ADD_WRITE(ac);
+    /* Always schedule a write when the write buffer is non-empty, unless it
+     * waits for the next reconnection attempt. */
+    if (!ac->reconnect || ac->reconnect->state != REDIS_RECONNECT_WAITING)
+        _EL_ADD_WRITE(ac);
 
     return REDIS_OK;
 oom:
+    if (cb.fn == __redisReplayCallback || cb.fn == __redisReconnectSaveCallback)
+        __redisReplayUnwrap(&cb);
+    if (cb.fn == __redisCacheFillCallback)
+        __redisReplayUnwrap(&cb);
     __redisSetError(&(ac->c), REDIS_ERR_OOM, "Out of memory");
     __redisAsyncCopyError(ac);
     return REDIS_ERR;
 }
 
+/* Swap the commands queued while reconnecting with the ones being sent. */
+static void __redisAsyncSwapQueued(redisAsyncContext *ac) {
+    struct redisAsyncReconnect *r = ac->reconnect;
+    redisCallbackList replies = ac->replies;
+    sds obuf = ac->c.obuf;
+
+    ac->c.obuf = r->queuedbuf;
+    ac->replies = r->queued;
+    r->queuedbuf = obuf;
+    r->queued = replies;
+}
+
+/* Helper function for the redisAsyncCommand* family of functions. Commands
+ * issued while the session state is restored are queued behind it. */
+static int __redisAsyncCommand(redisAsyncContext *ac, redisCallbackFn *fn, void *privdata, const char *cmd, size_t len) {
+    int status;
+
+    if (!ac->reconnect || ac->reconnect->state != REDIS_RECONNECT_RESTORING)
+        return __redisAsyncQueueCommand(ac,fn,privdata,cmd,len);
+
+    __redisAsyncSwapQueued(ac);
+    status = __redisAsyncQueueCommand(ac,fn,privdata,cmd,len);
+    __redisAsyncSwapQueued(ac);
+    return status;
+}
+
 int redisvAsyncCommand(redisAsyncContext *ac, redisCallbackFn *fn, void *privdata, const char *format, va_list ap) {
     char *cmd;
     int len;
@@ -1014,6 +2203,12 @@ redisAsyncPushFn *redisAsyncSetPushCallback(redisAsyncContext *ac, redisAsyncPus
     return old;
 }
 
+redisMessageCallback *redisAsyncSetMessageCallback(redisAsyncContext *ac, redisMessageCallback *fn) {
+    redisMessageCallback *old = ac->message_cb;
+    ac->message_cb = fn;
+    return old;
+}
+
 int redisAsyncSetTimeout(redisAsyncContext *ac, struct timeval tv) {
     if (!ac->c.command_timeout) {
         ac->c.command_timeout = hi_calloc(1, sizeof(tv));
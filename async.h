@@ -32,6 +32,8 @@
 #ifndef __HIREDIS_ASYNC_H
 #define __HIREDIS_ASYNC_H
 #include "hiredis.h"
+#include "cache.h"
+#include "histogram.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,6 +41,8 @@ extern "C" {
 
 struct redisAsyncContext; /* need forward declaration of redisAsyncContext */
 struct dict; /* dictionary header is included in async.c */
+struct redisAsyncReconnect; /* reconnection state, private to async.c */
+struct redisAsyncCache; /* client side caching state, private to async.c */
 
 /* Reply callback prototype and container */
 typedef void (redisCallbackFn)(struct redisAsyncContext*, void*, void*);
@@ -48,6 +52,8 @@ typedef struct redisCallback {
     int pending_subs;
     int unsubscribe_sent;
     void *privdata;
+    redisHistogram *latency; /* Where to record the reply time, or NULL */
+    long long queued; /* When the command was queued, in microseconds */
 } redisCallback;
 
 /* List of callbacks for either regular replies or pub/sub */
@@ -60,6 +66,8 @@ typedef void (redisDisconnectCallback)(const struct redisAsyncContext*, int stat
 typedef void (redisConnectCallback)(const struct redisAsyncContext*, int status);
 typedef void (redisConnectCallbackNC)(struct redisAsyncContext *, int status);
 typedef void(redisTimerCallback)(void *timer, void *privdata);
+typedef void (redisMessageCallback)(struct redisAsyncContext *ac,
+                                    const redisPubSubMessage *msg, void *privdata);
 
 /* Context for an async connection to Redis */
 typedef struct redisAsyncContext {
@@ -108,13 +116,52 @@ typedef struct redisAsyncContext {
         redisCallbackList replies;
         struct dict *channels;
         struct dict *patterns;
+        struct dict *schannels; /* Shard channels (SSUBSCRIBE) */
         int pending_unsubs;
     } sub;
 
     /* Any configured RESP3 PUSH handler */
     redisAsyncPushFn *push_cb;
+
+    /* Pub/sub message handler, see redisAsyncSetMessageCallback() */
+    redisMessageCallback *message_cb;
+
+    /* Automatic reconnection, see redisAsyncSetReconnect() */
+    struct redisAsyncReconnect *reconnect;
+
+    /* Client side caching, see redisAsyncEnableCache() */
+    struct redisAsyncCache *cache;
+
+    /* Reply times by command, see redisAsyncEnableLatency() */
+    struct dict *latency;
 } redisAsyncContext;
 
+/* Called on every new connection made by the automatic reconnection, before
+ * anything is sent on it, e.g. to call redisInitiateSSLWithContext(). Return
+ * REDIS_OK on success; on REDIS_ERR the attempt counts as failed. */
+typedef int (redisReconnectCallback)(struct redisAsyncContext *ac, void *privdata);
+
+typedef struct redisAsyncReconnectOptions {
+    /* Delay before the first attempt, doubled after every failed attempt up
+     * to max_delay. Each delay is randomly picked between half and all of
+     * its value, so clients dropped together don't come back together. */
+    struct timeval min_delay;
+    struct timeval max_delay;
+
+    /* Give up after this many failed attempts in a row, and disconnect as
+     * without automatic reconnection. 0 to retry forever. */
+    int max_attempts;
+
+    /* Send again the read-only commands that were not answered when the
+     * connection was lost. Other commands get a NULL reply, as they may or
+     * may not have been executed. */
+    int replay;
+
+    /* Optional callback for new connections, and its private data. */
+    redisReconnectCallback *reconnect_cb;
+    void *privdata;
+} redisAsyncReconnectOptions;
+
 /* Functions that proxy to hiredis */
 redisAsyncContext *redisAsyncConnectWithOptions(const redisOptions *options);
 redisAsyncContext *redisAsyncConnect(const char *ip, int port);
@@ -128,6 +175,64 @@ int redisAsyncSetDisconnectCallback(redisAsyncContext *ac, redisDisconnectCallba
 
 redisAsyncPushFn *redisAsyncSetPushCallback(redisAsyncContext *ac, redisAsyncPushFn *fn);
 int redisAsyncSetTimeout(redisAsyncContext *ac, struct timeval tv);
+
+/* Deliver "message" and "pmessage" pushes to fn rather than to the callback
+ * of the SUBSCRIBE or PSUBSCRIBE command, without building a reply. fn gets
+ * the channel, pattern and payload as slices of the read buffer, valid only
+ * during the call, and the privdata of the matching (P)SUBSCRIBE. Other
+ * subscription replies still go to the subscribe callbacks. Pass NULL to
+ * restore the default delivery. Returns the previous handler. */
+redisMessageCallback *redisAsyncSetMessageCallback(redisAsyncContext *ac, redisMessageCallback *fn);
+
+/* Reconnect automatically when the connection is lost because of an error,
+ * rather than failing every pending command and freeing the context. The
+ * context stays valid: commands sent while reconnecting are queued, and the
+ * last AUTH, HELLO and SELECT are sent again on the new connection, as are
+ * SUBSCRIBE, PSUBSCRIBE and SSUBSCRIBE for the active subscriptions. The
+ * connect callback is called again after every successful reconnection; the
+ * disconnect callback only when giving up.
+ *
+ * Waiting between attempts uses the timer of the event library adapter, so
+ * this has no effect with adapters that don't provide one. Only TCP and unix
+ * socket connections can reconnect. Pass NULL options to disable it again. */
+int redisAsyncSetReconnect(redisAsyncContext *ac, const redisAsyncReconnectOptions *options);
+
+/* Keep the replies to GET, HGET and HGETALL in a local cache, and answer
+ * these commands from it while the server does not announce the key has
+ * changed. This switches the connection to RESP3 with HELLO 3, and enables
+ * CLIENT TRACKING on it, which the cache relies on for invalidation.
+ *
+ * A command is answered from the cache only when no other command is waiting
+ * for a reply, so replies keep the order of commands. Its callback is then
+ * called before redisAsyncCommand() returns. The cache is emptied whenever
+ * the connection is lost. */
+int redisAsyncEnableCache(redisAsyncContext *ac, const redisCacheOptions *options);
+
+/* The cache of a context, e.g. for redisCacheGetStats(), or NULL. */
+redisCache *redisAsyncGetCache(redisAsyncContext *ac);
+
+/* Record the time between queueing every command and running its callback,
+ * in microseconds, in a histogram per command name (e.g. "GET", in upper
+ * case). Commands answered from the cache, pub/sub commands and MONITOR are
+ * not recorded. Returns REDIS_ERR when out of memory. */
+int redisAsyncEnableLatency(redisAsyncContext *ac);
+
+/* Call fn with every command name and its histogram, e.g. to export their
+ * percentiles with redisHistogramPercentile(). The histograms belong to the
+ * context and must not be freed. */
+typedef void (redisLatencyFn)(const char *command, const redisHistogram *h, void *privdata);
+void redisAsyncLatencyForEach(redisAsyncContext *ac, redisLatencyFn *fn, void *privdata);
+
+/* The histogram of one command, or NULL if none was recorded. */
+const redisHistogram *redisAsyncGetLatency(redisAsyncContext *ac, const char *command);
+
+/* Empty every histogram, e.g. after exporting them. */
+void redisAsyncResetLatency(redisAsyncContext *ac);
+
+/* Take a snapshot of the counters of a context, as redisGetStats() does for
+ * ac->c. May be called from any thread. */
+void redisAsyncGetStats(const redisAsyncContext *ac, redisContextStats *stats);
+
 void redisAsyncDisconnect(redisAsyncContext *ac);
 void redisAsyncFree(redisAsyncContext *ac);
 
@@ -0,0 +1,883 @@
+/*
+ * Measure the throughput, latency, CPU time and allocations of hiredis over a
+ * sweep of client configurations.
+ *
+ * Every option below takes a comma separated list, and every combination of
+ * them is run in turn, one line of results each:
+ *
+ *   -m     blocking (sync) or asynchronous (async) API
+ *   -c     number of connections, each driven by its own thread
+ *   -P     pipeline depth: commands sent before waiting for their replies
+ *   -d     size of the value in bytes, for SET and GET
+ *   -t     command: ping, set or get
+ *   --tls  plain text (off) or TLS (on), when built with SSL support
+ *   --transport
+ *          loopback TCP (tcp) or an in-memory ring (ring), see ring.h; the
+ *          ring only reaches the mock server, and not over TLS
+ *
+ * Without -h, the commands go to a RESP mock server embedded in the process,
+ * which answers from canned replies: PONG for PING, OK for SET, a value of
+ * the configured size for GET and OK for anything else. The numbers then only
+ * measure the client, and no Redis server is needed. For TLS, the mock server
+ * uses a self-signed certificate it generates at startup, which the client
+ * does not verify. With the ring, each connection gets its own mock server
+ * thread serving it, and no socket.
+ *
+ * Latencies run from sending a pipeline (or, for the asynchronous API, a
+ * command) to receiving the reply. CPU time is that of the client threads
+ * only, not of the mock server. Allocations are those made through the
+ * hiredis allocators, so do not include those of OpenSSL. With
+ * --object-cache, reply objects and callbacks are reused from the per thread
+ * object cache, see hiredisSetObjectCacheLimit().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <hiredis.h>
+#include <async.h>
+#include <histogram.h>
+#include <ring.h>
+#include <adapters/poll.h>
+
+#ifdef HIREDIS_BENCH_SSL
+#include <hiredis_ssl.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+#endif
+
+#define MAX_LIST 32
+
+typedef struct benchConfig {
+    int async;
+    int tls;
+    int ring;
+    int conns;
+    int pipeline;
+    int size;
+    const char *command;
+} benchConfig;
+
+typedef struct benchClient {
+    pthread_t thread;
+    const benchConfig *cfg;
+    const char *value;
+    long requests;
+    long issued;
+    long done;
+    long long *starts;
+    long long *latencies;
+    long long cpu_ns;
+    unsigned long long allocs;
+} benchClient;
+
+static const char *host;
+static int port = 6379;
+static int mock_port, mock_tls_port;
+
+#ifdef HIREDIS_BENCH_SSL
+static redisSSLContext *ssl;
+static SSL_CTX *mock_ssl;
+#endif
+
+/* Size of the value the mock server replies to GET with. */
+static int mock_value_len;
+
+/* Start line for the client threads of a run. */
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static int start_ready, start_go;
+
+static long long nowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long threadCpuNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void die(const char *what, const char *err) {
+    fprintf(stderr, "%s: %s\n", what, err);
+    exit(1);
+}
+
+static void *xmalloc(size_t size) {
+    void *ptr = malloc(size);
+
+    if (ptr == NULL)
+        die("malloc", "Out of memory");
+    return ptr;
+}
+
+/* Allocations made through the hiredis allocators by the current thread. */
+static __thread unsigned long long allocs;
+
+static void *countMalloc(size_t size) {
+    allocs++;
+    return malloc(size);
+}
+
+static void *countCalloc(size_t nmemb, size_t size) {
+    allocs++;
+    return calloc(nmemb, size);
+}
+
+static void *countRealloc(void *ptr, size_t size) {
+    allocs++;
+    return realloc(ptr, size);
+}
+
+static char *countStrdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = countMalloc(len);
+
+    if (copy)
+        memcpy(copy, str, len);
+    return copy;
+}
+
+/*---------------------------------------------------------------------------
+ * Mock server
+ *--------------------------------------------------------------------------*/
+
+typedef struct mockConn {
+    int fd;
+    redisRing *ring;
+#ifdef HIREDIS_BENCH_SSL
+    SSL *ssl;
+#endif
+} mockConn;
+
+static int mockRead(mockConn *conn, char *buf, size_t len) {
+    if (conn->ring)
+        return (int)redisRingRead(conn->ring, buf, len, 1);
+#ifdef HIREDIS_BENCH_SSL
+    if (conn->ssl)
+        return SSL_read(conn->ssl, buf, (int)len);
+#endif
+    return (int)read(conn->fd, buf, len);
+}
+
+static int mockWrite(mockConn *conn, const char *buf, size_t len) {
+    if (conn->ring)
+        return redisRingWrite(conn->ring, buf, len, 1) == (ssize_t)len ? 0 : -1;
+    while (len > 0) {
+        int n;
+
+#ifdef HIREDIS_BENCH_SSL
+        if (conn->ssl)
+            n = SSL_write(conn->ssl, buf, (int)len);
+        else
+#endif
+            n = (int)write(conn->fd, buf, len);
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Parse the number terminated by \r\n at p, returning the position after it,
+ * or NULL if the line is not complete. */
+static const char *mockNumber(const char *p, const char *end, long *value) {
+    *value = 0;
+    for (; p < end && isdigit((unsigned char)*p); p++)
+        *value = *value * 10 + (*p - '0');
+    return end - p >= 2 ? p + 2 : NULL;
+}
+
+/* Parse the multi bulk command at the start of buf. Returns its length, or 0
+ * when it is not complete yet, and sets name to its first argument. */
+static size_t mockParse(const char *buf, size_t len, const char **name, long *namelen) {
+    const char *p = buf, *end = buf + len;
+    long argc, arglen, i;
+
+    if (len == 0 || *p != '*' || (p = mockNumber(p + 1, end, &argc)) == NULL)
+        return 0;
+    *name = NULL;
+    *namelen = 0;
+    for (i = 0; i < argc; i++) {
+        if (p >= end || *p != '$' || (p = mockNumber(p + 1, end, &arglen)) == NULL)
+            return 0;
+        if (end - p < arglen + 2)
+            return 0;
+        if (i == 0) {
+            *name = p;
+            *namelen = arglen;
+        }
+        p += arglen + 2;
+    }
+    return p - buf;
+}
+
+static int mockIs(const char *name, long len, const char *command) {
+    long i;
+
+    for (i = 0; i < len && command[i]; i++) {
+        if (toupper((unsigned char)name[i]) != command[i])
+            return 0;
+    }
+    return i == len && command[i] == '\0';
+}
+
+static void *mockConnThread(void *arg) {
+    mockConn *conn = arg;
+    size_t inlen = 0, incap = 65536, outlen, outcap = 65536, getlen;
+    char *in = xmalloc(incap), *out = xmalloc(outcap), *get;
+    int value_len = __atomic_load_n(&mock_value_len, __ATOMIC_RELAXED);
+
+    /* The canned reply to GET. */
+    get = xmalloc(value_len + 32);
+    getlen = sprintf(get, "$%d\r\n", value_len);
+    memset(get + getlen, 'x', value_len);
+    getlen += value_len;
+    memcpy(get + getlen, "\r\n", 2);
+    getlen += 2;
+
+#ifdef HIREDIS_BENCH_SSL
+    if (conn->ssl && SSL_accept(conn->ssl) != 1)
+        goto done;
+#endif
+
+    for (;;) {
+        const char *name, *reply;
+        size_t pos = 0, cmdlen, replylen;
+        long namelen;
+        int n;
+
+        if (inlen == incap) {
+            incap *= 2;
+            if ((in = realloc(in, incap)) == NULL)
+                die("realloc", "Out of memory");
+        }
+        if ((n = mockRead(conn, in + inlen, incap - inlen)) <= 0)
+            break;
+        inlen += n;
+
+        /* Answer every complete command with a single write. */
+        for (outlen = 0; (cmdlen = mockParse(in + pos, inlen - pos, &name, &namelen)) > 0; pos += cmdlen) {
+            if (mockIs(name, namelen, "PING")) {
+                reply = "+PONG\r\n";
+                replylen = 7;
+            } else if (mockIs(name, namelen, "GET")) {
+                reply = get;
+                replylen = getlen;
+            } else {
+                reply = "+OK\r\n";
+                replylen = 5;
+            }
+            if (outlen + replylen > outcap) {
+                outcap = (outlen + replylen) * 2;
+                if ((out = realloc(out, outcap)) == NULL)
+                    die("realloc", "Out of memory");
+            }
+            memcpy(out + outlen, reply, replylen);
+            outlen += replylen;
+        }
+        memmove(in, in + pos, inlen - pos);
+        inlen -= pos;
+
+        if (outlen > 0 && mockWrite(conn, out, outlen) != 0)
+            break;
+    }
+
+#ifdef HIREDIS_BENCH_SSL
+done:
+    if (conn->ssl)
+        SSL_free(conn->ssl);
+#endif
+    if (conn->ring)
+        redisRingClose(conn->ring);
+    else
+        close(conn->fd);
+    free(conn);
+    free(in);
+    free(out);
+    free(get);
+    return NULL;
+}
+
+static void *mockAcceptThread(void *arg) {
+    int lfd = (int)(intptr_t)arg, tls = lfd < 0, one = 1;
+    pthread_t thread;
+
+    if (tls)
+        lfd = -lfd - 1;
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        mockConn *conn;
+
+        if (fd < 0)
+            continue;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        conn = xmalloc(sizeof(*conn));
+        conn->fd = fd;
+        conn->ring = NULL;
+#ifdef HIREDIS_BENCH_SSL
+        conn->ssl = NULL;
+        if (tls) {
+            if ((conn->ssl = SSL_new(mock_ssl)) == NULL)
+                die("SSL_new", "Out of memory");
+            SSL_set_fd(conn->ssl, fd);
+        }
+#endif
+        if (pthread_create(&thread, NULL, mockConnThread, conn) != 0)
+            die("pthread_create", "Cannot start mock connection thread");
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+/* Listen on an ephemeral port of the loopback interface, returning it. */
+static int mockListen(int tls) {
+    struct sockaddr_in sa;
+    socklen_t salen = sizeof(sa);
+    pthread_t thread;
+    int fd, one = 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = 0;
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 ||
+        listen(fd, 512) != 0 ||
+        getsockname(fd, (struct sockaddr *)&sa, &salen) != 0)
+    {
+        perror("mock server");
+        exit(1);
+    }
+
+    /* The descriptor is passed as is, or encoded as negative for TLS. */
+    if (pthread_create(&thread, NULL, mockAcceptThread,
+                       (void *)(intptr_t)(tls ? -fd - 1 : fd)) != 0)
+        die("pthread_create", "Cannot start mock server");
+    pthread_detach(thread);
+    return ntohs(sa.sin_port);
+}
+
+#ifdef HIREDIS_BENCH_SSL
+/* Server context with a freshly generated self-signed certificate. */
+static SSL_CTX *mockSSLContext(void) {
+    EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    X509 *cert = X509_new();
+    EVP_PKEY *pkey = NULL;
+
+    if (kctx == NULL || ctx == NULL || cert == NULL ||
+        EVP_PKEY_keygen_init(kctx) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) <= 0 ||
+        EVP_PKEY_keygen(kctx, &pkey) <= 0)
+        die("mock server", "Cannot generate a TLS key");
+
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 86400);
+    X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC,
+                               (const unsigned char *)"hiredis-bench", -1, -1, 0);
+    X509_set_issuer_name(cert, X509_get_subject_name(cert));
+    if (X509_set_pubkey(cert, pkey) != 1 || X509_sign(cert, pkey, EVP_sha256()) == 0 ||
+        SSL_CTX_use_certificate(ctx, cert) != 1 || SSL_CTX_use_PrivateKey(ctx, pkey) != 1)
+        die("mock server", "Cannot create a TLS certificate");
+
+    X509_free(cert);
+    EVP_PKEY_free(pkey);
+    EVP_PKEY_CTX_free(kctx);
+    return ctx;
+}
+#endif
+
+/*---------------------------------------------------------------------------
+ * Clients
+ *--------------------------------------------------------------------------*/
+
+/* Create a ring, served by a mock server thread of its own. */
+static void mockRing(redisOptions *options) {
+    mockConn *conn = xmalloc(sizeof(*conn));
+    pthread_t thread;
+
+    conn->fd = -1;
+    if ((conn->ring = redisRingCreate(0)) == NULL)
+        die("ring", "Cannot create a ring");
+#ifdef HIREDIS_BENCH_SSL
+    conn->ssl = NULL;
+#endif
+    redisRingSetOptions(conn->ring, options);
+    if (pthread_create(&thread, NULL, mockConnThread, conn) != 0)
+        die("pthread_create", "Cannot start mock connection thread");
+    pthread_detach(thread);
+}
+
+static void connectOptions(const benchConfig *cfg, redisOptions *options) {
+    memset(options, 0, sizeof(*options));
+    if (cfg->ring)
+        mockRing(options);
+    else if (host)
+        REDIS_OPTIONS_SET_TCP(options, host, port);
+    else
+        REDIS_OPTIONS_SET_TCP(options, "127.0.0.1", cfg->tls ? mock_tls_port : mock_port);
+}
+
+static void checkReply(const benchConfig *cfg, redisReply *reply, const char *err) {
+    if (reply == NULL)
+        die(cfg->command, err);
+    if (reply->type == REDIS_REPLY_ERROR)
+        die(cfg->command, reply->str);
+}
+
+/* Wait for the other clients to be connected, so that they all start
+ * sending at the same time. */
+static void waitStart(void) {
+    pthread_mutex_lock(&start_lock);
+    start_ready++;
+    pthread_cond_broadcast(&start_cond);
+    while (!start_go)
+        pthread_cond_wait(&start_cond, &start_lock);
+    pthread_mutex_unlock(&start_lock);
+}
+
+static int appendCommand(benchClient *cl, redisContext *c) {
+    const benchConfig *cfg = cl->cfg;
+
+    if (!strcmp(cfg->command, "SET"))
+        return redisAppendCommand(c, "SET hiredis-bench:key %b", cl->value, (size_t)cfg->size);
+    return redisAppendCommand(c, "%s hiredis-bench:key", cfg->command);
+}
+
+static void *syncClient(void *arg) {
+    benchClient *cl = arg;
+    const benchConfig *cfg = cl->cfg;
+    redisOptions options;
+    redisReply *reply;
+    redisContext *c;
+    long long cpu, start;
+    unsigned long long allocs_start;
+    long i, j, batch;
+
+    connectOptions(cfg, &options);
+    c = redisConnectWithOptions(&options);
+    if (c == NULL || c->err)
+        die("Connection error", c ? c->errstr : "Out of memory");
+#ifdef HIREDIS_BENCH_SSL
+    if (cfg->tls && redisInitiateSSLWithContext(c, ssl) != REDIS_OK)
+        die("TLS error", c->errstr);
+#endif
+    reply = redisCommand(c, "PING");
+    checkReply(cfg, reply, c->errstr);
+    freeReplyObject(reply);
+
+    waitStart();
+    cpu = threadCpuNs();
+    allocs_start = allocs;
+
+    for (i = 0; i < cl->requests; i += batch) {
+        batch = cl->requests - i < cfg->pipeline ? cl->requests - i : cfg->pipeline;
+        start = nowNs();
+        for (j = 0; j < batch; j++) {
+            if (appendCommand(cl, c) != REDIS_OK)
+                die(cfg->command, c->errstr);
+        }
+        for (j = 0; j < batch; j++) {
+            if (redisGetReply(c, (void **)&reply) != REDIS_OK)
+                reply = NULL;
+            checkReply(cfg, reply, c->errstr);
+            freeReplyObject(reply);
+            cl->latencies[i + j] = nowNs() - start;
+        }
+    }
+
+    cl->allocs = allocs - allocs_start;
+    cl->cpu_ns = threadCpuNs() - cpu;
+    redisFree(c);
+    return NULL;
+}
+
+static void asyncSend(redisAsyncContext *ac);
+
+static void onReply(redisAsyncContext *ac, void *r, void *privdata) {
+    benchClient *cl = ac->data;
+    long i = (long)(intptr_t)privdata;
+
+    checkReply(cl->cfg, r, ac->errstr);
+    if (i >= 0) {
+        cl->latencies[i] = nowNs() - cl->starts[i];
+        if (cl->issued < cl->requests)
+            asyncSend(ac);
+    }
+    cl->done++;
+}
+
+static void asyncSend(redisAsyncContext *ac) {
+    benchClient *cl = ac->data;
+    const benchConfig *cfg = cl->cfg;
+    void *privdata = (void *)(intptr_t)cl->issued;
+    int ret;
+
+    cl->starts[cl->issued++] = nowNs();
+    if (!strcmp(cfg->command, "SET")) {
+        ret = redisAsyncCommand(ac, onReply, privdata, "SET hiredis-bench:key %b",
+                                cl->value, (size_t)cfg->size);
+    } else {
+        ret = redisAsyncCommand(ac, onReply, privdata, "%s hiredis-bench:key", cfg->command);
+    }
+    if (ret != REDIS_OK)
+        die(cfg->command, ac->errstr);
+}
+
+static void asyncRun(redisAsyncContext *ac, long done) {
+    benchClient *cl = ac->data;
+
+    while (cl->done < done) {
+        redisPollTick(ac, 1.0);
+        if (ac->err)
+            die(cl->cfg->command, ac->errstr);
+    }
+}
+
+static void *asyncClient(void *arg) {
+    benchClient *cl = arg;
+    const benchConfig *cfg = cl->cfg;
+    redisOptions options;
+    redisAsyncContext *ac;
+    long long cpu;
+    unsigned long long allocs_start;
+    long i;
+
+    connectOptions(cfg, &options);
+    ac = redisAsyncConnectWithOptions(&options);
+    if (ac == NULL || ac->err)
+        die("Connection error", ac ? ac->errstr : "Out of memory");
+#ifdef HIREDIS_BENCH_SSL
+    if (cfg->tls && redisInitiateSSLWithContext(&ac->c, ssl) != REDIS_OK)
+        die("TLS error", ac->c.errstr);
+#endif
+    ac->data = cl;
+    redisPollAttach(ac);
+
+    /* Wait for the connection, and the handshake, to complete. */
+    if (redisAsyncCommand(ac, onReply, (void *)(intptr_t)-1, "PING") != REDIS_OK)
+        die("PING", ac->errstr);
+    asyncRun(ac, 1);
+    cl->done = 0;
+
+    waitStart();
+    cpu = threadCpuNs();
+    allocs_start = allocs;
+
+    for (i = 0; i < cfg->pipeline && cl->issued < cl->requests; i++)
+        asyncSend(ac);
+    asyncRun(ac, cl->requests);
+
+    cl->allocs = allocs - allocs_start;
+    cl->cpu_ns = threadCpuNs() - cpu;
+    redisAsyncFree(ac);
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------
+ * Runs
+ *--------------------------------------------------------------------------*/
+
+static void run(const benchConfig *cfg, long requests) {
+    benchClient *clients = xmalloc(sizeof(*clients) * cfg->conns);
+    char *value = xmalloc(cfg->size + 1);
+    redisHistogram *h = redisHistogramCreate();
+    unsigned long long total_allocs = 0;
+    long long start, elapsed, cpu = 0;
+    long per_client = requests / cfg->conns > 0 ? requests / cfg->conns : 1;
+    long total = per_client * cfg->conns, i, j;
+
+    if (h == NULL)
+        die("histogram", "Out of memory");
+    memset(value, 'x', cfg->size);
+    value[cfg->size] = '\0';
+    __atomic_store_n(&mock_value_len, cfg->size, __ATOMIC_RELAXED);
+
+    start_ready = start_go = 0;
+    for (i = 0; i < cfg->conns; i++) {
+        benchClient *cl = &clients[i];
+
+        memset(cl, 0, sizeof(*cl));
+        cl->cfg = cfg;
+        cl->value = value;
+        cl->requests = per_client;
+        cl->starts = cfg->async ? xmalloc(sizeof(long long) * per_client) : NULL;
+        cl->latencies = xmalloc(sizeof(long long) * per_client);
+        if (pthread_create(&cl->thread, NULL, cfg->async ? asyncClient : syncClient, cl) != 0)
+            die("pthread_create", "Cannot start client thread");
+    }
+
+    pthread_mutex_lock(&start_lock);
+    while (start_ready < cfg->conns)
+        pthread_cond_wait(&start_cond, &start_lock);
+    start_go = 1;
+    start = nowNs();
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&start_lock);
+
+    for (i = 0; i < cfg->conns; i++)
+        pthread_join(clients[i].thread, NULL);
+    elapsed = nowNs() - start;
+
+    for (i = 0; i < cfg->conns; i++) {
+        benchClient *cl = &clients[i];
+
+        for (j = 0; j < cl->requests; j++)
+            redisHistogramRecord(h, cl->latencies[j]);
+        cpu += cl->cpu_ns;
+        total_allocs += cl->allocs;
+        free(cl->starts);
+        free(cl->latencies);
+    }
+
+    printf("%-5s  %-3s  %-9s  %5d  %5d  %6d  %-4s  %10.0f  %8.1f  %8.1f  %8.1f  %8.1f  %9.2f  %9.2f\n",
+           cfg->async ? "async" : "sync", cfg->tls ? "on" : "off",
+           cfg->ring ? "ring" : "tcp", cfg->conns,
+           cfg->pipeline, cfg->size, cfg->command, total / (elapsed / 1e9),
+           redisHistogramPercentile(h, 50) / 1e3, redisHistogramPercentile(h, 99) / 1e3,
+           redisHistogramPercentile(h, 99.9) / 1e3, redisHistogramMax(h) / 1e3,
+           (double)cpu / total / 1e3, (double)total_allocs / total);
+    fflush(stdout);
+
+    redisHistogramFree(h);
+    free(clients);
+    free(value);
+}
+
+/*---------------------------------------------------------------------------
+ * Command line
+ *--------------------------------------------------------------------------*/
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -h <host>               Server host (default: embedded mock server)\n"
+        "  -p <port>               Server port (default 6379)\n"
+        "  -n <requests>           Requests per run, over all connections (default 100000)\n"
+        "  -m <modes>              sync and/or async (default sync)\n"
+        "  -c <connections>        Number of connections (default 1)\n"
+        "  -P <depths>             Pipeline depth (default 1)\n"
+        "  -d <sizes>              Value size in bytes (default 3)\n"
+        "  -t <commands>           ping, set and/or get (default ping,set,get)\n"
+        "  --transport <tcp|ring>  Loopback TCP and/or in-memory ring, mock server only\n"
+        "                          (default tcp)\n"
+        "  --object-cache <limit>  Cache up to limit freed reply objects and callbacks\n"
+        "                          per thread (default 0)\n"
+#ifdef HIREDIS_BENCH_SSL
+        "  --tls <off|on>          Plain text and/or TLS connections (default off)\n"
+        "  --cacert <file>         CA certificate to verify the server with\n"
+        "  --cert <file>           Client certificate\n"
+        "  --key <file>            Client private key\n"
+        "  --sni <name>            Server name indication\n"
+        "  --insecure              Do not verify the server certificate\n"
+#endif
+        "Lists are comma separated, e.g. -P 1,16,128, and every combination is run.\n",
+        prog);
+    exit(1);
+}
+
+/* Split a comma separated list in place. Returns the number of items. */
+static int parseList(char *list, char **items) {
+    char *item;
+    int n = 0;
+
+    for (item = strtok(list, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (n == MAX_LIST)
+            die(list, "Too many values");
+        items[n++] = item;
+    }
+    return n;
+}
+
+static int parseInts(const char *prog, char *list, int *values, int min) {
+    char *items[MAX_LIST];
+    int i, n = parseList(list, items);
+
+    for (i = 0; i < n; i++) {
+        values[i] = atoi(items[i]);
+        if (values[i] < min)
+            usage(prog);
+    }
+    return n;
+}
+
+/* Map a list of names to their index in names. */
+static int parseNames(const char *prog, char *list, int *values, const char **names) {
+    char *items[MAX_LIST];
+    int i, j, n = parseList(list, items);
+
+    for (i = 0; i < n; i++) {
+        for (j = 0; names[j] && strcmp(items[i], names[j]); j++)
+            ;
+        if (names[j] == NULL)
+            usage(prog);
+        values[i] = j;
+    }
+    return n;
+}
+
+int main(int argc, char **argv) {
+    static const char *mode_names[] = {"sync", "async", NULL};
+    static const char *tls_names[] = {"off", "on", NULL};
+    static const char *transport_names[] = {"tcp", "ring", NULL};
+    static const char *command_names[] = {"ping", "set", "get", NULL};
+    static const char *commands[] = {"PING", "SET", "GET"};
+    int modes[MAX_LIST] = {0}, conns[MAX_LIST] = {1}, pipelines[MAX_LIST] = {1};
+    int sizes[MAX_LIST] = {3}, cmds[MAX_LIST] = {0, 1, 2}, tls[MAX_LIST] = {0};
+    int transports[MAX_LIST] = {0};
+    int nmodes = 1, nconns = 1, npipelines = 1, nsizes = 1, ncmds = 3, ntls = 1, ntransports = 1;
+    int m, t, r, c, p, d, k, i;
+    long requests = 100000;
+#ifdef HIREDIS_BENCH_SSL
+    redisSSLOptions ssl_options = {0};
+    redisSSLContextError ssl_error = REDIS_SSL_CTX_NONE;
+
+    ssl_options.verify_mode = REDIS_SSL_VERIFY_PEER;
+#endif
+    hiredisAllocFuncs ha = {
+        .mallocFn = countMalloc,
+        .callocFn = countCalloc,
+        .reallocFn = countRealloc,
+        .strdupFn = countStrdup,
+        .freeFn = free,
+    };
+
+    for (i = 1; i < argc; i++) {
+        int lastarg = i == argc - 1;
+
+        if (!strcmp(argv[i], "-h") && !lastarg) {
+            host = argv[++i];
+        } else if (!strcmp(argv[i], "-p") && !lastarg) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && !lastarg) {
+            requests = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-m") && !lastarg) {
+            nmodes = parseNames(argv[0], argv[++i], modes, mode_names);
+        } else if (!strcmp(argv[i], "-c") && !lastarg) {
+            nconns = parseInts(argv[0], argv[++i], conns, 1);
+        } else if (!strcmp(argv[i], "-P") && !lastarg) {
+            npipelines = parseInts(argv[0], argv[++i], pipelines, 1);
+        } else if (!strcmp(argv[i], "-d") && !lastarg) {
+            nsizes = parseInts(argv[0], argv[++i], sizes, 0);
+        } else if (!strcmp(argv[i], "-t") && !lastarg) {
+            ncmds = parseNames(argv[0], argv[++i], cmds, command_names);
+        } else if (!strcmp(argv[i], "--object-cache") && !lastarg) {
+            hiredisSetObjectCacheLimit(strtoul(argv[++i], NULL, 10));
+        } else if (!strcmp(argv[i], "--transport") && !lastarg) {
+            ntransports = parseNames(argv[0], argv[++i], transports, transport_names);
+#ifdef HIREDIS_BENCH_SSL
+        } else if (!strcmp(argv[i], "--tls") && !lastarg) {
+            ntls = parseNames(argv[0], argv[++i], tls, tls_names);
+        } else if (!strcmp(argv[i], "--cacert") && !lastarg) {
+            ssl_options.cacert_filename = argv[++i];
+        } else if (!strcmp(argv[i], "--cert") && !lastarg) {
+            ssl_options.cert_filename = argv[++i];
+        } else if (!strcmp(argv[i], "--key") && !lastarg) {
+            ssl_options.private_key_filename = argv[++i];
+        } else if (!strcmp(argv[i], "--sni") && !lastarg) {
+            ssl_options.server_name = argv[++i];
+        } else if (!strcmp(argv[i], "--insecure")) {
+            ssl_options.verify_mode = REDIS_SSL_VERIFY_NONE;
+#endif
+        } else {
+            usage(argv[0]);
+        }
+    }
+    (void)tls_names;
+
+    if (requests <= 0)
+        usage(argv[0]);
+    for (i = 0; i < ntransports; i++) {
+        if (transports[i] && host)
+            die("ring", "Only reaches the embedded mock server");
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    hiredisSetAllocators(&ha);
+
+    for (i = 0; i < ntls && !tls[i]; i++)
+        ;
+#ifdef HIREDIS_BENCH_SSL
+    if (i < ntls) {
+        redisInitOpenSSL();
+        if (host == NULL) {
+            mock_ssl = mockSSLContext();
+            ssl_options.verify_mode = REDIS_SSL_VERIFY_NONE;
+        }
+        ssl = redisCreateSSLContextWithOptions(&ssl_options, &ssl_error);
+        if (ssl == NULL)
+            die("TLS error", redisSSLContextGetError(ssl_error));
+    }
+#endif
+    if (host == NULL) {
+        mock_port = mockListen(0);
+#ifdef HIREDIS_BENCH_SSL
+        if (mock_ssl)
+            mock_tls_port = mockListen(1);
+#endif
+        printf("server: embedded mock\n");
+    } else {
+        printf("server: %s:%d\n", host, port);
+    }
+
+    printf("%-5s  %-3s  %-9s  %5s  %5s  %6s  %-4s  %10s  %8s  %8s  %8s  %8s  %9s  %9s\n",
+           "mode", "tls", "transport", "conns", "pipe", "size", "cmd", "ops/s", "p50 us", "p99 us",
+           "p99.9 us", "max us", "cpu us/op", "allocs/op");
+
+    for (m = 0; m < nmodes; m++) {
+        for (t = 0; t < ntls; t++) {
+            for (r = 0; r < ntransports; r++) {
+                /* The ring carries no TLS. */
+                if (tls[t] && transports[r])
+                    continue;
+                for (c = 0; c < nconns; c++) {
+                    for (p = 0; p < npipelines; p++) {
+                        for (d = 0; d < nsizes; d++) {
+                            for (k = 0; k < ncmds; k++) {
+                                benchConfig cfg;
+
+                                /* The value size makes no difference to PING. */
+                                if (cmds[k] == 0 && d > 0)
+                                    continue;
+                                cfg.async = modes[m];
+                                cfg.tls = tls[t];
+                                cfg.ring = transports[r];
+                                cfg.conns = conns[c];
+                                cfg.pipeline = pipelines[p];
+                                cfg.size = sizes[d];
+                                cfg.command = commands[cmds[k]];
+                                run(&cfg, requests);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+#ifdef HIREDIS_BENCH_SSL
+    if (ssl)
+        redisFreeSSLContext(ssl);
+#endif
+    return 0;
+}
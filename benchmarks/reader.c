@@ -0,0 +1,387 @@
+/*
+ * Measure the reply parser in isolation from the network.
+ *
+ * Byte streams of RESP2 and RESP3 replies are fed through redisReaderFeed()
+ * and redisReaderGetReply(), in chunks of various sizes to mimic the reads of
+ * a real connection. The built-in corpora each stress one shape of reply:
+ *
+ *   status   many tiny status replies (+OK)
+ *   array    arrays of 1000 bulk strings and integers
+ *   map      RESP3 maps nested three deep, with sets and booleans
+ *   bulk     1 MiB bulk strings
+ *   double   RESP3 doubles
+ *   push     RESP3 pub/sub message pushes
+ *
+ * Streams captured from a real connection can be run with -f; they must only
+ * hold complete replies.
+ *
+ * Every corpus is run with the default reply object functions, which build a
+ * redisReply tree, and with a reader without functions, which only parses.
+ * For each run the time per byte and per reply is reported, along with the
+ * allocations per reply made through the hiredis allocators. With
+ * --object-cache, reply objects are reused from the per thread object cache,
+ * see hiredisSetObjectCacheLimit().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <hiredis.h>
+
+#define MAX_LIST 32
+
+typedef struct corpus {
+    const char *name;
+    char *buf;
+    size_t len;
+    size_t cap;
+    long replies;
+} corpus;
+
+static unsigned long long allocs;
+
+static void *countMalloc(size_t size) {
+    allocs++;
+    return malloc(size);
+}
+
+static void *countCalloc(size_t nmemb, size_t size) {
+    allocs++;
+    return calloc(nmemb, size);
+}
+
+static void *countRealloc(void *ptr, size_t size) {
+    allocs++;
+    return realloc(ptr, size);
+}
+
+static char *countStrdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = countMalloc(len);
+
+    if (copy)
+        memcpy(copy, str, len);
+    return copy;
+}
+
+static long long nowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void outOfMemory(void) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+}
+
+static void append(corpus *c, const char *buf, size_t len) {
+    if (c->len + len > c->cap) {
+        c->cap = (c->len + len) * 2;
+        if ((c->buf = realloc(c->buf, c->cap)) == NULL)
+            outOfMemory();
+    }
+    memcpy(c->buf + c->len, buf, len);
+    c->len += len;
+}
+
+static void appendf(corpus *c, const char *fmt, long value) {
+    char buf[64];
+
+    append(c, buf, snprintf(buf, sizeof(buf), fmt, value));
+}
+
+static void appendBulk(corpus *c, long len) {
+    appendf(c, "$%ld\r\n", len);
+    while (len > 0) {
+        static const char data[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+        long n = len < (long)sizeof(data) - 1 ? len : (long)sizeof(data) - 1;
+
+        append(c, data, n);
+        len -= n;
+    }
+    append(c, "\r\n", 2);
+}
+
+static void buildStatus(corpus *c) {
+    long i;
+
+    for (i = 0; i < 10000; i++)
+        append(c, "+OK\r\n", 5);
+    c->replies = 10000;
+}
+
+static void buildArray(corpus *c) {
+    long i, j;
+
+    for (i = 0; i < 50; i++) {
+        append(c, "*1000\r\n", 7);
+        for (j = 0; j < 1000; j++) {
+            if (j % 4 == 3)
+                appendf(c, ":%ld\r\n", i * 1000 + j);
+            else
+                appendBulk(c, 8 + j % 32);
+        }
+    }
+    c->replies = 50;
+}
+
+static void buildMap(corpus *c) {
+    long i, j, k;
+
+    for (i = 0; i < 50; i++) {
+        append(c, "%20\r\n", 5);
+        for (j = 0; j < 20; j++) {
+            appendf(c, "+field:%ld\r\n", j);
+            append(c, "%4\r\n", 4);
+            for (k = 0; k < 4; k++) {
+                appendf(c, "+key:%ld\r\n", k);
+                if (k == 0) {
+                    append(c, "~3\r\n:1\r\n:2\r\n:3\r\n", 16);
+                } else if (k == 1) {
+                    append(c, j % 2 ? "#t\r\n" : "#f\r\n", 4);
+                } else {
+                    appendBulk(c, 16);
+                }
+            }
+        }
+    }
+    c->replies = 50;
+}
+
+static void buildBulk(corpus *c) {
+    long i;
+
+    for (i = 0; i < 8; i++)
+        appendBulk(c, 1024 * 1024);
+    c->replies = 8;
+}
+
+static void buildDouble(corpus *c) {
+    static const char *doubles[] = {
+        ",3.14159265358979\r\n", ",-0.5\r\n", ",1e+300\r\n", ",42\r\n", ",inf\r\n",
+        ",-1.7976931348623157e308\r\n", ",0.1\r\n", ",-inf\r\n",
+    };
+    long i;
+
+    for (i = 0; i < 10000; i++)
+        append(c, doubles[i % 8], strlen(doubles[i % 8]));
+    c->replies = 10000;
+}
+
+static void buildPush(corpus *c) {
+    long i;
+
+    for (i = 0; i < 10000; i++) {
+        append(c, ">3\r\n$7\r\nmessage\r\n", 17);
+        appendf(c, "$13\r\nchannel:%05ld\r\n", i);
+        appendBulk(c, 32);
+    }
+    c->replies = 10000;
+}
+
+/* Count the replies of a captured stream, and check it parses. */
+static void loadFile(corpus *c, const char *path) {
+    redisReader *r = redisReaderCreateWithFunctions(NULL);
+    char buf[65536];
+    void *reply;
+    FILE *fp;
+    size_t n;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        append(c, buf, n);
+    fclose(fp);
+
+    if (r == NULL)
+        outOfMemory();
+    if (redisReaderFeed(r, c->buf, c->len) != REDIS_OK)
+        outOfMemory();
+    for (;;) {
+        if (redisReaderGetReply(r, &reply) != REDIS_OK) {
+            fprintf(stderr, "%s: %s\n", path, r->errstr);
+            exit(1);
+        }
+        if (reply == NULL)
+            break;
+        c->replies++;
+    }
+    if (c->replies == 0 || r->pos != r->len) {
+        fprintf(stderr, "%s: Not a stream of complete replies\n", path);
+        exit(1);
+    }
+    redisReaderFree(r);
+}
+
+/* Feed the corpus until at least target bytes have been parsed. */
+static void run(const corpus *c, int objects, size_t chunk, size_t target) {
+    redisReader *r = objects ? redisReaderCreate() : redisReaderCreateWithFunctions(NULL);
+    unsigned long long allocs_start;
+    size_t bytes = 0, pos, n;
+    long long start, elapsed;
+    long replies = 0, got;
+    void *reply;
+
+    if (r == NULL)
+        outOfMemory();
+    if (chunk == 0 || chunk > c->len)
+        chunk = c->len;
+
+    allocs_start = allocs;
+    start = nowNs();
+    while (bytes < target) {
+        for (pos = 0, got = 0; pos < c->len; pos += n) {
+            n = c->len - pos < chunk ? c->len - pos : chunk;
+            if (redisReaderFeed(r, c->buf + pos, n) != REDIS_OK)
+                outOfMemory();
+            for (;;) {
+                if (redisReaderGetReply(r, &reply) != REDIS_OK) {
+                    fprintf(stderr, "%s: %s\n", c->name, r->errstr);
+                    exit(1);
+                }
+                if (reply == NULL)
+                    break;
+                if (objects)
+                    freeReplyObject(reply);
+                got++;
+            }
+        }
+        if (got != c->replies) {
+            fprintf(stderr, "%s: Parsed %ld replies instead of %ld\n", c->name, got,
+                    c->replies);
+            exit(1);
+        }
+        bytes += c->len;
+        replies += got;
+    }
+    elapsed = nowNs() - start;
+
+    printf("%-16s  %-7s  %7zu  %9.1f  %8.3f  %10.1f  %12.3f\n", c->name,
+           objects ? "default" : "null", chunk, bytes / (elapsed / 1e9) / (1024 * 1024),
+           (double)elapsed / bytes, (double)elapsed / replies,
+           (double)(allocs - allocs_start) / replies);
+    fflush(stdout);
+    redisReaderFree(r);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -t <corpora>            Built-in corpora to run, any of status, array, map,\n"
+        "                          bulk, double and push (default: all)\n"
+        "  -f <file>               Run a captured stream of replies (repeatable), in\n"
+        "                          place of the built-in corpora unless -t is given\n"
+        "  -c <chunks>             Feed sizes in bytes, 0 for the whole corpus at once\n"
+        "                          (default 16,512,16384,0)\n"
+        "  -r <functions>          default and/or null reply functions (default both)\n"
+        "  -n <MiB>                Bytes parsed per run (default 64)\n"
+        "  --object-cache <limit>  Cache up to limit freed reply objects (default 0)\n"
+        "Lists are comma separated.\n",
+        prog);
+    exit(1);
+}
+
+/* Whether name is in the comma separated list. */
+static int inList(const char *list, const char *name) {
+    size_t len = strlen(name);
+
+    while (list) {
+        if (!strncmp(list, name, len) && (list[len] == ',' || list[len] == '\0'))
+            return 1;
+        if ((list = strchr(list, ',')) != NULL)
+            list++;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static const struct {
+        const char *name;
+        void (*build)(corpus *c);
+    } builtins[] = {
+        {"status", buildStatus}, {"array", buildArray}, {"map", buildMap},
+        {"bulk", buildBulk}, {"double", buildDouble}, {"push", buildPush},
+    };
+    const int nbuiltins = sizeof(builtins) / sizeof(builtins[0]);
+    corpus corpora[MAX_LIST];
+    const char *files[MAX_LIST], *selected = NULL;
+    size_t chunks[MAX_LIST] = {16, 512, 16384, 0}, target = 64;
+    int ncorpora = 0, nfiles = 0, nchunks = 4, functions[2] = {1, 0}, nfunctions = 2;
+    char *item;
+    int i, j, k;
+    hiredisAllocFuncs ha = {
+        .mallocFn = countMalloc,
+        .callocFn = countCalloc,
+        .reallocFn = countRealloc,
+        .strdupFn = countStrdup,
+        .freeFn = free,
+    };
+
+    for (i = 1; i < argc; i++) {
+        int lastarg = i == argc - 1;
+
+        if (!strcmp(argv[i], "-t") && !lastarg) {
+            selected = argv[++i];
+        } else if (!strcmp(argv[i], "-f") && !lastarg) {
+            if (nfiles == MAX_LIST - nbuiltins)
+                usage(argv[0]);
+            files[nfiles++] = argv[++i];
+        } else if (!strcmp(argv[i], "-c") && !lastarg) {
+            for (nchunks = 0, item = strtok(argv[++i], ","); item; item = strtok(NULL, ",")) {
+                if (nchunks == MAX_LIST || atol(item) < 0)
+                    usage(argv[0]);
+                chunks[nchunks++] = atol(item);
+            }
+        } else if (!strcmp(argv[i], "-r") && !lastarg) {
+            for (nfunctions = 0, item = strtok(argv[++i], ","); item; item = strtok(NULL, ",")) {
+                if (nfunctions == 2 || (strcmp(item, "default") && strcmp(item, "null")))
+                    usage(argv[0]);
+                functions[nfunctions++] = !strcmp(item, "default");
+            }
+        } else if (!strcmp(argv[i], "-n") && !lastarg) {
+            target = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--object-cache") && !lastarg) {
+            hiredisSetObjectCacheLimit(strtoul(argv[++i], NULL, 10));
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (target == 0 || nchunks == 0 || nfunctions == 0)
+        usage(argv[0]);
+    target *= 1024 * 1024;
+
+    /* All built-in corpora run by default, but only the selected ones with -t,
+     * and none when only captured streams are given. */
+    memset(corpora, 0, sizeof(corpora));
+    for (j = 0; j < nbuiltins; j++) {
+        if (selected ? inList(selected, builtins[j].name) : nfiles == 0) {
+            corpora[ncorpora].name = builtins[j].name;
+            builtins[j].build(&corpora[ncorpora++]);
+        }
+    }
+    if (selected && ncorpora == 0)
+        usage(argv[0]);
+    for (j = 0; j < nfiles; j++) {
+        corpora[ncorpora].name = files[j];
+        loadFile(&corpora[ncorpora++], files[j]);
+    }
+
+    hiredisSetAllocators(&ha);
+
+    printf("%-16s  %-7s  %7s  %9s  %8s  %10s  %12s\n", "corpus", "funcs", "chunk", "MiB/s",
+           "ns/byte", "ns/reply", "allocs/reply");
+    for (i = 0; i < ncorpora; i++) {
+        for (j = 0; j < nfunctions; j++) {
+            for (k = 0; k < nchunks; k++)
+                run(&corpora[i], functions[j], chunks[k], target);
+        }
+        free(corpora[i].buf);
+    }
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Replay a capture made with redisCaptureStart() through a context, as fast
+ * as possible.
+ *
+ * The context is wired to a fake transport: writes accept exactly the bytes
+ * that were written when capturing, and reads return the captured reads one
+ * by one, so the replay reproduces the fragmentation and pipelining of the
+ * original traffic without a server. Captured writes are appended to the
+ * output buffer and flushed; after every captured read, all the replies it
+ * completed are parsed and freed.
+ *
+ * The capture is loaded in memory first, so only the replay is timed, and
+ * can be replayed several times with -n.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <hiredis.h>
+#include <capture.h>
+
+typedef struct record {
+    int type;
+    char *buf;
+    size_t len;
+} record;
+
+/* The read a context is being fed. */
+typedef struct replayState {
+    const char *buf;
+    size_t len;
+} replayState;
+
+static long long nowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static ssize_t replayRead(redisContext *c, char *buf, size_t size) {
+    replayState *state = c->privdata;
+    size_t len = state->len < size ? state->len : size;
+
+    memcpy(buf, state->buf, len);
+    state->buf += len;
+    state->len -= len;
+    return (ssize_t)len;
+}
+
+static ssize_t replayWrite(redisContext *c) {
+    return (ssize_t)sdslen(c->obuf);
+}
+
+static void replayClose(redisContext *c) {
+    (void)c;
+}
+
+static redisContextFuncs replayFuncs = {
+    .close = replayClose,
+    .read = replayRead,
+    .write = replayWrite,
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options] <capture>\n"
+        "  -n <count>              Number of times to replay the capture (default 1)\n",
+        prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    redisOptions options = {0};
+    redisCaptureRecord rec;
+    redisCaptureFile *f;
+    redisContext *c;
+    replayState state;
+    record *records = NULL;
+    size_t nrecords = 0, cap = 0, i, bytes_read = 0, bytes_written = 0;
+    unsigned long long span = 0;
+    long long start_time, start, elapsed;
+    long loops = 1, loop, replies = 0, reads = 0, writes = 0;
+    int ret, done;
+
+    for (i = 1; i < (size_t)argc; i++) {
+        int lastarg = i == (size_t)argc - 1;
+
+        if (!strcmp(argv[i], "-n") && !lastarg) {
+            loops = atol(argv[++i]);
+        } else if (argv[i][0] != '-' && path == NULL) {
+            path = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (path == NULL || loops <= 0)
+        usage(argv[0]);
+
+    if ((f = redisCaptureOpen(path, &start_time)) == NULL) {
+        fprintf(stderr, "%s: Cannot open capture\n", path);
+        return 1;
+    }
+    while ((ret = redisCaptureNext(f, &rec)) == 1) {
+        if (nrecords == cap) {
+            cap = cap ? cap * 2 : 1024;
+            if ((records = realloc(records, cap * sizeof(*records))) == NULL)
+                goto oom;
+        }
+        records[nrecords].type = rec.type;
+        records[nrecords].len = rec.len;
+        if ((records[nrecords].buf = malloc(rec.len ? rec.len : 1)) == NULL)
+            goto oom;
+        memcpy(records[nrecords].buf, rec.buf, rec.len);
+        if (rec.type == REDIS_CAPTURE_READ) {
+            reads++;
+            bytes_read += rec.len;
+        } else {
+            writes++;
+            bytes_written += rec.len;
+        }
+        span = rec.time_us;
+        nrecords++;
+    }
+    redisCaptureClose(f);
+    if (ret < 0)
+        fprintf(stderr, "%s: Truncated capture, replaying the first %zu records\n", path,
+                nrecords);
+
+    /* A context without a connection, reading and writing to the capture. */
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = REDIS_INVALID_FD;
+    c = redisConnectWithOptions(&options);
+    if (c == NULL || c->err) {
+        fprintf(stderr, "Context error: %s\n", c ? c->errstr : "out of memory");
+        return 1;
+    }
+    c->funcs = &replayFuncs;
+    c->privdata = &state;
+
+    start = nowNs();
+    for (loop = 0; loop < loops; loop++) {
+        for (i = 0; i < nrecords; i++) {
+            record *r = &records[i];
+            void *reply;
+
+            if (r->type == REDIS_CAPTURE_WRITE) {
+                if (redisAppendFormattedCommand(c, r->buf, r->len) != REDIS_OK ||
+                    redisBufferWrite(c, &done) != REDIS_OK)
+                    goto error;
+                continue;
+            }
+
+            state.buf = r->buf;
+            state.len = r->len;
+            while (state.len > 0) {
+                if (redisBufferRead(c) != REDIS_OK)
+                    goto error;
+            }
+            for (;;) {
+                if (redisGetReplyFromReader(c, &reply) != REDIS_OK)
+                    goto error;
+                if (reply == NULL)
+                    break;
+                freeReplyObject(reply);
+                replies++;
+            }
+        }
+    }
+    elapsed = nowNs() - start;
+
+    printf("capture:     %s, started %lld\n", path, start_time);
+    printf("records:     %zu (%ld reads, %ld writes)\n", nrecords, reads, writes);
+    printf("bytes:       %zu read, %zu written\n", bytes_read, bytes_written);
+    printf("replies:     %ld per replay\n", replies / loops);
+    printf("captured:    %.3f ms\n", span / 1e3);
+    printf("replayed:    %.3f ms per replay, %ld replays\n", elapsed / 1e6 / loops, loops);
+    if (replies > 0)
+        printf("             %.1f ns/reply, %.1f MiB/s read\n", (double)elapsed / replies,
+               bytes_read * (double)loops / (elapsed / 1e9) / (1024 * 1024));
+
+    redisFree(c);
+    for (i = 0; i < nrecords; i++)
+        free(records[i].buf);
+    free(records);
+    return 0;
+
+error:
+    fprintf(stderr, "Replay error: %s\n", c->errstr);
+    return 1;
+oom:
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+}
@@ -0,0 +1,177 @@
+/*
+ * Measure the memory used by a large number of idle TLS connections.
+ *
+ * Opens N connections to a TLS enabled Redis server, sends a PING on each so
+ * the handshake and any post-handshake messages are fully processed, then
+ * reports the growth of the resident set size. Run it with and without
+ * --release-buffers to compare the footprint of idle connections.
+ *
+ * The server must accept N clients (see maxclients) and the process must be
+ * allowed N file descriptors (see ulimit -n).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <hiredis.h>
+#include <hiredis_ssl.h>
+
+/* Resident set size of the process in bytes, or 0 if unknown. */
+static size_t getRSS(void) {
+#if defined(__linux__)
+    unsigned long size, resident;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    int ok;
+
+    if (fp == NULL)
+        return 0;
+    ok = fscanf(fp, "%lu %lu", &size, &resident) == 2;
+    fclose(fp);
+    return ok ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+    /* Peak rather than current RSS, good enough as we only grow. */
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return (size_t)ru.ru_maxrss;
+#else
+    return (size_t)ru.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -h <host>               Server host (default 127.0.0.1)\n"
+        "  -p <port>               Server port (default 6379)\n"
+        "  -n <count>              Number of connections (default 10000)\n"
+        "  --cacert <file>         CA certificate to verify the server with\n"
+        "  --cert <file>           Client certificate\n"
+        "  --key <file>            Client private key\n"
+        "  --sni <name>            Server name indication\n"
+        "  --insecure              Do not verify the server certificate\n"
+        "  --release-buffers       Set REDIS_SSL_OPT_RELEASE_BUFFERS\n"
+        "  --max-send-fragment <n> Set max_send_fragment\n"
+        "  --read-ahead <n>        Set read_ahead_len\n",
+        prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    int port = 6379;
+    long count = 10000;
+    redisSSLOptions options = {0};
+    redisSSLContextError ssl_error = REDIS_SSL_CTX_NONE;
+    redisSSLContext *ssl;
+    redisContext **contexts;
+    struct rlimit rl;
+    size_t rss_before, rss_after;
+    long i;
+
+    options.verify_mode = REDIS_SSL_VERIFY_PEER;
+
+    for (i = 1; i < argc; i++) {
+        int lastarg = i == argc - 1;
+
+        if (!strcmp(argv[i], "-h") && !lastarg) {
+            host = argv[++i];
+        } else if (!strcmp(argv[i], "-p") && !lastarg) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && !lastarg) {
+            count = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--cacert") && !lastarg) {
+            options.cacert_filename = argv[++i];
+        } else if (!strcmp(argv[i], "--cert") && !lastarg) {
+            options.cert_filename = argv[++i];
+        } else if (!strcmp(argv[i], "--key") && !lastarg) {
+            options.private_key_filename = argv[++i];
+        } else if (!strcmp(argv[i], "--sni") && !lastarg) {
+            options.server_name = argv[++i];
+        } else if (!strcmp(argv[i], "--insecure")) {
+            options.verify_mode = REDIS_SSL_VERIFY_NONE;
+        } else if (!strcmp(argv[i], "--release-buffers")) {
+            options.options |= REDIS_SSL_OPT_RELEASE_BUFFERS;
+        } else if (!strcmp(argv[i], "--max-send-fragment") && !lastarg) {
+            options.max_send_fragment = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--read-ahead") && !lastarg) {
+            options.read_ahead_len = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (count <= 0)
+        usage(argv[0]);
+
+    /* One descriptor per connection, plus some slack. */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)count + 32) {
+        rl.rlim_cur = (rlim_t)count + 32;
+        if (rl.rlim_max != RLIM_INFINITY && rl.rlim_cur > rl.rlim_max)
+            rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    redisInitOpenSSL();
+    ssl = redisCreateSSLContextWithOptions(&options, &ssl_error);
+    if (ssl == NULL) {
+        fprintf(stderr, "SSL context error: %s\n", redisSSLContextGetError(ssl_error));
+        return 1;
+    }
+
+    contexts = calloc(count, sizeof(*contexts));
+    if (contexts == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    rss_before = getRSS();
+
+    for (i = 0; i < count; i++) {
+        redisContext *c = redisConnect(host, port);
+        redisReply *reply;
+
+        if (c == NULL || c->err) {
+            fprintf(stderr, "Connection %ld error: %s\n", i, c ? c->errstr : "out of memory");
+            redisFree(c);
+            break;
+        }
+
+        if (redisInitiateSSLWithContext(c, ssl) != REDIS_OK) {
+            fprintf(stderr, "Connection %ld SSL error: %s\n", i, c->errstr);
+            redisFree(c);
+            break;
+        }
+
+        reply = redisCommand(c, "PING");
+        if (reply == NULL) {
+            fprintf(stderr, "Connection %ld PING error: %s\n", i, c->errstr);
+            redisFree(c);
+            break;
+        }
+        freeReplyObject(reply);
+
+        contexts[i] = c;
+    }
+
+    rss_after = getRSS();
+
+    printf("connections:     %ld\n", i);
+    printf("release buffers: %s\n", (options.options & REDIS_SSL_OPT_RELEASE_BUFFERS) ? "yes" : "no");
+    printf("rss before:      %zu KB\n", rss_before / 1024);
+    printf("rss after:       %zu KB\n", rss_after / 1024);
+    if (i > 0 && rss_after >= rss_before)
+        printf("per connection:  %zu bytes\n", (rss_after - rss_before) / (size_t)i);
+
+    while (i-- > 0)
+        redisFree(contexts[i]);
+    free(contexts);
+    redisFreeSSLContext(ssl);
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Measure the cost of subscribing to, and unsubscribing from, a large number
+ * of channels on a single asynchronous connection.
+ *
+ * No server is needed: the context talks to one end of a socket pair, and the
+ * benchmark plays the server on the other end, discarding the commands and
+ * sending back the replies Redis would. Three phases are timed:
+ *
+ *   subscribe    SUBSCRIBE every channel, and read the confirmations
+ *   messages     deliver one message per channel to the message callback
+ *   unsubscribe  UNSUBSCRIBE every channel, and read the confirmations
+ *
+ * Messages are delivered in the order the channels were subscribed to, or
+ * with -r in a random order, as traffic from many publishers would be.
+ *
+ * Besides the average cost per channel, the slowest single SUBSCRIBE and
+ * UNSUBSCRIBE call is reported, which is where a table resize shows up.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <hiredis.h>
+#include <async.h>
+
+/* Channels per batch of commands and replies, small enough for the replies
+ * to fit in the socket buffer. */
+#define BATCH 500
+
+static long long nowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -n <count>              Number of channels (default 100000)\n"
+        "  -r                      Deliver messages in a random channel order\n",
+        prog);
+    exit(1);
+}
+
+static void onMessage(redisAsyncContext *ac, const redisPubSubMessage *msg, void *privdata) {
+    long *messages = ac->data;
+    (void)msg;
+    (void)privdata;
+    (*messages)++;
+}
+
+/* Discard what the context wrote, as the server would read it. */
+static void drainCommands(redisAsyncContext *ac, int fd) {
+    char buf[65536];
+
+    while (ac->c.obuf[0] != '\0') {
+        redisAsyncHandleWrite(ac);
+        while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+            ;
+    }
+}
+
+/* Send replies to the context, and have it process them. */
+static void sendReplies(redisAsyncContext *ac, int fd, const char *buf, size_t len) {
+    char c;
+
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len > 16384 ? 16384 : len);
+
+        if (n <= 0) {
+            perror("write");
+            exit(1);
+        }
+        buf += n;
+        len -= n;
+
+        /* Let the context read everything written so far. */
+        while (recv(ac->c.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0)
+            redisAsyncHandleRead(ac);
+    }
+}
+
+/* Run one phase: call the command for every channel, then feed the replies
+ * built with the reply format, for the channels in the given order (or in
+ * order when NULL). Returns the elapsed time in nanoseconds and the slowest
+ * command call in *slowest. */
+static long long runPhase(redisAsyncContext *ac, int fd, long count, const long *order,
+                          const char *command, const char *reply, int remaining,
+                          long long *slowest)
+{
+    char *buf = malloc(BATCH * 128);
+    long long start = nowNs(), t;
+    long i, j;
+    size_t len;
+
+    if (buf == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    *slowest = 0;
+
+    for (i = 0; i < count; i += BATCH) {
+        for (j = i; j < count && j < i + BATCH; j++) {
+            if (command) {
+                t = nowNs();
+                if (redisAsyncCommand(ac, NULL, NULL, command, j) != REDIS_OK) {
+                    fprintf(stderr, "Command error: %s\n", ac->errstr);
+                    exit(1);
+                }
+                t = nowNs() - t;
+                if (t > *slowest)
+                    *slowest = t;
+            }
+        }
+        drainCommands(ac, fd);
+
+        for (len = 0, j = i; j < count && j < i + BATCH; j++) {
+            char name[32];
+            int n = snprintf(name, sizeof(name), "channel:%ld", order ? order[j] : j);
+
+            if (remaining)
+                len += sprintf(buf + len, reply, n, name,
+                               remaining > 0 ? j + 1 : count - j - 1);
+            else
+                len += sprintf(buf + len, reply, n, name);
+        }
+        sendReplies(ac, fd, buf, len);
+    }
+
+    free(buf);
+    return nowNs() - start;
+}
+
+static void report(const char *phase, long count, long long ns, long long slowest) {
+    printf("%-12s %8.1f ms %8.1f ns/channel", phase, ns / 1e6, (double)ns / count);
+    if (slowest)
+        printf("   slowest call %8.1f us", slowest / 1e3);
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    long count = 100000, messages = 0, *order = NULL;
+    redisOptions options = {0};
+    int shuffle = 0;
+    redisAsyncContext *ac;
+    long long ns, slowest;
+    int fds[2];
+    long i;
+
+    for (i = 1; i < argc; i++) {
+        int lastarg = i == argc - 1;
+
+        if (!strcmp(argv[i], "-n") && !lastarg) {
+            count = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "-r")) {
+            shuffle = 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (count <= 0)
+        usage(argv[0]);
+
+    if (shuffle) {
+        if ((order = malloc(count * sizeof(*order))) == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        for (i = 0; i < count; i++)
+            order[i] = i;
+        srand(1);
+        for (i = count - 1; i > 0; i--) {
+            long j = (long)(((unsigned long long)rand() * RAND_MAX + rand()) % (i + 1));
+            long t = order[i];
+
+            order[i] = order[j];
+            order[j] = t;
+        }
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = fds[0];
+    ac = redisAsyncConnectWithOptions(&options);
+    if (ac == NULL || ac->err) {
+        fprintf(stderr, "Context error: %s\n", ac ? ac->errstr : "out of memory");
+        return 1;
+    }
+    /* The socket pair is connected already: skip the connection check of
+     * the first read event. */
+    ac->c.flags |= REDIS_CONNECTED;
+    ac->data = &messages;
+    redisAsyncSetMessageCallback(ac, onMessage);
+
+    printf("channels:    %ld%s\n", count, shuffle ? " (messages in random order)" : "");
+
+    ns = runPhase(ac, fds[1], count, NULL, "SUBSCRIBE channel:%ld",
+                  "*3\r\n$9\r\nsubscribe\r\n$%d\r\n%s\r\n:%ld\r\n", 1, &slowest);
+    report("subscribe", count, ns, slowest);
+
+    ns = runPhase(ac, fds[1], count, order, NULL,
+                  "*3\r\n$7\r\nmessage\r\n$%d\r\n%s\r\n$5\r\nhello\r\n", 0, &slowest);
+    report("messages", count, ns, 0);
+    if (messages != count) {
+        fprintf(stderr, "Delivered %ld messages out of %ld\n", messages, count);
+        return 1;
+    }
+
+    ns = runPhase(ac, fds[1], count, NULL, "UNSUBSCRIBE channel:%ld",
+                  "*3\r\n$11\r\nunsubscribe\r\n$%d\r\n%s\r\n:%ld\r\n", -1, &slowest);
+    report("unsubscribe", count, ns, slowest);
+
+    redisAsyncFree(ac);
+    close(fds[1]);
+    free(order);
+    return 0;
+}
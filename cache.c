@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fmacros.h"
+#include "alloc.h"
+#include <stdlib.h>
+#include <string.h>
+#ifndef _MSC_VER
+#include <strings.h>
+#endif
+#include "cache.h"
+#include "dict.c"
+#include "sds.h"
+#include "win32.h"
+
+/* A cached reply. Entries for the same key are chained together so they can
+ * be invalidated at once, and every entry is in the list of its frequency
+ * bucket, most recently used first. */
+typedef struct redisCacheEntry {
+    struct redisCacheKey *key;
+    sds cmd;
+    redisReply *reply;
+    size_t size;
+    struct redisCacheEntry *knext;
+    struct redisCacheBucket *bucket;
+    struct redisCacheEntry *prev, *next;
+} redisCacheEntry;
+
+typedef struct redisCacheKey {
+    sds name;
+    redisCacheEntry *entries;
+} redisCacheKey;
+
+/* Entries used the same number of times. With LRU eviction, there is only
+ * ever one bucket. */
+typedef struct redisCacheBucket {
+    unsigned long long freq;
+    redisCacheEntry *head, *tail;
+    struct redisCacheBucket *prev, *next;
+} redisCacheBucket;
+
+struct redisCache {
+    redisCacheOptions options;
+    dict *keys;     /* Key name -> redisCacheKey */
+    dict *commands; /* Command -> redisCacheEntry */
+    redisCacheBucket *buckets; /* Least used first */
+    redisCacheStats stats;
+};
+
+static size_t cacheKeyLength(const void *key) {
+    return sdslen((const sds)key);
+}
+
+/* Both dictionaries point to strings owned by their values. */
+static dictType cacheDict = {
+    cacheKeyLength,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+/* What a cached command reads, which the reply must match. */
+#define CACHE_CMD_VALUE 1 /* GET and HGET: a string, or nil */
+#define CACHE_CMD_HASH 2  /* HGETALL: a map, or an array with RESP2 */
+
+/* Parse a formatted command, and return one of CACHE_CMD_xxx with its key if
+ * it is one that is cached, 0 otherwise. */
+static int cacheParseCommand(const char *cmd, size_t len, const char **key, size_t *keylen) {
+    const char *p = cmd, *end = cmd + len, *argv[3];
+    size_t argvlen[3];
+    long argc, i;
+    char *eptr;
+
+    if (len < 4 || *p != '*')
+        return 0;
+    argc = strtol(p + 1, &eptr, 10);
+    if (argc < 2 || argc > 3 || eptr + 2 > end || eptr[0] != '\r')
+        return 0;
+    p = eptr + 2;
+
+    for (i = 0; i < argc; i++) {
+        long l;
+
+        if (p >= end || *p != '$')
+            return 0;
+        l = strtol(p + 1, &eptr, 10);
+        if (l < 0 || eptr + 2 + l + 2 > end || eptr[0] != '\r')
+            return 0;
+        argv[i] = eptr + 2;
+        argvlen[i] = (size_t)l;
+        p = argv[i] + l + 2;
+    }
+
+    *key = argv[1];
+    *keylen = argvlen[1];
+    if ((argc == 2 && argvlen[0] == 3 && strncasecmp(argv[0],"get",3) == 0) ||
+        (argc == 3 && argvlen[0] == 4 && strncasecmp(argv[0],"hget",4) == 0))
+        return CACHE_CMD_VALUE;
+    if (argc == 2 && argvlen[0] == 7 && strncasecmp(argv[0],"hgetall",7) == 0)
+        return CACHE_CMD_HASH;
+    return 0;
+}
+
+/* Deep copy of a reply, adding up its size. */
+static redisReply *cacheReplyDup(const redisReply *reply, size_t *size) {
+    redisReply *r;
+    size_t i;
+
+    r = hi_calloc(1,sizeof(*r));
+    if (r == NULL)
+        return NULL;
+    *size += sizeof(*r);
+
+    r->type = reply->type;
+    r->integer = reply->integer;
+    r->dval = reply->dval;
+    r->len = reply->len;
+    memcpy(r->vtype,reply->vtype,sizeof(r->vtype));
+
+    if (reply->str) {
+        r->str = hi_malloc(reply->len + 1);
+        if (r->str == NULL)
+            goto oom;
+        memcpy(r->str,reply->str,reply->len);
+        r->str[reply->len] = '\0';
+        *size += reply->len + 1;
+    }
+
+    if (reply->element) {
+        r->element = hi_calloc(reply->elements,sizeof(*r->element));
+        if (r->element == NULL)
+            goto oom;
+        r->elements = reply->elements;
+        *size += reply->elements * sizeof(*r->element);
+        for (i = 0; i < reply->elements; i++) {
+            if (reply->element[i] == NULL)
+                continue;
+            r->element[i] = cacheReplyDup(reply->element[i],size);
+            if (r->element[i] == NULL)
+                goto oom;
+        }
+    }
+
+    return r;
+
+oom:
+    freeReplyObject(r);
+    return NULL;
+}
+
+static void cacheBucketUnlink(redisCache *cache, redisCacheBucket *b) {
+    if (b->prev) b->prev->next = b->next;
+    else cache->buckets = b->next;
+    if (b->next) b->next->prev = b->prev;
+    hi_free(b);
+}
+
+static void cacheListRemove(redisCacheBucket *b, redisCacheEntry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else b->head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else b->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void cacheListPush(redisCacheBucket *b, redisCacheEntry *e) {
+    e->bucket = b;
+    e->prev = NULL;
+    e->next = b->head;
+    if (b->head) b->head->prev = e;
+    else b->tail = e;
+    b->head = e;
+}
+
+/* Create the bucket for freq after prev, or first when prev is NULL. */
+static redisCacheBucket *cacheBucketCreate(redisCache *cache, redisCacheBucket *prev,
+                                           unsigned long long freq)
+{
+    redisCacheBucket *b = hi_calloc(1,sizeof(*b));
+
+    if (b == NULL)
+        return NULL;
+    b->freq = freq;
+    b->prev = prev;
+    b->next = prev ? prev->next : cache->buckets;
+    if (b->next) b->next->prev = b;
+    if (prev) prev->next = b;
+    else cache->buckets = b;
+    return b;
+}
+
+/* Remove an entry from its bucket, freeing the bucket once empty. */
+static void cacheEntryUnlink(redisCache *cache, redisCacheEntry *e) {
+    redisCacheBucket *b = e->bucket;
+
+    cacheListRemove(b,e);
+    e->bucket = NULL;
+    if (b->head == NULL)
+        cacheBucketUnlink(cache,b);
+}
+
+/* Record a use of an entry. */
+static void cacheEntryTouch(redisCache *cache, redisCacheEntry *e) {
+    redisCacheBucket *b = e->bucket, *next = b->next;
+
+    if (cache->options.policy == REDIS_CACHE_LRU) {
+        cacheListRemove(b,e);
+        cacheListPush(b,e);
+        return;
+    }
+
+    /* The entry stays where it is when out of memory. */
+    if (next == NULL || next->freq != b->freq + 1) {
+        next = cacheBucketCreate(cache,b,b->freq + 1);
+        if (next == NULL)
+            return;
+    }
+    cacheEntryUnlink(cache,e);
+    cacheListPush(next,e);
+}
+
+static void cacheEntryFree(redisCache *cache, redisCacheEntry *e) {
+    redisCacheKey *k = e->key;
+    redisCacheEntry **pe;
+
+    cacheEntryUnlink(cache,e);
+    dictDelete(cache->commands,e->cmd);
+
+    for (pe = &k->entries; *pe != e; pe = &(*pe)->knext);
+    *pe = e->knext;
+    if (k->entries == NULL) {
+        dictDelete(cache->keys,k->name);
+        sdsfree(k->name);
+        hi_free(k);
+    }
+
+    cache->stats.entries--;
+    cache->stats.memory -= e->size;
+    freeReplyObject(e->reply);
+    sdsfree(e->cmd);
+    hi_free(e);
+}
+
+/* Evict entries until there is room for a new one of the given size. The
+ * new entry is not a candidate, or with LFU it would always be the first
+ * one evicted. */
+static void cacheEvict(redisCache *cache, size_t size) {
+    while (cache->buckets &&
+           ((cache->options.max_entries && cache->stats.entries >= cache->options.max_entries) ||
+            (cache->options.max_memory && cache->stats.memory + size > cache->options.max_memory)))
+    {
+        cacheEntryFree(cache,cache->buckets->tail);
+        cache->stats.evictions++;
+    }
+}
+
+/* Find the entries of a key, creating an empty chain if there is none. */
+static redisCacheKey *cacheKeyGet(redisCache *cache, const char *key, size_t keylen) {
+    redisCacheKey *k;
+    dictEntry *de;
+    sds name;
+
+    de = dictFindBuf(cache->keys,key,keylen);
+    if (de != NULL)
+        return dictGetEntryVal(de);
+
+    name = sdsnewlen(key,keylen);
+    if (name == NULL)
+        return NULL;
+
+    k = hi_calloc(1,sizeof(*k));
+    if (k == NULL || dictReplace(cache->keys,name,k) == 0) {
+        hi_free(k);
+        sdsfree(name);
+        return NULL;
+    }
+    k->name = name;
+    return k;
+}
+
+redisCache *redisCacheCreate(const redisCacheOptions *options) {
+    redisCache *cache;
+    size_t i;
+
+    if (options == NULL ||
+        (options->policy != REDIS_CACHE_LRU && options->policy != REDIS_CACHE_LFU) ||
+        (options->nprefixes && (options->prefixes == NULL || !options->bcast)))
+        return NULL;
+
+    cache = hi_calloc(1,sizeof(*cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->options = *options;
+    cache->options.prefixes = NULL;
+    if (options->nprefixes) {
+        cache->options.prefixes = hi_calloc(options->nprefixes,sizeof(*cache->options.prefixes));
+        if (cache->options.prefixes == NULL)
+            goto oom;
+        for (i = 0; i < options->nprefixes; i++) {
+            cache->options.prefixes[i] = sdsnew(options->prefixes[i]);
+            if (cache->options.prefixes[i] == NULL)
+                goto oom;
+        }
+    }
+
+    cache->keys = dictCreate(&cacheDict,NULL);
+    cache->commands = dictCreate(&cacheDict,NULL);
+    if (cache->keys == NULL || cache->commands == NULL)
+        goto oom;
+
+    return cache;
+
+oom:
+    redisCacheFree(cache);
+    return NULL;
+}
+
+redisReply *redisCacheGet(redisCache *cache, const char *cmd, size_t len) {
+    redisCacheEntry *e;
+    dictEntry *de;
+    const char *key;
+    size_t keylen, size = 0;
+
+    if (!cacheParseCommand(cmd,len,&key,&keylen))
+        return NULL;
+
+    de = dictFindBuf(cache->commands,cmd,len);
+    if (de == NULL) {
+        cache->stats.misses++;
+        return NULL;
+    }
+
+    e = dictGetEntryVal(de);
+    cacheEntryTouch(cache,e);
+    cache->stats.hits++;
+    return cacheReplyDup(e->reply,&size);
+}
+
+int redisCacheSet(redisCache *cache, const char *cmd, size_t len, const redisReply *reply) {
+    redisCacheEntry *e;
+    redisCacheKey *k;
+    dictEntry *de;
+    const char *key;
+    size_t keylen;
+
+    switch (cacheParseCommand(cmd,len,&key,&keylen)) {
+    case CACHE_CMD_VALUE:
+        if (reply->type != REDIS_REPLY_STRING && reply->type != REDIS_REPLY_NIL)
+            return REDIS_ERR;
+        break;
+    case CACHE_CMD_HASH:
+        if (reply->type != REDIS_REPLY_MAP && reply->type != REDIS_REPLY_ARRAY)
+            return REDIS_ERR;
+        break;
+    default:
+        return REDIS_ERR;
+    }
+
+    e = hi_calloc(1,sizeof(*e));
+    if (e == NULL)
+        return REDIS_ERR;
+    e->size = sizeof(*e) + len;
+    e->cmd = sdsnewlen(cmd,len);
+    if (e->cmd == NULL) {
+        hi_free(e);
+        return REDIS_ERR;
+    }
+    e->reply = cacheReplyDup(reply,&e->size);
+    if (e->reply == NULL) {
+        sdsfree(e->cmd);
+        hi_free(e);
+        return REDIS_ERR;
+    }
+
+    /* Replace any previous reply, and make room. */
+    de = dictFindBuf(cache->commands,e->cmd,sdslen(e->cmd));
+    if (de != NULL)
+        cacheEntryFree(cache,dictGetEntryVal(de));
+    k = NULL;
+    if (cache->options.max_memory && e->size > cache->options.max_memory)
+        goto error;
+    cacheEvict(cache,e->size);
+
+    k = cacheKeyGet(cache,key,keylen);
+    if (k == NULL)
+        goto error;
+
+    if (dictReplace(cache->commands,e->cmd,e) == 0)
+        goto error;
+    if (cache->buckets == NULL || cache->buckets->freq != 1) {
+        if (cacheBucketCreate(cache,NULL,1) == NULL) {
+            dictDelete(cache->commands,e->cmd);
+            goto error;
+        }
+    }
+    cacheListPush(cache->buckets,e);
+
+    e->key = k;
+    e->knext = k->entries;
+    k->entries = e;
+    cache->stats.entries++;
+    cache->stats.memory += e->size;
+    return REDIS_OK;
+
+error:
+    if (k && k->entries == NULL) {
+        dictDelete(cache->keys,k->name);
+        sdsfree(k->name);
+        hi_free(k);
+    }
+    freeReplyObject(e->reply);
+    sdsfree(e->cmd);
+    hi_free(e);
+    return REDIS_ERR;
+}
+
+void redisCacheInvalidate(redisCache *cache, const char *key, size_t len) {
+    redisCacheKey *k;
+    dictEntry *de;
+
+    de = dictFindBuf(cache->keys,key,len);
+    if (de == NULL)
+        return;
+
+    /* Freeing the last entry frees the key too. */
+    k = dictGetEntryVal(de);
+    while (k->entries->knext) {
+        cacheEntryFree(cache,k->entries);
+        cache->stats.invalidations++;
+    }
+    cacheEntryFree(cache,k->entries);
+    cache->stats.invalidations++;
+}
+
+void redisCacheFlush(redisCache *cache) {
+    while (cache->buckets) {
+        cacheEntryFree(cache,cache->buckets->head);
+        cache->stats.invalidations++;
+    }
+}
+
+int redisCacheHandlePush(redisCache *cache, const redisReply *reply) {
+    const redisReply *keys;
+    size_t i;
+
+    if (reply == NULL || reply->type != REDIS_REPLY_PUSH || reply->elements != 2 ||
+        reply->element[0]->type != REDIS_REPLY_STRING ||
+        reply->element[0]->len != 10 ||
+        strncasecmp(reply->element[0]->str,"invalidate",10) != 0)
+        return 0;
+
+    /* A NULL key list means every key, e.g. after FLUSHALL. */
+    keys = reply->element[1];
+    if (keys->type == REDIS_REPLY_NIL) {
+        redisCacheFlush(cache);
+    } else if (keys->type == REDIS_REPLY_ARRAY || keys->type == REDIS_REPLY_SET) {
+        for (i = 0; i < keys->elements; i++) {
+            if (keys->element[i]->type == REDIS_REPLY_STRING)
+                redisCacheInvalidate(cache,keys->element[i]->str,keys->element[i]->len);
+        }
+    }
+
+    return 1;
+}
+
+void redisCacheGetStats(redisCache *cache, redisCacheStats *stats) {
+    *stats = cache->stats;
+}
+
+const redisCacheOptions *redisCacheGetOptions(redisCache *cache) {
+    return &cache->options;
+}
+
+void redisCacheFree(redisCache *cache) {
+    redisCacheBucket *b, *nb;
+    redisCacheEntry *e, *ne;
+    dictIterator it;
+    dictEntry *de;
+    size_t i;
+
+    if (cache == NULL)
+        return;
+
+    for (b = cache->buckets; b; b = nb) {
+        for (e = b->head; e; e = ne) {
+            ne = e->next;
+            freeReplyObject(e->reply);
+            sdsfree(e->cmd);
+            hi_free(e);
+        }
+        nb = b->next;
+        hi_free(b);
+    }
+
+    if (cache->keys) {
+        dictInitIterator(&it,cache->keys);
+        while ((de = dictNext(&it)) != NULL) {
+            redisCacheKey *k = dictGetEntryVal(de);
+            sdsfree(k->name);
+            hi_free(k);
+        }
+        dictReleaseIterator(&it);
+        dictRelease(cache->keys);
+    }
+    if (cache->commands)
+        dictRelease(cache->commands);
+
+    if (cache->options.prefixes) {
+        for (i = 0; i < cache->options.nprefixes; i++)
+            sdsfree((sds)cache->options.prefixes[i]);
+        hi_free((void *)cache->options.prefixes);
+    }
+    hi_free(cache);
+}
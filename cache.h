@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HIREDIS_CACHE_H
+#define __HIREDIS_CACHE_H
+#include "hiredis.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Which entry is evicted when the cache is full. */
+#define REDIS_CACHE_LRU 0 /* Least recently used */
+#define REDIS_CACHE_LFU 1 /* Least frequently used, least recently among ties */
+
+typedef struct redisCacheOptions {
+    /* Maximum number of entries, and approximate number of bytes used by
+     * them. 0 for no limit. */
+    size_t max_entries;
+    size_t max_memory;
+    /* One of REDIS_CACHE_xxx. */
+    int policy;
+
+    /* How the server tracks the keys of a context the cache is enabled on.
+     * By default the server remembers every key read by the connection.
+     * With bcast set, it announces changes to any key starting with one of
+     * the prefixes instead (all keys if there are none), which uses no
+     * memory on the server but invalidates more entries. */
+    int bcast;
+    const char **prefixes;
+    size_t nprefixes;
+} redisCacheOptions;
+
+typedef struct redisCacheStats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;     /* Entries removed to make room */
+    unsigned long long invalidations; /* Entries removed as possibly stale */
+    size_t entries;
+    size_t memory;
+} redisCacheStats;
+
+typedef struct redisCache redisCache;
+
+/* Create an empty cache. Returns NULL for invalid options or when out of
+ * memory. */
+redisCache *redisCacheCreate(const redisCacheOptions *options);
+
+/* Look a command up. Only GET, HGET and HGETALL, formatted as by
+ * redisFormatCommand(), are ever cached. Returns a copy of the cached reply,
+ * to be freed with freeReplyObject(), or NULL if there is none. */
+redisReply *redisCacheGet(redisCache *cache, const char *cmd, size_t len);
+
+/* Store a copy of the reply to a command, evicting other entries as needed.
+ * Returns REDIS_ERR if the command can't be cached, if the reply can't answer
+ * it (an error, or a QUEUED status inside a transaction), or when out of
+ * memory. */
+int redisCacheSet(redisCache *cache, const char *cmd, size_t len, const redisReply *reply);
+
+/* Remove every entry for a key. */
+void redisCacheInvalidate(redisCache *cache, const char *key, size_t len);
+
+/* Remove every entry. */
+void redisCacheFlush(redisCache *cache);
+
+/* Apply an "invalidate" push message from the server. Returns 1 if the reply
+ * was one, 0 otherwise. */
+int redisCacheHandlePush(redisCache *cache, const redisReply *reply);
+
+void redisCacheGetStats(redisCache *cache, redisCacheStats *stats);
+const redisCacheOptions *redisCacheGetOptions(redisCache *cache);
+
+void redisCacheFree(redisCache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
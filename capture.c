@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fmacros.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+#include "capture.h"
+
+/* A capture file starts with an 8 byte magic, the last byte of which is the
+ * format version, and the Unix time the capture started at as a 64 bit
+ * little endian integer. It is followed by records:
+ *
+ *   type       REDIS_CAPTURE_READ or REDIS_CAPTURE_WRITE, one byte
+ *   delta      microseconds since the previous record (or the start), varint
+ *   length     number of bytes, varint
+ *   bytes
+ *
+ * Varints are LEB128: 7 bits per byte, least significant first, the high bit
+ * set on all bytes but the last. */
+static const char captureMagic[8] = {'H', 'I', 'R', 'E', 'D', 'C', 'A', 1};
+
+struct redisCapture {
+    FILE *fp;
+    long long last; /* Time of the previous record */
+};
+
+struct redisCaptureFile {
+    FILE *fp;
+    char *buf;
+    size_t size;
+    unsigned long long time_us;
+};
+
+static long long captureMicros(void) {
+#ifndef _MSC_VER
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((long long)now.tv_sec * 1000000) + now.tv_nsec / 1000;
+#else
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (now.QuadPart / freq.QuadPart) * 1000000 +
+           (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#endif
+}
+
+static size_t captureEncodeVarint(unsigned char *p, unsigned long long v) {
+    size_t len = 0;
+
+    while (v >= 0x80) {
+        p[len++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    p[len++] = (unsigned char)v;
+    return len;
+}
+
+/* Returns 0 on success, -1 at the end of the file or on a malformed varint. */
+static int captureReadVarint(FILE *fp, unsigned long long *v) {
+    int shift, byte;
+
+    *v = 0;
+    for (shift = 0; shift < 64; shift += 7) {
+        if ((byte = fgetc(fp)) == EOF)
+            return -1;
+        *v |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+int redisCaptureStart(redisContext *c, const char *path) {
+    unsigned char start[8];
+    unsigned long long now = (unsigned long long)time(NULL);
+    struct redisCapture *capture;
+    int i;
+
+    redisCaptureStop(c);
+
+    capture = hi_malloc(sizeof(*capture));
+    if (capture == NULL)
+        return REDIS_ERR;
+    if ((capture->fp = fopen(path, "wb")) == NULL) {
+        hi_free(capture);
+        return REDIS_ERR;
+    }
+
+    for (i = 0; i < 8; i++)
+        start[i] = (unsigned char)(now >> (i * 8));
+    if (fwrite(captureMagic, 1, sizeof(captureMagic), capture->fp) != sizeof(captureMagic) ||
+        fwrite(start, 1, sizeof(start), capture->fp) != sizeof(start))
+    {
+        fclose(capture->fp);
+        hi_free(capture);
+        return REDIS_ERR;
+    }
+    capture->last = captureMicros();
+    c->capture = capture;
+    return REDIS_OK;
+}
+
+void redisCaptureStop(redisContext *c) {
+    if (c->capture == NULL)
+        return;
+    fclose(c->capture->fp);
+    hi_free(c->capture);
+    c->capture = NULL;
+}
+
+void redisCaptureData(redisContext *c, int type, const char *buf, size_t len) {
+    struct redisCapture *capture = c->capture;
+    unsigned char header[21];
+    long long now = captureMicros();
+    size_t hlen = 0;
+
+    header[hlen++] = (unsigned char)type;
+    hlen += captureEncodeVarint(header + hlen, (unsigned long long)(now - capture->last));
+    hlen += captureEncodeVarint(header + hlen, len);
+    capture->last = now;
+
+    if (fwrite(header, 1, hlen, capture->fp) != hlen ||
+        fwrite(buf, 1, len, capture->fp) != len)
+        redisCaptureStop(c);
+}
+
+redisCaptureFile *redisCaptureOpen(const char *path, long long *start_time) {
+    unsigned char header[16];
+    redisCaptureFile *f;
+    unsigned long long start = 0;
+    int i;
+
+    f = hi_calloc(1, sizeof(*f));
+    if (f == NULL)
+        return NULL;
+    if ((f->fp = fopen(path, "rb")) == NULL) {
+        hi_free(f);
+        return NULL;
+    }
+    if (fread(header, 1, sizeof(header), f->fp) != sizeof(header) ||
+        memcmp(header, captureMagic, sizeof(captureMagic)) != 0)
+    {
+        redisCaptureClose(f);
+        return NULL;
+    }
+
+    for (i = 7; i >= 0; i--)
+        start = (start << 8) | header[8 + i];
+    if (start_time)
+        *start_time = (long long)start;
+    return f;
+}
+
+int redisCaptureNext(redisCaptureFile *f, redisCaptureRecord *record) {
+    unsigned long long delta, len;
+    int type;
+
+    if ((type = fgetc(f->fp)) == EOF)
+        return 0;
+    if ((type != REDIS_CAPTURE_READ && type != REDIS_CAPTURE_WRITE) ||
+        captureReadVarint(f->fp, &delta) != 0 || captureReadVarint(f->fp, &len) != 0 ||
+        len > SIZE_MAX)
+        return -1;
+
+    if (len > f->size) {
+        char *buf = hi_realloc(f->buf, len);
+        if (buf == NULL)
+            return -1;
+        f->buf = buf;
+        f->size = len;
+    }
+    if (fread(f->buf, 1, len, f->fp) != len)
+        return -1;
+
+    f->time_us += delta;
+    record->type = type;
+    record->time_us = f->time_us;
+    record->buf = f->buf;
+    record->len = len;
+    return 1;
+}
+
+void redisCaptureClose(redisCaptureFile *f) {
+    if (f == NULL)
+        return;
+    if (f->fp)
+        fclose(f->fp);
+    hi_free(f->buf);
+    hi_free(f);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HIREDIS_CAPTURE_H
+#define __HIREDIS_CAPTURE_H
+#include "hiredis.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Record types, what the context read from or wrote to its connection. */
+#define REDIS_CAPTURE_READ 'R'
+#define REDIS_CAPTURE_WRITE 'W'
+
+/* Record the bytes a context exchanges with the server to the file at path,
+ * replacing any capture already in progress. Every read into the reader and
+ * every write of the output buffer is appended as one record, with the time
+ * it happened, so a capture keeps the exact fragmentation of the traffic. For
+ * TLS connections the decrypted bytes are recorded.
+ *
+ * Returns REDIS_ERR if the file cannot be created. Should writing to it fail
+ * later, the capture stops but the context carries on. */
+int redisCaptureStart(redisContext *c, const char *path);
+
+/* Stop capturing and close the file. Called by redisFree(). */
+void redisCaptureStop(redisContext *c);
+
+/* Append a record to the capture of c. Internal, used by redisBufferRead()
+ * and redisBufferWrite(). */
+void redisCaptureData(redisContext *c, int type, const char *buf, size_t len);
+
+typedef struct redisCaptureRecord {
+    int type;                   /* REDIS_CAPTURE_xxx */
+    unsigned long long time_us; /* Microseconds since the capture started */
+    const char *buf;            /* Valid until the next redisCaptureNext() */
+    size_t len;
+} redisCaptureRecord;
+
+typedef struct redisCaptureFile redisCaptureFile;
+
+/* Open a capture for reading. Returns NULL if the file cannot be opened or is
+ * not a capture. start_time, if not NULL, is set to the Unix time the capture
+ * started at. */
+redisCaptureFile *redisCaptureOpen(const char *path, long long *start_time);
+
+/* Read the next record. Returns 1 when one was read, 0 at the end of the
+ * capture and -1 if the file is truncated or corrupt. */
+int redisCaptureNext(redisCaptureFile *f, redisCaptureRecord *record);
+
+void redisCaptureClose(redisCaptureFile *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
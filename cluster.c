@@ -0,0 +1,1783 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "fmacros.h"
+#include "alloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "cluster.h"
+#include "sds.h"
+#include "win32.h"
+
+struct redisClusterNode {
+    char *host;
+    int port;
+
+    /* Connections to the node, opened on first use. */
+    redisContext *c;
+    redisAsyncContext *ac;
+
+    /* Owner of ac, for its dataCleanup. */
+    redisClusterAsyncContext *acc;
+};
+
+/* CRC16 (XMODEM), as used by Redis Cluster for key hashing. */
+static const uint16_t crc16tab[256] = {
+    0x0000,0x1021,0x2042,0x3063,0x4084,0x50a5,0x60c6,0x70e7,
+    0x8108,0x9129,0xa14a,0xb16b,0xc18c,0xd1ad,0xe1ce,0xf1ef,
+    0x1231,0x0210,0x3273,0x2252,0x52b5,0x4294,0x72f7,0x62d6,
+    0x9339,0x8318,0xb37b,0xa35a,0xd3bd,0xc39c,0xf3ff,0xe3de,
+    0x2462,0x3443,0x0420,0x1401,0x64e6,0x74c7,0x44a4,0x5485,
+    0xa56a,0xb54b,0x8528,0x9509,0xe5ee,0xf5cf,0xc5ac,0xd58d,
+    0x3653,0x2672,0x1611,0x0630,0x76d7,0x66f6,0x5695,0x46b4,
+    0xb75b,0xa77a,0x9719,0x8738,0xf7df,0xe7fe,0xd79d,0xc7bc,
+    0x48c4,0x58e5,0x6886,0x78a7,0x0840,0x1861,0x2802,0x3823,
+    0xc9cc,0xd9ed,0xe98e,0xf9af,0x8948,0x9969,0xa90a,0xb92b,
+    0x5af5,0x4ad4,0x7ab7,0x6a96,0x1a71,0x0a50,0x3a33,0x2a12,
+    0xdbfd,0xcbdc,0xfbbf,0xeb9e,0x9b79,0x8b58,0xbb3b,0xab1a,
+    0x6ca6,0x7c87,0x4ce4,0x5cc5,0x2c22,0x3c03,0x0c60,0x1c41,
+    0xedae,0xfd8f,0xcdec,0xddcd,0xad2a,0xbd0b,0x8d68,0x9d49,
+    0x7e97,0x6eb6,0x5ed5,0x4ef4,0x3e13,0x2e32,0x1e51,0x0e70,
+    0xff9f,0xefbe,0xdfdd,0xcffc,0xbf1b,0xaf3a,0x9f59,0x8f78,
+    0x9188,0x81a9,0xb1ca,0xa1eb,0xd10c,0xc12d,0xf14e,0xe16f,
+    0x1080,0x00a1,0x30c2,0x20e3,0x5004,0x4025,0x7046,0x6067,
+    0x83b9,0x9398,0xa3fb,0xb3da,0xc33d,0xd31c,0xe37f,0xf35e,
+    0x02b1,0x1290,0x22f3,0x32d2,0x4235,0x5214,0x6277,0x7256,
+    0xb5ea,0xa5cb,0x95a8,0x8589,0xf56e,0xe54f,0xd52c,0xc50d,
+    0x34e2,0x24c3,0x14a0,0x0481,0x7466,0x6447,0x5424,0x4405,
+    0xa7db,0xb7fa,0x8799,0x97b8,0xe75f,0xf77e,0xc71d,0xd73c,
+    0x26d3,0x36f2,0x0691,0x16b0,0x6657,0x7676,0x4615,0x5634,
+    0xd94c,0xc96d,0xf90e,0xe92f,0x99c8,0x89e9,0xb98a,0xa9ab,
+    0x5844,0x4865,0x7806,0x6827,0x18c0,0x08e1,0x3882,0x28a3,
+    0xcb7d,0xdb5c,0xeb3f,0xfb1e,0x8bf9,0x9bd8,0xabbb,0xbb9a,
+    0x4a75,0x5a54,0x6a37,0x7a16,0x0af1,0x1ad0,0x2ab3,0x3a92,
+    0xfd2e,0xed0f,0xdd6c,0xcd4d,0xbdaa,0xad8b,0x9de8,0x8dc9,
+    0x7c26,0x6c07,0x5c64,0x4c45,0x3ca2,0x2c83,0x1ce0,0x0cc1,
+    0xef1f,0xff3e,0xcf5d,0xdf7c,0xaf9b,0xbfba,0x8fd9,0x9ff8,
+    0x6e17,0x7e36,0x4e55,0x5e74,0x2e93,0x3eb2,0x0ed1,0x1ef0
+};
+
+static uint16_t crc16(const char *buf, size_t len) {
+    uint16_t crc = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        crc = (crc << 8) ^ crc16tab[((crc >> 8) ^ (unsigned char)buf[i]) & 0x00ff];
+    return crc;
+}
+
+unsigned int redisClusterKeySlot(const char *key, size_t keylen) {
+    size_t s, e;
+
+    for (s = 0; s < keylen; s++)
+        if (key[s] == '{') break;
+
+    /* No '{', hash the whole key. */
+    if (s == keylen)
+        return crc16(key, keylen) & (REDIS_CLUSTER_SLOTS - 1);
+
+    for (e = s + 1; e < keylen; e++)
+        if (key[e] == '}') break;
+
+    /* No '}' or nothing between {}, hash the whole key. */
+    if (e == keylen || e == s + 1)
+        return crc16(key, keylen) & (REDIS_CLUSTER_SLOTS - 1);
+
+    return crc16(key + s + 1, e - s - 1) & (REDIS_CLUSTER_SLOTS - 1);
+}
+
+/* -----------------------------------------------------------------------------
+ * Nodes and slot map
+ * -------------------------------------------------------------------------- */
+
+static struct redisClusterNode *clusterFindNode(redisClusterNodes *map, const char *host, size_t hostlen, int port) {
+    size_t i;
+
+    for (i = 0; i < map->count; i++) {
+        struct redisClusterNode *node = map->nodes[i];
+        if (node->port == port && strlen(node->host) == hostlen &&
+            !memcmp(node->host, host, hostlen))
+            return node;
+    }
+    return NULL;
+}
+
+/* Return the node with this address, adding it if unknown. NULL when out of
+ * memory. Nodes are kept for the lifetime of the map, so their pointers stay
+ * valid across slot map refreshes. */
+static struct redisClusterNode *clusterGetNode(redisClusterNodes *map, const char *host, size_t hostlen, int port) {
+    struct redisClusterNode *node, **nodes;
+
+    if ((node = clusterFindNode(map, host, hostlen, port)) != NULL)
+        return node;
+
+    nodes = hi_realloc(map->nodes, (map->count + 1) * sizeof(*nodes));
+    if (nodes == NULL)
+        return NULL;
+    map->nodes = nodes;
+
+    node = hi_calloc(1, sizeof(*node));
+    if (node == NULL)
+        return NULL;
+    node->host = hi_malloc(hostlen + 1);
+    if (node->host == NULL) {
+        hi_free(node);
+        return NULL;
+    }
+    memcpy(node->host, host, hostlen);
+    node->host[hostlen] = '\0';
+    node->port = port;
+
+    map->nodes[map->count++] = node;
+    return node;
+}
+
+/* Split "host:port", "[host]:port" or "host:port@cport" into its parts. */
+static int clusterParseAddress(const char *addr, size_t len, const char **host, size_t *hostlen, int *port) {
+    const char *colon = NULL, *p;
+    long val;
+    char *end;
+
+    for (p = addr; p < addr + len; p++) {
+        if (*p == ':') colon = p;
+        else if (*p == '@') break;
+    }
+    if (colon == NULL || colon == addr)
+        return REDIS_ERR;
+
+    val = strtol(colon + 1, &end, 10);
+    if (end == colon + 1 || val <= 0 || val > 65535)
+        return REDIS_ERR;
+
+    *host = addr;
+    *hostlen = colon - addr;
+    if (*hostlen >= 2 && addr[0] == '[' && colon[-1] == ']') {
+        (*host)++;
+        *hostlen -= 2;
+    }
+    *port = (int)val;
+    return REDIS_OK;
+}
+
+static void clusterFreeNodes(redisClusterNodes *map) {
+    size_t i;
+
+    for (i = 0; i < map->count; i++) {
+        redisFree(map->nodes[i]->c);
+        hi_free(map->nodes[i]->host);
+        hi_free(map->nodes[i]);
+    }
+    hi_free(map->nodes);
+    map->nodes = NULL;
+    map->count = 0;
+}
+
+static int clusterAddSeeds(redisClusterNodes *map, const char **seeds, int nseeds) {
+    const char *host;
+    size_t hostlen;
+    int i, port;
+
+    for (i = 0; i < nseeds; i++) {
+        if (clusterParseAddress(seeds[i], strlen(seeds[i]), &host, &hostlen, &port) != REDIS_OK)
+            return REDIS_ERR;
+        if (clusterGetNode(map, host, hostlen, port) == NULL)
+            return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
+
+/* Look a field up in a map reply, which is a flat array of alternating keys
+ * and values in RESP2. */
+static redisReply *clusterMapGet(redisReply *r, const char *field) {
+    size_t i;
+
+    if (r->type != REDIS_REPLY_ARRAY && r->type != REDIS_REPLY_MAP)
+        return NULL;
+
+    for (i = 0; i + 1 < r->elements; i += 2) {
+        redisReply *k = r->element[i];
+        if ((k->type == REDIS_REPLY_STRING || k->type == REDIS_REPLY_STATUS) &&
+            !strcasecmp(k->str, field))
+            return r->element[i + 1];
+    }
+    return NULL;
+}
+
+static int clusterIsString(redisReply *r) {
+    return r && (r->type == REDIS_REPLY_STRING || r->type == REDIS_REPLY_STATUS ||
+                 r->type == REDIS_REPLY_VERB);
+}
+
+/* Address advertised for a node. An empty (or "?") endpoint means the node
+ * that sent the reply. */
+static struct redisClusterNode *clusterReplyNode(redisClusterNodes *map, redisReply *host, long long port,
+                                                 struct redisClusterNode *from)
+{
+    if (port <= 0 || port > 65535)
+        return NULL;
+    if (host == NULL || host->len == 0 || (host->len == 1 && host->str[0] == '?'))
+        return clusterGetNode(map, from->host, strlen(from->host), (int)port);
+    return clusterGetNode(map, host->str, host->len, (int)port);
+}
+
+/* Fill slots from a CLUSTER SHARDS reply (Redis 7.0+). */
+static int clusterParseShards(redisClusterNodes *map, redisReply *r, struct redisClusterNode *from,
+                              struct redisClusterNode **slots)
+{
+    size_t i, j;
+
+    if (r->type != REDIS_REPLY_ARRAY)
+        return REDIS_ERR;
+
+    for (i = 0; i < r->elements; i++) {
+        redisReply *ranges = clusterMapGet(r->element[i], "slots");
+        redisReply *nodes = clusterMapGet(r->element[i], "nodes");
+        struct redisClusterNode *primary = NULL;
+
+        if (ranges == NULL || nodes == NULL || ranges->type != REDIS_REPLY_ARRAY ||
+            nodes->type != REDIS_REPLY_ARRAY)
+            return REDIS_ERR;
+
+        for (j = 0; j < nodes->elements && primary == NULL; j++) {
+            redisReply *role = clusterMapGet(nodes->element[j], "role");
+            redisReply *health = clusterMapGet(nodes->element[j], "health");
+            redisReply *endpoint = clusterMapGet(nodes->element[j], "endpoint");
+            redisReply *port = clusterMapGet(nodes->element[j], "port");
+
+            if (!clusterIsString(role) || strcasecmp(role->str, "master") != 0)
+                continue;
+            if (clusterIsString(health) && strcasecmp(health->str, "online") != 0)
+                continue;
+            if (port == NULL || port->type != REDIS_REPLY_INTEGER)
+                port = clusterMapGet(nodes->element[j], "tls-port");
+            if (port == NULL || port->type != REDIS_REPLY_INTEGER)
+                continue;
+            if (!clusterIsString(endpoint))
+                endpoint = clusterMapGet(nodes->element[j], "ip");
+
+            primary = clusterReplyNode(map, clusterIsString(endpoint) ? endpoint : NULL,
+                                       port->integer, from);
+            if (primary == NULL)
+                return REDIS_ERR;
+        }
+        if (primary == NULL)
+            continue;
+
+        for (j = 0; j + 1 < ranges->elements; j += 2) {
+            long long start = ranges->element[j]->integer;
+            long long end = ranges->element[j + 1]->integer;
+
+            if (ranges->element[j]->type != REDIS_REPLY_INTEGER ||
+                ranges->element[j + 1]->type != REDIS_REPLY_INTEGER ||
+                start < 0 || end >= REDIS_CLUSTER_SLOTS || start > end)
+                return REDIS_ERR;
+            while (start <= end)
+                slots[start++] = primary;
+        }
+    }
+
+    return REDIS_OK;
+}
+
+/* Fill slots from a CLUSTER SLOTS reply. */
+static int clusterParseSlots(redisClusterNodes *map, redisReply *r, struct redisClusterNode *from,
+                             struct redisClusterNode **slots)
+{
+    size_t i;
+
+    if (r->type != REDIS_REPLY_ARRAY)
+        return REDIS_ERR;
+
+    for (i = 0; i < r->elements; i++) {
+        redisReply *e = r->element[i], *addr;
+        struct redisClusterNode *primary;
+        long long start, end;
+
+        if (e->type != REDIS_REPLY_ARRAY || e->elements < 3 ||
+            e->element[0]->type != REDIS_REPLY_INTEGER ||
+            e->element[1]->type != REDIS_REPLY_INTEGER ||
+            e->element[2]->type != REDIS_REPLY_ARRAY)
+            return REDIS_ERR;
+
+        start = e->element[0]->integer;
+        end = e->element[1]->integer;
+        addr = e->element[2];
+        if (start < 0 || end >= REDIS_CLUSTER_SLOTS || start > end || addr->elements < 2 ||
+            addr->element[1]->type != REDIS_REPLY_INTEGER)
+            return REDIS_ERR;
+
+        primary = clusterReplyNode(map, clusterIsString(addr->element[0]) ? addr->element[0] : NULL,
+                                   addr->element[1]->integer, from);
+        if (primary == NULL)
+            return REDIS_ERR;
+        while (start <= end)
+            slots[start++] = primary;
+    }
+
+    return REDIS_OK;
+}
+
+/* Replace the slot map with the one described by a CLUSTER SHARDS (shards
+ * set) or CLUSTER SLOTS reply. */
+static int clusterApplyMap(redisClusterNodes *map, redisReply *r, int shards, struct redisClusterNode *from) {
+    struct redisClusterNode **slots;
+    int ret;
+
+    slots = hi_calloc(REDIS_CLUSTER_SLOTS, sizeof(*slots));
+    if (slots == NULL)
+        return REDIS_ERR;
+
+    ret = shards ? clusterParseShards(map, r, from, slots) : clusterParseSlots(map, r, from, slots);
+    if (ret == REDIS_OK)
+        memcpy(map->slots, slots, sizeof(map->slots));
+
+    hi_free(slots);
+    return ret;
+}
+
+/* Parse a MOVED or ASK error. Returns 1 for MOVED, 2 for ASK, 0 otherwise. */
+static int clusterParseRedirect(redisReply *r, unsigned int *slot, const char **host, size_t *hostlen, int *port) {
+    const char *p, *addr;
+    int kind;
+    long val;
+    char *end;
+
+    if (r == NULL || r->type != REDIS_REPLY_ERROR)
+        return 0;
+
+    if (r->len > 6 && !strncmp(r->str, "MOVED ", 6)) {
+        kind = 1;
+        p = r->str + 6;
+    } else if (r->len > 4 && !strncmp(r->str, "ASK ", 4)) {
+        kind = 2;
+        p = r->str + 4;
+    } else {
+        return 0;
+    }
+
+    val = strtol(p, &end, 10);
+    if (end == p || *end != ' ' || val < 0 || val >= REDIS_CLUSTER_SLOTS)
+        return 0;
+    addr = end + 1;
+    if (clusterParseAddress(addr, r->str + r->len - addr, host, hostlen, port) != REDIS_OK)
+        return 0;
+
+    *slot = (unsigned int)val;
+    return kind;
+}
+
+/* -----------------------------------------------------------------------------
+ * Command routing
+ * -------------------------------------------------------------------------- */
+
+/* Iterate the arguments of a command in RESP format. */
+static const char *clusterNextArg(const char *p, const char *end, const char **arg, size_t *len) {
+    char *eol;
+    long long n;
+
+    if (p >= end || *p != '$')
+        return NULL;
+    n = strtoll(p + 1, &eol, 10);
+    if (n < 0 || eol + 2 > end || eol[0] != '\r')
+        return NULL;
+    *arg = eol + 2;
+    *len = (size_t)n;
+    if ((size_t)(end - *arg) < *len + 2)
+        return NULL;
+    return *arg + *len + 2;
+}
+
+static int clusterArgIs(const char *arg, size_t len, const char *name) {
+    return strlen(name) == len && !strncasecmp(arg, name, len);
+}
+
+/* Position of the first key of a command, following the conventions of the
+ * Redis command table for the commands where it is not the first argument.
+ * SPUBLISH is routed by its channel, which is its first argument.
+ * Returns 0 for commands without a key, or -1 when the key is the argument
+ * after a "numkeys" argument at position -ret. */
+static int clusterFirstKeyPos(const char *name, size_t len, int argc) {
+    static const char *keyless[] = {
+        "ping", "echo", "info", "time", "dbsize", "cluster", "command", "config",
+        "client", "script", "function", "hello", "auth", "select", "flushall",
+        "flushdb", "randomkey", "scan", "keys", "wait", "waitaof", "lastsave",
+        "memory", "latency", "slowlog", "publish", "pubsub", "multi", "exec",
+        "discard", "quit", "readonly", "readwrite", "asking"
+    };
+    size_t i;
+
+    if (clusterArgIs(name, len, "eval") || clusterArgIs(name, len, "evalsha") ||
+        clusterArgIs(name, len, "eval_ro") || clusterArgIs(name, len, "evalsha_ro") ||
+        clusterArgIs(name, len, "fcall") || clusterArgIs(name, len, "fcall_ro") ||
+        clusterArgIs(name, len, "blmpop") || clusterArgIs(name, len, "bzmpop"))
+        return -2;
+    if (clusterArgIs(name, len, "zunion") || clusterArgIs(name, len, "zinter") ||
+        clusterArgIs(name, len, "zdiff") || clusterArgIs(name, len, "zintercard") ||
+        clusterArgIs(name, len, "sintercard") || clusterArgIs(name, len, "lmpop") ||
+        clusterArgIs(name, len, "zmpop"))
+        return -1;
+    if (clusterArgIs(name, len, "object") || clusterArgIs(name, len, "xgroup") ||
+        clusterArgIs(name, len, "xinfo") || clusterArgIs(name, len, "bitop"))
+        return 2;
+    if (clusterArgIs(name, len, "memory") && argc > 2)
+        return 2;
+
+    for (i = 0; i < sizeof(keyless) / sizeof(*keyless); i++) {
+        if (clusterArgIs(name, len, keyless[i]))
+            return 0;
+    }
+    return 1;
+}
+
+/* Return the slot of a command in RESP format, -1 when it has no key, or
+ * -2 when it can't be parsed. */
+static int clusterCommandSlot(const char *cmd, size_t len) {
+    const char *end = cmd + len, *p, *arg, *name;
+    size_t arglen, namelen;
+    long long argc;
+    char *eol;
+    int pos, i, streams = 0;
+
+    if (len == 0 || cmd[0] != '*')
+        return -2;
+    argc = strtoll(cmd + 1, &eol, 10);
+    if (argc <= 0 || eol + 2 > end)
+        return -2;
+    p = eol + 2;
+
+    if ((p = clusterNextArg(p, end, &name, &namelen)) == NULL)
+        return -2;
+
+    if (clusterArgIs(name, namelen, "xread") || clusterArgIs(name, namelen, "xreadgroup"))
+        streams = 1;
+    pos = streams ? 0 : clusterFirstKeyPos(name, namelen, (int)argc);
+    if (pos == 0 && !streams)
+        return -1;
+
+    for (i = 1; i < argc; i++) {
+        if ((p = clusterNextArg(p, end, &arg, &arglen)) == NULL)
+            return -2;
+
+        if (streams) {
+            /* The key is the first argument after STREAMS. */
+            if (pos == i)
+                return redisClusterKeySlot(arg, arglen);
+            if (clusterArgIs(arg, arglen, "streams"))
+                pos = i + 1;
+        } else if (pos < 0) {
+            /* Key after a numkeys argument */
+            if (i == -pos) {
+                if (arglen == 0 || arg[0] == '0')
+                    return -1;
+                pos = i + 1;
+            }
+        } else if (pos == i) {
+            return redisClusterKeySlot(arg, arglen);
+        }
+    }
+
+    return -1;
+}
+
+/* Commands whose callback may be called more than once, which the cluster
+ * client can't route. */
+static int clusterIsStreamingCommand(const char *cmd, size_t len) {
+    static const char *names[] = {
+        "subscribe", "psubscribe", "ssubscribe",
+        "unsubscribe", "punsubscribe", "sunsubscribe", "monitor"
+    };
+    const char *end = cmd + len, *name;
+    size_t namelen, i;
+    char *eol;
+
+    if (len == 0 || cmd[0] != '*')
+        return 0;
+    strtoll(cmd + 1, &eol, 10);
+    if (eol + 2 > end || clusterNextArg(eol + 2, end, &name, &namelen) == NULL)
+        return 0;
+
+    for (i = 0; i < sizeof(names) / sizeof(*names); i++) {
+        if (clusterArgIs(name, namelen, names[i]))
+            return 1;
+    }
+    return 0;
+}
+
+/* Pick a node for a command without a key: the first one serving slots. */
+static struct redisClusterNode *clusterAnyNode(redisClusterNodes *map) {
+    int i;
+
+    for (i = 0; i < REDIS_CLUSTER_SLOTS; i++) {
+        if (map->slots[i])
+            return map->slots[i];
+    }
+    return map->count ? map->nodes[0] : NULL;
+}
+
+static void clusterCopyOptions(redisClusterOptions *dst, struct timeval *connect_timeout,
+                               struct timeval *command_timeout, const redisClusterOptions *src)
+{
+    *dst = *src;
+    dst->seeds = NULL;
+    dst->nseeds = 0;
+
+    if (src->connect_timeout) {
+        *connect_timeout = *src->connect_timeout;
+        dst->connect_timeout = connect_timeout;
+    }
+    if (src->command_timeout) {
+        *command_timeout = *src->command_timeout;
+        dst->command_timeout = command_timeout;
+    }
+    if (dst->max_redirects <= 0)
+        dst->max_redirects = REDIS_CLUSTER_MAX_REDIRECTS;
+}
+
+/* -----------------------------------------------------------------------------
+ * Multi-key commands
+ * -------------------------------------------------------------------------- */
+
+/* How the replies of a multi-key command split by slot are merged. */
+#define CLUSTER_MERGE_ARRAY 1  /* MGET: array in key order */
+#define CLUSTER_MERGE_STATUS 2 /* MSET: status */
+#define CLUSTER_MERGE_SUM 3    /* DEL, EXISTS, UNLINK, TOUCH: sum */
+
+/* A multi-key command split into one command per slot. */
+typedef struct clusterFanout {
+    int merge;
+    size_t nkeys;
+    size_t ncmds;
+    sds *cmds;
+    size_t *keys;   /* Number of keys of each command */
+    size_t *keycmd; /* Command each key was sent with, in key order */
+} clusterFanout;
+
+static void clusterFanoutFree(clusterFanout *f) {
+    size_t i;
+
+    for (i = 0; i < f->ncmds; i++)
+        sdsfree(f->cmds[i]);
+    hi_free(f->cmds);
+    hi_free(f->keys);
+    hi_free(f->keycmd);
+    memset(f, 0, sizeof(*f));
+}
+
+/* Split a MGET, MSET, DEL, EXISTS, UNLINK or TOUCH whose keys are in more
+ * than one slot into one command per slot. Returns 1 if the command was
+ * split, 0 if it doesn't need to be, or -1 when out of memory. */
+static int clusterSplitCommand(const char *cmd, size_t len, clusterFanout *f) {
+    const char *end = cmd + len, *p, **argv = NULL, **cargv = NULL;
+    size_t *argvlen = NULL, *cargvlen = NULL;
+    int *slotcmd = NULL, merge, step = 1, first = -1, split = 0;
+    long long argc, i;
+    size_t j, k;
+    char *eol;
+
+    memset(f, 0, sizeof(*f));
+
+    if (len == 0 || cmd[0] != '*')
+        return 0;
+    argc = strtoll(cmd + 1, &eol, 10);
+    if (argc < 3 || eol + 2 > end)
+        return 0;
+
+    argv = hi_malloc(argc * sizeof(*argv));
+    argvlen = hi_malloc(argc * sizeof(*argvlen));
+    if (argv == NULL || argvlen == NULL)
+        goto oom;
+
+    p = eol + 2;
+    for (i = 0; i < argc; i++) {
+        if ((p = clusterNextArg(p, end, &argv[i], &argvlen[i])) == NULL)
+            goto nosplit;
+    }
+
+    if (clusterArgIs(argv[0], argvlen[0], "mget")) {
+        merge = CLUSTER_MERGE_ARRAY;
+    } else if (clusterArgIs(argv[0], argvlen[0], "mset")) {
+        merge = CLUSTER_MERGE_STATUS;
+        step = 2;
+    } else if (clusterArgIs(argv[0], argvlen[0], "del") ||
+               clusterArgIs(argv[0], argvlen[0], "exists") ||
+               clusterArgIs(argv[0], argvlen[0], "unlink") ||
+               clusterArgIs(argv[0], argvlen[0], "touch")) {
+        merge = CLUSTER_MERGE_SUM;
+    } else {
+        goto nosplit;
+    }
+    if ((argc - 1) % step != 0)
+        goto nosplit;
+
+    for (i = 1; i < argc; i += step) {
+        int slot = (int)redisClusterKeySlot(argv[i], argvlen[i]);
+
+        if (first < 0)
+            first = slot;
+        else if (slot != first)
+            split = 1;
+    }
+    if (!split)
+        goto nosplit;
+
+    f->merge = merge;
+    f->nkeys = (size_t)(argc - 1) / step;
+    slotcmd = hi_malloc(REDIS_CLUSTER_SLOTS * sizeof(*slotcmd));
+    f->keycmd = hi_malloc(f->nkeys * sizeof(*f->keycmd));
+    f->keys = hi_calloc(f->nkeys, sizeof(*f->keys));
+    if (slotcmd == NULL || f->keycmd == NULL || f->keys == NULL)
+        goto oom;
+    for (k = 0; k < REDIS_CLUSTER_SLOTS; k++)
+        slotcmd[k] = -1;
+
+    /* Assign commands to slots in order of first appearance. */
+    for (k = 0; k < f->nkeys; k++) {
+        unsigned int slot = redisClusterKeySlot(argv[1 + k * step], argvlen[1 + k * step]);
+
+        if (slotcmd[slot] < 0)
+            slotcmd[slot] = (int)f->ncmds++;
+        f->keycmd[k] = slotcmd[slot];
+        f->keys[f->keycmd[k]]++;
+    }
+
+    f->cmds = hi_calloc(f->ncmds, sizeof(*f->cmds));
+    cargv = hi_malloc(argc * sizeof(*cargv));
+    cargvlen = hi_malloc(argc * sizeof(*cargvlen));
+    if (f->cmds == NULL || cargv == NULL || cargvlen == NULL)
+        goto oom;
+
+    /* Build the commands one at a time, reusing the argument vectors. */
+    for (j = 0; j < f->ncmds; j++) {
+        size_t n = 1;
+
+        cargv[0] = argv[0];
+        cargvlen[0] = argvlen[0];
+        for (k = 0; k < f->nkeys; k++) {
+            if (f->keycmd[k] != j)
+                continue;
+            cargv[n] = argv[1 + k * step];
+            cargvlen[n++] = argvlen[1 + k * step];
+            if (step == 2) {
+                cargv[n] = argv[2 + k * step];
+                cargvlen[n++] = argvlen[2 + k * step];
+            }
+        }
+        if (redisFormatSdsCommandArgv(&f->cmds[j], (int)n, cargv, cargvlen) < 0)
+            goto oom;
+    }
+
+    hi_free(argv);
+    hi_free(argvlen);
+    hi_free(cargv);
+    hi_free(cargvlen);
+    hi_free(slotcmd);
+    return 1;
+
+oom:
+    clusterFanoutFree(f);
+    split = -1;
+nosplit:
+    hi_free(argv);
+    hi_free(argvlen);
+    hi_free(cargv);
+    hi_free(cargvlen);
+    hi_free(slotcmd);
+    return split < 0 ? -1 : 0;
+}
+
+/* Merge the replies of a split command, in command order, into the reply the
+ * original command would have had. The replies are consumed. Returns NULL
+ * when they are not what the command should reply, or out of memory. */
+static redisReply *clusterMergeReplies(clusterFanout *f, redisReply **replies) {
+    redisReply *merged = NULL;
+    size_t *next = NULL;
+    size_t i;
+
+    /* The first error is the reply, as for a single command. */
+    for (i = 0; i < f->ncmds; i++) {
+        if (replies[i] && replies[i]->type == REDIS_REPLY_ERROR) {
+            merged = replies[i];
+            replies[i] = NULL;
+            goto done;
+        }
+    }
+
+    for (i = 0; i < f->ncmds; i++) {
+        if (replies[i] == NULL)
+            goto done;
+        if (f->merge == CLUSTER_MERGE_ARRAY &&
+            (replies[i]->type != REDIS_REPLY_ARRAY || replies[i]->elements != f->keys[i]))
+            goto done;
+        if (f->merge == CLUSTER_MERGE_SUM && replies[i]->type != REDIS_REPLY_INTEGER)
+            goto done;
+    }
+
+    if (f->merge == CLUSTER_MERGE_ARRAY) {
+        if ((merged = hi_calloc(1, sizeof(*merged))) == NULL ||
+            (next = hi_calloc(f->ncmds, sizeof(*next))) == NULL ||
+            (merged->element = hi_calloc(f->nkeys, sizeof(*merged->element))) == NULL)
+        {
+            hi_free(merged);
+            merged = NULL;
+            goto done;
+        }
+        merged->type = REDIS_REPLY_ARRAY;
+        merged->elements = f->nkeys;
+        for (i = 0; i < f->nkeys; i++) {
+            size_t j = f->keycmd[i];
+
+            merged->element[i] = replies[j]->element[next[j]];
+            replies[j]->element[next[j]++] = NULL;
+        }
+    } else {
+        merged = replies[0];
+        replies[0] = NULL;
+        for (i = 1; f->merge == CLUSTER_MERGE_SUM && i < f->ncmds; i++)
+            merged->integer += replies[i]->integer;
+    }
+
+done:
+    for (i = 0; i < f->ncmds; i++) {
+        freeReplyObject(replies[i]);
+        replies[i] = NULL;
+    }
+    hi_free(next);
+    return merged;
+}
+
+/* -----------------------------------------------------------------------------
+ * Blocking API
+ * -------------------------------------------------------------------------- */
+
+static void clusterSetError(int *err, char *errstr, int type, const char *str) {
+    size_t len = strlen(str);
+
+    *err = type;
+    len = len < 127 ? len : 127;
+    memcpy(errstr, str, len);
+    errstr[len] = '\0';
+}
+
+#define __clusterSetError(cc, type, str) clusterSetError(&(cc)->err, (cc)->errstr, type, str)
+
+static void clusterClearError(redisClusterContext *cc) {
+    cc->err = 0;
+    cc->errstr[0] = '\0';
+}
+
+/* Return an usable connection to a node, (re)connecting as needed. */
+static redisContext *clusterNodeContext(redisClusterContext *cc, struct redisClusterNode *node) {
+    redisOptions options = {0};
+    redisContext *c;
+
+    if (node->c && node->c->err == 0)
+        return node->c;
+
+    redisFree(node->c);
+    node->c = NULL;
+
+    REDIS_OPTIONS_SET_TCP(&options, node->host, node->port);
+    options.connect_timeout = cc->options.connect_timeout;
+    options.command_timeout = cc->options.command_timeout;
+
+    c = redisConnectWithOptions(&options);
+    if (c == NULL) {
+        __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+    if (c->err == 0 && cc->options.connect_cb &&
+        cc->options.connect_cb(c, cc->options.connect_privdata) != REDIS_OK && c->err == 0)
+    {
+        clusterSetError(&c->err, c->errstr, REDIS_ERR_OTHER, "Cluster connect callback failed");
+    }
+    if (c->err) {
+        __clusterSetError(cc, c->err, c->errstr);
+        redisFree(c);
+        return NULL;
+    }
+
+    node->c = c;
+    return c;
+}
+
+/* Load the slot map from a node, with CLUSTER SHARDS or, for servers older
+ * than 7.0, CLUSTER SLOTS. */
+static int clusterRefreshFrom(redisClusterContext *cc, struct redisClusterNode *node) {
+    redisContext *c = clusterNodeContext(cc, node);
+    redisReply *reply;
+    int shards = 1, ret;
+
+    if (c == NULL)
+        return REDIS_ERR;
+
+    reply = redisCommand(c, "CLUSTER SHARDS");
+    if (reply && reply->type == REDIS_REPLY_ERROR) {
+        freeReplyObject(reply);
+        reply = redisCommand(c, "CLUSTER SLOTS");
+        shards = 0;
+    }
+    if (reply == NULL) {
+        __clusterSetError(cc, c->err, c->errstr);
+        return REDIS_ERR;
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        __clusterSetError(cc, REDIS_ERR_OTHER, reply->str);
+        freeReplyObject(reply);
+        return REDIS_ERR;
+    }
+
+    ret = clusterApplyMap(&cc->map, reply, shards, node);
+    if (ret != REDIS_OK)
+        __clusterSetError(cc, REDIS_ERR_PROTOCOL, "Invalid cluster slot map");
+    freeReplyObject(reply);
+    return ret;
+}
+
+int redisClusterRefresh(redisClusterContext *cc) {
+    size_t i;
+
+    /* Nodes may be added while refreshing, so don't cache the count. */
+    for (i = 0; i < cc->map.count; i++) {
+        if (clusterRefreshFrom(cc, cc->map.nodes[i]) == REDIS_OK) {
+            clusterClearError(cc);
+            cc->needRefresh = 0;
+            return REDIS_OK;
+        }
+    }
+
+    if (cc->err == 0)
+        __clusterSetError(cc, REDIS_ERR_OTHER, "No cluster node reachable");
+    return REDIS_ERR;
+}
+
+redisClusterContext *redisClusterConnectWithOptions(const redisClusterOptions *options) {
+    redisClusterContext *cc;
+
+    cc = hi_calloc(1, sizeof(*cc));
+    if (cc == NULL)
+        return NULL;
+
+    clusterCopyOptions(&cc->options, &cc->connect_timeout, &cc->command_timeout, options);
+
+    if (options->nseeds <= 0 || clusterAddSeeds(&cc->map, options->seeds, options->nseeds) != REDIS_OK) {
+        __clusterSetError(cc, REDIS_ERR_OTHER, "Invalid cluster seed address");
+        return cc;
+    }
+
+    redisClusterRefresh(cc);
+    return cc;
+}
+
+redisClusterContext *redisClusterConnect(const char *seeds) {
+    redisClusterOptions options = {0};
+    redisClusterContext *cc;
+    sds *addrs;
+    int count;
+
+    addrs = sdssplitlen(seeds, strlen(seeds), ",", 1, &count);
+    if (addrs == NULL)
+        return NULL;
+
+    options.seeds = (const char **)addrs;
+    options.nseeds = count;
+    cc = redisClusterConnectWithOptions(&options);
+
+    sdsfreesplitres(addrs, count);
+    return cc;
+}
+
+redisContext *redisClusterGetContext(redisClusterContext *cc, unsigned int slot) {
+    if (slot >= REDIS_CLUSTER_SLOTS)
+        return NULL;
+
+    if (cc->map.slots[slot] == NULL && redisClusterRefresh(cc) != REDIS_OK)
+        return NULL;
+    if (cc->map.slots[slot] == NULL) {
+        __clusterSetError(cc, REDIS_ERR_OTHER, "Slot not served by any node");
+        return NULL;
+    }
+
+    return clusterNodeContext(cc, cc->map.slots[slot]);
+}
+
+/* Return the node a command should be sent to, or NULL on error. */
+static struct redisClusterNode *clusterRouteCommand(redisClusterContext *cc, const char *cmd, size_t len) {
+    struct redisClusterNode *node;
+    int slot;
+
+    if (clusterIsStreamingCommand(cmd, len)) {
+        __clusterSetError(cc, REDIS_ERR_OTHER, "Command not supported in cluster mode");
+        return NULL;
+    }
+
+    if ((slot = clusterCommandSlot(cmd, len)) == -2) {
+        __clusterSetError(cc, REDIS_ERR_PROTOCOL, "Invalid command");
+        return NULL;
+    }
+
+    if (slot >= 0) {
+        if (cc->map.slots[slot] == NULL)
+            redisClusterRefresh(cc);
+        node = cc->map.slots[slot];
+    } else {
+        node = clusterAnyNode(&cc->map);
+    }
+    if (node == NULL)
+        __clusterSetError(cc, REDIS_ERR_OTHER, "Slot not served by any node");
+    return node;
+}
+
+/* Send a command to a node and return its final reply, following
+ * redirections. When reply is not NULL, it is the node's reply to a command
+ * already sent, and only the redirections it asks for are followed. */
+static void *clusterExecute(redisClusterContext *cc, struct redisClusterNode *node,
+                            redisReply *reply, const char *cmd, size_t len)
+{
+    int asking = 0, redirects;
+
+    for (redirects = 0; ; redirects++) {
+        const char *host;
+        size_t hostlen;
+        unsigned int rslot;
+        int port, kind;
+
+        if (reply == NULL) {
+            redisContext *c = clusterNodeContext(cc, node);
+
+            if (c == NULL)
+                return NULL;
+
+            if (asking && redisAppendCommand(c, "ASKING") != REDIS_OK)
+                goto ioerr;
+            if (redisAppendFormattedCommand(c, cmd, len) != REDIS_OK)
+                goto ioerr;
+            if (asking) {
+                if (redisGetReply(c, (void **)&reply) != REDIS_OK)
+                    goto ioerr;
+                freeReplyObject(reply);
+            }
+            if (redisGetReply(c, (void **)&reply) != REDIS_OK)
+                goto ioerr;
+        }
+
+        kind = clusterParseRedirect(reply, &rslot, &host, &hostlen, &port);
+        if (kind == 0) {
+            /* A failed refresh along the way is not an error. */
+            clusterClearError(cc);
+            return reply;
+        }
+
+        if (redirects == cc->options.max_redirects) {
+            __clusterSetError(cc, REDIS_ERR_OTHER, "Too many cluster redirections");
+            freeReplyObject(reply);
+            return NULL;
+        }
+
+        node = clusterGetNode(&cc->map, host, hostlen, port);
+        freeReplyObject(reply);
+        reply = NULL;
+        if (node == NULL) {
+            __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+            return NULL;
+        }
+
+        /* A MOVED means the slot map is outdated: fix the slot right away
+         * and reload the whole map before the next command. */
+        asking = kind == 2;
+        if (kind == 1) {
+            cc->map.slots[rslot] = node;
+            cc->needRefresh = 1;
+        }
+    }
+
+ioerr:
+    /* The command may have been executed, so it is not retried. The node may
+     * have failed over though, so reload the slot map next time. */
+    __clusterSetError(cc, node->c->err, node->c->errstr);
+    cc->needRefresh = 1;
+    return NULL;
+}
+
+/* A pipelined command, and once the pipeline is sent, its reply or error. */
+typedef struct clusterPipelineEntry {
+    sds cmd;
+    struct redisClusterNode *node;
+    void *reply;
+    int err;
+    sds errstr;
+} clusterPipelineEntry;
+
+struct redisClusterPipeline {
+    clusterPipelineEntry *entries;
+    size_t count;
+    size_t cap;
+    size_t sent; /* Entries before this one were sent, and read back. */
+    size_t next; /* Next entry returned by redisClusterGetReply(). */
+};
+
+static void clusterPipelineFailEntry(clusterPipelineEntry *e, int type, const char *str) {
+    e->err = type;
+    e->errstr = sdsnew(str);
+}
+
+static void clusterPipelineReset(struct redisClusterPipeline *p) {
+    size_t i;
+
+    for (i = 0; i < p->count; i++) {
+        sdsfree(p->entries[i].cmd);
+        sdsfree(p->entries[i].errstr);
+        if (p->entries[i].reply)
+            freeReplyObject(p->entries[i].reply);
+    }
+    p->count = p->sent = p->next = 0;
+}
+
+static void clusterPipelineFree(struct redisClusterPipeline *p) {
+    if (p == NULL)
+        return;
+
+    clusterPipelineReset(p);
+    hi_free(p->entries);
+    hi_free(p);
+}
+
+/* Send the pipelined commands not sent yet, and read back all their replies.
+ *
+ * Commands are split by node: each node's share is appended to its
+ * connection, then all the connections are flushed before any reply is read,
+ * so the nodes work on their sub-pipelines in parallel and each costs a
+ * single round trip. Redirections are followed once every reply is in, as
+ * following them reuses the connections. */
+static void clusterPipelineSend(redisClusterContext *cc) {
+    struct redisClusterPipeline *p = cc->pipeline;
+    size_t i;
+
+    if (cc->needRefresh)
+        redisClusterRefresh(cc);
+
+    /* Route everything first, as routing may reload the slot map through
+     * the same connections. */
+    for (i = p->sent; i < p->count; i++) {
+        clusterPipelineEntry *e = &p->entries[i];
+
+        clusterClearError(cc);
+        if ((e->node = clusterRouteCommand(cc, e->cmd, sdslen(e->cmd))) == NULL)
+            clusterPipelineFailEntry(e, cc->err, cc->errstr);
+    }
+
+    for (i = p->sent; i < p->count; i++) {
+        clusterPipelineEntry *e = &p->entries[i];
+        redisContext *c;
+
+        if (e->node == NULL)
+            continue;
+        if ((c = clusterNodeContext(cc, e->node)) == NULL) {
+            clusterPipelineFailEntry(e, cc->err, cc->errstr);
+            e->node = NULL;
+        } else if (redisAppendFormattedCommand(c, e->cmd, sdslen(e->cmd)) != REDIS_OK) {
+            clusterPipelineFailEntry(e, REDIS_ERR_OOM, "Out of memory");
+            e->node = NULL;
+        }
+    }
+
+    for (i = 0; i < cc->map.count; i++) {
+        redisContext *c = cc->map.nodes[i]->c;
+        int done = 0;
+
+        if (c == NULL || c->err || sdslen(c->obuf) == 0)
+            continue;
+        do {
+            if (redisBufferWrite(c, &done) != REDIS_OK)
+                break;
+        } while (!done);
+    }
+
+    for (i = p->sent; i < p->count; i++) {
+        clusterPipelineEntry *e = &p->entries[i];
+        redisContext *c;
+
+        if (e->node == NULL)
+            continue;
+        c = e->node->c;
+        if (c->err || redisGetReply(c, &e->reply) != REDIS_OK) {
+            clusterPipelineFailEntry(e, c->err, c->errstr);
+            cc->needRefresh = 1;
+        }
+    }
+
+    for (i = p->sent; i < p->count; i++) {
+        clusterPipelineEntry *e = &p->entries[i];
+
+        if (e->reply == NULL)
+            continue;
+        e->reply = clusterExecute(cc, e->node, e->reply, e->cmd, sdslen(e->cmd));
+        if (e->reply == NULL)
+            clusterPipelineFailEntry(e, cc->err, cc->errstr);
+    }
+
+    p->sent = p->count;
+}
+
+int redisClusterAppendFormattedCommand(redisClusterContext *cc, const char *cmd, size_t len) {
+    struct redisClusterPipeline *p = cc->pipeline;
+    clusterPipelineEntry *e;
+
+    if (clusterIsStreamingCommand(cmd, len)) {
+        __clusterSetError(cc, REDIS_ERR_OTHER, "Command not supported in cluster mode");
+        return REDIS_ERR;
+    }
+
+    if (p == NULL) {
+        p = hi_calloc(1, sizeof(*p));
+        if (p == NULL)
+            goto oom;
+        cc->pipeline = p;
+    }
+
+    if (p->count == p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 16;
+        clusterPipelineEntry *entries = hi_realloc(p->entries, cap * sizeof(*entries));
+
+        if (entries == NULL)
+            goto oom;
+        p->entries = entries;
+        p->cap = cap;
+    }
+
+    e = &p->entries[p->count];
+    memset(e, 0, sizeof(*e));
+    if ((e->cmd = sdsnewlen(cmd, len)) == NULL)
+        goto oom;
+    p->count++;
+
+    return REDIS_OK;
+
+oom:
+    __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+    return REDIS_ERR;
+}
+
+int redisvClusterAppendCommand(redisClusterContext *cc, const char *format, va_list ap) {
+    char *cmd;
+    int len;
+    int status;
+
+    len = redisvFormatCommand(&cmd, format, ap);
+    if (len == -1) {
+        __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    } else if (len == -2) {
+        __clusterSetError(cc, REDIS_ERR_OTHER, "Invalid format string");
+        return REDIS_ERR;
+    }
+
+    status = redisClusterAppendFormattedCommand(cc, cmd, len);
+    hi_free(cmd);
+    return status;
+}
+
+int redisClusterAppendCommand(redisClusterContext *cc, const char *format, ...) {
+    va_list ap;
+    int status;
+
+    va_start(ap, format);
+    status = redisvClusterAppendCommand(cc, format, ap);
+    va_end(ap);
+    return status;
+}
+
+int redisClusterAppendCommandArgv(redisClusterContext *cc, int argc, const char **argv, const size_t *argvlen) {
+    sds cmd;
+    long long len;
+    int status;
+
+    len = redisFormatSdsCommandArgv(&cmd, argc, argv, argvlen);
+    if (len == -1) {
+        __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+
+    status = redisClusterAppendFormattedCommand(cc, cmd, len);
+    sdsfree(cmd);
+    return status;
+}
+
+int redisClusterGetReply(redisClusterContext *cc, void **reply) {
+    struct redisClusterPipeline *p = cc->pipeline;
+    clusterPipelineEntry *e;
+
+    if (reply != NULL)
+        *reply = NULL;
+
+    if (p == NULL || p->next == p->count) {
+        __clusterSetError(cc, REDIS_ERR_OTHER, "No pending pipelined replies");
+        return REDIS_ERR;
+    }
+
+    if (p->next == p->sent)
+        clusterPipelineSend(cc);
+
+    clusterClearError(cc);
+    e = &p->entries[p->next++];
+    if (e->err)
+        __clusterSetError(cc, e->err, e->errstr ? e->errstr : "Out of memory");
+    else if (reply != NULL)
+        *reply = e->reply;
+    else
+        freeReplyObject(e->reply);
+    e->reply = NULL;
+
+    if (p->next == p->count)
+        clusterPipelineReset(p);
+
+    return cc->err ? REDIS_ERR : REDIS_OK;
+}
+
+/* Run the commands of a split multi-key command as a pipeline of its own,
+ * and merge their replies. */
+static void *clusterFanoutCommand(redisClusterContext *cc, clusterFanout *f) {
+    struct redisClusterPipeline *saved = cc->pipeline;
+    redisReply **replies;
+    int err = 0;
+    char errstr[128];
+    void *reply;
+    size_t i;
+
+    if ((replies = hi_calloc(f->ncmds, sizeof(*replies))) == NULL) {
+        __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+
+    cc->pipeline = NULL;
+    for (i = 0; i < f->ncmds; i++) {
+        if (redisClusterAppendFormattedCommand(cc, f->cmds[i], sdslen(f->cmds[i])) != REDIS_OK)
+            break;
+    }
+    if (i < f->ncmds) {
+        err = cc->err;
+        memcpy(errstr, cc->errstr, sizeof(errstr));
+    } else {
+        for (i = 0; i < f->ncmds; i++) {
+            if (redisClusterGetReply(cc, (void **)&replies[i]) != REDIS_OK && err == 0) {
+                err = cc->err;
+                memcpy(errstr, cc->errstr, sizeof(errstr));
+            }
+        }
+    }
+    clusterPipelineFree(cc->pipeline);
+    cc->pipeline = saved;
+
+    reply = clusterMergeReplies(f, replies);
+    hi_free(replies);
+
+    if (err) {
+        freeReplyObject(reply);
+        __clusterSetError(cc, err, errstr);
+        return NULL;
+    }
+    if (reply == NULL)
+        __clusterSetError(cc, REDIS_ERR_PROTOCOL, "Unexpected reply to a multi-key command");
+    else
+        clusterClearError(cc);
+    return reply;
+}
+
+void *redisClusterFormattedCommand(redisClusterContext *cc, const char *cmd, size_t len) {
+    struct redisClusterNode *node;
+    clusterFanout f;
+    void *reply;
+
+    clusterClearError(cc);
+
+    if (cc->needRefresh)
+        redisClusterRefresh(cc);
+
+    switch (clusterSplitCommand(cmd, len, &f)) {
+    case 1:
+        reply = clusterFanoutCommand(cc, &f);
+        clusterFanoutFree(&f);
+        return reply;
+    case -1:
+        __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+
+    if ((node = clusterRouteCommand(cc, cmd, len)) == NULL)
+        return NULL;
+
+    return clusterExecute(cc, node, NULL, cmd, len);
+}
+
+void *redisvClusterCommand(redisClusterContext *cc, const char *format, va_list ap) {
+    char *cmd;
+    void *reply;
+    int len;
+
+    len = redisvFormatCommand(&cmd, format, ap);
+    if (len == -1) {
+        __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return NULL;
+    } else if (len == -2) {
+        __clusterSetError(cc, REDIS_ERR_OTHER, "Invalid format string");
+        return NULL;
+    }
+
+    reply = redisClusterFormattedCommand(cc, cmd, len);
+    hi_free(cmd);
+    return reply;
+}
+
+void *redisClusterCommand(redisClusterContext *cc, const char *format, ...) {
+    va_list ap;
+    void *reply;
+
+    va_start(ap, format);
+    reply = redisvClusterCommand(cc, format, ap);
+    va_end(ap);
+    return reply;
+}
+
+void *redisClusterCommandArgv(redisClusterContext *cc, int argc, const char **argv, const size_t *argvlen) {
+    sds cmd;
+    long long len;
+    void *reply;
+
+    len = redisFormatSdsCommandArgv(&cmd, argc, argv, argvlen);
+    if (len == -1) {
+        __clusterSetError(cc, REDIS_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+
+    reply = redisClusterFormattedCommand(cc, cmd, len);
+    sdsfree(cmd);
+    return reply;
+}
+
+void redisClusterFree(redisClusterContext *cc) {
+    if (cc == NULL)
+        return;
+
+    clusterPipelineFree(cc->pipeline);
+    clusterFreeNodes(&cc->map);
+    hi_free(cc);
+}
+
+/* -----------------------------------------------------------------------------
+ * Asynchronous API
+ * -------------------------------------------------------------------------- */
+
+/* A command in flight, kept until its final reply so it can be sent again
+ * when redirected. */
+typedef struct clusterAsyncCommand {
+    redisClusterAsyncContext *acc;
+    redisClusterCallbackFn *fn;
+    void *privdata;
+    sds cmd;
+    int redirects;
+} clusterAsyncCommand;
+
+static void clusterAsyncRelease(redisClusterAsyncContext *acc) {
+    clusterFreeNodes(&acc->map);
+    hi_free(acc);
+}
+
+static void clusterAsyncUnref(redisClusterAsyncContext *acc) {
+    if (--acc->refs == 0)
+        clusterAsyncRelease(acc);
+}
+
+/* dataCleanup of node connections: forget the connection, a new one is made
+ * on the next command for the node. */
+static void clusterAsyncNodeGone(void *privdata) {
+    struct redisClusterNode *node = privdata;
+    redisClusterAsyncContext *acc = node->acc;
+
+    node->ac = NULL;
+    clusterAsyncUnref(acc);
+}
+
+static redisAsyncContext *clusterAsyncNodeContext(redisClusterAsyncContext *acc, struct redisClusterNode *node) {
+    redisOptions options = {0};
+    redisAsyncContext *ac;
+
+    if (node->ac && !(node->ac->c.flags & (REDIS_DISCONNECTING | REDIS_FREEING)))
+        return node->ac;
+    if (node->ac)
+        return NULL;
+
+    REDIS_OPTIONS_SET_TCP(&options, node->host, node->port);
+    options.connect_timeout = acc->options.connect_timeout;
+    options.command_timeout = acc->options.command_timeout;
+
+    ac = redisAsyncConnectWithOptions(&options);
+    if (ac == NULL) {
+        __clusterSetError(acc, REDIS_ERR_OOM, "Out of memory");
+        return NULL;
+    }
+    if (ac->err) {
+        __clusterSetError(acc, ac->err, ac->errstr);
+        redisAsyncFree(ac);
+        return NULL;
+    }
+
+    node->acc = acc;
+    node->ac = ac;
+    ac->data = node;
+    ac->dataCleanup = clusterAsyncNodeGone;
+    acc->refs++;
+
+    if (acc->options.attach_cb &&
+        acc->options.attach_cb(ac, acc->options.attach_privdata) != REDIS_OK)
+    {
+        __clusterSetError(acc, REDIS_ERR_OTHER, "Cluster attach callback failed");
+        redisAsyncFree(ac);
+        return NULL;
+    }
+
+    return ac;
+}
+
+static void clusterAsyncRefreshReply(redisAsyncContext *ac, void *r, void *privdata);
+
+/* Reload the slot map in the background, from the node at hand. */
+static void clusterAsyncRefresh(redisClusterAsyncContext *acc, struct redisClusterNode *node, int shards) {
+    redisAsyncContext *ac;
+    int ret;
+
+    if (acc->freeing || node == NULL || (ac = clusterAsyncNodeContext(acc, node)) == NULL)
+        return;
+
+    ret = shards ? redisAsyncCommand(ac, clusterAsyncRefreshReply, acc, "CLUSTER SHARDS") :
+                   redisAsyncCommand(ac, clusterAsyncRefreshReply, acc, "CLUSTER SLOTS");
+    if (ret == REDIS_OK) {
+        acc->refreshing = shards ? 1 : 2;
+        acc->refs++;
+    }
+}
+
+static void clusterAsyncRefreshReply(redisAsyncContext *ac, void *r, void *privdata) {
+    redisClusterAsyncContext *acc = privdata;
+    struct redisClusterNode *node = ac->data;
+    redisReply *reply = r;
+    int shards = acc->refreshing == 1;
+
+    acc->refreshing = 0;
+    if (reply && !acc->freeing) {
+        if (reply->type == REDIS_REPLY_ERROR && shards)
+            clusterAsyncRefresh(acc, node, 0);
+        else if (reply->type != REDIS_REPLY_ERROR)
+            clusterApplyMap(&acc->map, reply, shards, node);
+    }
+    clusterAsyncUnref(acc);
+}
+
+static void clusterAsyncReply(redisAsyncContext *ac, void *r, void *privdata);
+
+static int clusterAsyncSend(redisClusterAsyncContext *acc, struct redisClusterNode *node,
+                            clusterAsyncCommand *cmd, int asking)
+{
+    redisAsyncContext *ac = clusterAsyncNodeContext(acc, node);
+
+    if (ac == NULL)
+        return REDIS_ERR;
+    if (asking && redisAsyncCommand(ac, NULL, NULL, "ASKING") != REDIS_OK)
+        return REDIS_ERR;
+    return redisAsyncFormattedCommand(ac, clusterAsyncReply, cmd, cmd->cmd, sdslen(cmd->cmd));
+}
+
+static void clusterAsyncReply(redisAsyncContext *ac, void *r, void *privdata) {
+    clusterAsyncCommand *cmd = privdata;
+    redisClusterAsyncContext *acc = cmd->acc;
+    const char *host;
+    size_t hostlen;
+    unsigned int slot;
+    int port, kind;
+
+    kind = clusterParseRedirect(r, &slot, &host, &hostlen, &port);
+    if (kind && !acc->freeing && cmd->redirects < acc->options.max_redirects) {
+        struct redisClusterNode *node = clusterGetNode(&acc->map, host, hostlen, port);
+
+        if (node) {
+            if (kind == 1) {
+                acc->map.slots[slot] = node;
+                if (!acc->refreshing)
+                    clusterAsyncRefresh(acc, node, 1);
+            }
+            cmd->redirects++;
+            if (clusterAsyncSend(acc, node, cmd, kind == 2) == REDIS_OK)
+                return;
+        }
+    }
+    (void)ac;
+
+    if (cmd->fn)
+        cmd->fn(acc, r, cmd->privdata);
+    sdsfree(cmd->cmd);
+    hi_free(cmd);
+    clusterAsyncUnref(acc);
+}
+
+redisClusterAsyncContext *redisClusterAsyncConnectWithOptions(const redisClusterOptions *options) {
+    redisClusterAsyncContext *acc;
+    redisClusterContext *cc;
+
+    acc = hi_calloc(1, sizeof(*acc));
+    if (acc == NULL)
+        return NULL;
+
+    /* Held until redisClusterAsyncFree(). */
+    acc->refs = 1;
+    clusterCopyOptions(&acc->options, &acc->connect_timeout, &acc->command_timeout, options);
+
+    /* Load the initial map with a blocking client, and take over its nodes. */
+    cc = redisClusterConnectWithOptions(options);
+    if (cc == NULL) {
+        __clusterSetError(acc, REDIS_ERR_OOM, "Out of memory");
+        return acc;
+    }
+    if (cc->err)
+        __clusterSetError(acc, cc->err, cc->errstr);
+
+    acc->map = cc->map;
+    memset(&cc->map, 0, sizeof(cc->map));
+    redisClusterFree(cc);
+
+    /* Blocking connections were only needed for the initial map. */
+    {
+        size_t i;
+        for (i = 0; i < acc->map.count; i++) {
+            redisFree(acc->map.nodes[i]->c);
+            acc->map.nodes[i]->c = NULL;
+        }
+    }
+
+    return acc;
+}
+
+/* A split multi-key command, waiting for the replies of its parts. */
+typedef struct clusterAsyncFanout {
+    clusterFanout f;
+    redisClusterCallbackFn *fn;
+    void *privdata;
+    redisReply **replies;
+    size_t pending;
+    int failed;
+} clusterAsyncFanout;
+
+typedef struct clusterAsyncPart {
+    clusterAsyncFanout *fanout;
+    size_t idx;
+} clusterAsyncPart;
+
+static void clusterAsyncFanoutFree(clusterAsyncFanout *fo, clusterAsyncPart *parts) {
+    clusterFanoutFree(&fo->f);
+    hi_free(fo->replies);
+    hi_free(parts);
+    hi_free(fo);
+}
+
+static void clusterAsyncPartReply(redisClusterAsyncContext *acc, void *r, void *privdata) {
+    clusterAsyncPart *part = privdata;
+    clusterAsyncFanout *fo = part->fanout;
+    redisReply *reply = NULL;
+    size_t i;
+
+    if (r == NULL || (fo->replies[part->idx] = redisTakeReply(r)) == NULL)
+        fo->failed = 1;
+
+    if (--fo->pending > 0)
+        return;
+
+    /* The parts are laid out after one another, starting at index 0. */
+    part -= part->idx;
+
+    if (!fo->failed)
+        reply = clusterMergeReplies(&fo->f, fo->replies);
+    for (i = 0; i < fo->f.ncmds; i++)
+        freeReplyObject(fo->replies[i]);
+    if (fo->fn)
+        fo->fn(acc, reply, fo->privdata);
+    freeReplyObject(reply);
+    clusterAsyncFanoutFree(fo, part);
+}
+
+/* Send the parts of a split multi-key command. Their replies are merged
+ * once all are in; if any part is lost, the callback gets a NULL reply. */
+static int clusterAsyncFanoutCommand(redisClusterAsyncContext *acc, clusterFanout *f,
+                                     redisClusterCallbackFn *fn, void *privdata)
+{
+    clusterAsyncFanout *fo;
+    clusterAsyncPart *parts;
+    size_t i;
+
+    fo = hi_calloc(1, sizeof(*fo));
+    parts = hi_calloc(f->ncmds, sizeof(*parts));
+    if (fo == NULL || parts == NULL ||
+        (fo->replies = hi_calloc(f->ncmds, sizeof(*fo->replies))) == NULL)
+    {
+        hi_free(fo);
+        hi_free(parts);
+        clusterFanoutFree(f);
+        __clusterSetError(acc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+    fo->f = *f;
+    fo->fn = fn;
+    fo->privdata = privdata;
+
+    /* Count every part as pending until all are sent, so replies coming
+     * in meanwhile (e.g. a failed connection) can't complete the command. */
+    fo->pending = f->ncmds + 1;
+    for (i = 0; i < f->ncmds; i++) {
+        parts[i].fanout = fo;
+        parts[i].idx = i;
+        if (redisClusterAsyncFormattedCommand(acc, clusterAsyncPartReply, &parts[i],
+                                              f->cmds[i], sdslen(f->cmds[i])) != REDIS_OK)
+        {
+            fo->failed = 1;
+            fo->pending--;
+        }
+    }
+
+    /* Nothing sent: fail the call rather than the callback. */
+    if (fo->pending == 1) {
+        clusterAsyncFanoutFree(fo, parts);
+        return REDIS_ERR;
+    }
+
+    fo->pending--;
+    return REDIS_OK;
+}
+
+int redisClusterAsyncFormattedCommand(redisClusterAsyncContext *acc, redisClusterCallbackFn *fn, void *privdata, const char *cmd, size_t len) {
+    struct redisClusterNode *node;
+    clusterFanout f;
+    clusterAsyncCommand *acmd;
+    int slot;
+
+    if (acc->freeing || clusterIsStreamingCommand(cmd, len))
+        return REDIS_ERR;
+
+    switch (clusterSplitCommand(cmd, len, &f)) {
+    case 1:
+        return clusterAsyncFanoutCommand(acc, &f, fn, privdata);
+    case -1:
+        __clusterSetError(acc, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+
+    if ((slot = clusterCommandSlot(cmd, len)) == -2)
+        return REDIS_ERR;
+
+    node = slot >= 0 ? acc->map.slots[slot] : clusterAnyNode(&acc->map);
+    if (node == NULL) {
+        __clusterSetError(acc, REDIS_ERR_OTHER, "Slot not served by any node");
+        if (!acc->refreshing)
+            clusterAsyncRefresh(acc, clusterAnyNode(&acc->map), 1);
+        return REDIS_ERR;
+    }
+
+    acmd = hi_calloc(1, sizeof(*acmd));
+    if (acmd == NULL)
+        return REDIS_ERR;
+    acmd->cmd = sdsnewlen(cmd, len);
+    if (acmd->cmd == NULL) {
+        hi_free(acmd);
+        return REDIS_ERR;
+    }
+    acmd->acc = acc;
+    acmd->fn = fn;
+    acmd->privdata = privdata;
+
+    if (clusterAsyncSend(acc, node, acmd, 0) != REDIS_OK) {
+        sdsfree(acmd->cmd);
+        hi_free(acmd);
+        return REDIS_ERR;
+    }
+
+    acc->refs++;
+    return REDIS_OK;
+}
+
+int redisvClusterAsyncCommand(redisClusterAsyncContext *acc, redisClusterCallbackFn *fn, void *privdata, const char *format, va_list ap) {
+    char *cmd;
+    int len;
+    int status;
+
+    len = redisvFormatCommand(&cmd, format, ap);
+    if (len < 0)
+        return REDIS_ERR;
+
+    status = redisClusterAsyncFormattedCommand(acc, fn, privdata, cmd, len);
+    hi_free(cmd);
+    return status;
+}
+
+int redisClusterAsyncCommand(redisClusterAsyncContext *acc, redisClusterCallbackFn *fn, void *privdata, const char *format, ...) {
+    va_list ap;
+    int status;
+
+    va_start(ap, format);
+    status = redisvClusterAsyncCommand(acc, fn, privdata, format, ap);
+    va_end(ap);
+    return status;
+}
+
+int redisClusterAsyncCommandArgv(redisClusterAsyncContext *acc, redisClusterCallbackFn *fn, void *privdata, int argc, const char **argv, const size_t *argvlen) {
+    sds cmd;
+    long long len;
+    int status;
+
+    len = redisFormatSdsCommandArgv(&cmd, argc, argv, argvlen);
+    if (len < 0)
+        return REDIS_ERR;
+
+    status = redisClusterAsyncFormattedCommand(acc, fn, privdata, cmd, len);
+    sdsfree(cmd);
+    return status;
+}
+
+void redisClusterAsyncFree(redisClusterAsyncContext *acc) {
+    size_t i;
+
+    if (acc == NULL || acc->freeing)
+        return;
+
+    acc->freeing = 1;
+    for (i = 0; i < acc->map.count; i++) {
+        if (acc->map.nodes[i]->ac)
+            redisAsyncFree(acc->map.nodes[i]->ac);
+    }
+
+    clusterAsyncUnref(acc);
+}
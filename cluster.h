@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __HIREDIS_CLUSTER_H
+#define __HIREDIS_CLUSTER_H
+#include "hiredis.h"
+#include "async.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REDIS_CLUSTER_SLOTS 16384
+
+/* Default number of MOVED/ASK redirections followed for a single command. */
+#define REDIS_CLUSTER_MAX_REDIRECTS 5
+
+/* Return the hash slot of a key. When the key contains a non-empty hash tag
+ * ("{...}"), only the tag is hashed. */
+unsigned int redisClusterKeySlot(const char *key, size_t keylen);
+
+struct redisClusterNode; /* opaque */
+
+/* Called on every blocking connection opened to a node, to set it up before
+ * use (e.g. redisInitiateSSLWithContext() or AUTH). Return REDIS_OK on
+ * success. */
+typedef int (redisClusterConnectFn)(redisContext *c, void *privdata);
+
+/* Called on every asynchronous connection opened to a node, to attach it to
+ * an event loop and set it up (e.g. redisLibeventAttach(), then
+ * redisInitiateSSLWithContext() or AUTH). Return REDIS_OK on success. */
+typedef int (redisClusterAttachFn)(redisAsyncContext *ac, void *privdata);
+
+typedef struct redisClusterOptions {
+    /* Addresses of nodes to load the slot map from, as "host:port". IPv6
+     * addresses may be enclosed in brackets. */
+    const char **seeds;
+    int nseeds;
+
+    /* Timeouts used for every node connection. If NULL, none is used. */
+    const struct timeval *connect_timeout;
+    const struct timeval *command_timeout;
+
+    /* Maximum number of MOVED/ASK redirections followed for a command, 0 for
+     * REDIS_CLUSTER_MAX_REDIRECTS. */
+    int max_redirects;
+
+    /* Connection setup for redisClusterContext. */
+    redisClusterConnectFn *connect_cb;
+    void *connect_privdata;
+
+    /* Connection setup for redisClusterAsyncContext, where it is required to
+     * attach the connections to an event loop. */
+    redisClusterAttachFn *attach_cb;
+    void *attach_privdata;
+} redisClusterOptions;
+
+/* Slot to node mapping and node connections, shared by both client kinds. */
+typedef struct redisClusterNodes {
+    struct redisClusterNode **nodes;
+    size_t count;
+    struct redisClusterNode *slots[REDIS_CLUSTER_SLOTS];
+} redisClusterNodes;
+
+/* Blocking cluster client. Like redisContext, err and errstr describe the
+ * last error. */
+typedef struct redisClusterContext {
+    int err;
+    char errstr[128];
+
+    redisClusterOptions options;
+    struct timeval connect_timeout;
+    struct timeval command_timeout;
+    redisClusterNodes map;
+
+    /* Set when a redirection showed the slot map is outdated. */
+    int needRefresh;
+
+    /* Commands appended with redisClusterAppendCommand(), and the replies
+     * not yet returned by redisClusterGetReply(). */
+    struct redisClusterPipeline *pipeline;
+} redisClusterContext;
+
+/* Connect to the cluster and load its slot map. Like redisConnect(), the
+ * returned context must be checked for an error with its err field. */
+redisClusterContext *redisClusterConnectWithOptions(const redisClusterOptions *options);
+/* Same as redisClusterConnectWithOptions() with default options, and seeds
+ * given as a comma separated list of "host:port". */
+redisClusterContext *redisClusterConnect(const char *seeds);
+
+/* Reload the slot map from the cluster. Done automatically when redirects
+ * show the map is outdated. */
+int redisClusterRefresh(redisClusterContext *cc);
+
+/* Send a command to the node owning the slot of its key and return its
+ * reply, following MOVED and ASK redirections. Commands without a key are
+ * sent to any node; SUBSCRIBE-like commands and MONITOR are not supported.
+ * A MGET, MSET, DEL, EXISTS, UNLINK or TOUCH with keys in several slots is
+ * split into one command per slot, run as a pipeline, and the replies are
+ * merged into the one the command would get from a single node. Returns
+ * NULL on error, with err and errstr set. */
+void *redisvClusterCommand(redisClusterContext *cc, const char *format, va_list ap);
+void *redisClusterCommand(redisClusterContext *cc, const char *format, ...);
+void *redisClusterCommandArgv(redisClusterContext *cc, int argc, const char **argv, const size_t *argvlen);
+void *redisClusterFormattedCommand(redisClusterContext *cc, const char *cmd, size_t len);
+
+/* Pipelining. Appended commands are buffered until the first call to
+ * redisClusterGetReply(), which splits them by node, sends every node its
+ * share at once and reads all the replies back; replies are then returned
+ * in the order the commands were appended. A redirected command is sent
+ * again once the whole pipeline has been read, so it runs after the
+ * commands that followed it on its new node.
+ *
+ * redisClusterGetReply() returns REDIS_ERR, with err and errstr set, for a
+ * command that could not be sent or whose node failed; the replies of the
+ * other commands are still returned by the following calls. */
+int redisvClusterAppendCommand(redisClusterContext *cc, const char *format, va_list ap);
+int redisClusterAppendCommand(redisClusterContext *cc, const char *format, ...);
+int redisClusterAppendCommandArgv(redisClusterContext *cc, int argc, const char **argv, const size_t *argvlen);
+int redisClusterAppendFormattedCommand(redisClusterContext *cc, const char *cmd, size_t len);
+int redisClusterGetReply(redisClusterContext *cc, void **reply);
+
+/* Return the connection to the node serving a slot, connecting to it if
+ * needed, or NULL if the slot is not served or on error. The connection is
+ * owned by the cluster context. */
+redisContext *redisClusterGetContext(redisClusterContext *cc, unsigned int slot);
+
+void redisClusterFree(redisClusterContext *cc);
+
+struct redisClusterAsyncContext;
+
+/* Reply callback prototype for redisClusterAsyncContext. The reply is NULL
+ * when the connection it was sent on is lost, or the cluster context is
+ * freed. */
+typedef void (redisClusterCallbackFn)(struct redisClusterAsyncContext *acc, void *reply, void *privdata);
+
+/* Asynchronous cluster client. */
+typedef struct redisClusterAsyncContext {
+    int err;
+    char errstr[128];
+
+    redisClusterOptions options;
+    struct timeval connect_timeout;
+    struct timeval command_timeout;
+    redisClusterNodes map;
+
+    /* A slot map refresh is in progress. */
+    int refreshing;
+
+    /* Set by redisClusterAsyncFree(). The context itself is released once
+     * the last of its connections is gone. */
+    int freeing;
+    int refs;
+
+    /* Not used by hiredis */
+    void *data;
+} redisClusterAsyncContext;
+
+/* Create an asynchronous cluster client. The initial slot map is loaded
+ * with blocking connections, so the client can route commands right away;
+ * later refreshes are asynchronous. Check the err field for errors. */
+redisClusterAsyncContext *redisClusterAsyncConnectWithOptions(const redisClusterOptions *options);
+
+/* Send a command to the node owning the slot of its key, following MOVED and
+ * ASK redirections. SUBSCRIBE-like commands and MONITOR are not supported.
+ * Multi-key commands are split by slot as with redisClusterCommand(), the
+ * parts running concurrently; the callback gets the merged reply, or NULL if
+ * any part was lost. */
+int redisvClusterAsyncCommand(redisClusterAsyncContext *acc, redisClusterCallbackFn *fn, void *privdata, const char *format, va_list ap);
+int redisClusterAsyncCommand(redisClusterAsyncContext *acc, redisClusterCallbackFn *fn, void *privdata, const char *format, ...);
+int redisClusterAsyncCommandArgv(redisClusterAsyncContext *acc, redisClusterCallbackFn *fn, void *privdata, int argc, const char **argv, const size_t *argvlen);
+int redisClusterAsyncFormattedCommand(redisClusterAsyncContext *acc, redisClusterCallbackFn *fn, void *privdata, const char *cmd, size_t len);
+
+/* Close all connections, calling the callbacks of pending commands with a
+ * NULL reply, and free the context. May be called from a callback. */
+void redisClusterAsyncFree(redisClusterAsyncContext *acc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,9 +1,10 @@
 /* Hash table implementation.
  *
- * This file implements in memory hash tables with insert/del/replace/find/
- * get-random-element operations. Hash tables will auto resize if needed
- * tables of power of two in size are used, collisions are handled by
- * chaining. See the source code for more information... :)
+ * This file implements in memory hash tables with insert/del/replace/find
+ * operations, keyed by byte strings. Tables are a power of two in size and
+ * use open addressing with linear probing; they grow incrementally, moving a
+ * few slots on every insertion rather than all of them at once. See the
+ * source code for more information... :)
  *
  * Copyright (c) 2006-2010, Salvatore Sanfilippo <antirez at gmail dot com>
  * All rights reserved.
@@ -36,38 +37,111 @@
 #include "fmacros.h"
 #include "alloc.h"
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <limits.h>
 #include "dict.h"
 
+/* The key of deleted slots, which lookups probe past. */
+static char dictDeletedKey;
+#define DICT_DELETED ((void *)&dictDeletedKey)
+
+#define dictIsFree(he) ((he)->key == NULL || (he)->key == DICT_DELETED)
+
 /* -------------------------- private prototypes ---------------------------- */
 
 static int _dictExpandIfNeeded(dict *ht);
 static unsigned long _dictNextPower(unsigned long size);
-static int _dictKeyIndex(dict *ht, const void *key);
-static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
+static void _dictRehashStep(dict *ht, unsigned long slots);
+static void _dictRehashStepIfNeeded(dict *ht);
+static void _dictInit(dict *ht, dictType *type, void *privDataPtr);
 
 /* -------------------------- hash functions -------------------------------- */
 
-/* Generic hash function (a popular one from Bernstein).
- * I tested a few and this was the best. */
-static unsigned int dictGenHashFunction(const unsigned char *buf, int len) {
-    unsigned int hash = 5381;
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 dictUint128;
+#endif
+
+/* Multiply a and b, and fold the 128 bit product into 64 bits. */
+static uint64_t _dictMix(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    dictUint128 r = (dictUint128)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = (uint32_t)a, hb = b >> 32, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), lo, hi, c = t < rl;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+static uint64_t _dictRead64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t _dictRead32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
 
-    while (len--)
-        hash = ((hash << 5) + hash) + (*buf++); /* hash * 33 + c */
-    return hash;
+/* Hash function for byte strings, after wyhash: the input is read 8 bytes at
+ * a time (or 4, or 1, for short strings) and mixed with 64 bit multiplies. */
+static uint64_t dictGenHashFunction(const void *buf, size_t len) {
+    static const uint64_t s0 = 0xa0761d6478bd642fULL, s1 = 0xe7037ed1a0b428dbULL,
+                          s2 = 0x8ebc6af09c88c6e3ULL;
+    const unsigned char *p = buf;
+    uint64_t seed = s0, a, b;
+    size_t n = len;
+
+    if (n <= 16) {
+        if (n >= 4) {
+            a = (_dictRead32(p) << 32) | _dictRead32(p + ((n >> 3) << 2));
+            b = (_dictRead32(p + n - 4) << 32) | _dictRead32(p + n - 4 - ((n >> 3) << 2));
+        } else if (n > 0) {
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[n >> 1] << 8) | p[n - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        while (n > 16) {
+            seed = _dictMix(_dictRead64(p) ^ s1, _dictRead64(p + 8) ^ seed);
+            p += 16;
+            n -= 16;
+        }
+        /* The last 16 bytes, overlapping with those already mixed. */
+        a = _dictRead64(p + n - 16);
+        b = _dictRead64(p + n - 8);
+    }
+    return _dictMix(s1 ^ len, _dictMix(a ^ s1, b ^ seed) ^ s2);
 }
 
 /* ----------------------------- API implementation ------------------------- */
 
-/* Reset an hashtable already initialized with ht_init().
- * NOTE: This function should only called by ht_destroy(). */
-static void _dictReset(dict *ht) {
-    ht->table = NULL;
-    ht->size = 0;
-    ht->sizemask = 0;
-    ht->used = 0;
+static void _dictTableReset(dictTable *t) {
+    t->table = NULL;
+    t->size = 0;
+    t->sizemask = 0;
+    t->used = 0;
+    t->filled = 0;
+}
+
+static int _dictTableCreate(dictTable *t, unsigned long size) {
+    t->table = hi_calloc(size,sizeof(dictEntry));
+    if (t->table == NULL)
+        return DICT_ERR;
+    t->size = size;
+    t->sizemask = size-1;
+    t->used = 0;
+    t->filled = 0;
+    return DICT_OK;
 }
 
 /* Create a new hash table */
@@ -81,85 +155,83 @@ static dict *dictCreate(dictType *type, void *privDataPtr) {
 }
 
 /* Initialize the hash table */
-static int _dictInit(dict *ht, dictType *type, void *privDataPtr) {
-    _dictReset(ht);
+static void _dictInit(dict *ht, dictType *type, void *privDataPtr) {
+    _dictTableReset(&ht->ht[0]);
+    _dictTableReset(&ht->ht[1]);
+    ht->rehashidx = -1;
+    ht->iterators = 0;
     ht->type = type;
     ht->privdata = privDataPtr;
-    return DICT_OK;
 }
 
-/* Expand or create the hashtable */
-static int dictExpand(dict *ht, unsigned long size) {
-    dict n; /* the new hashtable */
-    unsigned long realsize = _dictNextPower(size), i;
+/* Find the entry of a key in one of the tables, along with its table. */
+static dictEntry *_dictTableFind(dict *ht, dictTable *t, uint64_t hash,
+                                 const void *buf, size_t len)
+{
+    unsigned long i;
+    dictEntry *he;
 
-    /* the size is invalid if it is smaller than the number of
-     * elements already inside the hashtable */
-    if (ht->used > size)
-        return DICT_ERR;
+    if (t->size == 0)
+        return NULL;
 
-    _dictInit(&n, ht->type, ht->privdata);
-    n.size = realsize;
-    n.sizemask = realsize-1;
-    n.table = hi_calloc(realsize,sizeof(dictEntry*));
-    if (n.table == NULL)
-        return DICT_ERR;
+    /* The tables always have free slots, which end the probing. */
+    for (i = hash & t->sizemask; ; i = (i+1) & t->sizemask) {
+        he = &t->table[i];
+        if (he->key == NULL)
+            return NULL;
+        if (he->key != DICT_DELETED && he->hash == hash &&
+            dictKeyLength(ht, he->key) == len && memcmp(he->key, buf, len) == 0)
+            return he;
+    }
+}
+
+static dictEntry *_dictFind(dict *ht, uint64_t hash, const void *buf, size_t len,
+                            dictTable **table)
+{
+    dictEntry *he;
+    int i;
 
-    /* Copy all the elements from the old to the new table:
-     * note that if the old hash table is empty ht->size is zero,
-     * so dictExpand just creates an hash table. */
-    n.used = ht->used;
-    for (i = 0; i < ht->size && ht->used > 0; i++) {
-        dictEntry *he, *nextHe;
-
-        if (ht->table[i] == NULL) continue;
-
-        /* For each hash entry on this slot... */
-        he = ht->table[i];
-        while(he) {
-            unsigned int h;
-
-            nextHe = he->next;
-            /* Get the new element index */
-            h = dictHashKey(ht, he->key) & n.sizemask;
-            he->next = n.table[h];
-            n.table[h] = he;
-            ht->used--;
-            /* Pass to the next element */
-            he = nextHe;
+    for (i = 0; i <= dictIsRehashing(ht); i++) {
+        if ((he = _dictTableFind(ht, &ht->ht[i], hash, buf, len)) != NULL) {
+            if (table) *table = &ht->ht[i];
+            return he;
         }
     }
-    assert(ht->used == 0);
-    hi_free(ht->table);
+    return NULL;
+}
 
-    /* Remap the new hashtable in the old */
-    *ht = n;
-    return DICT_OK;
+/* Take the first free slot on the probe path of a hash. The key must not be
+ * in the table already. */
+static dictEntry *_dictTableInsert(dictTable *t, uint64_t hash) {
+    unsigned long i = hash & t->sizemask;
+    dictEntry *he;
+
+    while (!dictIsFree(&t->table[i]))
+        i = (i+1) & t->sizemask;
+
+    he = &t->table[i];
+    if (he->key == NULL)
+        t->filled++;
+    t->used++;
+    he->hash = hash;
+    return he;
 }
 
-/* Add an element to the target hash table */
-static int dictAdd(dict *ht, void *key, void *val) {
-    int index;
-    dictEntry *entry;
+/* Make a slot for a new key, or return NULL with *existing set if the key is
+ * already there, or NULL alone when out of memory. */
+static dictEntry *_dictAddRaw(dict *ht, const void *key, dictEntry **existing) {
+    size_t len = dictKeyLength(ht, key);
+    uint64_t hash = dictGenHashFunction(key, len);
 
-    /* Get the index of the new element, or -1 if
-     * the element already exists. */
-    if ((index = _dictKeyIndex(ht, key)) == -1)
-        return DICT_ERR;
+    _dictRehashStepIfNeeded(ht);
 
-    /* Allocates the memory and stores key */
-    entry = hi_malloc(sizeof(*entry));
-    if (entry == NULL)
-        return DICT_ERR;
+    if ((*existing = _dictFind(ht, hash, key, len, NULL)) != NULL)
+        return NULL;
 
-    entry->next = ht->table[index];
-    ht->table[index] = entry;
+    if (_dictExpandIfNeeded(ht) == DICT_ERR)
+        return NULL;
 
-    /* Set the hash entry fields. */
-    dictSetHashKey(ht, entry, key);
-    dictSetHashVal(ht, entry, val);
-    ht->used++;
-    return DICT_OK;
+    return _dictTableInsert(&ht->ht[dictIsRehashing(ht) ? 1 : 0], hash);
 }
 
 /* Add an element, discarding the old if the key already exists.
@@ -167,143 +239,178 @@ static int dictAdd(dict *ht, void *key, void *val) {
  * element with such key and dictReplace() just performed a value update
  * operation. */
 static int dictReplace(dict *ht, void *key, void *val) {
-    dictEntry *entry, auxentry;
+    dictEntry *entry, *existing, auxentry;
 
     /* Try to add the element. If the key
-     * does not exists dictAdd will succeed. */
-    if (dictAdd(ht, key, val) == DICT_OK)
+     * does not exists this will succeed. */
+    if ((entry = _dictAddRaw(ht, key, &existing)) != NULL) {
+        dictSetHashKey(ht, entry, key);
+        dictSetHashVal(ht, entry, val);
         return 1;
-    /* It already exists, get the entry */
-    entry = dictFind(ht, key);
-    if (entry == NULL)
+    }
+    if (existing == NULL)
         return 0;
 
-    /* Free the old value and set the new one */
     /* Set the new value and free the old one. Note that it is important
      * to do that in this order, as the value may just be exactly the same
      * as the previous one. In this context, think to reference counting,
      * you want to increment (set), and then decrement (free), and not the
      * reverse. */
-    auxentry = *entry;
-    dictSetHashVal(ht, entry, val);
+    auxentry = *existing;
+    dictSetHashVal(ht, existing, val);
     dictFreeEntryVal(ht, &auxentry);
     return 0;
 }
 
 /* Search and remove an element */
-static int dictDelete(dict *ht, const void *key) {
-    unsigned int h;
-    dictEntry *de, *prevde;
+static int dictDeleteBuf(dict *ht, const void *buf, size_t len) {
+    dictTable *t;
+    dictEntry *he;
+    unsigned long i;
 
-    if (ht->size == 0)
-        return DICT_ERR;
-    h = dictHashKey(ht, key) & ht->sizemask;
-    de = ht->table[h];
-
-    prevde = NULL;
-    while(de) {
-        if (dictCompareHashKeys(ht,key,de->key)) {
-            /* Unlink the element from the list */
-            if (prevde)
-                prevde->next = de->next;
-            else
-                ht->table[h] = de->next;
-
-            dictFreeEntryKey(ht,de);
-            dictFreeEntryVal(ht,de);
-            hi_free(de);
-            ht->used--;
-            return DICT_OK;
-        }
-        prevde = de;
-        de = de->next;
+    _dictRehashStepIfNeeded(ht);
+
+    he = _dictFind(ht, dictGenHashFunction(buf, len), buf, len, &t);
+    if (he == NULL)
+        return DICT_ERR; /* not found */
+
+    dictFreeEntryKey(ht, he);
+    dictFreeEntryVal(ht, he);
+    he->key = DICT_DELETED;
+    t->used--;
+
+    /* Deleted slots followed by an empty one are on no probe path anymore:
+     * empty them too, so they don't count towards growing. */
+    i = he - t->table;
+    while (t->table[i].key == DICT_DELETED &&
+           t->table[(i+1) & t->sizemask].key == NULL)
+    {
+        t->table[i].key = NULL;
+        t->filled--;
+        i = (i-1) & t->sizemask;
     }
-    return DICT_ERR; /* not found */
+    return DICT_OK;
+}
+
+static int dictDelete(dict *ht, const void *key) {
+    return dictDeleteBuf(ht, key, dictKeyLength(ht, key));
 }
 
 /* Destroy an entire hash table */
-static int _dictClear(dict *ht) {
+static void _dictClear(dict *ht, dictTable *t) {
     unsigned long i;
 
     /* Free all the elements */
-    for (i = 0; i < ht->size && ht->used > 0; i++) {
-        dictEntry *he, *nextHe;
-
-        if ((he = ht->table[i]) == NULL) continue;
-        while(he) {
-            nextHe = he->next;
-            dictFreeEntryKey(ht, he);
-            dictFreeEntryVal(ht, he);
-            hi_free(he);
-            ht->used--;
-            he = nextHe;
-        }
+    for (i = 0; i < t->size && t->used > 0; i++) {
+        dictEntry *he = &t->table[i];
+
+        if (dictIsFree(he)) continue;
+        dictFreeEntryKey(ht, he);
+        dictFreeEntryVal(ht, he);
+        t->used--;
     }
     /* Free the table and the allocated cache structure */
-    hi_free(ht->table);
+    hi_free(t->table);
     /* Re-initialize the table */
-    _dictReset(ht);
-    return DICT_OK; /* never fails */
+    _dictTableReset(t);
 }
 
 /* Clear & Release the hash table */
 static void dictRelease(dict *ht) {
-    _dictClear(ht);
+    _dictClear(ht, &ht->ht[0]);
+    _dictClear(ht, &ht->ht[1]);
     hi_free(ht);
 }
 
-static dictEntry *dictFind(dict *ht, const void *key) {
-    dictEntry *he;
-    unsigned int h;
-
-    if (ht->size == 0) return NULL;
-    h = dictHashKey(ht, key) & ht->sizemask;
-    he = ht->table[h];
-    while(he) {
-        if (dictCompareHashKeys(ht, key, he->key))
-            return he;
-        he = he->next;
-    }
-    return NULL;
+static dictEntry *dictFindBuf(dict *ht, const void *buf, size_t len) {
+    _dictRehashStepIfNeeded(ht);
+    return _dictFind(ht, dictGenHashFunction(buf, len), buf, len, NULL);
 }
 
 static void dictInitIterator(dictIterator *iter, dict *ht) {
     iter->ht = ht;
+    iter->table = 0;
     iter->index = -1;
-    iter->entry = NULL;
-    iter->nextEntry = NULL;
+    ht->iterators++;
+}
+
+static void dictReleaseIterator(dictIterator *iter) {
+    iter->ht->iterators--;
 }
 
 static dictEntry *dictNext(dictIterator *iter) {
-    while (1) {
-        if (iter->entry == NULL) {
-            iter->index++;
-            if (iter->index >=
-                    (signed)iter->ht->size) break;
-            iter->entry = iter->ht->table[iter->index];
-        } else {
-            iter->entry = iter->nextEntry;
-        }
-        if (iter->entry) {
-            /* We need to save the 'next' here, the iterator user
-             * may delete the entry we are returning. */
-            iter->nextEntry = iter->entry->next;
-            return iter->entry;
+    dictTable *t;
+    dictEntry *he;
+
+    while (iter->table < 2) {
+        t = &iter->ht->ht[iter->table];
+        while (++iter->index < (long)t->size) {
+            he = &t->table[iter->index];
+            if (!dictIsFree(he))
+                return he;
         }
+        iter->table++;
+        iter->index = -1;
     }
     return NULL;
 }
 
 /* ------------------------- private functions ------------------------------ */
 
-/* Expand the hash table if needed */
+/* Move the entries of up to 'slots' slots of the old table to the new one,
+ * and switch to the new table once all are moved. Moved slots are marked
+ * deleted rather than emptied, as they may be on the probe path of entries
+ * that are not moved yet. */
+static void _dictRehashStep(dict *ht, unsigned long slots) {
+    dictTable *from = &ht->ht[0], *to = &ht->ht[1];
+    dictEntry *he, *moved;
+
+    while (slots-- > 0 && (unsigned long)ht->rehashidx < from->size) {
+        he = &from->table[ht->rehashidx++];
+        if (dictIsFree(he)) continue;
+
+        moved = _dictTableInsert(to, he->hash);
+        moved->key = he->key;
+        moved->val = he->val;
+        he->key = DICT_DELETED;
+        from->used--;
+    }
+
+    if ((unsigned long)ht->rehashidx == from->size) {
+        assert(from->used == 0);
+        hi_free(from->table);
+        *from = *to;
+        _dictTableReset(to);
+        ht->rehashidx = -1;
+    }
+}
+
+/* Move a few slots while growing, unless iterators are live: moving entries
+ * from under them would make them skip some and return others twice. */
+static void _dictRehashStepIfNeeded(dict *ht) {
+    if (dictIsRehashing(ht) && ht->iterators == 0)
+        _dictRehashStep(ht, DICT_REHASH_STEP);
+}
+
+/* Start growing when the table would be more than 3/4 full, counting deleted
+ * slots. The new table is sized for twice the entries, and at least half the
+ * old size: as every insertion moves DICT_REHASH_STEP slots, it can't get
+ * full itself before all entries are moved. */
 static int _dictExpandIfNeeded(dict *ht) {
-    /* If the hash table is empty expand it to the initial size,
-     * if the table is "full" double its size. */
-    if (ht->size == 0)
-        return dictExpand(ht, DICT_HT_INITIAL_SIZE);
-    if (ht->used == ht->size)
-        return dictExpand(ht, ht->size*2);
+    dictTable *t = &ht->ht[0];
+    unsigned long size;
+
+    if (t->size == 0)
+        return _dictTableCreate(t, DICT_HT_INITIAL_SIZE);
+    if (dictIsRehashing(ht) || (t->filled+1)*4 <= t->size*3)
+        return DICT_OK;
+
+    size = _dictNextPower((t->used+1)*2);
+    if (size < t->size/2)
+        size = t->size/2;
+    if (_dictTableCreate(&ht->ht[1], size) == DICT_ERR)
+        return DICT_ERR;
+    ht->rehashidx = 0;
     return DICT_OK;
 }
 
@@ -318,26 +425,3 @@ static unsigned long _dictNextPower(unsigned long size) {
         i *= 2;
     }
 }
-
-/* Returns the index of a free slot that can be populated with
- * an hash entry for the given 'key'.
- * If the key already exists, -1 is returned. */
-static int _dictKeyIndex(dict *ht, const void *key) {
-    unsigned int h;
-    dictEntry *he;
-
-    /* Expand the hashtable if needed */
-    if (_dictExpandIfNeeded(ht) == DICT_ERR)
-        return -1;
-    /* Compute the key hash value */
-    h = dictHashKey(ht, key) & ht->sizemask;
-    /* Search if this slot does not already contain the given key */
-    he = ht->table[h];
-    while(he) {
-        if (dictCompareHashKeys(ht, key, he->key))
-            return -1;
-        he = he->next;
-    }
-    return h;
-}
-
@@ -1,9 +1,10 @@
 /* Hash table implementation.
  *
- * This file implements in memory hash tables with insert/del/replace/find/
- * get-random-element operations. Hash tables will auto resize if needed
- * tables of power of two in size are used, collisions are handled by
- * chaining. See the source code for more information... :)
+ * This file implements in memory hash tables with insert/del/replace/find
+ * operations, keyed by byte strings. Tables are a power of two in size and
+ * use open addressing with linear probing; they grow incrementally, moving a
+ * few slots on every insertion rather than all of them at once. See the
+ * source code for more information... :)
  *
  * Copyright (c) 2006-2010, Salvatore Sanfilippo <antirez at gmail dot com>
  * All rights reserved.
@@ -36,6 +37,9 @@
 #ifndef __DICT_H
 #define __DICT_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define DICT_OK 0
 #define DICT_ERR 1
 
@@ -45,36 +49,51 @@
 typedef struct dictEntry {
     void *key;
     void *val;
-    struct dictEntry *next;
+    uint64_t hash;
 } dictEntry;
 
+/* Keys are byte strings: the key pointer points to keyLength(key) bytes,
+ * which are hashed and compared by the dict itself. */
 typedef struct dictType {
-    unsigned int (*hashFunction)(const void *key);
+    size_t (*keyLength)(const void *key);
     void *(*keyDup)(void *privdata, const void *key);
     void *(*valDup)(void *privdata, const void *obj);
-    int (*keyCompare)(void *privdata, const void *key1, const void *key2);
     void (*keyDestructor)(void *privdata, void *key);
     void (*valDestructor)(void *privdata, void *obj);
 } dictType;
 
-typedef struct dict {
-    dictEntry **table;
-    dictType *type;
+typedef struct dictTable {
+    dictEntry *table;
     unsigned long size;
     unsigned long sizemask;
-    unsigned long used;
+    unsigned long used;   /* Entries */
+    unsigned long filled; /* Entries and deleted slots */
+} dictTable;
+
+/* While growing, entries move from ht[0] to ht[1], from slot rehashidx on,
+ * and new entries go to ht[1]. */
+typedef struct dict {
+    dictTable ht[2];
+    long rehashidx; /* -1 when not growing */
+    int iterators;  /* Live iterators, which pause growing */
+    dictType *type;
     void *privdata;
 } dict;
 
+/* Entries may be looked up and deleted while iterating, but not added.
+ * Every initialized iterator must be released. */
 typedef struct dictIterator {
     dict *ht;
-    int index;
-    dictEntry *entry, *nextEntry;
+    int table;
+    long index;
 } dictIterator;
 
 /* This is the initial size of every hash table */
 #define DICT_HT_INITIAL_SIZE     4
 
+/* Slots of the old table looked at by every insertion while growing */
+#define DICT_REHASH_STEP         64
+
 /* ------------------------------- Macros ------------------------------------*/
 #define dictFreeEntryVal(ht, entry) \
     if ((ht)->type->valDestructor) \
@@ -98,28 +117,25 @@ typedef struct dictIterator {
         entry->key = (_key_); \
 } while(0)
 
-#define dictCompareHashKeys(ht, key1, key2) \
-    (((ht)->type->keyCompare) ? \
-        (ht)->type->keyCompare((ht)->privdata, key1, key2) : \
-        (key1) == (key2))
-
-#define dictHashKey(ht, key) (ht)->type->hashFunction(key)
+#define dictKeyLength(ht, key) (ht)->type->keyLength(key)
 
 #define dictGetEntryKey(he) ((he)->key)
 #define dictGetEntryVal(he) ((he)->val)
-#define dictSlots(ht) ((ht)->size)
-#define dictSize(ht) ((ht)->used)
+#define dictSlots(d) ((d)->ht[0].size + (d)->ht[1].size)
+#define dictSize(d) ((d)->ht[0].used + (d)->ht[1].used)
+#define dictIsRehashing(d) ((d)->rehashidx != -1)
 
-/* API */
-static unsigned int dictGenHashFunction(const unsigned char *buf, int len);
+/* API. Entries returned by dictFindBuf() and dictNext() may move when others
+ * are added. */
+static uint64_t dictGenHashFunction(const void *buf, size_t len);
 static dict *dictCreate(dictType *type, void *privDataPtr);
-static int dictExpand(dict *ht, unsigned long size);
-static int dictAdd(dict *ht, void *key, void *val);
 static int dictReplace(dict *ht, void *key, void *val);
 static int dictDelete(dict *ht, const void *key);
+static int dictDeleteBuf(dict *ht, const void *buf, size_t len);
 static void dictRelease(dict *ht);
-static dictEntry * dictFind(dict *ht, const void *key);
+static dictEntry * dictFindBuf(dict *ht, const void *buf, size_t len);
 static void dictInitIterator(dictIterator *iter, dict *ht);
 static dictEntry *dictNext(dictIterator *iter);
+static void dictReleaseIterator(dictIterator *iter);
 
 #endif /* __DICT_H */
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <signal.h>
+
+#include <hiredis_coro.h>
+#include <adapters/libevent.h>
+
+/* Set a key, read it back and disconnect, one command after the other. */
+RedisDetached run(RedisClient client, const char *value) {
+    RedisReply reply = co_await client.command("SET", "key", value);
+    if (!reply || reply.isError()) {
+        printf("SET failed: %s\n", reply ? reply->str : client.context()->errstr);
+        redisAsyncDisconnect(client.context());
+        co_return;
+    }
+
+    reply = co_await client.command("GET", "key");
+    if (reply)
+        printf("key: %.*s\n", (int)reply.str().size(), reply.str().data());
+
+    /* Integers are formatted in place, no temporary string needed. */
+    reply = co_await client.command("INCRBY", "counter", 10);
+    if (reply)
+        printf("counter: %lld\n", reply->integer);
+
+    redisAsyncDisconnect(client.context());
+}
+
+int main (int argc, char **argv) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    struct event_base *base = event_base_new();
+    redisAsyncContext *c = redisAsyncConnect("127.0.0.1", 6379);
+    if (c->err) {
+        printf("Error: %s\n", c->errstr);
+        redisAsyncFree(c);
+        return 1;
+    }
+
+    redisLibeventAttach(c,base);
+    run(RedisClient(c), argv[argc-1]);
+    event_base_dispatch(base);
+    event_base_free(base);
+    return 0;
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "fmacros.h"
+#include "alloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+#include "group.h"
+#include "sds.h"
+#include "win32.h"
+
+/* Forward declarations of hiredis.c functions */
+int __redisCheckSharedOptions(const redisOptions *options);
+int __redisCopyOptions(redisOptions *dst, const redisOptions *src);
+void __redisFreeOptions(redisOptions *options);
+
+typedef struct redisGroupMember {
+    struct redisAsyncGroup *group;
+    redisAsyncContext *ac;      /* NULL while disconnected */
+    int connected;              /* ac completed its connection */
+    int inflight;               /* Callbacks still expecting a reply */
+    long long nextRetry;        /* Earliest reconnection attempt, in ms */
+} redisGroupMember;
+
+/* Wraps the callback of every command sent through the group, to keep the
+ * number of in-flight commands of each connection. */
+typedef struct redisGroupCallback {
+    redisGroupMember *member;
+    redisCallbackFn *fn;
+    void *privdata;
+} redisGroupCallback;
+
+struct redisAsyncGroup {
+    redisOptions options;
+    int size;
+    int policy;
+    long long reconnect_interval;   /* In milliseconds */
+    redisAsyncGroupAttachFn *attach_cb;
+    void *attach_privdata;
+
+    /* Set by redisAsyncGroupFree(). The group itself is released once the
+     * last of its contexts is gone, as freeing a context from within one of
+     * its callbacks is deferred. */
+    int freeing;
+    int refs;
+
+    redisGroupMember *members;
+};
+
+static long long groupMillis(void) {
+#ifndef _MSC_VER
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((long long)now.tv_sec * 1000) + now.tv_nsec / 1000000;
+#else
+    return (long long)GetTickCount64();
+#endif
+}
+
+static void groupRelease(redisAsyncGroup *group) {
+    __redisFreeOptions(&group->options);
+
+    hi_free(group->members);
+    hi_free(group);
+}
+
+static void groupUnref(redisAsyncGroup *group) {
+    if (--group->refs == 0)
+        groupRelease(group);
+}
+
+static int groupConnect(redisGroupMember *member);
+
+static void groupConnectCallback(redisAsyncContext *ac, int status) {
+    redisGroupMember *member = ac->data;
+
+    if (status == REDIS_OK)
+        member->connected = 1;
+}
+
+/* Installed as the dataCleanup of every context of the group, so it runs
+ * however the context goes away: failed connection, lost connection or
+ * explicit free. */
+static void groupContextGone(void *privdata) {
+    redisGroupMember *member = privdata;
+    redisAsyncGroup *group = member->group;
+    int wasConnected = member->connected;
+
+    member->ac = NULL;
+    member->connected = 0;
+
+    if (group->freeing) {
+        groupUnref(group);
+        return;
+    }
+
+    /* Not the last reference, the group holds one until it is freed. */
+    group->refs--;
+
+    /* A connection that worked is likely to work again right away, while
+     * one that never connected is retried later, on a future command. */
+    if (wasConnected)
+        groupConnect(member);
+    else
+        member->nextRetry = groupMillis() + group->reconnect_interval;
+}
+
+static int groupConnect(redisGroupMember *member) {
+    redisAsyncGroup *group = member->group;
+    redisAsyncContext *ac;
+
+    member->nextRetry = groupMillis() + group->reconnect_interval;
+
+    ac = redisAsyncConnectWithOptions(&group->options);
+    if (ac == NULL)
+        return REDIS_ERR;
+    if (ac->err) {
+        redisAsyncFree(ac);
+        return REDIS_ERR;
+    }
+
+    ac->data = member;
+    ac->dataCleanup = groupContextGone;
+    member->ac = ac;
+    member->connected = 0;
+    group->refs++;
+
+    redisAsyncSetConnectCallbackNC(ac, groupConnectCallback);
+    if (group->attach_cb && group->attach_cb(ac, group->attach_privdata) != REDIS_OK) {
+        redisAsyncFree(ac);
+        return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+/* Whether the member should be preferred over the current best one. */
+static int groupBetter(redisAsyncGroup *group, redisGroupMember *m, redisGroupMember *best) {
+    size_t mobuf, bobuf;
+
+    if (best == NULL)
+        return 1;
+    if (m->connected != best->connected)
+        return m->connected;
+
+    mobuf = sdslen(m->ac->c.obuf);
+    bobuf = sdslen(best->ac->c.obuf);
+    if (group->policy == REDIS_GROUP_LEAST_OBUF) {
+        if (mobuf != bobuf)
+            return mobuf < bobuf;
+        return m->inflight < best->inflight;
+    }
+
+    if (m->inflight != best->inflight)
+        return m->inflight < best->inflight;
+    return mobuf < bobuf;
+}
+
+static redisGroupMember *groupPick(redisAsyncGroup *group) {
+    redisGroupMember *best = NULL;
+    long long now = -1;
+    int i;
+
+    for (i = 0; i < group->size; i++) {
+        redisGroupMember *m = &group->members[i];
+
+        if (m->ac == NULL) {
+            if (now < 0)
+                now = groupMillis();
+            if (now < m->nextRetry || groupConnect(m) != REDIS_OK)
+                continue;
+        }
+        if (m->ac->c.flags & (REDIS_DISCONNECTING | REDIS_FREEING))
+            continue;
+
+        if (groupBetter(group, m, best))
+            best = m;
+    }
+
+    return best;
+}
+
+/* Commands whose callback may be called more than once, which the group
+ * can't track. */
+static int groupIsStreamingCommand(const char *cmd, size_t len) {
+    static const char *names[] = {
+        "subscribe", "psubscribe", "ssubscribe",
+        "unsubscribe", "punsubscribe", "sunsubscribe", "monitor"
+    };
+    const char *p, *end = cmd + len;
+    size_t i, nlen;
+
+    /* The command name is the first bulk string of the request. */
+    if (len == 0 || cmd[0] != '*' || (p = memchr(cmd, '$', len)) == NULL)
+        return 0;
+    nlen = strtoul(p + 1, NULL, 10);
+    if ((p = memchr(p, '\n', end - p)) == NULL || (size_t)(end - ++p) < nlen)
+        return 0;
+
+    for (i = 0; i < sizeof(names) / sizeof(*names); i++) {
+        if (strlen(names[i]) == nlen && !strncasecmp(p, names[i], nlen))
+            return 1;
+    }
+    return 0;
+}
+
+static void groupCallback(redisAsyncContext *ac, void *reply, void *privdata) {
+    redisGroupCallback *cb = privdata;
+
+    cb->member->inflight--;
+    if (cb->fn)
+        cb->fn(ac, reply, cb->privdata);
+    hi_free(cb);
+}
+
+redisAsyncGroup *redisAsyncGroupCreate(const redisAsyncGroupOptions *options) {
+    const redisOptions *ropts = &options->options;
+    redisAsyncGroup *group;
+    int i;
+
+    if (options->size <= 0 ||
+        (options->policy != REDIS_GROUP_LEAST_INFLIGHT &&
+         options->policy != REDIS_GROUP_LEAST_OBUF))
+        return NULL;
+
+    /* Contexts must be freed by hiredis once disconnected, for the group to
+     * notice and replace them. */
+    if (__redisCheckSharedOptions(ropts) != REDIS_OK || (ropts->options & REDIS_OPT_NOAUTOFREE))
+        return NULL;
+
+    group = hi_calloc(1, sizeof(*group));
+    if (group == NULL)
+        return NULL;
+
+    /* Held until redisAsyncGroupFree(). */
+    group->refs = 1;
+
+    group->members = hi_calloc(options->size, sizeof(*group->members));
+    if (group->members == NULL || __redisCopyOptions(&group->options, ropts) != REDIS_OK) {
+        groupRelease(group);
+        return NULL;
+    }
+
+    group->size = options->size;
+    group->policy = options->policy;
+    group->reconnect_interval = 100;
+    if (options->reconnect_interval) {
+        group->reconnect_interval = (long long)options->reconnect_interval->tv_sec * 1000 +
+                                    options->reconnect_interval->tv_usec / 1000;
+    }
+    group->attach_cb = options->attach_cb;
+    group->attach_privdata = options->attach_privdata;
+
+    for (i = 0; i < group->size; i++) {
+        group->members[i].group = group;
+        groupConnect(&group->members[i]);
+    }
+
+    if (group->refs == 1) {
+        redisAsyncGroupFree(group);
+        return NULL;
+    }
+
+    return group;
+}
+
+int redisAsyncGroupFormattedCommand(redisAsyncGroup *group, redisCallbackFn *fn, void *privdata, const char *cmd, size_t len) {
+    redisGroupMember *member;
+    redisGroupCallback *cb;
+
+    if (group->freeing || groupIsStreamingCommand(cmd, len))
+        return REDIS_ERR;
+
+    if ((member = groupPick(group)) == NULL)
+        return REDIS_ERR;
+
+    cb = hi_malloc(sizeof(*cb));
+    if (cb == NULL)
+        return REDIS_ERR;
+    cb->member = member;
+    cb->fn = fn;
+    cb->privdata = privdata;
+
+    if (redisAsyncFormattedCommand(member->ac, groupCallback, cb, cmd, len) != REDIS_OK) {
+        hi_free(cb);
+        return REDIS_ERR;
+    }
+
+    member->inflight++;
+    return REDIS_OK;
+}
+
+int redisvAsyncGroupCommand(redisAsyncGroup *group, redisCallbackFn *fn, void *privdata, const char *format, va_list ap) {
+    char *cmd;
+    int len;
+    int status;
+
+    len = redisvFormatCommand(&cmd, format, ap);
+    if (len < 0)
+        return REDIS_ERR;
+
+    status = redisAsyncGroupFormattedCommand(group, fn, privdata, cmd, len);
+    hi_free(cmd);
+    return status;
+}
+
+int redisAsyncGroupCommand(redisAsyncGroup *group, redisCallbackFn *fn, void *privdata, const char *format, ...) {
+    va_list ap;
+    int status;
+
+    va_start(ap, format);
+    status = redisvAsyncGroupCommand(group, fn, privdata, format, ap);
+    va_end(ap);
+    return status;
+}
+
+int redisAsyncGroupCommandArgv(redisAsyncGroup *group, redisCallbackFn *fn, void *privdata, int argc, const char **argv, const size_t *argvlen) {
+    sds cmd;
+    long long len;
+    int status;
+
+    len = redisFormatSdsCommandArgv(&cmd, argc, argv, argvlen);
+    if (len < 0)
+        return REDIS_ERR;
+
+    status = redisAsyncGroupFormattedCommand(group, fn, privdata, cmd, len);
+    sdsfree(cmd);
+    return status;
+}
+
+int redisAsyncGroupConnected(redisAsyncGroup *group) {
+    int i, connected = 0;
+
+    for (i = 0; i < group->size; i++)
+        connected += group->members[i].connected;
+
+    return connected;
+}
+
+void redisAsyncGroupFree(redisAsyncGroup *group) {
+    int i;
+
+    if (group == NULL || group->freeing)
+        return;
+
+    group->freeing = 1;
+    for (i = 0; i < group->size; i++) {
+        if (group->members[i].ac)
+            redisAsyncFree(group->members[i].ac);
+    }
+
+    groupUnref(group);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __HIREDIS_GROUP_H
+#define __HIREDIS_GROUP_H
+#include "async.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* How redisAsyncGroup picks the connection a command is sent on. */
+#define REDIS_GROUP_LEAST_INFLIGHT 0 /* Fewest replies still expected */
+#define REDIS_GROUP_LEAST_OBUF 1     /* Smallest output buffer not yet written */
+
+/* Called on every connection the group creates, including reconnections, to
+ * attach it to an event loop (e.g. with redisLibeventAttach()). Commands
+ * needed to set up the connection, such as AUTH or SELECT, can be sent from
+ * here too as they are queued until the connection is established. Return
+ * REDIS_OK on success; on REDIS_ERR the connection is dropped. */
+typedef int (redisAsyncGroupAttachFn)(redisAsyncContext *ac, void *privdata);
+
+typedef struct redisAsyncGroupOptions {
+    /* How to connect to the server, for every connection of the group. Only
+     * the TCP and unix socket connection types are supported, without a
+     * privdata destructor. */
+    redisOptions options;
+
+    /* Number of connections. */
+    int size;
+    /* One of REDIS_GROUP_xxx. */
+    int policy;
+
+    /* Minimum delay between two attempts to reconnect a connection that
+     * could not be established. A connection that is lost after having been
+     * established is reconnected right away. If NULL, 100 milliseconds. */
+    const struct timeval *reconnect_interval;
+
+    redisAsyncGroupAttachFn *attach_cb;
+    void *attach_privdata;
+} redisAsyncGroupOptions;
+
+typedef struct redisAsyncGroup redisAsyncGroup;
+
+/* Create a group and start connecting all of its connections. Returns NULL
+ * for invalid options, when out of memory, or if no connection could be
+ * started at all. */
+redisAsyncGroup *redisAsyncGroupCreate(const redisAsyncGroupOptions *options);
+
+/* Send a command on the least loaded connection of the group, reconnecting
+ * lost connections as needed. The callback receives the context the command
+ * was sent on, and is called exactly once, with a NULL reply if the
+ * connection is lost first.
+ *
+ * Replies of commands sent on different connections may arrive in any order.
+ * Commands that change the state of a connection across commands, such as
+ * SUBSCRIBE, MONITOR, MULTI or SELECT, must not be sent through a group;
+ * SUBSCRIBE-like commands and MONITOR are rejected with REDIS_ERR. */
+int redisvAsyncGroupCommand(redisAsyncGroup *group, redisCallbackFn *fn, void *privdata, const char *format, va_list ap);
+int redisAsyncGroupCommand(redisAsyncGroup *group, redisCallbackFn *fn, void *privdata, const char *format, ...);
+int redisAsyncGroupCommandArgv(redisAsyncGroup *group, redisCallbackFn *fn, void *privdata, int argc, const char **argv, const size_t *argvlen);
+int redisAsyncGroupFormattedCommand(redisAsyncGroup *group, redisCallbackFn *fn, void *privdata, const char *cmd, size_t len);
+
+/* Number of connections of the group currently established. */
+int redisAsyncGroupConnected(redisAsyncGroup *group);
+
+/* Close all connections of the group and free it. Callbacks of pending
+ * commands are called with a NULL reply. May be called from a callback. */
+void redisAsyncGroupFree(redisAsyncGroup *group);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
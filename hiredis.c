@@ -37,11 +37,17 @@
 #include <assert.h>
 #include <errno.h>
 #include <ctype.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 #include "hiredis.h"
 #include "net.h"
 #include "sds.h"
 #include "async.h"
+#include "capture.h"
+#include "stats.h"
+#include "trace.h"
 #include "win32.h"
 
 extern int redisContextUpdateConnectTimeout(redisContext *c, const struct timeval *timeout);
@@ -56,7 +62,7 @@ static redisContextFuncs redisContextDefaultFuncs = {
     .write = redisNetWrite
 };
 
-static redisReply *createReplyObject(int type);
+static redisReply *createReplyObject(const hiredisAllocator *a, int type);
 static void *createStringObject(const redisReadTask *task, char *str, size_t len);
 static void *createArrayObject(const redisReadTask *task, size_t elements);
 static void *createIntegerObject(const redisReadTask *task, long long value);
@@ -76,9 +82,36 @@ static redisReplyObjectFunctions defaultFunctions = {
     freeReplyObject
 };
 
+/* The reply was built with its own allocator, which follows it in a
+ * redisAllocatedReply. Its strings and elements vector come from it too. */
+#define REDIS_REPLY_FLAG_ALLOCATOR 0x1
+
+typedef struct redisAllocatedReply {
+    redisReply reply;
+    const hiredisAllocator *allocator;
+} redisAllocatedReply;
+
+static const hiredisAllocator *replyAllocator(const redisReply *r) {
+    if (r->flags & REDIS_REPLY_FLAG_ALLOCATOR)
+        return ((const redisAllocatedReply *)r)->allocator;
+    return NULL;
+}
+
 /* Create a reply object */
-static redisReply *createReplyObject(int type) {
-    redisReply *r = hi_calloc(1,sizeof(*r));
+static redisReply *createReplyObject(const hiredisAllocator *a, int type) {
+    redisAllocatedReply *ar;
+    redisReply *r;
+
+    if (a == NULL) {
+        r = hi_obj_calloc(sizeof(*r));
+    } else {
+        ar = hi_calloc_from(a,1,sizeof(*ar));
+        if (ar == NULL)
+            return NULL;
+        ar->allocator = a;
+        r = &ar->reply;
+        r->flags = REDIS_REPLY_FLAG_ALLOCATOR;
+    }
 
     if (r == NULL)
         return NULL;
@@ -87,13 +120,31 @@ static redisReply *createReplyObject(int type) {
     return r;
 }
 
+redisReply *redisTakeReply(redisReply *r) {
+    redisReply *copy = createReplyObject(replyAllocator(r), r->type);
+    int flags;
+
+    if (copy == NULL)
+        return NULL;
+    flags = copy->flags;
+    *copy = *r;
+    copy->flags = flags;
+    r->str = NULL;
+    r->len = 0;
+    r->element = NULL;
+    r->elements = 0;
+    return copy;
+}
+
 /* Free a reply object */
 void freeReplyObject(void *reply) {
     redisReply *r = reply;
+    const hiredisAllocator *a;
     size_t j;
 
     if (r == NULL)
         return;
+    a = replyAllocator(r);
 
     switch(r->type) {
     case REDIS_REPLY_INTEGER:
@@ -108,7 +159,7 @@ void freeReplyObject(void *reply) {
         if (r->element != NULL) {
             for (j = 0; j < r->elements; j++)
                 freeReplyObject(r->element[j]);
-            hi_free(r->element);
+            hi_free_from(a, r->element);
         }
         break;
     case REDIS_REPLY_ERROR:
@@ -117,17 +168,20 @@ void freeReplyObject(void *reply) {
     case REDIS_REPLY_DOUBLE:
     case REDIS_REPLY_VERB:
     case REDIS_REPLY_BIGNUM:
-        hi_free(r->str);
+        hi_free_from(a, r->str);
         break;
     }
-    hi_free(r);
+    if (a == NULL)
+        hi_obj_free(r, sizeof(*r));
+    else
+        hi_free_from(a, r);
 }
 
 static void *createStringObject(const redisReadTask *task, char *str, size_t len) {
     redisReply *r, *parent;
     char *buf;
 
-    r = createReplyObject(task->type);
+    r = createReplyObject(task->allocator, task->type);
     if (r == NULL)
         return NULL;
 
@@ -139,7 +193,7 @@ static void *createStringObject(const redisReadTask *task, char *str, size_t len
 
     /* Copy string value */
     if (task->type == REDIS_REPLY_VERB) {
-        buf = hi_malloc(len-4+1); /* Skip 4 bytes of verbatim type header. */
+        buf = hi_malloc_from(task->allocator, len-4+1); /* Skip 4 bytes of verbatim type header. */
         if (buf == NULL) goto oom;
 
         memcpy(r->vtype,str,3);
@@ -148,7 +202,7 @@ static void *createStringObject(const redisReadTask *task, char *str, size_t len
         buf[len-4] = '\0';
         r->len = len - 4;
     } else {
-        buf = hi_malloc(len+1);
+        buf = hi_malloc_from(task->allocator, len+1);
         if (buf == NULL) goto oom;
 
         memcpy(buf,str,len);
@@ -176,12 +230,12 @@ oom:
 static void *createArrayObject(const redisReadTask *task, size_t elements) {
     redisReply *r, *parent;
 
-    r = createReplyObject(task->type);
+    r = createReplyObject(task->allocator, task->type);
     if (r == NULL)
         return NULL;
 
     if (elements > 0) {
-        r->element = hi_calloc(elements,sizeof(redisReply*));
+        r->element = hi_calloc_from(task->allocator,elements,sizeof(redisReply*));
         if (r->element == NULL) {
             freeReplyObject(r);
             return NULL;
@@ -205,7 +259,7 @@ static void *createArrayObject(const redisReadTask *task, size_t elements) {
 static void *createIntegerObject(const redisReadTask *task, long long value) {
     redisReply *r, *parent;
 
-    r = createReplyObject(REDIS_REPLY_INTEGER);
+    r = createReplyObject(task->allocator, REDIS_REPLY_INTEGER);
     if (r == NULL)
         return NULL;
 
@@ -229,12 +283,12 @@ static void *createDoubleObject(const redisReadTask *task, double value, char *s
     if (len == SIZE_MAX) // Prevents hi_malloc(0) if len equals to SIZE_MAX
         return NULL;
 
-    r = createReplyObject(REDIS_REPLY_DOUBLE);
+    r = createReplyObject(task->allocator, REDIS_REPLY_DOUBLE);
     if (r == NULL)
         return NULL;
 
     r->dval = value;
-    r->str = hi_malloc(len+1);
+    r->str = hi_malloc_from(task->allocator, len+1);
     if (r->str == NULL) {
         freeReplyObject(r);
         return NULL;
@@ -264,7 +318,7 @@ static void *createDoubleObject(const redisReadTask *task, double value, char *s
 static void *createNilObject(const redisReadTask *task) {
     redisReply *r, *parent;
 
-    r = createReplyObject(REDIS_REPLY_NIL);
+    r = createReplyObject(task->allocator, REDIS_REPLY_NIL);
     if (r == NULL)
         return NULL;
 
@@ -283,7 +337,7 @@ static void *createNilObject(const redisReadTask *task) {
 static void *createBoolObject(const redisReadTask *task, int bval) {
     redisReply *r, *parent;
 
-    r = createReplyObject(REDIS_REPLY_BOOL);
+    r = createReplyObject(task->allocator, REDIS_REPLY_BOOL);
     if (r == NULL)
         return NULL;
 
@@ -730,6 +784,7 @@ static redisContext *redisContextInit(void) {
         redisFree(c);
         return NULL;
     }
+    c->reader->stats = &c->stats.reader;
 
     return c;
 }
@@ -742,6 +797,7 @@ void redisFree(redisContext *c) {
         c->funcs->close(c);
     }
 
+    redisCaptureStop(c);
     sdsfree(c->obuf);
     redisReaderFree(c->reader);
     hi_free(c->tcp.host);
@@ -768,7 +824,88 @@ redisFD redisFreeKeepFd(redisContext *c) {
     return fd;
 }
 
+/* Reconnect the socket of an asynchronous context, as redisReconnect() does,
+ * but keep the reader settings and, where possible, the file descriptor
+ * number: event loop adapters registered the old one. The output buffer is
+ * left to the caller. Internal, used by the async reconnection. */
+int __redisReopen(redisContext *c) {
+    redisFD fd = c->fd;
+    redisReader *r;
+    int ret;
+
+    c->err = 0;
+    c->errstr[0] = '\0';
+
+    if (c->privctx && c->funcs && c->funcs->free_privctx) {
+        c->funcs->free_privctx(c->privctx);
+        c->privctx = NULL;
+    }
+    c->funcs = &redisContextDefaultFuncs;
+
+    r = redisReaderCreateWithFunctions(c->reader->fn);
+    if (r == NULL) {
+        __redisSetError(c, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+    r->maxbuf = c->reader->maxbuf;
+    r->maxelements = c->reader->maxelements;
+    r->maxdepth = c->reader->maxdepth;
+    r->privdata = c->reader->privdata;
+    r->stats = &c->stats.reader;
+    r->allocator = c->allocator;
+    redisReaderFree(c->reader);
+    c->reader = r;
+
+    c->fd = REDIS_INVALID_FD;
+    if (c->connection_type == REDIS_CONN_TCP) {
+        ret = redisContextConnectBindTcp(c, c->tcp.host, c->tcp.port,
+               c->connect_timeout, c->tcp.source_addr);
+    } else if (c->connection_type == REDIS_CONN_UNIX) {
+        ret = redisContextConnectUnix(c, c->unix_sock.path, c->connect_timeout);
+    } else {
+        __redisSetError(c,REDIS_ERR_OTHER,"Not enough information to reconnect");
+        ret = REDIS_ERR;
+    }
+    c->flags &= ~REDIS_CONNECTED;
+
+    if (ret != REDIS_OK) {
+        /* Keep the old descriptor, and its number, until the next attempt. */
+        redisNetClose(c);
+        c->fd = fd;
+        return REDIS_ERR;
+    }
+    if (fd == REDIS_INVALID_FD)
+        return REDIS_OK;
+
+#ifndef _WIN32
+    if (dup2(c->fd, fd) == -1) {
+        __redisSetError(c, REDIS_ERR_IO, NULL);
+        redisNetClose(c);
+        c->fd = fd;
+        return REDIS_ERR;
+    }
+    close(c->fd);
+    c->fd = fd;
+#else
+    /* Sockets can't be renumbered, adapters must follow c->fd. */
+    {
+        redisFD s = c->fd;
+        c->fd = fd;
+        redisNetClose(c);
+        c->fd = s;
+    }
+#endif
+
+    return REDIS_OK;
+}
+
 int redisReconnect(redisContext *c) {
+    /* There is nothing to reconnect a transport with. */
+    if (c->connection_type == REDIS_CONN_TRANSPORT) {
+        __redisSetError(c, REDIS_ERR_OTHER, "Cannot reconnect a custom transport");
+        return REDIS_ERR;
+    }
+
     c->err = 0;
     memset(c->errstr, '\0', strlen(c->errstr));
 
@@ -791,6 +928,8 @@ int redisReconnect(redisContext *c) {
         __redisSetError(c, REDIS_ERR_OOM, "Out of memory");
         return REDIS_ERR;
     }
+    c->reader->stats = &c->stats.reader;
+    c->reader->allocator = c->allocator;
 
     int ret = REDIS_ERR;
     if (c->connection_type == REDIS_CONN_TCP) {
@@ -812,9 +951,165 @@ int redisReconnect(redisContext *c) {
     return ret;
 }
 
+/* A user provided transport, and its context, kept in privctx. */
+typedef struct redisTransportState {
+    const redisTransport *funcs;
+    void *ctx;
+} redisTransportState;
+
+static void redisTransportSetError(redisContext *c) {
+    if (c->err)
+        return;
+    if (errno == EPIPE || errno == ECONNRESET)
+        __redisSetError(c, REDIS_ERR_EOF, "Server closed the connection");
+    else
+        __redisSetError(c, REDIS_ERR_IO, NULL);
+}
+
+static ssize_t redisTransportRead(redisContext *c, char *buf, size_t len) {
+    redisTransportState *t = c->privctx;
+    ssize_t nread = t->funcs->read(c, t->ctx, buf, len);
+
+    if (nread < 0)
+        redisTransportSetError(c);
+    return nread;
+}
+
+static ssize_t redisTransportWrite(redisContext *c) {
+    redisTransportState *t = c->privctx;
+    ssize_t nwritten = t->funcs->write(c, t->ctx, c->obuf, sdslen(c->obuf));
+
+    if (nwritten < 0)
+        redisTransportSetError(c);
+    return nwritten;
+}
+
+/* The descriptor belongs to the transport. */
+static void redisTransportClose(redisContext *c) {
+    c->fd = REDIS_INVALID_FD;
+}
+
+static void redisTransportFree(void *privctx) {
+    redisTransportState *t = privctx;
+
+    if (t->funcs->close)
+        t->funcs->close(t->ctx);
+    hi_free(t);
+}
+
+static redisContextFuncs redisContextTransportFuncs = {
+    .close = redisTransportClose,
+    .free_privctx = redisTransportFree,
+    .async_read = redisAsyncRead,
+    .async_write = redisAsyncWrite,
+    .read = redisTransportRead,
+    .write = redisTransportWrite
+};
+
+/* Release a transport the context could not take ownership of. */
+static void redisTransportDrop(const redisOptions *options) {
+    const redisTransport *funcs = options->endpoint.transport.funcs;
+
+    if (options->type == REDIS_CONN_TRANSPORT && funcs != NULL && funcs->close)
+        funcs->close(options->endpoint.transport.ctx);
+}
+
+static int redisContextConnectTransport(redisContext *c, const redisOptions *options) {
+    redisTransportState *t;
+
+    if (options->endpoint.transport.funcs == NULL) {
+        __redisSetError(c, REDIS_ERR_OTHER, "No transport callbacks");
+        return REDIS_ERR;
+    }
+
+    t = hi_malloc(sizeof(*t));
+    if (t == NULL) {
+        redisTransportDrop(options);
+        __redisSetError(c, REDIS_ERR_OOM, "Out of memory");
+        return REDIS_ERR;
+    }
+    t->funcs = options->endpoint.transport.funcs;
+    t->ctx = options->endpoint.transport.ctx;
+
+    c->funcs = &redisContextTransportFuncs;
+    c->privctx = t;
+    c->connection_type = REDIS_CONN_TRANSPORT;
+    c->fd = options->endpoint.transport.fd;
+    c->flags |= REDIS_CONNECTED;
+    return REDIS_OK;
+}
+
+/* Options of connections that are created, and replaced, by pools, groups
+ * and runtimes. They must reconnect by themselves to a TCP or unix socket
+ * endpoint, and can't have a privdata destructor, which every connection
+ * would call on the same privdata. */
+int __redisCheckSharedOptions(const redisOptions *options) {
+    if ((options->type == REDIS_CONN_TCP && options->endpoint.tcp.ip == NULL) ||
+        (options->type == REDIS_CONN_UNIX && options->endpoint.unix_socket == NULL) ||
+        (options->type != REDIS_CONN_TCP && options->type != REDIS_CONN_UNIX) ||
+        options->free_privdata)
+        return REDIS_ERR;
+    return REDIS_OK;
+}
+
+/* Copy checked shared options, along with their timeouts and endpoint
+ * strings. On failure, the copy holds what could be copied, and must still
+ * be released with __redisFreeOptions(). */
+int __redisCopyOptions(redisOptions *dst, const redisOptions *src) {
+    struct timeval *tv;
+
+    *dst = *src;
+    dst->connect_timeout = NULL;
+    dst->command_timeout = NULL;
+    if (src->type == REDIS_CONN_TCP) {
+        dst->endpoint.tcp.ip = NULL;
+        dst->endpoint.tcp.source_addr = NULL;
+    } else {
+        dst->endpoint.unix_socket = NULL;
+    }
+
+    if (src->connect_timeout) {
+        if ((tv = hi_malloc(sizeof(*tv))) == NULL)
+            return REDIS_ERR;
+        *tv = *src->connect_timeout;
+        dst->connect_timeout = tv;
+    }
+    if (src->command_timeout) {
+        if ((tv = hi_malloc(sizeof(*tv))) == NULL)
+            return REDIS_ERR;
+        *tv = *src->command_timeout;
+        dst->command_timeout = tv;
+    }
+
+    if (src->type == REDIS_CONN_TCP) {
+        if ((dst->endpoint.tcp.ip = hi_strdup(src->endpoint.tcp.ip)) == NULL)
+            return REDIS_ERR;
+        if (src->endpoint.tcp.source_addr &&
+            (dst->endpoint.tcp.source_addr = hi_strdup(src->endpoint.tcp.source_addr)) == NULL)
+            return REDIS_ERR;
+    } else {
+        if ((dst->endpoint.unix_socket = hi_strdup(src->endpoint.unix_socket)) == NULL)
+            return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+void __redisFreeOptions(redisOptions *options) {
+    hi_free((void *)options->connect_timeout);
+    hi_free((void *)options->command_timeout);
+    if (options->type == REDIS_CONN_TCP) {
+        hi_free((void *)options->endpoint.tcp.ip);
+        hi_free((void *)options->endpoint.tcp.source_addr);
+    } else if (options->type == REDIS_CONN_UNIX) {
+        hi_free((void *)options->endpoint.unix_socket);
+    }
+}
+
 redisContext *redisConnectWithOptions(const redisOptions *options) {
     redisContext *c = redisContextInit();
     if (c == NULL) {
+        redisTransportDrop(options);
         return NULL;
     }
     if (!(options->options & REDIS_OPT_NONBLOCK)) {
@@ -847,10 +1142,13 @@ redisContext *redisConnectWithOptions(const redisOptions *options) {
         redisSetPushCallback(c, redisPushAutoFree);
 
     c->privdata = options->privdata;
+    c->allocator = options->allocator;
+    c->reader->allocator = options->allocator;
     c->free_privdata = options->free_privdata;
 
     if (redisContextUpdateConnectTimeout(c, options->connect_timeout) != REDIS_OK ||
         redisContextUpdateCommandTimeout(c, options->command_timeout) != REDIS_OK) {
+        redisTransportDrop(options);
         __redisSetError(c, REDIS_ERR_OOM, "Out of memory");
         return c;
     }
@@ -865,6 +1163,8 @@ redisContext *redisConnectWithOptions(const redisOptions *options) {
     } else if (options->type == REDIS_CONN_USERFD) {
         c->fd = options->endpoint.fd;
         c->flags |= REDIS_CONNECTED;
+    } else if (options->type == REDIS_CONN_TRANSPORT) {
+        redisContextConnectTransport(c, options);
     } else {
         redisFree(c);
         return NULL;
@@ -989,9 +1289,17 @@ int redisBufferRead(redisContext *c) {
         return REDIS_ERR;
 
     nread = c->funcs->read(c, buf, sizeof(buf));
+    redisStatIncr(&c->stats.reads);
+    redisTrace2(read, c, nread);
     if (nread < 0) {
         return REDIS_ERR;
     }
+    if (nread == 0)
+        redisStatIncr(&c->stats.read_again);
+    else
+        redisStatAdd(&c->stats.bytes_read, (unsigned long long)nread);
+    if (nread > 0 && c->capture)
+        redisCaptureData(c, REDIS_CAPTURE_READ, buf, nread);
     if (nread > 0 && redisReaderFeed(c->reader, buf, nread) != REDIS_OK) {
         __redisSetError(c, c->reader->err, c->reader->errstr);
         return REDIS_ERR;
@@ -1016,15 +1324,23 @@ int redisBufferWrite(redisContext *c, int *done) {
 
     if (sdslen(c->obuf) > 0) {
         ssize_t nwritten = c->funcs->write(c);
+        redisStatIncr(&c->stats.writes);
+        redisTrace3(write, c, sdslen(c->obuf), nwritten);
         if (nwritten < 0) {
             return REDIS_ERR;
-        } else if (nwritten > 0) {
+        } else if (nwritten == 0) {
+            redisStatIncr(&c->stats.write_again);
+        } else {
+            redisStatAdd(&c->stats.bytes_written, (unsigned long long)nwritten);
+            if (c->capture)
+                redisCaptureData(c, REDIS_CAPTURE_WRITE, c->obuf, nwritten);
             if (nwritten == (ssize_t)sdslen(c->obuf)) {
                 sdsfree(c->obuf);
                 c->obuf = sdsempty();
                 if (c->obuf == NULL)
                     goto oom;
             } else {
+                redisStatIncr(&c->stats.partial_writes);
                 if (sdsrange(c->obuf,nwritten,-1) < 0) goto oom;
             }
         }
@@ -1037,6 +1353,25 @@ oom:
     return REDIS_ERR;
 }
 
+void redisGetStats(const redisContext *c, redisContextStats *stats) {
+    const redisContextStats *s = &c->stats;
+    int i;
+
+    stats->bytes_read = redisStatLoad(&s->bytes_read);
+    stats->bytes_written = redisStatLoad(&s->bytes_written);
+    stats->reads = redisStatLoad(&s->reads);
+    stats->writes = redisStatLoad(&s->writes);
+    stats->read_again = redisStatLoad(&s->read_again);
+    stats->write_again = redisStatLoad(&s->write_again);
+    stats->partial_writes = redisStatLoad(&s->partial_writes);
+    stats->obuf_peak = redisStatLoad(&s->obuf_peak);
+    stats->callbacks = redisStatLoad(&s->callbacks);
+    for (i = 0; i <= REDIS_REPLY_VERB; i++)
+        stats->reader.replies[i] = redisStatLoad(&s->reader.replies[i]);
+    stats->reader.allocs = redisStatLoad(&s->reader.allocs);
+    stats->reader.buf_peak = redisStatLoad(&s->reader.buf_peak);
+}
+
 /* Internal helper that returns 1 if the reply was a RESP3 PUSH
  * message and we handled it with a user-provided callback. */
 static int redisHandledPushReply(redisContext *c, void *reply) {
@@ -1123,6 +1458,8 @@ int __redisAppendCommand(redisContext *c, const char *cmd, size_t len) {
     }
 
     c->obuf = newbuf;
+    redisStatMax(&c->stats.obuf_peak, sdslen(c->obuf));
+    redisTrace3(command__append, c, cmd, len);
     return REDIS_OK;
 }
 
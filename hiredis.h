@@ -119,6 +119,7 @@ extern "C" {
 /* This is the reply object returned by redisCommand() */
 typedef struct redisReply {
     int type; /* REDIS_REPLY_* */
+    int flags; /* Private to hiredis */
     long long integer; /* The integer when type is REDIS_REPLY_INTEGER */
     double dval; /* The double when type is REDIS_REPLY_DOUBLE */
     size_t len; /* Length of string */
@@ -136,6 +137,12 @@ redisReader *redisReaderCreate(void);
 /* Function to free the reply objects hiredis returns by default. */
 void freeReplyObject(void *reply);
 
+/* Move the contents of a reply the caller does not own, such as one passed to
+ * an asynchronous callback, to a new top level reply that the caller frees
+ * with freeReplyObject(). The new reply comes from the same allocator as r,
+ * and r is left empty for its owner to free. Returns NULL when out of memory. */
+redisReply *redisTakeReply(redisReply *r);
+
 /* Functions to format a command according to the protocol. */
 int redisvFormatCommand(char **target, const char *format, va_list ap);
 int redisFormatCommand(char **target, const char *format, ...);
@@ -147,7 +154,8 @@ void redisFreeSdsCommand(sds cmd);
 enum redisConnectionType {
     REDIS_CONN_TCP,
     REDIS_CONN_UNIX,
-    REDIS_CONN_USERFD
+    REDIS_CONN_USERFD,
+    REDIS_CONN_TRANSPORT
 };
 
 struct redisSsl;
@@ -183,6 +191,21 @@ typedef unsigned long redisFD;      /* SOCKET = 32-bit UINT_PTR */
 #define REDIS_INVALID_FD ((redisFD)(~0)) /* INVALID_SOCKET */
 #endif
 
+struct redisContext;
+
+/* Callbacks of a user provided transport, see REDIS_OPTIONS_SET_TRANSPORT().
+ * read() and write() return the number of bytes transferred, 0 when nothing
+ * can be transferred without blocking, or -1 on error with errno set (EPIPE
+ * and ECONNRESET are reported as the server closing the connection). For
+ * blocking contexts, with REDIS_BLOCK set in c->flags, they should wait
+ * rather than return 0, and may honour c->command_timeout. close() releases
+ * ctx once the context is freed, or could not be created, and may be NULL. */
+typedef struct redisTransport {
+    ssize_t (*read)(struct redisContext *c, void *ctx, char *buf, size_t len);
+    ssize_t (*write)(struct redisContext *c, void *ctx, const char *buf, size_t len);
+    void (*close)(void *ctx);
+} redisTransport;
+
 typedef struct {
     /*
      * the type of connection to use. This also indicates which
@@ -209,6 +232,14 @@ typedef struct {
          * use this field to have hiredis operate an already-open
          * file descriptor */
         redisFD fd;
+        /** use this field to have hiredis operate over a user provided
+         * transport, with fd the descriptor event loop adapters watch for
+         * asynchronous contexts (REDIS_INVALID_FD if there is none) */
+        struct {
+            const redisTransport *funcs;
+            void *ctx;
+            redisFD fd;
+        } transport;
     } endpoint;
 
     /* Optional user defined data/destructor */
@@ -218,6 +249,11 @@ typedef struct {
     /* A user defined PUSH message callback */
     redisPushFn *push_cb;
     redisAsyncPushFn *async_push_cb;
+
+    /* Optional allocator of the replies and, for asynchronous contexts, of
+     * the pending command callbacks. It must outlive the context and the
+     * replies. See hiredisAllocator in alloc.h. */
+    const hiredisAllocator *allocator;
 } redisOptions;
 
 /**
@@ -234,6 +270,13 @@ typedef struct {
         (opts)->endpoint.unix_socket = path;    \
     } while(0)
 
+#define REDIS_OPTIONS_SET_TRANSPORT(opts, funcs_, ctx_) do { \
+        (opts)->type = REDIS_CONN_TRANSPORT;                \
+        (opts)->endpoint.transport.funcs = funcs_;          \
+        (opts)->endpoint.transport.ctx = ctx_;              \
+        (opts)->endpoint.transport.fd = REDIS_INVALID_FD;   \
+    } while(0)
+
 #define REDIS_OPTIONS_SET_PRIVDATA(opts, data, dtor) do {  \
         (opts)->privdata = data;                           \
         (opts)->free_privdata = dtor;                      \
@@ -254,6 +297,20 @@ typedef struct redisContextFuncs {
 } redisContextFuncs;
 
 
+/* Counters of a context, see redisGetStats(). */
+typedef struct redisContextStats {
+    unsigned long long bytes_read;
+    unsigned long long bytes_written;
+    unsigned long long reads; /* Calls to the read function, e.g. read(2) */
+    unsigned long long writes; /* Calls to the write function */
+    unsigned long long read_again; /* Reads that would have blocked (EAGAIN) */
+    unsigned long long write_again; /* Writes that would have blocked */
+    unsigned long long partial_writes; /* Writes of part of the output buffer */
+    size_t obuf_peak; /* Largest output buffer */
+    unsigned long long callbacks; /* Async callbacks waiting for their reply */
+    redisReaderStats reader; /* Replies, allocations and input buffer peak */
+} redisContextStats;
+
 /* Context for a connection to Redis */
 typedef struct redisContext {
     const redisContextFuncs *funcs;   /* Function table */
@@ -294,6 +351,15 @@ typedef struct redisContext {
 
     /* An optional RESP3 PUSH handler */
     redisPushFn *push_cb;
+
+    /* Counters, read with redisGetStats() */
+    redisContextStats stats;
+
+    /* Traffic capture, see redisCaptureStart() in capture.h */
+    struct redisCapture *capture;
+
+    /* Set from redisOptions.allocator */
+    const hiredisAllocator *allocator;
 } redisContext;
 
 redisContext *redisConnectWithOptions(const redisOptions *options);
@@ -330,6 +396,12 @@ redisFD redisFreeKeepFd(redisContext *c);
 int redisBufferRead(redisContext *c);
 int redisBufferWrite(redisContext *c, int *done);
 
+/* Take a snapshot of the counters of a context. The counters are always kept,
+ * and are kept across redisReconnect(). Unlike other calls, this one may be
+ * made from any thread while the context is in use: each counter is read
+ * atomically, although the snapshot as a whole is not. */
+void redisGetStats(const redisContext *c, redisContextStats *stats);
+
 /* In a blocking context, this function first checks if there are unconsumed
  * replies to return and returns one if so. Otherwise, it flushes the output
  * buffer to the socket and reads until it has a reply. In a non-blocking
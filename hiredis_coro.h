@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __HIREDIS_CORO_H
+#define __HIREDIS_CORO_H
+
+/* Header-only C++20 coroutine front-end for asynchronous contexts:
+ *
+ *     RedisClient client(ac);
+ *     RedisReply reply = co_await client.command("GET", key);
+ *
+ * The awaitable returned by command() is the callback's private data and
+ * lives in the coroutine frame, so awaiting a command allocates nothing
+ * beyond what redisAsyncCommandArgv() does. The coroutine is resumed from
+ * the reply callback, on the event loop thread. */
+
+#if !defined(__cpp_impl_coroutine)
+#error "hiredis_coro.h requires C++20 coroutines"
+#endif
+
+#include <array>
+#include <charconv>
+#include <concepts>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "async.h"
+
+/* Owns a reply and frees it with freeReplyObject(). Empty when the command
+ * could not be sent or the connection was lost before its reply. */
+class RedisReply {
+    public:
+        RedisReply() noexcept : m_reply(nullptr) {}
+        explicit RedisReply(redisReply *reply) noexcept : m_reply(reply) {}
+        RedisReply(RedisReply &&other) noexcept : m_reply(other.release()) {}
+        RedisReply &operator=(RedisReply &&other) noexcept {
+            reset(other.release());
+            return *this;
+        }
+        RedisReply(const RedisReply &) = delete;
+        RedisReply &operator=(const RedisReply &) = delete;
+        ~RedisReply() { reset(); }
+
+        redisReply *get() const noexcept { return m_reply; }
+        redisReply *operator->() const noexcept { return m_reply; }
+        explicit operator bool() const noexcept { return m_reply != nullptr; }
+
+        bool isError() const noexcept {
+            return m_reply && m_reply->type == REDIS_REPLY_ERROR;
+        }
+        /* Contents of string-like replies, empty for others. */
+        std::string_view str() const noexcept {
+            if (m_reply == nullptr || m_reply->str == nullptr)
+                return {};
+            return std::string_view(m_reply->str, m_reply->len);
+        }
+
+        redisReply *release() noexcept {
+            return std::exchange(m_reply, nullptr);
+        }
+        void reset(redisReply *reply = nullptr) noexcept {
+            if (m_reply)
+                freeReplyObject(m_reply);
+            m_reply = reply;
+        }
+
+    private:
+        redisReply *m_reply;
+};
+
+/* Arguments of a command. Strings are referenced, not copied, so they must
+ * outlive the command; integers are formatted in place. Up to InlineArgs
+ * arguments are kept inside the object, without allocating. */
+class RedisCommand {
+    public:
+        static constexpr std::size_t InlineArgs = 8;
+
+        RedisCommand() noexcept = default;
+        template <typename... Args>
+        explicit RedisCommand(Args &&...args) {
+            (arg(std::forward<Args>(args)), ...);
+        }
+        RedisCommand(RedisCommand &&other) noexcept { moveFrom(other); }
+        RedisCommand &operator=(RedisCommand &&other) noexcept {
+            if (this != &other)
+                moveFrom(other);
+            return *this;
+        }
+        RedisCommand(const RedisCommand &) = delete;
+        RedisCommand &operator=(const RedisCommand &) = delete;
+
+        RedisCommand &arg(std::string_view s) {
+            push(s.data(), s.size());
+            return *this;
+        }
+        RedisCommand &arg(const char *s) {
+            return arg(std::string_view(s));
+        }
+        template <std::integral T>
+        RedisCommand &arg(T value) {
+            char *buf;
+            if (m_nnumbers < InlineArgs) {
+                buf = m_numbers[m_nnumbers].data();
+            } else {
+                m_moreNumbers.push_back(std::make_unique<std::array<char, NumberSize>>());
+                buf = m_moreNumbers.back()->data();
+            }
+            m_nnumbers++;
+            auto res = std::to_chars(buf, buf + NumberSize, value);
+            push(buf, res.ptr - buf);
+            return *this;
+        }
+
+        int argc() const noexcept { return static_cast<int>(m_argc); }
+        const char **argv() noexcept {
+            return m_argc <= InlineArgs ? m_argv.data() : m_moreArgv.data();
+        }
+        const std::size_t *argvlen() const noexcept {
+            return m_argc <= InlineArgs ? m_argvlen.data() : m_moreArgvlen.data();
+        }
+
+    private:
+        /* Enough for any 64 bit integer. */
+        static constexpr std::size_t NumberSize = 24;
+
+        void push(const char *s, std::size_t len) {
+            if (m_argc < InlineArgs) {
+                m_argv[m_argc] = s;
+                m_argvlen[m_argc] = len;
+            } else {
+                if (m_argc == InlineArgs) {
+                    m_moreArgv.assign(m_argv.begin(), m_argv.end());
+                    m_moreArgvlen.assign(m_argvlen.begin(), m_argvlen.end());
+                }
+                m_moreArgv.push_back(s);
+                m_moreArgvlen.push_back(len);
+            }
+            m_argc++;
+        }
+
+        /* Arguments formatted in m_numbers point into the other object, so
+         * they are pointed to the copy here instead. The vectors keep their
+         * buffers when moved. */
+        void moveFrom(RedisCommand &other) noexcept {
+            const char *begin = other.m_numbers[0].data();
+            const char *end = begin + sizeof(m_numbers);
+            std::size_t i;
+
+            m_argc = other.m_argc;
+            m_nnumbers = other.m_nnumbers;
+            m_numbers = other.m_numbers;
+            m_argv = other.m_argv;
+            m_argvlen = other.m_argvlen;
+            m_moreArgv = std::move(other.m_moreArgv);
+            m_moreArgvlen = std::move(other.m_moreArgvlen);
+            m_moreNumbers = std::move(other.m_moreNumbers);
+
+            const char **argv = this->argv();
+            std::less<const char *> less;
+            for (i = 0; i < m_argc; i++) {
+                if (!less(argv[i], begin) && less(argv[i], end))
+                    argv[i] = m_numbers[0].data() + (argv[i] - begin);
+            }
+            other.m_argc = 0;
+            other.m_nnumbers = 0;
+        }
+
+        std::size_t m_argc = 0;
+        std::size_t m_nnumbers = 0;
+        std::array<const char *, InlineArgs> m_argv;
+        std::array<std::size_t, InlineArgs> m_argvlen;
+        std::array<std::array<char, NumberSize>, InlineArgs> m_numbers;
+        std::vector<const char *> m_moreArgv;
+        std::vector<std::size_t> m_moreArgvlen;
+        /* Allocated one by one, so they don't move as the vector grows. */
+        std::vector<std::unique_ptr<std::array<char, NumberSize>>> m_moreNumbers;
+};
+
+/* Awaitable for one command, returned by RedisClient::command(). It must be
+ * awaited right away, and the awaiting coroutine must not be destroyed
+ * before it is resumed: freeing the context resumes it with an empty
+ * reply. */
+class RedisAwaitable {
+    public:
+        RedisAwaitable(redisAsyncContext *ac, RedisCommand &&cmd) noexcept
+            : m_ac(ac), m_cmd(std::move(cmd)) {}
+        RedisAwaitable(const RedisAwaitable &) = delete;
+        RedisAwaitable &operator=(const RedisAwaitable &) = delete;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) noexcept {
+            int status;
+
+            m_handle = handle;
+            m_suspending = true;
+            status = redisAsyncCommandArgv(m_ac, callback, this, m_cmd.argc(),
+                                           m_cmd.argv(), m_cmd.argvlen());
+            m_suspending = false;
+
+            /* Don't suspend if the command failed, or was answered right
+             * away, e.g. from the client side cache. */
+            return status == REDIS_OK && !m_done;
+        }
+
+        RedisReply await_resume() noexcept { return std::move(m_reply); }
+
+    private:
+        static void callback(redisAsyncContext *ac, void *r, void *privdata) {
+            RedisAwaitable *self = static_cast<RedisAwaitable *>(privdata);
+
+            self->m_reply.reset(take(ac, static_cast<redisReply *>(r)));
+            self->m_done = true;
+            if (!self->m_suspending)
+                self->m_handle.resume();
+        }
+
+        /* The reply belongs to the context and is freed when the callback
+         * returns, unless REDIS_OPT_NO_AUTO_FREE_REPLIES is set. Its
+         * contents are moved into a new top level object instead of being
+         * copied. */
+        static redisReply *take(redisAsyncContext *ac, redisReply *r) noexcept {
+            if (r == nullptr || (ac->c.flags & REDIS_NO_AUTO_FREE_REPLIES))
+                return r;
+            return redisTakeReply(r);
+        }
+
+        redisAsyncContext *m_ac;
+        RedisCommand m_cmd;
+        RedisReply m_reply;
+        std::coroutine_handle<> m_handle;
+        bool m_suspending = false;
+        bool m_done = false;
+};
+
+/* Coroutine front-end of an asynchronous context, which it does not own. */
+class RedisClient {
+    public:
+        explicit RedisClient(redisAsyncContext *ac) noexcept : m_ac(ac) {}
+
+        redisAsyncContext *context() const noexcept { return m_ac; }
+
+        template <typename... Args>
+        RedisAwaitable command(Args &&...args) {
+            return RedisAwaitable(m_ac, RedisCommand(std::forward<Args>(args)...));
+        }
+        RedisAwaitable command(RedisCommand &&cmd) noexcept {
+            return RedisAwaitable(m_ac, std::move(cmd));
+        }
+
+    private:
+        redisAsyncContext *m_ac;
+};
+
+/* Minimal coroutine type for coroutines nobody waits for: it starts right
+ * away and frees itself when done. Exceptions escaping it terminate. */
+struct RedisDetached {
+    struct promise_type {
+        RedisDetached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+#endif
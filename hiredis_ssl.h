@@ -60,7 +60,8 @@ typedef enum {
     REDIS_SSL_CTX_PRIVATE_KEY_LOAD_FAILED,      /* Failed to load private key */
     REDIS_SSL_CTX_OS_CERTSTORE_OPEN_FAILED,     /* Failed to open system certificate store */
     REDIS_SSL_CTX_OS_CERT_ADD_FAILED,           /* Failed to add CA certificates obtained from system to the SSL context */
-    REDIS_SSL_CTX_VERIFY_NAME_FAILED            /* Failed to set the expected peer certificate name for verification */
+    REDIS_SSL_CTX_VERIFY_NAME_FAILED,           /* Failed to set the expected peer certificate name for verification */
+    REDIS_SSL_CTX_INVALID_OPTION                /* A buffer or record size option is out of range */
 } redisSSLContextError;
 
 /* Constants that mirror OpenSSL's verify modes. By default,
@@ -74,6 +75,26 @@ typedef enum {
 #define REDIS_SSL_VERIFY_CLIENT_ONCE 0x04
 #define REDIS_SSL_VERIFY_POST_HANDSHAKE 0x08
 
+/* Default number of TLS sessions a redisSSLContext keeps for resumption. */
+#define REDIS_SSL_SESSION_CACHE_SIZE 256
+
+/* Bits for redisSSLOptions.options */
+
+/* Let the kernel encrypt (and, where supported, decrypt) TLS records once the
+ * handshake is complete. Requires OpenSSL 3.0 built with kTLS support and a
+ * kernel with the tls module; otherwise records are processed by OpenSSL as
+ * usual. Use redisGetSSLKTLSFlags() to find out what was offloaded. */
+#define REDIS_SSL_OPT_ENABLE_KTLS 0x01
+
+/* Free the OpenSSL read and write buffers of a connection whenever they are
+ * empty, instead of keeping them (about 34KB) for its lifetime. Trades a few
+ * allocations per request for a much smaller footprint of idle connections. */
+#define REDIS_SSL_OPT_RELEASE_BUFFERS 0x02
+
+/* Flags returned by redisGetSSLKTLSFlags() */
+#define REDIS_SSL_KTLS_SEND 0x01
+#define REDIS_SSL_KTLS_RECV 0x02
+
 /* Options to create an OpenSSL context. */
 typedef struct {
     const char *cacert_filename;
@@ -97,6 +118,22 @@ typedef struct {
      * Note that server_name is used for SNI routing only and does NOT verify
      * the peer's identity. */
     const char *verify_name;
+    /* Maximum number of TLS sessions cached for resumption, keyed by SNI and
+     * server address. Connections initiated with redisInitiateSSLWithContext()
+     * (including after redisReconnect()) resume a cached session with the same
+     * server instead of doing a full handshake. 0 selects
+     * REDIS_SSL_SESSION_CACHE_SIZE, a negative value disables resumption. */
+    int session_cache_size;
+    /* Bit field of REDIS_SSL_OPT_xxx */
+    int options;
+    /* Maximum plaintext size of the TLS records we send, between 512 and
+     * 16384. Smaller records mean a smaller write buffer. 0 keeps the OpenSSL
+     * default (16384). */
+    int max_send_fragment;
+    /* When non-zero, enable read-ahead with a read buffer of this size so
+     * several records can be read with a single read(2). 0 (the default)
+     * disables read-ahead, which keeps the read buffer to a single record. */
+    int read_ahead_len;
 } redisSSLOptions;
 
 /**
@@ -174,6 +211,21 @@ int redisInitiateSSLWithContext(redisContext *c, redisSSLContext *redis_ssl_ctx)
 
 int redisInitiateSSL(redisContext *c, struct ssl_st *ssl);
 
+/**
+ * Return 1 if the SSL/TLS connection of the context resumed a previous
+ * session instead of performing a full handshake, 0 otherwise.
+ */
+
+int redisIsSSLSessionReused(redisContext *c);
+
+/**
+ * Return a combination of REDIS_SSL_KTLS_SEND and REDIS_SSL_KTLS_RECV
+ * describing which directions of the SSL/TLS connection of the context are
+ * handled by kernel TLS, or 0 if none are.
+ */
+
+int redisGetSSLKTLSFlags(redisContext *c);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fmacros.h"
+#include "alloc.h"
+#include <string.h>
+#include "histogram.h"
+
+/* Values below 2^HISTOGRAM_BITS have a bucket each. Above, every power of two
+ * is split in HISTOGRAM_SUB linear buckets: a value v with its highest bit at
+ * position m goes in bucket e * HISTOGRAM_SUB + (v >> e), where
+ * e = m - HISTOGRAM_BITS + 1 keeps the top HISTOGRAM_BITS bits of v. */
+#define HISTOGRAM_BITS 6
+#define HISTOGRAM_SUB (1 << (HISTOGRAM_BITS - 1))
+
+/* The buckets array grows by this many buckets. */
+#define HISTOGRAM_CHUNK 64
+
+struct redisHistogram {
+    unsigned long long *counts;
+    int buckets;
+
+    unsigned long long count;
+    unsigned long long min;
+    unsigned long long max;
+    double sum;
+};
+
+static int histogramHighestBit(unsigned long long v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(v);
+#else
+    int m = 0;
+    while (v >>= 1)
+        m++;
+    return m;
+#endif
+}
+
+static int histogramBucket(unsigned long long v) {
+    int e;
+
+    if (v < (1ULL << HISTOGRAM_BITS))
+        return (int)v;
+    e = histogramHighestBit(v) - HISTOGRAM_BITS + 1;
+    return e * HISTOGRAM_SUB + (int)(v >> e);
+}
+
+/* Highest value that goes in a bucket. */
+static unsigned long long histogramBucketMax(int bucket) {
+    int e;
+
+    if (bucket < (1 << HISTOGRAM_BITS))
+        return bucket;
+    e = bucket / HISTOGRAM_SUB - 1;
+    return ((unsigned long long)(bucket - e * HISTOGRAM_SUB + 1) << e) - 1;
+}
+
+redisHistogram *redisHistogramCreate(void) {
+    return hi_calloc(1, sizeof(redisHistogram));
+}
+
+int redisHistogramRecord(redisHistogram *h, unsigned long long value) {
+    int bucket = histogramBucket(value);
+
+    if (bucket >= h->buckets) {
+        int buckets = (bucket / HISTOGRAM_CHUNK + 1) * HISTOGRAM_CHUNK;
+        unsigned long long *counts;
+
+        counts = hi_realloc(h->counts, buckets * sizeof(*counts));
+        if (counts == NULL)
+            return REDIS_ERR;
+        memset(counts + h->buckets, 0, (buckets - h->buckets) * sizeof(*counts));
+        h->counts = counts;
+        h->buckets = buckets;
+    }
+
+    h->counts[bucket]++;
+    if (h->count == 0 || value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+    h->count++;
+    h->sum += (double)value;
+    return REDIS_OK;
+}
+
+unsigned long long redisHistogramCount(const redisHistogram *h) {
+    return h->count;
+}
+
+double redisHistogramMean(const redisHistogram *h) {
+    return h->count ? h->sum / h->count : 0;
+}
+
+unsigned long long redisHistogramMin(const redisHistogram *h) {
+    return h->min;
+}
+
+unsigned long long redisHistogramMax(const redisHistogram *h) {
+    return h->max;
+}
+
+unsigned long long redisHistogramPercentile(const redisHistogram *h, double percentile) {
+    unsigned long long rank, seen = 0, value;
+    double target;
+    int i;
+
+    if (h->count == 0)
+        return 0;
+    if (percentile <= 0)
+        return h->min;
+
+    /* Rank of the value, counting from 1. */
+    target = percentile / 100 * h->count;
+    rank = (unsigned long long)target;
+    if (rank < target || rank < 1)
+        rank++;
+    if (rank > h->count)
+        rank = h->count;
+
+    for (i = 0; i < h->buckets; i++) {
+        seen += h->counts[i];
+        if (seen >= rank)
+            break;
+    }
+
+    value = histogramBucketMax(i);
+    return value < h->max ? value : h->max;
+}
+
+void redisHistogramReset(redisHistogram *h) {
+    if (h->counts)
+        memset(h->counts, 0, h->buckets * sizeof(*h->counts));
+    h->count = 0;
+    h->min = 0;
+    h->max = 0;
+    h->sum = 0;
+}
+
+void redisHistogramFree(redisHistogram *h) {
+    if (h == NULL)
+        return;
+    hi_free(h->counts);
+    hi_free(h);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HIREDIS_HISTOGRAM_H
+#define __HIREDIS_HISTOGRAM_H
+#include "hiredis.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A log-linear histogram, as HdrHistogram: values below 64 are counted
+ * exactly, and larger ones in 32 buckets per power of two, i.e. within about
+ * 3% of their value. Memory grows with the largest value recorded, to about
+ * 6KB for values up to a minute in microseconds. */
+typedef struct redisHistogram redisHistogram;
+
+/* Create an empty histogram. Returns NULL when out of memory. */
+redisHistogram *redisHistogramCreate(void);
+
+/* Count a value. Returns REDIS_ERR when out of memory. */
+int redisHistogramRecord(redisHistogram *h, unsigned long long value);
+
+/* Number of values, their mean, and the smallest and largest values. All
+ * are 0 for an empty histogram. */
+unsigned long long redisHistogramCount(const redisHistogram *h);
+double redisHistogramMean(const redisHistogram *h);
+unsigned long long redisHistogramMin(const redisHistogram *h);
+unsigned long long redisHistogramMax(const redisHistogram *h);
+
+/* Value below or at which the given percentage (0 to 100) of the values
+ * are, e.g. 99.9 for the p999. The result is the highest value of the bucket
+ * the percentile falls into, but never above the largest value recorded. */
+unsigned long long redisHistogramPercentile(const redisHistogram *h, double percentile);
+
+/* Remove all values. */
+void redisHistogramReset(redisHistogram *h);
+
+void redisHistogramFree(redisHistogram *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -336,6 +336,12 @@ static int redisContextWaitReady(redisContext *c, long msec) {
 }
 
 int redisCheckConnectDone(redisContext *c, int *completed) {
+    /* A transport is connected once it is created. */
+    if (c->connection_type == REDIS_CONN_TRANSPORT) {
+        *completed = 1;
+        return REDIS_OK;
+    }
+
     int rc = connect(c->fd, (const struct sockaddr *)c->saddr, c->addrlen);
     if (rc == 0) {
         *completed = 1;
@@ -401,6 +407,9 @@ int redisContextSetTimeout(redisContext *c, const struct timeval tv) {
         __redisSetError(c, REDIS_ERR_OOM, "Out of memory");
         return REDIS_ERR;
     }
+    /* Transports apply c->command_timeout themselves, if at all. */
+    if (c->connection_type == REDIS_CONN_TRANSPORT)
+        return REDIS_OK;
     if (setsockopt(c->fd,SOL_SOCKET,SO_RCVTIMEO,to_ptr,to_sz) == -1) {
         __redisSetErrorFromErrno(c,REDIS_ERR_IO,"setsockopt(SO_RCVTIMEO)");
         return REDIS_ERR;
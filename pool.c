@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fmacros.h"
+#include "alloc.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+#include "pool.h"
+#include "win32.h"
+
+/* Forward declarations of hiredis.c functions */
+void __redisSetError(redisContext *c, int type, const char *str);
+int __redisCheckSharedOptions(const redisOptions *options);
+int __redisCopyOptions(redisOptions *dst, const redisOptions *src);
+void __redisFreeOptions(redisOptions *options);
+
+/* The pool is a fixed array of max_size slots. A slot either holds an open
+ * connection or is empty, and is at any time in exactly one of three places:
+ * the idle stack, the empty stack, or checked out by a caller. Both stacks
+ * are lock-free (Treiber) stacks linked through slot indexes, so checkout and
+ * checkin are a single compare-and-swap in the common case.
+ *
+ * A stack head packs the index of the top slot plus one (0 for an empty
+ * stack) in its low 32 bits, and a counter bumped on every pop in its high
+ * 32 bits so a head that was popped and pushed back in between is not
+ * mistaken for an unchanged one (ABA). */
+
+/* Atomic helpers. The compare-and-swap ones update *expected with the
+ * current value on failure, like C11 atomic_compare_exchange. */
+#ifdef _MSC_VER
+static uint64_t poolLoad64(uint64_t *p) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p, 0, 0);
+}
+static int poolCAS64(uint64_t *p, uint64_t *expected, uint64_t desired) {
+    uint64_t cur = (uint64_t)InterlockedCompareExchange64((volatile LONG64 *)p,
+                                                          (LONG64)desired, (LONG64)*expected);
+    if (cur == *expected)
+        return 1;
+    *expected = cur;
+    return 0;
+}
+static uint32_t poolLoad32(uint32_t *p) {
+    return (uint32_t)InterlockedCompareExchange((volatile LONG *)p, 0, 0);
+}
+static void poolStore32(uint32_t *p, uint32_t v) {
+    InterlockedExchange((volatile LONG *)p, (LONG)v);
+}
+static int poolLoadInt(int *p) {
+    return (int)InterlockedCompareExchange((volatile LONG *)p, 0, 0);
+}
+static int poolCASInt(int *p, int *expected, int desired) {
+    int cur = (int)InterlockedCompareExchange((volatile LONG *)p, desired, *expected);
+    if (cur == *expected)
+        return 1;
+    *expected = cur;
+    return 0;
+}
+static void poolDecrInt(int *p) {
+    InterlockedDecrement((volatile LONG *)p);
+}
+static int poolLoadSeq(int *p) {
+    return (int)InterlockedCompareExchange((volatile LONG *)p, 0, 0);
+}
+static void poolBumpSeq(int *p) {
+    InterlockedIncrement((volatile LONG *)p);
+}
+static redisContext *poolLoadPtr(redisContext **p) {
+    return InterlockedCompareExchangePointer((PVOID volatile *)p, NULL, NULL);
+}
+static void poolStorePtr(redisContext **p, redisContext *v) {
+    InterlockedExchangePointer((PVOID volatile *)p, v);
+}
+#else
+static uint64_t poolLoad64(uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static int poolCAS64(uint64_t *p, uint64_t *expected, uint64_t desired) {
+    return __atomic_compare_exchange_n(p, expected, desired, 0, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE);
+}
+static uint32_t poolLoad32(uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static void poolStore32(uint32_t *p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+static int poolLoadInt(int *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static int poolCASInt(int *p, int *expected, int desired) {
+    return __atomic_compare_exchange_n(p, expected, desired, 0, __ATOMIC_RELAXED,
+                                       __ATOMIC_RELAXED);
+}
+static void poolDecrInt(int *p) {
+    __atomic_sub_fetch(p, 1, __ATOMIC_RELAXED);
+}
+/* Sequence counters order the stack operations around them. */
+static int poolLoadSeq(int *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+static void poolBumpSeq(int *p) {
+    __atomic_add_fetch(p, 1, __ATOMIC_RELEASE);
+}
+static redisContext *poolLoadPtr(redisContext **p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static void poolStorePtr(redisContext **p, redisContext *v) {
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+#endif
+
+typedef struct redisPoolSlot {
+    /* Connection, or NULL for an empty slot. Only changed by the owner of
+     * the slot, but read by redisPoolPut() scans from any thread. */
+    redisContext *c;
+    /* Monotonic time in milliseconds the connection was last put back. */
+    long long lastUsed;
+    /* Next slot in the stack, as index plus one (0 for none). */
+    uint32_t next;
+} redisPoolSlot;
+
+typedef struct redisPoolStack {
+    uint64_t head;
+} redisPoolStack;
+
+struct redisPool {
+    redisOptions options;
+    int min_size;
+    int max_size;
+    long long idle_timeout;     /* In milliseconds, -1 to never evict */
+    long long health_check;     /* In milliseconds, -1 to never check */
+    redisPoolConnectFn *connect_cb;
+    void *connect_privdata;
+
+    /* Number of slots holding a connection. */
+    int size;
+    /* Bumped when redisPoolEvictIdle() takes the idle stack and when it is
+     * done, so it is odd while idle connections may be hidden from
+     * redisPoolGet(). */
+    int scans;
+
+    redisPoolStack idle;
+    redisPoolStack empty;
+    redisPoolSlot *slots;
+};
+
+static long long poolMillis(void) {
+#ifndef _MSC_VER
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((long long)now.tv_sec * 1000) + now.tv_nsec / 1000000;
+#else
+    return (long long)GetTickCount64();
+#endif
+}
+
+static long long poolTimevalMillis(const struct timeval *tv) {
+    if (tv == NULL)
+        return -1;
+    return ((long long)tv->tv_sec * 1000) + tv->tv_usec / 1000;
+}
+
+static void poolPush(redisPool *pool, redisPoolStack *stack, redisPoolSlot *slot) {
+    uint32_t id = (uint32_t)(slot - pool->slots) + 1;
+    uint64_t head = poolLoad64(&stack->head), next;
+
+    do {
+        poolStore32(&slot->next, (uint32_t)head);
+        next = (head & 0xffffffff00000000ULL) | id;
+    } while (!poolCAS64(&stack->head, &head, next));
+}
+
+static redisPoolSlot *poolPop(redisPool *pool, redisPoolStack *stack) {
+    uint64_t head = poolLoad64(&stack->head), next;
+    redisPoolSlot *slot;
+
+    do {
+        if ((uint32_t)head == 0)
+            return NULL;
+        slot = &pool->slots[(uint32_t)head - 1];
+        /* The slot may be popped and relinked concurrently, in which case
+         * the counter makes the CAS below fail and we retry. */
+        next = ((head >> 32) + 1) << 32 | poolLoad32(&slot->next);
+    } while (!poolCAS64(&stack->head, &head, next));
+
+    return slot;
+}
+
+/* Reserve room for one more connection, unless max_size is reached. */
+static int poolTryGrow(redisPool *pool) {
+    int size = poolLoadInt(&pool->size);
+
+    do {
+        if (size >= pool->max_size)
+            return 0;
+    } while (!poolCASInt(&pool->size, &size, size + 1));
+
+    return 1;
+}
+
+/* Give up room for one connection, unless only min_size are left. */
+static int poolTryShrink(redisPool *pool) {
+    int size = poolLoadInt(&pool->size);
+
+    do {
+        if (size <= pool->min_size)
+            return 0;
+    } while (!poolCASInt(&pool->size, &size, size - 1));
+
+    return 1;
+}
+
+static void poolSetup(redisPool *pool, redisContext *c) {
+    if (c->err || pool->connect_cb == NULL)
+        return;
+
+    if (pool->connect_cb(c, pool->connect_privdata) != REDIS_OK && c->err == 0)
+        __redisSetError(c, REDIS_ERR_OTHER, "Pool connect callback failed");
+}
+
+static void poolReconnect(redisPool *pool, redisContext *c) {
+    if (redisReconnect(c) == REDIS_OK)
+        poolSetup(pool, c);
+}
+
+/* Check a connection idle for a while with a PING, as the server may have
+ * closed it in the meantime. */
+static int poolHealthy(redisContext *c) {
+    redisReply *reply = NULL;
+    int ok;
+
+    if (redisAppendCommand(c, "PING") != REDIS_OK ||
+        redisGetReply(c, (void **)&reply) != REDIS_OK)
+        return 0;
+
+    ok = reply->type == REDIS_REPLY_STATUS && strcmp(reply->str, "PONG") == 0;
+    freeReplyObject(reply);
+    return ok;
+}
+
+redisPool *redisPoolCreate(const redisPoolOptions *options) {
+    const redisOptions *ropts = &options->options;
+    redisPool *pool;
+    int i;
+
+    if (options->max_size <= 0 || options->min_size < 0 ||
+        options->min_size > options->max_size)
+        return NULL;
+
+    /* Connections must be blocking. */
+    if (__redisCheckSharedOptions(ropts) != REDIS_OK || (ropts->options & REDIS_OPT_NONBLOCK))
+        return NULL;
+
+    pool = hi_calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->slots = hi_calloc(options->max_size, sizeof(*pool->slots));
+    if (pool->slots == NULL || __redisCopyOptions(&pool->options, ropts) != REDIS_OK)
+        goto oom;
+
+    pool->min_size = options->min_size;
+    pool->max_size = options->max_size;
+    pool->idle_timeout = poolTimevalMillis(options->idle_timeout);
+    pool->health_check = poolTimevalMillis(options->health_check_interval);
+    pool->connect_cb = options->connect_cb;
+    pool->connect_privdata = options->connect_privdata;
+
+    /* Push in reverse so the first slots are handed out first. */
+    for (i = pool->max_size - 1; i >= 0; i--)
+        poolPush(pool, &pool->empty, &pool->slots[i]);
+
+    for (i = 0; i < pool->min_size; i++) {
+        redisContext *c = redisPoolGet(pool);
+        if (c == NULL)
+            goto oom;
+        redisPoolPut(pool, c);
+    }
+
+    return pool;
+
+oom:
+    redisPoolFree(pool);
+    return NULL;
+}
+
+redisContext *redisPoolGet(redisPool *pool) {
+    redisPoolSlot *slot;
+    redisContext *c;
+    int scans;
+
+    do {
+        scans = poolLoadSeq(&pool->scans);
+
+        if ((slot = poolPop(pool, &pool->idle)) != NULL) {
+            c = slot->c;
+            if (c->err) {
+                poolReconnect(pool, c);
+            } else if (pool->health_check >= 0 &&
+                       poolMillis() - slot->lastUsed >= pool->health_check &&
+                       !poolHealthy(c))
+            {
+                poolReconnect(pool, c);
+            }
+            return c;
+        }
+
+        /* Room was reserved, so an empty slot is available unless a
+         * concurrent eviction has not pushed back the slot it freed yet. */
+        if (poolTryGrow(pool)) {
+            if ((slot = poolPop(pool, &pool->empty)) != NULL)
+                break;
+            poolDecrInt(&pool->size);
+        }
+
+        /* Nothing is available, which is only certain if no eviction was
+         * holding the idle connections in the meantime. */
+    } while ((scans & 1) || poolLoadSeq(&pool->scans) != scans);
+
+    if (slot == NULL)
+        return NULL;
+
+    c = redisConnectWithOptions(&pool->options);
+    if (c == NULL) {
+        poolPush(pool, &pool->empty, slot);
+        poolDecrInt(&pool->size);
+        return NULL;
+    }
+
+    poolSetup(pool, c);
+    poolStorePtr(&slot->c, c);
+    return c;
+}
+
+void redisPoolPut(redisPool *pool, redisContext *c) {
+    redisPoolSlot *slot = NULL;
+    int i;
+
+    if (c == NULL)
+        return;
+
+    /* Contexts stay in the same slot for as long as they are open, and only
+     * the caller can be changing the slot of its own context, so a scan is
+     * enough to find it back without any extra bookkeeping in the context. */
+    for (i = 0; i < pool->max_size; i++) {
+        if (poolLoadPtr(&pool->slots[i].c) == c) {
+            slot = &pool->slots[i];
+            break;
+        }
+    }
+    assert(slot != NULL);
+
+    slot->lastUsed = poolMillis();
+    poolPush(pool, &pool->idle, slot);
+}
+
+int redisPoolEvictIdle(redisPool *pool) {
+    redisPoolSlot *keep = NULL, *slot;
+    long long now;
+    int evicted = 0, scans;
+
+    if (pool->idle_timeout < 0)
+        return 0;
+
+    /* Only one eviction runs at a time. */
+    scans = poolLoadSeq(&pool->scans);
+    do {
+        if (scans & 1)
+            return 0;
+    } while (!poolCASInt(&pool->scans, &scans, scans + 1));
+
+    /* Take the whole idle stack, so other threads don't race with us for the
+     * ones being looked at; redisPoolGet() waits for them rather than fail.
+     * The stack is LIFO, so the least recently used connections are at its
+     * bottom. */
+    now = poolMillis();
+    while ((slot = poolPop(pool, &pool->idle)) != NULL) {
+        if (now - slot->lastUsed >= pool->idle_timeout && poolTryShrink(pool)) {
+            redisContext *c = slot->c;
+            poolStorePtr(&slot->c, NULL);
+            poolPush(pool, &pool->empty, slot);
+            redisFree(c);
+            evicted++;
+        } else {
+            /* Keep the order of the survivors, reusing next as a list link
+             * as the slot belongs to us for now. */
+            poolStore32(&slot->next, keep ? (uint32_t)(keep - pool->slots) + 1 : 0);
+            keep = slot;
+        }
+    }
+
+    while (keep) {
+        uint32_t next = poolLoad32(&keep->next);
+        poolPush(pool, &pool->idle, keep);
+        keep = next ? &pool->slots[next - 1] : NULL;
+    }
+
+    poolBumpSeq(&pool->scans);
+    return evicted;
+}
+
+int redisPoolSize(redisPool *pool) {
+    return poolLoadInt(&pool->size);
+}
+
+void redisPoolFree(redisPool *pool) {
+    int i;
+
+    if (pool == NULL)
+        return;
+
+    if (pool->slots) {
+        for (i = 0; i < pool->max_size; i++)
+            redisFree(pool->slots[i].c);
+        hi_free(pool->slots);
+    }
+
+    __redisFreeOptions(&pool->options);
+    hi_free(pool);
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HIREDIS_POOL_H
+#define __HIREDIS_POOL_H
+#include "hiredis.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called on every connection the pool opens or reconnects, before it is
+ * handed out, to set it up (e.g. redisInitiateSSLWithContext(), AUTH or
+ * SELECT). Return REDIS_OK on success; on REDIS_ERR the connection is
+ * considered broken and will be reconnected on its next checkout. */
+typedef int (redisPoolConnectFn)(redisContext *c, void *privdata);
+
+typedef struct redisPoolOptions {
+    /* How to connect to the server. Only the TCP and unix socket connection
+     * types are supported, as connections must be able to reconnect. */
+    redisOptions options;
+
+    /* Number of connections opened when the pool is created, and below which
+     * idle connections are not evicted. */
+    int min_size;
+    /* Maximum number of connections, checked out or idle. */
+    int max_size;
+
+    /* Connections idle for longer than this are closed by
+     * redisPoolEvictIdle() as long as more than min_size are open. If NULL,
+     * idle connections are never evicted. */
+    const struct timeval *idle_timeout;
+    /* Connections idle for longer than this are checked with a PING before
+     * being handed out, and reconnected if it fails. If NULL, no health
+     * check is done. */
+    const struct timeval *health_check_interval;
+
+    /* Optional connection setup callback and its private data. */
+    redisPoolConnectFn *connect_cb;
+    void *connect_privdata;
+} redisPoolOptions;
+
+typedef struct redisPool redisPool;
+
+/* Create a pool and open its first min_size connections. Connections that
+ * cannot be opened now are retried on checkout, so this only returns NULL
+ * for invalid options or when out of memory. */
+redisPool *redisPoolCreate(const redisPoolOptions *options);
+
+/* Check a connection out of the pool. Safe to call from any thread.
+ *
+ * Returns NULL when max_size connections are already checked out, or when out
+ * of memory. While a concurrent redisPoolEvictIdle() holds the idle
+ * connections, this waits for it to give them back instead of failing. Otherwise the returned context is owned by the caller until it
+ * is given back with redisPoolPut(). Like redisConnect(), the context may
+ * have its err field set if the connection could not be (re)established; it
+ * must still be put back, and will be reconnected on a later checkout. */
+redisContext *redisPoolGet(redisPool *pool);
+
+/* Give a connection back to the pool. Safe to call from any thread. A
+ * connection with its err field set is reconnected on its next checkout, so
+ * callers don't have to distinguish broken connections. */
+void redisPoolPut(redisPool *pool, redisContext *c);
+
+/* Close idle connections that exceeded idle_timeout, keeping at least
+ * min_size connections open. Meant to be called periodically, e.g. from a
+ * housekeeping thread. Returns the number of connections closed, 0 if
+ * another call is already in progress. */
+int redisPoolEvictIdle(redisPool *pool);
+
+/* Number of connections currently open, checked out or idle. */
+int redisPoolSize(redisPool *pool);
+
+/* Free the pool and close all its connections. No connection may be checked
+ * out, nor any other pool call be in progress. */
+void redisPoolFree(redisPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,554 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "fmacros.h"
+#include "alloc.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _MSC_VER
+#include <strings.h>
+#endif
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "queue.h"
+#include "async_private.h"
+#include "win32.h"
+
+/* Both queues are lock-free (Treiber) stacks of commands: producers push with
+ * a compare-and-swap on the head, and the single consumer takes the whole
+ * stack at once by swapping the head with NULL, then reverses it to get the
+ * commands in the order they were pushed. There is no ABA problem as nodes
+ * are never popped one by one.
+ *
+ * A producer signals the wakeup fd only when it pushes onto an empty stack,
+ * so a batch of commands costs a single wakeup. The consumer clears the fd
+ * before taking the stack, so a push racing with it either lands in the
+ * batch being taken or signals again. */
+
+typedef struct redisQueueItem {
+    struct redisQueueItem *next;
+    redisCallbackFn *fn;
+    void *privdata;
+    redisCompletionQueue *cq;
+
+    /* Formatted command, until it is drained. */
+    char *cmd;
+    size_t len;
+
+    /* Context and reply handed over to the completion queue. */
+    redisAsyncContext *ac;
+    redisReply *reply;
+} redisQueueItem;
+
+/* Atomic helpers. The compare-and-swap one updates *expected with the
+ * current value on failure, like C11 atomic_compare_exchange. */
+#ifdef _MSC_VER
+static redisQueueItem *queueLoad(redisQueueItem **p) {
+    return InterlockedCompareExchangePointer((PVOID volatile *)p, NULL, NULL);
+}
+static int queueCAS(redisQueueItem **p, redisQueueItem **expected, redisQueueItem *desired) {
+    redisQueueItem *cur = InterlockedCompareExchangePointer((PVOID volatile *)p,
+                                                            desired, *expected);
+    if (cur == *expected)
+        return 1;
+    *expected = cur;
+    return 0;
+}
+static redisQueueItem *queueExchange(redisQueueItem **p, redisQueueItem *v) {
+    return InterlockedExchangePointer((PVOID volatile *)p, v);
+}
+#else
+static redisQueueItem *queueLoad(redisQueueItem **p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+static int queueCAS(redisQueueItem **p, redisQueueItem **expected, redisQueueItem *desired) {
+    return __atomic_compare_exchange_n(p, expected, desired, 0, __ATOMIC_RELEASE,
+                                       __ATOMIC_RELAXED);
+}
+static redisQueueItem *queueExchange(redisQueueItem **p, redisQueueItem *v) {
+    return __atomic_exchange_n(p, v, __ATOMIC_ACQUIRE);
+}
+#endif
+
+/* Push an item, returning 1 if the stack was empty. */
+static int queuePush(redisQueueItem **head, redisQueueItem *item) {
+    redisQueueItem *top = queueLoad(head);
+
+    do {
+        item->next = top;
+    } while (!queueCAS(head, &top, item));
+
+    return top == NULL;
+}
+
+/* Take all items, oldest first. */
+static redisQueueItem *queueTakeAll(redisQueueItem **head) {
+    redisQueueItem *item = queueExchange(head, NULL), *list = NULL, *next;
+
+    while (item != NULL) {
+        next = item->next;
+        item->next = list;
+        list = item;
+        item = next;
+    }
+
+    return list;
+}
+
+static void queueFreeItem(redisQueueItem *item) {
+    hi_free(item->cmd);
+    if (item->reply)
+        freeReplyObject(item->reply);
+    hi_free(item);
+}
+
+/* The wakeup is an eventfd, or a non-blocking pipe where eventfd is not
+ * available, in which case fds[0] is its read end and fds[1] its write end.
+ * There is no wakeup on Windows. */
+static int queueWakeupCreate(redisFD *fds) {
+#if defined(__linux__)
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1)
+        return REDIS_ERR;
+    fds[0] = fds[1] = fd;
+    return REDIS_OK;
+#elif !defined(_WIN32)
+    int p[2], i;
+
+    if (pipe(p) == -1)
+        return REDIS_ERR;
+    for (i = 0; i < 2; i++) {
+        if (fcntl(p[i], F_SETFL, fcntl(p[i], F_GETFL) | O_NONBLOCK) == -1 ||
+            fcntl(p[i], F_SETFD, FD_CLOEXEC) == -1)
+        {
+            close(p[0]);
+            close(p[1]);
+            return REDIS_ERR;
+        }
+    }
+    fds[0] = p[0];
+    fds[1] = p[1];
+    return REDIS_OK;
+#else
+    fds[0] = fds[1] = REDIS_INVALID_FD;
+    return REDIS_OK;
+#endif
+}
+
+static void queueWakeupSignal(redisFD fd) {
+#ifndef _WIN32
+    uint64_t one = 1;
+    ssize_t n;
+
+    /* A full pipe or eventfd counter is already signaled. */
+    do {
+        n = write(fd, &one, sizeof(one));
+    } while (n == -1 && errno == EINTR);
+#else
+    (void)fd;
+#endif
+}
+
+static void queueWakeupClear(redisFD fd) {
+#ifndef _WIN32
+    char buf[64];
+    ssize_t n;
+
+    if (fd == REDIS_INVALID_FD)
+        return;
+    do {
+        n = read(fd, buf, sizeof(buf));
+    } while (n > 0 || (n == -1 && errno == EINTR));
+#else
+    (void)fd;
+#endif
+}
+
+static void queueWakeupClose(redisFD *fds) {
+#ifndef _WIN32
+    if (fds[1] != fds[0] && fds[1] != REDIS_INVALID_FD)
+        close(fds[1]);
+    if (fds[0] != REDIS_INVALID_FD)
+        close(fds[0]);
+#endif
+    fds[0] = fds[1] = REDIS_INVALID_FD;
+}
+
+struct redisCompletionQueue {
+    redisQueueItem *head;
+    redisFD fds[2];
+};
+
+redisCompletionQueue *redisCompletionQueueCreate(void) {
+    redisCompletionQueue *cq = hi_calloc(1, sizeof(*cq));
+
+    if (cq == NULL)
+        return NULL;
+    if (queueWakeupCreate(cq->fds) != REDIS_OK) {
+        hi_free(cq);
+        return NULL;
+    }
+
+    return cq;
+}
+
+redisFD redisCompletionQueueGetFd(redisCompletionQueue *cq) {
+    return cq->fds[0];
+}
+
+int redisCompletionQueueRun(redisCompletionQueue *cq) {
+    redisQueueItem *item, *next;
+    int n = 0;
+
+    queueWakeupClear(cq->fds[0]);
+    for (item = queueTakeAll(&cq->head); item != NULL; item = next) {
+        next = item->next;
+        if (item->fn)
+            item->fn(item->ac, item->reply, item->privdata);
+        queueFreeItem(item);
+        n++;
+    }
+
+    return n;
+}
+
+void redisCompletionQueueFree(redisCompletionQueue *cq) {
+    redisQueueItem *item, *next;
+
+    if (cq == NULL)
+        return;
+
+    for (item = queueTakeAll(&cq->head); item != NULL; item = next) {
+        next = item->next;
+        queueFreeItem(item);
+    }
+    queueWakeupClose(cq->fds);
+    hi_free(cq);
+}
+
+/* Hand an item over to its completion queue, from the event loop thread. */
+static void queueComplete(redisQueueItem *item, redisAsyncContext *ac, redisReply *reply) {
+    redisCompletionQueue *cq = item->cq;
+
+    item->ac = ac;
+    item->reply = reply;
+    if (queuePush(&cq->head, item) && cq->fds[1] != REDIS_INVALID_FD)
+        queueWakeupSignal(cq->fds[1]);
+}
+
+/* Reply callback of commands with a completion queue. The reply belongs to
+ * the context and is freed when this returns, unless REDIS_NO_AUTO_FREE_REPLIES
+ * is set, so its contents are moved into a new top level object instead of
+ * copying them. */
+static void queueReplyCallback(redisAsyncContext *ac, void *reply, void *privdata) {
+    redisReply *r = reply, *own = NULL;
+
+    if (r != NULL && (ac->c.flags & REDIS_NO_AUTO_FREE_REPLIES)) {
+        own = r;
+    } else if (r != NULL) {
+        own = redisTakeReply(r);
+    }
+
+    queueComplete(privdata, ac, own);
+}
+
+struct redisAsyncQueue {
+    redisQueueItem *head;
+    redisAsyncContext *ac;
+
+    /* Context watching the read end of the wakeup fd, with read and write
+     * handlers replaced so the event loop drains the queue instead. */
+    redisAsyncContext *wakeup;
+    redisContextFuncs funcs;
+    redisFD fds[2];
+};
+
+static void queueAsyncRead(redisAsyncContext *wakeup) {
+    redisAsyncQueue *q = wakeup->data;
+
+    redisAsyncQueueDrain(q);
+    _EL_ADD_READ(wakeup);
+}
+
+static void queueAsyncWrite(redisAsyncContext *wakeup) {
+    _EL_DEL_WRITE(wakeup);
+}
+
+redisAsyncQueue *redisAsyncQueueCreate(redisAsyncContext *ac,
+                                       redisAsyncQueueAttachFn *attach_cb,
+                                       void *privdata)
+{
+    redisAsyncQueue *q;
+    redisOptions options = {0};
+
+    q = hi_calloc(1, sizeof(*q));
+    if (q == NULL)
+        return NULL;
+    q->ac = ac;
+    q->fds[0] = q->fds[1] = REDIS_INVALID_FD;
+
+#ifndef _WIN32
+    if (attach_cb == NULL)
+        return q;
+
+    if (queueWakeupCreate(q->fds) != REDIS_OK)
+        goto error;
+
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = q->fds[0];
+    q->wakeup = redisAsyncConnectWithOptions(&options);
+    if (q->wakeup == NULL) {
+        /* The read end was closed along with the context. */
+        if (q->fds[1] == q->fds[0])
+            q->fds[1] = REDIS_INVALID_FD;
+        q->fds[0] = REDIS_INVALID_FD;
+        goto error;
+    }
+    if (q->wakeup->err)
+        goto error;
+
+    /* Nothing to connect, so don't let the first read event check for it. */
+    q->wakeup->c.flags |= REDIS_CONNECTED;
+
+    q->funcs = *q->wakeup->c.funcs;
+    q->funcs.async_read = queueAsyncRead;
+    q->funcs.async_write = queueAsyncWrite;
+    q->wakeup->c.funcs = &q->funcs;
+    q->wakeup->data = q;
+
+    if (attach_cb(q->wakeup, privdata) != REDIS_OK)
+        goto error;
+    _EL_ADD_READ(q->wakeup);
+#else
+    (void)attach_cb;
+    (void)privdata;
+    (void)options;
+#endif
+
+    return q;
+
+error:
+    redisAsyncQueueFree(q);
+    return NULL;
+}
+
+/* Commands with more than one reply call their callback more than once, and
+ * unsubscribe commands never call theirs: neither can be delivered by a
+ * completion queue. */
+static int queueIsMultiReply(const char *cmd, size_t len) {
+    static const char *names[] = {
+        "subscribe", "psubscribe", "ssubscribe",
+        "unsubscribe", "punsubscribe", "sunsubscribe", "monitor"
+    };
+    const char *p, *end = cmd + len;
+    size_t namelen, i;
+
+    /* Skip "*<argc>\r\n$" to the length of the command name. */
+    p = memchr(cmd, '\n', len);
+    if (p == NULL || p + 2 >= end || p[1] != '$')
+        return 0;
+    namelen = strtoul(p + 2, NULL, 10);
+    p = memchr(p + 2, '\n', end - (p + 2));
+    if (p == NULL || (size_t)(end - p - 1) < namelen)
+        return 0;
+
+    for (i = 0; i < sizeof(names) / sizeof(*names); i++) {
+        if (strlen(names[i]) == namelen && !strncasecmp(p + 1, names[i], namelen))
+            return 1;
+    }
+    return 0;
+}
+
+/* Push a formatted command, taking ownership of it. */
+static int queuePushCommand(redisAsyncQueue *q, redisCompletionQueue *cq,
+                            redisCallbackFn *fn, void *privdata,
+                            char *cmd, size_t len)
+{
+    redisQueueItem *item;
+
+    if (cq != NULL && queueIsMultiReply(cmd, len)) {
+        hi_free(cmd);
+        return REDIS_ERR;
+    }
+
+    item = hi_calloc(1, sizeof(*item));
+    if (item == NULL) {
+        hi_free(cmd);
+        return REDIS_ERR;
+    }
+    item->fn = fn;
+    item->privdata = privdata;
+    item->cq = cq;
+    item->cmd = cmd;
+    item->len = len;
+
+    if (queuePush(&q->head, item) && q->fds[1] != REDIS_INVALID_FD)
+        queueWakeupSignal(q->fds[1]);
+    return REDIS_OK;
+}
+
+int redisvAsyncQueueCommand(redisAsyncQueue *q, redisCompletionQueue *cq,
+                            redisCallbackFn *fn, void *privdata,
+                            const char *format, va_list ap)
+{
+    char *cmd;
+    int len;
+
+    len = redisvFormatCommand(&cmd, format, ap);
+    if (len < 0)
+        return REDIS_ERR;
+    return queuePushCommand(q, cq, fn, privdata, cmd, len);
+}
+
+int redisAsyncQueueCommand(redisAsyncQueue *q, redisCompletionQueue *cq,
+                           redisCallbackFn *fn, void *privdata,
+                           const char *format, ...)
+{
+    va_list ap;
+    int status;
+
+    va_start(ap, format);
+    status = redisvAsyncQueueCommand(q, cq, fn, privdata, format, ap);
+    va_end(ap);
+    return status;
+}
+
+int redisAsyncQueueCommandArgv(redisAsyncQueue *q, redisCompletionQueue *cq,
+                               redisCallbackFn *fn, void *privdata, int argc,
+                               const char **argv, const size_t *argvlen)
+{
+    char *cmd;
+    long long len;
+
+    len = redisFormatCommandArgv(&cmd, argc, argv, argvlen);
+    if (len < 0)
+        return REDIS_ERR;
+    return queuePushCommand(q, cq, fn, privdata, cmd, len);
+}
+
+int redisAsyncQueueFormattedCommand(redisAsyncQueue *q, redisCompletionQueue *cq,
+                                    redisCallbackFn *fn, void *privdata,
+                                    const char *cmd, size_t len)
+{
+    char *copy = hi_malloc(len + 1);
+
+    if (copy == NULL)
+        return REDIS_ERR;
+    /* Keep it terminated like the commands formatted by hiredis, which
+     * redisAsyncFormattedCommand() relies on. */
+    memcpy(copy, cmd, len);
+    copy[len] = '\0';
+    return queuePushCommand(q, cq, fn, privdata, copy, len);
+}
+
+/* Complete a command that was not sent with a NULL reply. */
+static void queueFail(redisAsyncQueue *q, redisQueueItem *item) {
+    if (item->cq != NULL) {
+        queueComplete(item, q->ac, NULL);
+    } else {
+        if (item->fn)
+            item->fn(q->ac, NULL, item->privdata);
+        queueFreeItem(item);
+    }
+}
+
+int redisAsyncQueueDrain(redisAsyncQueue *q) {
+    redisQueueItem *item, *next;
+    redisCallbackFn *fn;
+    void *privdata;
+    char *cmd;
+    int n = 0, status;
+
+    queueWakeupClear(q->fds[0]);
+    for (item = queueTakeAll(&q->head); item != NULL; item = next) {
+        next = item->next;
+        cmd = item->cmd;
+        item->cmd = NULL;
+
+        if (item->cq != NULL) {
+            fn = queueReplyCallback;
+            privdata = item;
+        } else {
+            fn = item->fn;
+            privdata = item->privdata;
+        }
+
+        /* With a completion queue, the item may already be gone to another
+         * thread once the command is appended, e.g. on a cache hit. */
+        status = REDIS_ERR;
+        if (q->ac != NULL)
+            status = redisAsyncFormattedCommand(q->ac, fn, privdata, cmd, item->len);
+        hi_free(cmd);
+        if (status != REDIS_OK)
+            queueFail(q, item);
+        else if (fn != queueReplyCallback)
+            queueFreeItem(item);
+        n++;
+    }
+
+    return n;
+}
+
+void redisAsyncQueueSetContext(redisAsyncQueue *q, redisAsyncContext *ac) {
+    q->ac = ac;
+}
+
+void redisAsyncQueueFree(redisAsyncQueue *q) {
+    redisQueueItem *item, *next;
+
+    if (q == NULL)
+        return;
+
+    for (item = queueTakeAll(&q->head); item != NULL; item = next) {
+        next = item->next;
+        queueFail(q, item);
+    }
+    if (q->wakeup) {
+        /* Freeing the wakeup context closes the read end. */
+        redisAsyncFree(q->wakeup);
+        if (q->fds[1] == q->fds[0])
+            q->fds[1] = REDIS_INVALID_FD;
+        q->fds[0] = REDIS_INVALID_FD;
+    }
+    queueWakeupClose(q->fds);
+    hi_free(q);
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __HIREDIS_QUEUE_H
+#define __HIREDIS_QUEUE_H
+#include "async.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Attaches the wakeup context of a submission queue to the event loop of the
+ * queue's async context, with the same adapter (e.g. redisLibeventAttach()).
+ * Return REDIS_OK on success. */
+typedef int (redisAsyncQueueAttachFn)(redisAsyncContext *ac, void *privdata);
+
+typedef struct redisAsyncQueue redisAsyncQueue;
+typedef struct redisCompletionQueue redisCompletionQueue;
+
+/* Create a submission queue for an async context. Commands can be pushed into
+ * it from any thread, and are sent in batches by the thread running the event
+ * loop of the context.
+ *
+ * The event loop is woken up through an eventfd (a pipe where eventfd is not
+ * available), watched by a wakeup context that attach_cb attaches to the loop
+ * like any other async context. If attach_cb is NULL, or on Windows, there is
+ * no wakeup and the loop thread must call redisAsyncQueueDrain() itself.
+ * Returns NULL when out of memory or if the wakeup could not be set up. */
+redisAsyncQueue *redisAsyncQueueCreate(redisAsyncContext *ac,
+                                       redisAsyncQueueAttachFn *attach_cb,
+                                       void *privdata);
+
+/* Push a command into the queue. Safe to call from any thread; the command is
+ * formatted on the calling thread.
+ *
+ * If cq is NULL, fn is called from the event loop thread like for
+ * redisAsyncCommand(). Otherwise the reply is handed over to the completion
+ * queue and fn is called from redisCompletionQueueRun(), on the thread owning
+ * cq; the reply is only valid for the duration of the callback and is NULL if
+ * the command could not be sent or the connection was lost. Subscribe and
+ * MONITOR commands, which have more than one reply, and unsubscribe commands,
+ * whose replies go to the subscribe callbacks, cannot be used with a
+ * completion queue.
+ *
+ * Returns REDIS_ERR on formatting errors or when out of memory, in which case
+ * fn will never be called. */
+int redisAsyncQueueCommand(redisAsyncQueue *q, redisCompletionQueue *cq,
+                           redisCallbackFn *fn, void *privdata,
+                           const char *format, ...);
+int redisvAsyncQueueCommand(redisAsyncQueue *q, redisCompletionQueue *cq,
+                            redisCallbackFn *fn, void *privdata,
+                            const char *format, va_list ap);
+int redisAsyncQueueCommandArgv(redisAsyncQueue *q, redisCompletionQueue *cq,
+                               redisCallbackFn *fn, void *privdata, int argc,
+                               const char **argv, const size_t *argvlen);
+int redisAsyncQueueFormattedCommand(redisAsyncQueue *q, redisCompletionQueue *cq,
+                                    redisCallbackFn *fn, void *privdata,
+                                    const char *cmd, size_t len);
+
+/* Move every command pushed so far into the output buffer of the context.
+ * Must be called from the event loop thread; this is done automatically when
+ * the wakeup context is attached. Returns the number of commands moved. */
+int redisAsyncQueueDrain(redisAsyncQueue *q);
+
+/* Change the context commands are drained into, from the event loop thread,
+ * e.g. when the previous one was lost. While it is NULL, drained commands
+ * complete with a NULL reply and a NULL context. */
+void redisAsyncQueueSetContext(redisAsyncQueue *q, redisAsyncContext *ac);
+
+/* Free the queue and its wakeup context, from the event loop thread. Commands
+ * that were not drained yet are completed with a NULL reply. No other thread
+ * may be pushing into the queue, and the queue must be freed before its async
+ * context. */
+void redisAsyncQueueFree(redisAsyncQueue *q);
+
+/* Create a completion queue, to receive the replies of commands pushed into
+ * submission queues on the thread that will run it. Returns NULL when out of
+ * memory or if its wakeup fd could not be created. */
+redisCompletionQueue *redisCompletionQueueCreate(void);
+
+/* File descriptor that becomes readable when replies are waiting, for the
+ * owning thread to poll along with its own. REDIS_INVALID_FD on Windows. */
+redisFD redisCompletionQueueGetFd(redisCompletionQueue *cq);
+
+/* Call the callbacks of all replies received so far, in the order they were
+ * received, and free the replies. Returns the number of callbacks called. */
+int redisCompletionQueueRun(redisCompletionQueue *cq);
+
+/* Free the completion queue. Replies still waiting are freed without calling
+ * their callback. Commands sent with this completion queue may no longer be
+ * pending. */
+void redisCompletionQueueFree(redisCompletionQueue *cq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -45,6 +45,8 @@
 #include "alloc.h"
 #include "read.h"
 #include "sds.h"
+#include "stats.h"
+#include "trace.h"
 #include "win32.h"
 
 #ifndef HIREDIS_FLOAT_STRTOD
@@ -258,6 +260,12 @@ static char *readLine(redisReader *r, int *_len) {
     return NULL;
 }
 
+/* Count an allocation made on behalf of the reader. */
+static void readerCountAlloc(redisReader *r) {
+    if (r->stats)
+        redisStatIncr(&r->stats->allocs);
+}
+
 static void moveToNextTask(redisReader *r) {
     redisReadTask *cur, *prv;
     while (r->ridx >= 0) {
@@ -442,6 +450,8 @@ static int processLineItem(redisReader *r) {
             __redisReaderSetErrorOOM(r);
             return REDIS_ERR;
         }
+        if (r->fn)
+            readerCountAlloc(r);
 
         /* Set reply if this is the root object. */
         if (r->ridx == 0) r->reply = obj;
@@ -511,6 +521,8 @@ static int processBulkItem(redisReader *r) {
                 __redisReaderSetErrorOOM(r);
                 return REDIS_ERR;
             }
+            if (r->fn)
+                readerCountAlloc(r);
 
             r->pos += bytelen;
 
@@ -535,10 +547,11 @@ static int redisReaderGrow(redisReader *r) {
         goto oom;
 
     r->task = aux;
+    readerCountAlloc(r);
 
     /* Allocate new tasks */
     for (; r->tasks < newlen; r->tasks++) {
-        r->task[r->tasks] = hi_calloc(1, sizeof(**r->task));
+        r->task[r->tasks] = hi_obj_calloc(sizeof(**r->task));
         if (r->task[r->tasks] == NULL)
             goto oom;
     }
@@ -635,11 +648,15 @@ static int processAggregateItem(redisReader *r) {
                 r->task[r->ridx]->obj = NULL;
                 r->task[r->ridx]->parent = cur;
                 r->task[r->ridx]->privdata = r->privdata;
+                r->task[r->ridx]->allocator = r->allocator;
             } else {
                 moveToNextTask(r);
             }
         }
 
+        if (r->fn)
+            readerCountAlloc(r);
+
         /* Set reply if this is the root object. */
         if (root) r->reply = obj;
         return REDIS_OK;
@@ -749,7 +766,7 @@ redisReader *redisReaderCreateWithFunctions(redisReplyObjectFunctions *fn) {
         goto oom;
 
     for (; r->tasks < REDIS_READER_STACK_SIZE; r->tasks++) {
-        r->task[r->tasks] = hi_calloc(1, sizeof(**r->task));
+        r->task[r->tasks] = hi_obj_calloc(sizeof(**r->task));
         if (r->task[r->tasks] == NULL)
             goto oom;
     }
@@ -766,6 +783,10 @@ oom:
     return NULL;
 }
 
+void redisReaderSetAllocator(redisReader *r, const hiredisAllocator *a) {
+    r->allocator = a;
+}
+
 void redisReaderFree(redisReader *r) {
     if (r == NULL)
         return;
@@ -776,7 +797,7 @@ void redisReaderFree(redisReader *r) {
     if (r->task) {
         /* We know r->task[i] is allocated if i < r->tasks */
         for (int i = 0; i < r->tasks; i++) {
-            hi_free(r->task[i]);
+            hi_obj_free(r->task[i], sizeof(**r->task));
         }
 
         hi_free(r->task);
@@ -804,11 +825,15 @@ int redisReaderFeed(redisReader *r, const char *buf, size_t len) {
             r->pos = 0;
         }
 
+        if (sdsavail(r->buf) < len)
+            readerCountAlloc(r);
         newbuf = sdscatlen(r->buf,buf,len);
         if (newbuf == NULL) goto oom;
 
         r->buf = newbuf;
         r->len = sdslen(r->buf);
+        if (r->stats)
+            redisStatMax(&r->stats->buf_peak, r->len);
     }
 
     return REDIS_OK;
@@ -817,6 +842,121 @@ oom:
     return REDIS_ERR;
 }
 
+/* Parse a "<type><length>\r\n" header between p and end. Returns a pointer
+ * past it, or NULL when it is not a plain length, or when it is incomplete in
+ * which case *more is set. */
+static const char *readMessageHeader(const char *p, const char *end, char type,
+                                     size_t *len, int *more)
+{
+    size_t v = 0;
+    const char *start;
+
+    if (p == end || *p++ != type)
+        return NULL;
+
+    start = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (v > (SIZE_MAX - 9) / 10)
+            return NULL;
+        v = v*10 + (*p++ - '0');
+    }
+
+    if (end - p < 2 && (p == end || *p == '\r')) {
+        *more = 1;
+        return NULL;
+    }
+    if (p == start || p[0] != '\r' || p[1] != '\n')
+        return NULL;
+
+    *len = v;
+    return p + 2;
+}
+
+/* Parse a bulk string between p and end, like readMessageHeader(). */
+static const char *readMessageBulk(const char *p, const char *end,
+                                   const char **str, size_t *len, int *more)
+{
+    if (p == end) {
+        *more = 1;
+        return NULL;
+    }
+    if ((p = readMessageHeader(p, end, '$', len, more)) == NULL)
+        return NULL;
+    if ((size_t)(end - p) < *len + 2) {
+        *more = 1;
+        return NULL;
+    }
+    if (p[*len] != '\r' || p[*len+1] != '\n')
+        return NULL;
+
+    *str = p;
+    return p + *len + 2;
+}
+
+int redisReaderGetMessage(redisReader *r, int push_only, redisPubSubMessage *msg) {
+    const char *p, *end, *kind;
+    size_t elements, kindlen;
+    int pattern, more = 0;
+
+    /* Only start at a reply boundary of a healthy reader. */
+    if (r->err || r->ridx != -1)
+        return 0;
+    if (r->pos == r->len)
+        return -1;
+
+    /* Discard the consumed part of the buffer here rather than after the
+     * message, as the returned slices point into it. */
+    if (r->pos >= 1024) {
+        if (sdsrange(r->buf,r->pos,-1) < 0) return 0;
+        r->pos = 0;
+        r->len = sdslen(r->buf);
+    }
+
+    p = r->buf + r->pos;
+    end = r->buf + r->len;
+
+    if (*p != '>' && (push_only || *p != '*'))
+        return 0;
+    if ((p = readMessageHeader(p, end, *p, &elements, &more)) == NULL)
+        goto fail;
+    if (elements != 3 && elements != 4)
+        return 0;
+    if ((p = readMessageBulk(p, end, &kind, &kindlen, &more)) == NULL)
+        goto fail;
+
+    pattern = elements == 4;
+    if (pattern) {
+        if (kindlen != 8 || strncasecmp(kind, "pmessage", 8) != 0)
+            return 0;
+        msg->sharded = 0;
+    } else if (kindlen == 7 && strncasecmp(kind, "message", 7) == 0) {
+        msg->sharded = 0;
+    } else if (kindlen == 8 && strncasecmp(kind, "smessage", 8) == 0) {
+        msg->sharded = 1;
+    } else {
+        return 0;
+    }
+
+    msg->pattern = NULL;
+    msg->pattern_len = 0;
+    if (pattern && (p = readMessageBulk(p, end, &msg->pattern, &msg->pattern_len, &more)) == NULL)
+        goto fail;
+    if ((p = readMessageBulk(p, end, &msg->channel, &msg->channel_len, &more)) == NULL)
+        goto fail;
+    if ((p = readMessageBulk(p, end, &msg->payload, &msg->payload_len, &more)) == NULL)
+        goto fail;
+
+    if (r->stats) {
+        redisStatIncr(&r->stats->replies[r->buf[r->pos] == '>' ?
+                                         REDIS_REPLY_PUSH : REDIS_REPLY_ARRAY]);
+    }
+    redisTrace2(reply, r, r->buf[r->pos] == '>' ? REDIS_REPLY_PUSH : REDIS_REPLY_ARRAY);
+    r->pos = p - r->buf;
+    return 1;
+fail:
+    return more ? -1 : 0;
+}
+
 int redisReaderGetReply(redisReader *r, void **reply) {
     /* Default target pointer to NULL. */
     if (reply != NULL)
@@ -838,6 +978,7 @@ int redisReaderGetReply(redisReader *r, void **reply) {
         r->task[0]->obj = NULL;
         r->task[0]->parent = NULL;
         r->task[0]->privdata = r->privdata;
+        r->task[0]->allocator = r->allocator;
         r->ridx = 0;
     }
 
@@ -860,6 +1001,9 @@ int redisReaderGetReply(redisReader *r, void **reply) {
 
     /* Emit a reply when there is one. */
     if (r->ridx == -1) {
+        if (r->stats)
+            redisStatIncr(&r->stats->replies[r->task[0]->type]);
+        redisTrace2(reply, r, r->task[0]->type);
         if (reply != NULL) {
             *reply = r->reply;
         } else if (r->reply != NULL && r->fn && r->fn->freeObject) {
@@ -83,6 +83,7 @@ typedef struct redisReadTask {
     void *obj; /* holds user-generated value for a read task */
     struct redisReadTask *parent; /* parent task */
     void *privdata; /* user-settable arbitrary field */
+    const struct hiredisAllocator *allocator; /* for the objects, or NULL */
 } redisReadTask;
 
 typedef struct redisReplyObjectFunctions {
@@ -95,6 +96,26 @@ typedef struct redisReplyObjectFunctions {
     void (*freeObject)(void*);
 } redisReplyObjectFunctions;
 
+/* A pub/sub message as returned by redisReaderGetMessage(). The pointers
+ * point into the reader's buffer and are not NUL-terminated. */
+typedef struct redisPubSubMessage {
+    const char *pattern; /* Matching pattern for a pmessage, NULL otherwise */
+    size_t pattern_len;
+    const char *channel;
+    size_t channel_len;
+    const char *payload;
+    size_t payload_len;
+    int sharded; /* Set for an smessage */
+} redisPubSubMessage;
+
+/* Counters kept by a reader whose stats field is set, as done by contexts
+ * for redisGetStats(). */
+typedef struct redisReaderStats {
+    unsigned long long replies[REDIS_REPLY_VERB+1]; /* Replies parsed, by type */
+    unsigned long long allocs; /* Reply objects created and buffer growths */
+    size_t buf_peak; /* Largest amount of buffered input */
+} redisReaderStats;
+
 typedef struct redisReader {
     int err; /* Error flags, 0 when there is no error */
     char errstr[128]; /* String representation of error when applicable */
@@ -115,6 +136,11 @@ typedef struct redisReader {
     void *privdata;
 
     int maxdepth; /* Max nested aggregate reply depth */
+
+    redisReaderStats *stats; /* Counters to update, or NULL */
+
+    /* Allocator of the reply objects, or NULL for the configured ones. */
+    const struct hiredisAllocator *allocator;
 } redisReader;
 
 /* Public API for the protocol parser. */
@@ -123,6 +149,23 @@ void redisReaderFree(redisReader *r);
 int redisReaderFeed(redisReader *r, const char *buf, size_t len);
 int redisReaderGetReply(redisReader *r, void **reply);
 
+/* Build the reply objects with their own allocator from now on, or with the
+ * configured allocators if a is NULL. It is handed to the reply functions
+ * in redisReadTask.allocator, and must outlive the replies built with it.
+ * The reader itself, its buffer and its task stack keep using the
+ * configured allocators. */
+void redisReaderSetAllocator(redisReader *r, const struct hiredisAllocator *a);
+
+/* Consume the next reply straight from the buffer when it is a complete
+ * "message", "pmessage" or "smessage", without building a reply object. Returns 1 and
+ * fills msg when one was consumed. Otherwise nothing is consumed, and it
+ * returns -1 when the buffer ends before the message does (or before telling
+ * whether the reply is one), and 0 when the reply is something else, to be
+ * read with redisReaderGetReply(). Only RESP3 pushes are considered when
+ * push_only is set. The slices in msg are valid until the next call on the
+ * reader. */
+int redisReaderGetMessage(redisReader *r, int push_only, redisPubSubMessage *msg);
+
 #define redisReaderSetPrivdata(_r, _p) (int)(((redisReader*)(_r))->privdata = (_p))
 #define redisReaderGetObject(_r) (((redisReader*)(_r))->reply)
 #define redisReaderGetError(_r) (((redisReader*)(_r))->errstr)
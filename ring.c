@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "fmacros.h"
+#include "alloc.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ring.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#define RING_DEFAULT_CAPACITY (1024 * 1024)
+
+/* A circular buffer of len bytes starting at head. */
+typedef struct ringBuffer {
+    char *buf;
+    size_t cap;
+    size_t head;
+    size_t len;
+} ringBuffer;
+
+/* Both sides share one mutex, and one condition broadcast on every change:
+ * there is at most one waiter on each side. The wakeup descriptor is
+ * readable while the context has replies to read or the server side is
+ * closed; it is only signaled and cleared with the mutex held, so it never
+ * disagrees with the buffers. */
+struct redisRing {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ringBuffer commands;    /* Client to server */
+    ringBuffer replies;     /* Server to client */
+    int client_closed;
+    int server_closed;
+    int fds[2];             /* Wakeup, read end first */
+};
+
+static size_t ringPut(ringBuffer *b, const char *src, size_t len) {
+    size_t tail, chunk, n;
+
+    n = b->cap - b->len < len ? b->cap - b->len : len;
+    tail = (b->head + b->len) % b->cap;
+    chunk = b->cap - tail < n ? b->cap - tail : n;
+    memcpy(b->buf + tail, src, chunk);
+    memcpy(b->buf, src + chunk, n - chunk);
+    b->len += n;
+    return n;
+}
+
+static size_t ringGet(ringBuffer *b, char *dst, size_t len) {
+    size_t chunk, n;
+
+    n = b->len < len ? b->len : len;
+    chunk = b->cap - b->head < n ? b->cap - b->head : n;
+    memcpy(dst, b->buf + b->head, chunk);
+    memcpy(dst + chunk, b->buf, n - chunk);
+    b->head = (b->head + n) % b->cap;
+    b->len -= n;
+    return n;
+}
+
+/* An eventfd, or a non-blocking socket pair where eventfd is not available.
+ * Unlike the read end of a pipe, both are always writable, which is what the
+ * adapters of asynchronous contexts wait for before writing commands. */
+static int ringWakeupCreate(int *fds) {
+#ifdef __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1)
+        return REDIS_ERR;
+    fds[0] = fds[1] = fd;
+    return REDIS_OK;
+#else
+    int i;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+        return REDIS_ERR;
+    for (i = 0; i < 2; i++) {
+        if (fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK) == -1 ||
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC) == -1)
+        {
+            close(fds[0]);
+            close(fds[1]);
+            return REDIS_ERR;
+        }
+    }
+    return REDIS_OK;
+#endif
+}
+
+static void ringWakeupSignal(redisRing *ring) {
+    uint64_t one = 1;
+    ssize_t n;
+
+    do {
+        n = write(ring->fds[1], &one, sizeof(one));
+    } while (n == -1 && errno == EINTR);
+}
+
+static void ringWakeupClear(redisRing *ring) {
+    char buf[64];
+    ssize_t n;
+
+    do {
+        n = read(ring->fds[0], buf, sizeof(buf));
+    } while (n > 0 || (n == -1 && errno == EINTR));
+}
+
+static void ringFree(redisRing *ring) {
+    if (ring->fds[1] != ring->fds[0])
+        close(ring->fds[1]);
+    close(ring->fds[0]);
+    pthread_cond_destroy(&ring->cond);
+    pthread_mutex_destroy(&ring->lock);
+    hi_free(ring->commands.buf);
+    hi_free(ring->replies.buf);
+    hi_free(ring);
+}
+
+redisRing *redisRingCreate(size_t capacity) {
+    redisRing *ring;
+
+    if (capacity == 0)
+        capacity = RING_DEFAULT_CAPACITY;
+
+    ring = hi_calloc(1, sizeof(*ring));
+    if (ring == NULL)
+        return NULL;
+    ring->commands.cap = ring->replies.cap = capacity;
+    ring->commands.buf = hi_malloc(capacity);
+    ring->replies.buf = hi_malloc(capacity);
+    if (ring->commands.buf == NULL || ring->replies.buf == NULL)
+        goto oom_buffers;
+    if (ringWakeupCreate(ring->fds) != REDIS_OK)
+        goto oom_buffers;
+    if (pthread_mutex_init(&ring->lock, NULL) != 0)
+        goto oom_wakeup;
+    if (pthread_cond_init(&ring->cond, NULL) != 0)
+        goto oom_lock;
+    return ring;
+
+oom_lock:
+    pthread_mutex_destroy(&ring->lock);
+oom_wakeup:
+    if (ring->fds[1] != ring->fds[0])
+        close(ring->fds[1]);
+    close(ring->fds[0]);
+oom_buffers:
+    hi_free(ring->commands.buf);
+    hi_free(ring->replies.buf);
+    hi_free(ring);
+    return NULL;
+}
+
+/* Wait for a change on the other side, until the deadline if there is one.
+ * Returns -1 with errno set to EAGAIN, as a socket would, on timeout. */
+static int ringWait(redisRing *ring, const struct timespec *deadline) {
+    if (deadline == NULL) {
+        pthread_cond_wait(&ring->cond, &ring->lock);
+        return 0;
+    }
+    if (pthread_cond_timedwait(&ring->cond, &ring->lock, deadline) == ETIMEDOUT) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+/* The deadline of a blocking client call, or NULL if it has no timeout. */
+static struct timespec *ringDeadline(redisContext *c, struct timespec *ts) {
+    const struct timeval *tv = c->command_timeout;
+
+    if (!(c->flags & REDIS_BLOCK) || tv == NULL || (tv->tv_sec == 0 && tv->tv_usec == 0))
+        return NULL;
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += tv->tv_sec;
+    ts->tv_nsec += tv->tv_usec * 1000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+static ssize_t ringClientRead(redisContext *c, void *ctx, char *buf, size_t len) {
+    redisRing *ring = ctx;
+    struct timespec ts, *deadline = ringDeadline(c, &ts);
+    size_t n;
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->replies.len == 0 && !ring->server_closed) {
+        if (!(c->flags & REDIS_BLOCK) || ringWait(ring, deadline) == -1) {
+            pthread_mutex_unlock(&ring->lock);
+            return (c->flags & REDIS_BLOCK) ? -1 : 0;
+        }
+    }
+    if (ring->replies.len == 0) {
+        pthread_mutex_unlock(&ring->lock);
+        errno = ECONNRESET;
+        return -1;
+    }
+
+    n = ringGet(&ring->replies, buf, len);
+    if (ring->replies.len == 0 && !ring->server_closed)
+        ringWakeupClear(ring);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+    return (ssize_t)n;
+}
+
+static ssize_t ringClientWrite(redisContext *c, void *ctx, const char *buf, size_t len) {
+    redisRing *ring = ctx;
+    struct timespec ts, *deadline = ringDeadline(c, &ts);
+    size_t n;
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->commands.len == ring->commands.cap && !ring->server_closed) {
+        if (!(c->flags & REDIS_BLOCK) || ringWait(ring, deadline) == -1) {
+            pthread_mutex_unlock(&ring->lock);
+            return (c->flags & REDIS_BLOCK) ? -1 : 0;
+        }
+    }
+    if (ring->server_closed) {
+        pthread_mutex_unlock(&ring->lock);
+        errno = EPIPE;
+        return -1;
+    }
+
+    n = ringPut(&ring->commands, buf, len);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+    return (ssize_t)n;
+}
+
+static void ringClientClose(void *ctx) {
+    redisRing *ring = ctx;
+    int last;
+
+    pthread_mutex_lock(&ring->lock);
+    ring->client_closed = 1;
+    last = ring->server_closed;
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+    if (last)
+        ringFree(ring);
+}
+
+static const redisTransport ringTransport = {
+    .read = ringClientRead,
+    .write = ringClientWrite,
+    .close = ringClientClose,
+};
+
+void redisRingSetOptions(redisRing *ring, redisOptions *options) {
+    REDIS_OPTIONS_SET_TRANSPORT(options, &ringTransport, ring);
+    options->endpoint.transport.fd = ring->fds[0];
+}
+
+ssize_t redisRingRead(redisRing *ring, char *buf, size_t len, int block) {
+    size_t n;
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->commands.len == 0 && !ring->client_closed) {
+        if (!block) {
+            pthread_mutex_unlock(&ring->lock);
+            return 0;
+        }
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    }
+    if (ring->commands.len == 0) {
+        pthread_mutex_unlock(&ring->lock);
+        errno = ECONNRESET;
+        return -1;
+    }
+
+    n = ringGet(&ring->commands, buf, len);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+    return (ssize_t)n;
+}
+
+ssize_t redisRingWrite(redisRing *ring, const char *buf, size_t len, int block) {
+    size_t written = 0;
+
+    pthread_mutex_lock(&ring->lock);
+    for (;;) {
+        if (ring->client_closed) {
+            pthread_mutex_unlock(&ring->lock);
+            errno = EPIPE;
+            return -1;
+        }
+        if (ring->replies.len < ring->replies.cap) {
+            if (ring->replies.len == 0)
+                ringWakeupSignal(ring);
+            written += ringPut(&ring->replies, buf + written, len - written);
+            pthread_cond_broadcast(&ring->cond);
+        }
+        if (written == len || !block)
+            break;
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return (ssize_t)written;
+}
+
+void redisRingClose(redisRing *ring) {
+    int last;
+
+    pthread_mutex_lock(&ring->lock);
+    ring->server_closed = 1;
+    ringWakeupSignal(ring);
+    last = ring->client_closed;
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+    if (last)
+        ringFree(ring);
+}
+
+#else /* _WIN32 */
+
+/* The ring relies on POSIX threads. */
+
+redisRing *redisRingCreate(size_t capacity) {
+    (void)capacity;
+    return NULL;
+}
+
+void redisRingSetOptions(redisRing *ring, redisOptions *options) {
+    (void)ring;
+    (void)options;
+}
+
+ssize_t redisRingRead(redisRing *ring, char *buf, size_t len, int block) {
+    (void)ring; (void)buf; (void)len; (void)block;
+    return -1;
+}
+
+ssize_t redisRingWrite(redisRing *ring, const char *buf, size_t len, int block) {
+    (void)ring; (void)buf; (void)len; (void)block;
+    return -1;
+}
+
+void redisRingClose(redisRing *ring) {
+    (void)ring;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HIREDIS_RING_H
+#define __HIREDIS_RING_H
+#include "hiredis.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An in-memory transport between a context and a server running in the same
+ * process, typically on another thread: two circular buffers guarded by a
+ * mutex, and a wakeup descriptor that event loop adapters watch in place of a
+ * socket. It avoids the kernel on every read and write, which makes it
+ * useful for tests, benchmarks and embedded servers. Not available on
+ * Windows. */
+typedef struct redisRing redisRing;
+
+/* Create a ring with capacity bytes in each direction, or 1 MiB if 0.
+ * Returns NULL when out of memory, or on Windows. */
+redisRing *redisRingCreate(size_t capacity);
+
+/* Set options to connect to the client side of the ring. Exactly one context
+ * must be created with them, with redisConnectWithOptions() or
+ * redisAsyncConnectWithOptions(); freeing it closes the client side. For
+ * asynchronous contexts, the descriptor is readable while there are replies
+ * to read or the server side is closed. Timeouts of blocking contexts are
+ * honoured. */
+void redisRingSetOptions(redisRing *ring, redisOptions *options);
+
+/* Server side. Read up to len bytes of commands, or write len bytes of
+ * replies. Without block, they return 0 when nothing can be transferred;
+ * with it, they wait for at least one byte to read, or for all the bytes to
+ * be written. Both return -1 once the client side is closed, after the
+ * pending commands were read. */
+ssize_t redisRingRead(redisRing *ring, char *buf, size_t len, int block);
+ssize_t redisRingWrite(redisRing *ring, const char *buf, size_t len, int block);
+
+/* Close the server side: the context sees the connection closed by the
+ * server once it read the pending replies. The ring is freed when both sides
+ * are closed. */
+void redisRingClose(redisRing *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,688 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifdef __linux__
+/* For pthread_setaffinity_np() */
+#define _GNU_SOURCE
+#endif
+#include "fmacros.h"
+#include "alloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "runtime.h"
+#include "async_private.h"
+#include "win32.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/* Forward declarations of hiredis.c functions */
+int __redisCheckSharedOptions(const redisOptions *options);
+int __redisCopyOptions(redisOptions *dst, const redisOptions *src);
+void __redisFreeOptions(redisOptions *options);
+
+/* Every thread runs its own event loop over the contexts it owns: one per
+ * shard connection, plus the wakeup context of the submission queue of each
+ * shard. The loop is a plain poll() over a handful of descriptors, with the
+ * context timers kept as deadlines; contexts are hooked into it through the
+ * usual adapter interface.
+ *
+ * All the state of a thread, including its contexts, is only touched by that
+ * thread once it is started. Other threads only push into submission queues
+ * and read the counters. */
+
+typedef struct redisRuntimeEvents {
+    struct redisRuntimeThread *thread;
+    redisAsyncContext *ac;
+    int reading, writing;
+    long long deadline;         /* Timer, in ms; 0 if not set */
+    int deleted;                /* Cleaned up while handling events */
+} redisRuntimeEvents;
+
+typedef struct redisRuntimeShard {
+    struct redisRuntimeThread *thread;
+    redisAsyncContext *ac;      /* NULL while disconnected */
+    redisAsyncQueue *queue;
+    long long nextRetry;        /* Earliest reconnection attempt, in ms */
+} redisRuntimeShard;
+
+typedef struct redisRuntimeThread {
+    struct redisRuntime *rt;
+    int id;
+    pthread_t tid;
+    int started;
+    int stop;
+    int stopfds[2];             /* Pipe to interrupt poll() on stop */
+
+    redisRuntimeEvents **events;
+    int nevents;
+    int capacity;
+    struct pollfd *pfds;
+    int handling;               /* Handling events, so don't free them */
+
+    redisRuntimeShard *shards;
+
+    /* Only written by the thread, except submitted. */
+    int connected;
+    unsigned long long submitted;
+    unsigned long long wakeups;
+    unsigned long long reads;
+    unsigned long long writes;
+    unsigned long long timeouts;
+    unsigned long long reconnects;
+} redisRuntimeThread;
+
+struct redisRuntime {
+    redisOptions options;
+    int nthreads;
+    int connections;
+    int nshards;
+    int pin;
+    int freeing;
+    long long reconnect_interval;   /* In milliseconds */
+    redisAsyncReconnectOptions reconnect;
+    int autoreconnect;
+    redisRuntimeConnectFn *connect_cb;
+    void *connect_privdata;
+
+    unsigned int next;              /* Next shard for shard -1 */
+    redisRuntimeThread *threads;
+    redisRuntimeShard *shards;
+};
+
+static long long runtimeMillis(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((long long)now.tv_sec * 1000) + now.tv_nsec / 1000000;
+}
+
+static unsigned long long runtimeLoad(unsigned long long *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static void runtimeIncr(unsigned long long *p) {
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+}
+
+/* Event library adapter. */
+
+static void runtimeAddRead(void *privdata) {
+    ((redisRuntimeEvents *)privdata)->reading = 1;
+}
+
+static void runtimeDelRead(void *privdata) {
+    ((redisRuntimeEvents *)privdata)->reading = 0;
+}
+
+static void runtimeAddWrite(void *privdata) {
+    ((redisRuntimeEvents *)privdata)->writing = 1;
+}
+
+static void runtimeDelWrite(void *privdata) {
+    ((redisRuntimeEvents *)privdata)->writing = 0;
+}
+
+static void runtimeScheduleTimer(void *privdata, struct timeval tv) {
+    redisRuntimeEvents *e = privdata;
+
+    e->deadline = runtimeMillis() + (long long)tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
+}
+
+static void runtimeRemoveEvents(redisRuntimeThread *t, redisRuntimeEvents *e) {
+    int i;
+
+    for (i = 0; i < t->nevents; i++) {
+        if (t->events[i] == e) {
+            memmove(&t->events[i], &t->events[i + 1],
+                    (t->nevents - i - 1) * sizeof(*t->events));
+            t->nevents--;
+            break;
+        }
+    }
+    hi_free(e);
+}
+
+static void runtimeCleanup(void *privdata) {
+    redisRuntimeEvents *e = privdata;
+
+    e->reading = e->writing = 0;
+    if (e->thread->handling)
+        e->deleted = 1;
+    else
+        runtimeRemoveEvents(e->thread, e);
+}
+
+/* Also the attach callback of the submission queues. */
+static int runtimeAttach(redisAsyncContext *ac, void *privdata) {
+    redisRuntimeThread *t = privdata;
+    redisRuntimeEvents *e, **events;
+    struct pollfd *pfds;
+    int capacity;
+
+    if (ac->ev.data != NULL)
+        return REDIS_ERR;
+
+    if (t->nevents == t->capacity) {
+        capacity = t->capacity ? t->capacity * 2 : 8;
+        events = hi_realloc(t->events, capacity * sizeof(*events));
+        if (events == NULL)
+            return REDIS_ERR;
+        t->events = events;
+        /* One more for the stop pipe. */
+        pfds = hi_realloc(t->pfds, (capacity + 1) * sizeof(*pfds));
+        if (pfds == NULL)
+            return REDIS_ERR;
+        t->pfds = pfds;
+        t->capacity = capacity;
+    }
+
+    e = hi_calloc(1, sizeof(*e));
+    if (e == NULL)
+        return REDIS_ERR;
+    e->thread = t;
+    e->ac = ac;
+    t->events[t->nevents++] = e;
+
+    ac->ev.addRead = runtimeAddRead;
+    ac->ev.delRead = runtimeDelRead;
+    ac->ev.addWrite = runtimeAddWrite;
+    ac->ev.delWrite = runtimeDelWrite;
+    ac->ev.cleanup = runtimeCleanup;
+    ac->ev.scheduleTimer = runtimeScheduleTimer;
+    ac->ev.data = e;
+    return REDIS_OK;
+}
+
+/* Installed as the dataCleanup of every shard context, so it runs however
+ * the context goes away. */
+static void runtimeContextGone(void *privdata) {
+    redisRuntimeShard *shard = privdata;
+    redisRuntime *rt = shard->thread->rt;
+
+    shard->ac = NULL;
+    if (shard->queue)
+        redisAsyncQueueSetContext(shard->queue, NULL);
+    if (!rt->freeing)
+        shard->nextRetry = runtimeMillis() + rt->reconnect_interval;
+}
+
+static int runtimeConnect(redisRuntimeShard *shard) {
+    redisRuntimeThread *t = shard->thread;
+    redisRuntime *rt = t->rt;
+    redisAsyncContext *ac;
+
+    shard->nextRetry = runtimeMillis() + rt->reconnect_interval;
+
+    ac = redisAsyncConnectWithOptions(&rt->options);
+    if (ac == NULL)
+        return REDIS_ERR;
+    if (ac->err || runtimeAttach(ac, t) != REDIS_OK ||
+        (rt->autoreconnect && redisAsyncSetReconnect(ac, &rt->reconnect) != REDIS_OK))
+    {
+        redisAsyncFree(ac);
+        return REDIS_ERR;
+    }
+
+    ac->data = shard;
+    ac->dataCleanup = runtimeContextGone;
+    shard->ac = ac;
+    redisAsyncQueueSetContext(shard->queue, ac);
+
+    /* The first write event tells when the connection is established. */
+    _EL_ADD_WRITE(ac);
+
+    if (rt->connect_cb && rt->connect_cb(ac, rt->connect_privdata) != REDIS_OK) {
+        redisAsyncFree(ac);
+        return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+/* Run one iteration of the event loop of a thread. */
+static void runtimeTick(redisRuntimeThread *t) {
+    redisRuntime *rt = t->rt;
+    redisRuntimeShard *shard;
+    redisRuntimeEvents *e;
+    long long now, wake = -1;
+    int i, n, ready, revents, connected = 0, timeout;
+
+    now = runtimeMillis();
+    for (i = 0; i < rt->connections; i++) {
+        shard = &t->shards[i];
+        if (shard->ac == NULL && shard->nextRetry <= now) {
+            if (shard->nextRetry != 0)
+                runtimeIncr(&t->reconnects);
+            runtimeConnect(shard);
+        }
+        if (shard->ac == NULL) {
+            if (wake < 0 || shard->nextRetry < wake)
+                wake = shard->nextRetry;
+        } else if (shard->ac->c.flags & REDIS_CONNECTED) {
+            connected++;
+        }
+    }
+    __atomic_store_n(&t->connected, connected, __ATOMIC_RELAXED);
+
+    t->pfds[0].fd = t->stopfds[0];
+    t->pfds[0].events = POLLIN;
+    for (i = 0; i < t->nevents; i++) {
+        e = t->events[i];
+        t->pfds[i + 1].events = (e->reading ? POLLIN : 0) | (e->writing ? POLLOUT : 0);
+        t->pfds[i + 1].fd = t->pfds[i + 1].events ? e->ac->c.fd : -1;
+        if (e->deadline && (wake < 0 || e->deadline < wake))
+            wake = e->deadline;
+    }
+
+    timeout = -1;
+    if (wake >= 0)
+        timeout = wake > now ? (int)(wake - now) : 0;
+
+    ready = poll(t->pfds, t->nevents + 1, timeout);
+    runtimeIncr(&t->wakeups);
+    if (ready < 0 && errno != EINTR)
+        return;
+
+    /* Contexts attached meanwhile are at the end and wait for the next
+     * iteration, while the ones freed are only marked as deleted. */
+    n = t->nevents;
+    t->handling = 1;
+    for (i = 0; i < n; i++) {
+        e = t->events[i];
+        revents = ready > 0 ? t->pfds[i + 1].revents : 0;
+
+        if (!e->deleted && e->reading && (revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))) {
+            runtimeIncr(&t->reads);
+            redisAsyncHandleRead(e->ac);
+        }
+        if (!e->deleted && e->writing && (revents & (POLLOUT | POLLERR | POLLHUP | POLLNVAL))) {
+            runtimeIncr(&t->writes);
+            redisAsyncHandleWrite(e->ac);
+        }
+        if (!e->deleted && e->deadline && runtimeMillis() >= e->deadline) {
+            e->deadline = 0;
+            runtimeIncr(&t->timeouts);
+            redisAsyncHandleTimeout(e->ac);
+        }
+    }
+    t->handling = 0;
+
+    for (i = 0; i < t->nevents; i++) {
+        if (t->events[i]->deleted)
+            runtimeRemoveEvents(t, t->events[i--]);
+    }
+}
+
+static void *runtimeThreadMain(void *arg) {
+    redisRuntimeThread *t = arg;
+
+#ifdef __linux__
+    if (t->rt->pin) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(ncpu > 0 ? t->id % ncpu : 0, &set);
+        /* Best effort: unpinned threads still work. */
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+
+    while (!__atomic_load_n(&t->stop, __ATOMIC_ACQUIRE))
+        runtimeTick(t);
+
+    return NULL;
+}
+
+static int runtimeThreadInit(redisRuntime *rt, redisRuntimeThread *t, int id) {
+    int i;
+
+    t->rt = rt;
+    t->id = id;
+    t->shards = &rt->shards[id * rt->connections];
+
+    t->pfds = hi_malloc(sizeof(*t->pfds));
+    if (t->pfds == NULL)
+        return REDIS_ERR;
+    if (pipe(t->stopfds) == -1) {
+        t->stopfds[0] = t->stopfds[1] = -1;
+        return REDIS_ERR;
+    }
+    for (i = 0; i < 2; i++) {
+        if (fcntl(t->stopfds[i], F_SETFD, FD_CLOEXEC) == -1)
+            return REDIS_ERR;
+    }
+
+    for (i = 0; i < rt->connections; i++) {
+        t->shards[i].thread = t;
+        t->shards[i].queue = redisAsyncQueueCreate(NULL, runtimeAttach, t);
+        if (t->shards[i].queue == NULL)
+            return REDIS_ERR;
+    }
+
+    return REDIS_OK;
+}
+
+redisRuntime *redisRuntimeCreate(const redisRuntimeOptions *options) {
+    const redisOptions *ropts = &options->options;
+    redisRuntime *rt;
+    long ncpu;
+    int i;
+
+    if (options->threads < 0 || options->connections < 0)
+        return NULL;
+
+    /* Contexts must be freed by hiredis once disconnected, for the runtime
+     * to notice and replace them. */
+    if (__redisCheckSharedOptions(ropts) != REDIS_OK || (ropts->options & REDIS_OPT_NOAUTOFREE))
+        return NULL;
+
+    rt = hi_calloc(1, sizeof(*rt));
+    if (rt == NULL)
+        return NULL;
+
+    rt->nthreads = options->threads;
+    if (rt->nthreads == 0) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        rt->nthreads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    rt->connections = options->connections ? options->connections : 1;
+    rt->nshards = rt->nthreads * rt->connections;
+    rt->pin = options->pin;
+    rt->reconnect_interval = 100;
+    if (options->reconnect_interval) {
+        rt->reconnect_interval = (long long)options->reconnect_interval->tv_sec * 1000 +
+                                 options->reconnect_interval->tv_usec / 1000;
+    }
+    if (options->reconnect) {
+        rt->reconnect = *options->reconnect;
+        rt->autoreconnect = 1;
+    }
+    rt->connect_cb = options->connect_cb;
+    rt->connect_privdata = options->connect_privdata;
+
+    rt->threads = hi_calloc(rt->nthreads, sizeof(*rt->threads));
+    rt->shards = hi_calloc(rt->nshards, sizeof(*rt->shards));
+    if (rt->threads == NULL || rt->shards == NULL)
+        goto error;
+    /* For redisRuntimeFree() to tell the threads that were initialized. */
+    for (i = 0; i < rt->nthreads; i++)
+        rt->threads[i].stopfds[0] = rt->threads[i].stopfds[1] = -1;
+    if (__redisCopyOptions(&rt->options, ropts) != REDIS_OK)
+        goto error;
+
+    for (i = 0; i < rt->nthreads; i++) {
+        if (runtimeThreadInit(rt, &rt->threads[i], i) != REDIS_OK)
+            goto error;
+    }
+
+    /* Connections are established by their threads, so everything about
+     * them happens there. */
+    for (i = 0; i < rt->nthreads; i++) {
+        if (pthread_create(&rt->threads[i].tid, NULL, runtimeThreadMain, &rt->threads[i]) != 0)
+            goto error;
+        rt->threads[i].started = 1;
+    }
+
+    return rt;
+
+error:
+    redisRuntimeFree(rt);
+    return NULL;
+}
+
+int redisRuntimeShards(redisRuntime *rt) {
+    return rt->nshards;
+}
+
+int redisRuntimeKeyShard(redisRuntime *rt, const char *key, size_t len) {
+    unsigned int hash = 2166136261u;
+    size_t i;
+
+    /* FNV-1a */
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 16777619u;
+    }
+
+    return hash % rt->nshards;
+}
+
+static redisRuntimeShard *runtimePick(redisRuntime *rt, int shard) {
+    if (shard < 0)
+        shard = __atomic_fetch_add(&rt->next, 1, __ATOMIC_RELAXED) % rt->nshards;
+    else if (shard >= rt->nshards)
+        return NULL;
+
+    return &rt->shards[shard];
+}
+
+static int runtimeSubmitted(redisRuntimeShard *shard, int status) {
+    if (status == REDIS_OK)
+        __atomic_add_fetch(&shard->thread->submitted, 1, __ATOMIC_RELAXED);
+    return status;
+}
+
+int redisRuntimeFormattedCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                                 redisCallbackFn *fn, void *privdata,
+                                 const char *cmd, size_t len)
+{
+    redisRuntimeShard *s = runtimePick(rt, shard);
+
+    if (s == NULL)
+        return REDIS_ERR;
+    return runtimeSubmitted(s, redisAsyncQueueFormattedCommand(s->queue, cq, fn, privdata,
+                                                               cmd, len));
+}
+
+int redisvRuntimeCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                         redisCallbackFn *fn, void *privdata, const char *format, va_list ap)
+{
+    redisRuntimeShard *s = runtimePick(rt, shard);
+
+    if (s == NULL)
+        return REDIS_ERR;
+    return runtimeSubmitted(s, redisvAsyncQueueCommand(s->queue, cq, fn, privdata, format, ap));
+}
+
+int redisRuntimeCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                        redisCallbackFn *fn, void *privdata, const char *format, ...)
+{
+    va_list ap;
+    int status;
+
+    va_start(ap, format);
+    status = redisvRuntimeCommand(rt, shard, cq, fn, privdata, format, ap);
+    va_end(ap);
+    return status;
+}
+
+int redisRuntimeCommandArgv(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                            redisCallbackFn *fn, void *privdata, int argc,
+                            const char **argv, const size_t *argvlen)
+{
+    redisRuntimeShard *s = runtimePick(rt, shard);
+
+    if (s == NULL)
+        return REDIS_ERR;
+    return runtimeSubmitted(s, redisAsyncQueueCommandArgv(s->queue, cq, fn, privdata,
+                                                          argc, argv, argvlen));
+}
+
+static void runtimeAddStats(redisRuntimeThread *t, redisRuntimeStats *stats) {
+    stats->connected += __atomic_load_n(&t->connected, __ATOMIC_RELAXED);
+    stats->submitted += runtimeLoad(&t->submitted);
+    stats->wakeups += runtimeLoad(&t->wakeups);
+    stats->reads += runtimeLoad(&t->reads);
+    stats->writes += runtimeLoad(&t->writes);
+    stats->timeouts += runtimeLoad(&t->timeouts);
+    stats->reconnects += runtimeLoad(&t->reconnects);
+}
+
+void redisRuntimeGetStats(redisRuntime *rt, int thread, redisRuntimeStats *stats) {
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = rt->nthreads;
+    stats->shards = rt->nshards;
+
+    if (thread >= 0) {
+        if (thread < rt->nthreads)
+            runtimeAddStats(&rt->threads[thread], stats);
+        return;
+    }
+
+    for (i = 0; i < rt->nthreads; i++)
+        runtimeAddStats(&rt->threads[i], stats);
+}
+
+void redisRuntimeFree(redisRuntime *rt) {
+    redisRuntimeThread *t;
+    redisRuntimeShard *shard;
+    ssize_t nwritten;
+    int i;
+
+    if (rt == NULL)
+        return;
+
+    for (i = 0; rt->threads && i < rt->nthreads; i++) {
+        t = &rt->threads[i];
+        if (!t->started)
+            continue;
+        __atomic_store_n(&t->stop, 1, __ATOMIC_RELEASE);
+        do {
+            nwritten = write(t->stopfds[1], "x", 1);
+        } while (nwritten == -1 && errno == EINTR);
+        pthread_join(t->tid, NULL);
+    }
+
+    /* The threads are gone: their contexts can be freed from here. */
+    rt->freeing = 1;
+    for (i = 0; rt->shards && i < rt->nshards; i++) {
+        shard = &rt->shards[i];
+        if (shard->queue)
+            redisAsyncQueueFree(shard->queue);
+        shard->queue = NULL;
+        if (shard->ac)
+            redisAsyncFree(shard->ac);
+    }
+
+    for (i = 0; rt->threads && i < rt->nthreads; i++) {
+        t = &rt->threads[i];
+        while (t->nevents > 0)
+            runtimeRemoveEvents(t, t->events[0]);
+        hi_free(t->events);
+        hi_free(t->pfds);
+        if (t->stopfds[0] != -1)
+            close(t->stopfds[0]);
+        if (t->stopfds[1] != -1)
+            close(t->stopfds[1]);
+    }
+
+    __redisFreeOptions(&rt->options);
+
+    hi_free(rt->threads);
+    hi_free(rt->shards);
+    hi_free(rt);
+}
+
+#else /* _WIN32 */
+
+/* The runtime relies on POSIX threads and poll(). */
+
+redisRuntime *redisRuntimeCreate(const redisRuntimeOptions *options) {
+    (void)options;
+    return NULL;
+}
+
+int redisRuntimeShards(redisRuntime *rt) {
+    (void)rt;
+    return 0;
+}
+
+int redisRuntimeKeyShard(redisRuntime *rt, const char *key, size_t len) {
+    (void)rt;
+    (void)key;
+    (void)len;
+    return 0;
+}
+
+int redisRuntimeCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                        redisCallbackFn *fn, void *privdata, const char *format, ...)
+{
+    (void)rt; (void)shard; (void)cq; (void)fn; (void)privdata; (void)format;
+    return REDIS_ERR;
+}
+
+int redisvRuntimeCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                         redisCallbackFn *fn, void *privdata, const char *format, va_list ap)
+{
+    (void)rt; (void)shard; (void)cq; (void)fn; (void)privdata; (void)format; (void)ap;
+    return REDIS_ERR;
+}
+
+int redisRuntimeCommandArgv(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                            redisCallbackFn *fn, void *privdata, int argc,
+                            const char **argv, const size_t *argvlen)
+{
+    (void)rt; (void)shard; (void)cq; (void)fn; (void)privdata;
+    (void)argc; (void)argv; (void)argvlen;
+    return REDIS_ERR;
+}
+
+int redisRuntimeFormattedCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                                 redisCallbackFn *fn, void *privdata,
+                                 const char *cmd, size_t len)
+{
+    (void)rt; (void)shard; (void)cq; (void)fn; (void)privdata; (void)cmd; (void)len;
+    return REDIS_ERR;
+}
+
+void redisRuntimeGetStats(redisRuntime *rt, int thread, redisRuntimeStats *stats) {
+    (void)rt;
+    (void)thread;
+    memset(stats, 0, sizeof(*stats));
+}
+
+void redisRuntimeFree(redisRuntime *rt) {
+    (void)rt;
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __HIREDIS_RUNTIME_H
+#define __HIREDIS_RUNTIME_H
+#include "async.h"
+#include "queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Called on every connection the runtime creates, including replacements of
+ * lost ones, from the thread that will own it. Commands needed to set up the
+ * connection, such as AUTH or SELECT, can be sent from here, and features
+ * such as redisAsyncEnableCache() enabled. Return REDIS_OK on success; on
+ * REDIS_ERR the connection is dropped and retried later. */
+typedef int (redisRuntimeConnectFn)(redisAsyncContext *ac, void *privdata);
+
+typedef struct redisRuntimeOptions {
+    /* How to connect to the server, for every connection. Only the TCP and
+     * unix socket connection types are supported, without a privdata
+     * destructor. */
+    redisOptions options;
+
+    /* Number of event loop threads. If 0, one per online CPU. */
+    int threads;
+    /* Connections owned by each thread. If 0, one. */
+    int connections;
+    /* Pin thread i to CPU i modulo the number of CPUs. Only on Linux. */
+    int pin;
+
+    /* Delay before replacing a connection that was lost or could not be
+     * established. If NULL, 100 milliseconds. */
+    const struct timeval *reconnect_interval;
+    /* If not NULL, connections also reconnect by themselves, keeping their
+     * pending commands. See redisAsyncSetReconnect(). */
+    const redisAsyncReconnectOptions *reconnect;
+
+    redisRuntimeConnectFn *connect_cb;
+    void *connect_privdata;
+} redisRuntimeOptions;
+
+typedef struct redisRuntimeStats {
+    int threads;
+    int shards;
+    int connected;                  /* Shards currently connected */
+    unsigned long long submitted;   /* Commands submitted */
+    unsigned long long wakeups;     /* Event loop iterations */
+    unsigned long long reads;       /* Read events handled */
+    unsigned long long writes;      /* Write events handled */
+    unsigned long long timeouts;    /* Timers expired */
+    unsigned long long reconnects;  /* Connections replaced */
+} redisRuntimeStats;
+
+typedef struct redisRuntime redisRuntime;
+
+/* Create a runtime: start its event loop threads, each owning its own
+ * connections. Returns NULL for invalid options, when out of memory, if a
+ * thread could not be started, or on Windows. Connections that cannot be
+ * established are retried in the background. */
+redisRuntime *redisRuntimeCreate(const redisRuntimeOptions *options);
+
+/* Number of shards, one per connection: threads * connections. Shard s is
+ * owned by thread s / connections. */
+int redisRuntimeShards(redisRuntime *rt);
+
+/* Shard of a key, so all the commands for a key go through one connection
+ * and keep their order. */
+int redisRuntimeKeyShard(redisRuntime *rt, const char *key, size_t len);
+
+/* Submit a command to a shard, or to the next shard in turn if shard is -1.
+ * Safe to call from any thread, including event loop threads.
+ *
+ * Replies are delivered as with redisAsyncQueueCommand(): on the event loop
+ * thread of the shard if cq is NULL, otherwise on the thread running cq. The
+ * callback gets a NULL reply, and a NULL context, if the command is drained
+ * while its shard is disconnected. Commands submitted to different shards
+ * may complete in any order. */
+int redisRuntimeCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                        redisCallbackFn *fn, void *privdata, const char *format, ...);
+int redisvRuntimeCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                         redisCallbackFn *fn, void *privdata, const char *format, va_list ap);
+int redisRuntimeCommandArgv(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                            redisCallbackFn *fn, void *privdata, int argc,
+                            const char **argv, const size_t *argvlen);
+int redisRuntimeFormattedCommand(redisRuntime *rt, int shard, redisCompletionQueue *cq,
+                                 redisCallbackFn *fn, void *privdata,
+                                 const char *cmd, size_t len);
+
+/* Counters of one thread, or summed over all threads if thread is -1. Safe
+ * to call from any thread; counters are read without stopping the threads. */
+void redisRuntimeGetStats(redisRuntime *rt, int thread, redisRuntimeStats *stats);
+
+/* Stop the threads, close all connections and free the runtime. Callbacks
+ * of pending commands are called with a NULL reply, on the calling thread
+ * unless they go to a completion queue. Must not be called from an event
+ * loop thread of the runtime, nor while other threads still submit. */
+void redisRuntimeFree(redisRuntime *rt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
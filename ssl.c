@@ -60,6 +60,7 @@
 #include "async_private.h"
 #include "hiredis_ssl.h"
 
+#define OPENSSL_1_1_1 0x10101000L
 #define OPENSSL_1_1_0 0x10100000L
 #define OPENSSL_1_0_2 0x10002000L
 
@@ -81,14 +82,33 @@ newer OpenSSL, or define HIREDIS_NO_PEER_NAME_VERIFICATION to build without peer
 certificate name verification."
 #endif
 
+/* Kernel TLS offload (redisSSLOptions.options REDIS_SSL_OPT_ENABLE_KTLS) is
+ * available since OpenSSL 3.0, and only used when OpenSSL was built with it
+ * and the kernel supports the negotiated cipher. Otherwise the option is
+ * silently ignored and records are processed by OpenSSL as usual. */
+#ifdef SSL_OP_ENABLE_KTLS
+#define HIREDIS_SSL_SUPPORTS_KTLS 1
+#else
+#define HIREDIS_SSL_SUPPORTS_KTLS 0
+#endif
+
 void __redisSetError(redisContext *c, int type, const char *str);
 
+struct redisSSLSessionCache;
+
 struct redisSSLContext {
     /* Associated OpenSSL SSL_CTX as created by redisCreateSSLContext() */
     SSL_CTX *ssl_ctx;
 
     /* Requested SNI, or NULL */
     char *server_name;
+
+    /* Bit field of REDIS_SSL_OPT_xxx */
+    int options;
+
+    /* Client-side cache of resumable sessions, or NULL when session
+     * resumption is disabled */
+    struct redisSSLSessionCache *sessions;
 };
 
 /* The SSL connection context is attached to SSL/TLS connections as a privdata. */
@@ -112,21 +132,29 @@ typedef struct redisSSL {
      * should resume whenever a read takes place, if possible
      */
     int pendingWrite;
+
+    /**
+     * Session cache of the redisSSLContext this connection was created from
+     * (we hold a reference), and the key new sessions are stored under.
+     * Both are NULL when resumption does not apply to this connection.
+     */
+    struct redisSSLSessionCache *sessions;
+    sds sessionKey;
+
+    /* Set while we still have to check whether the kernel took over record
+     * encryption once the handshake completes. */
+    int checkKTLS;
 } redisSSL;
 
-/* Forward declaration */
+/* Forward declarations */
 redisContextFuncs redisContextSSLFuncs;
+redisContextFuncs redisContextKTLSFuncs;
 
 /**
- * OpenSSL global initialization and locking handling callbacks.
- * Note that this is only required for OpenSSL < 1.1.0.
+ * Locking primitives, used by the session cache and (for OpenSSL < 1.1.0)
+ * by the OpenSSL locking callbacks below.
  */
 
-#if OPENSSL_VERSION_NUMBER < OPENSSL_1_1_0
-#define HIREDIS_USE_CRYPTO_LOCKS
-#endif
-
-#ifdef HIREDIS_USE_CRYPTO_LOCKS
 #ifdef _WIN32
 typedef CRITICAL_SECTION sslLockType;
 static void sslLockInit(sslLockType* l) {
@@ -138,6 +166,9 @@ static void sslLockAcquire(sslLockType* l) {
 static void sslLockRelease(sslLockType* l) {
     LeaveCriticalSection(l);
 }
+static void sslLockDestroy(sslLockType* l) {
+    DeleteCriticalSection(l);
+}
 #else
 typedef pthread_mutex_t sslLockType;
 static void sslLockInit(sslLockType *l) {
@@ -149,8 +180,21 @@ static void sslLockAcquire(sslLockType *l) {
 static void sslLockRelease(sslLockType *l) {
     pthread_mutex_unlock(l);
 }
+static void sslLockDestroy(sslLockType *l) {
+    pthread_mutex_destroy(l);
+}
 #endif
 
+/**
+ * OpenSSL global initialization and locking handling callbacks.
+ * Note that this is only required for OpenSSL < 1.1.0.
+ */
+
+#if OPENSSL_VERSION_NUMBER < OPENSSL_1_1_0
+#define HIREDIS_USE_CRYPTO_LOCKS
+#endif
+
+#ifdef HIREDIS_USE_CRYPTO_LOCKS
 static sslLockType* ossl_locks;
 
 static void opensslDoLock(int mode, int lkid, const char *f, int line) {
@@ -195,6 +239,199 @@ int redisInitOpenSSL(void)
     return REDIS_OK;
 }
 
+/**
+ * Client-side TLS session cache.
+ *
+ * Sessions (TLS 1.2 session IDs/tickets and TLS 1.3 tickets) are captured
+ * through OpenSSL's new session callback and stored under a key made of the
+ * requested SNI and the endpoint the redisContext is connected to. When TLS is
+ * initiated on a context whose key has a cached session, that session is
+ * offered to the server, so a reconnect (redisReconnect() followed by
+ * redisInitiateSSLWithContext()) or a new connection to the same server
+ * through the same redisSSLContext can skip the full handshake.
+ *
+ * The cache is shared by a redisSSLContext and every connection created from
+ * it, and is reference counted so connections may outlive their context.
+ */
+
+typedef struct redisSSLSessionEntry {
+    sds key;                        /* NULL when the slot is unused */
+    SSL_SESSION *session;
+    unsigned long long lastUsed;    /* For LRU eviction */
+} redisSSLSessionEntry;
+
+typedef struct redisSSLSessionCache {
+    sslLockType lock;
+    int refcount;
+    unsigned long long clock;
+    size_t size;
+    redisSSLSessionEntry *entries;
+} redisSSLSessionCache;
+
+static redisSSLSessionCache *redisSSLSessionCacheCreate(size_t size) {
+    redisSSLSessionCache *cache = hi_calloc(1, sizeof(*cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->entries = hi_calloc(size, sizeof(*cache->entries));
+    if (cache->entries == NULL) {
+        hi_free(cache);
+        return NULL;
+    }
+
+    sslLockInit(&cache->lock);
+    cache->refcount = 1;
+    cache->size = size;
+    return cache;
+}
+
+static redisSSLSessionCache *redisSSLSessionCacheRetain(redisSSLSessionCache *cache) {
+    sslLockAcquire(&cache->lock);
+    cache->refcount++;
+    sslLockRelease(&cache->lock);
+    return cache;
+}
+
+static void redisSSLSessionCacheRelease(redisSSLSessionCache *cache) {
+    int refcount;
+    size_t i;
+
+    if (cache == NULL)
+        return;
+
+    sslLockAcquire(&cache->lock);
+    refcount = --cache->refcount;
+    sslLockRelease(&cache->lock);
+    if (refcount > 0)
+        return;
+
+    for (i = 0; i < cache->size; i++) {
+        sdsfree(cache->entries[i].key);
+        if (cache->entries[i].session)
+            SSL_SESSION_free(cache->entries[i].session);
+    }
+
+    sslLockDestroy(&cache->lock);
+    hi_free(cache->entries);
+    hi_free(cache);
+}
+
+/* Return the entry stored under key or NULL. Called with the lock held. */
+static redisSSLSessionEntry *redisSSLSessionCacheFind(redisSSLSessionCache *cache, const sds key) {
+    redisSSLSessionEntry *e;
+    size_t i;
+
+    for (i = 0; i < cache->size; i++) {
+        e = &cache->entries[i];
+        if (e->key && sdslen(e->key) == sdslen(key) &&
+            memcmp(e->key, key, sdslen(key)) == 0)
+        {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+static void redisSSLSessionEntryClear(redisSSLSessionEntry *e) {
+    sdsfree(e->key);
+    if (e->session)
+        SSL_SESSION_free(e->session);
+    memset(e, 0, sizeof(*e));
+}
+
+/* Offer the session cached under key, if any, for resumption on ssl. */
+static void redisSSLSessionCacheApply(redisSSLSessionCache *cache, const sds key, SSL *ssl) {
+    redisSSLSessionEntry *e;
+
+    sslLockAcquire(&cache->lock);
+    e = redisSSLSessionCacheFind(cache, key);
+    if (e != NULL) {
+#if OPENSSL_VERSION_NUMBER >= OPENSSL_1_1_1
+        if (!SSL_SESSION_is_resumable(e->session)) {
+            redisSSLSessionEntryClear(e);
+        } else
+#endif
+        {
+            /* SSL_set_session() takes its own reference to the session */
+            SSL_set_session(ssl, e->session);
+            e->lastUsed = ++cache->clock;
+        }
+    }
+    sslLockRelease(&cache->lock);
+}
+
+/* Store session under key, replacing the session previously cached for it or
+ * evicting the least recently used entry when the cache is full. Returns 1
+ * when the cache took ownership of the session reference, 0 otherwise. */
+static int redisSSLSessionCacheStore(redisSSLSessionCache *cache, const sds key, SSL_SESSION *session) {
+    redisSSLSessionEntry *e, *victim;
+    size_t i;
+
+    sslLockAcquire(&cache->lock);
+    e = redisSSLSessionCacheFind(cache, key);
+    if (e == NULL) {
+        victim = &cache->entries[0];
+        for (i = 0; i < cache->size; i++) {
+            if (cache->entries[i].key == NULL) {
+                victim = &cache->entries[i];
+                break;
+            }
+            if (cache->entries[i].lastUsed < victim->lastUsed)
+                victim = &cache->entries[i];
+        }
+
+        redisSSLSessionEntryClear(victim);
+        victim->key = sdsdup(key);
+        if (victim->key == NULL) {
+            sslLockRelease(&cache->lock);
+            return 0;
+        }
+        e = victim;
+    } else if (e->session) {
+        SSL_SESSION_free(e->session);
+    }
+
+    e->session = session;
+    e->lastUsed = ++cache->clock;
+    sslLockRelease(&cache->lock);
+
+    return 1;
+}
+
+/* Build the key sessions of this connection are cached under. Returns NULL
+ * when the endpoint is unknown (e.g. a user provided fd), in which case the
+ * connection does not take part in session resumption. */
+static sds redisSSLSessionKey(redisContext *c, const char *server_name) {
+    sds key;
+
+    if (server_name == NULL)
+        server_name = "";
+
+    if (c->connection_type == REDIS_CONN_TCP && c->tcp.host) {
+        if ((key = sdsempty()) == NULL)
+            return NULL;
+        return sdscatfmt(key, "%s|%s:%i", server_name, c->tcp.host, c->tcp.port);
+    } else if (c->connection_type == REDIS_CONN_UNIX && c->unix_sock.path) {
+        if ((key = sdsempty()) == NULL)
+            return NULL;
+        return sdscatfmt(key, "%s|%s", server_name, c->unix_sock.path);
+    }
+
+    return NULL;
+}
+
+/* OpenSSL new session callback, invoked once the server issues a session
+ * (at the end of a TLS 1.2 handshake, or on receipt of a TLS 1.3 ticket). */
+static int redisSSLNewSessionCallback(SSL *ssl, SSL_SESSION *session) {
+    redisSSL *rssl = SSL_get_app_data(ssl);
+
+    if (rssl == NULL || rssl->sessions == NULL)
+        return 0;
+
+    return redisSSLSessionCacheStore(rssl->sessions, rssl->sessionKey, session);
+}
+
 /**
  * redisSSLContext helper context destruction.
  */
@@ -220,6 +457,8 @@ const char *redisSSLContextGetError(redisSSLContextError error)
             return "Failed to add CA certificates obtained from system to the SSL context";
         case REDIS_SSL_CTX_VERIFY_NAME_FAILED:
             return "Failed to set the expected peer certificate name for verification";
+        case REDIS_SSL_CTX_INVALID_OPTION:
+            return "Invalid SSL buffer or record size option";
         default:
             return "Unknown error code";
     }
@@ -240,6 +479,9 @@ void redisFreeSSLContext(redisSSLContext *ctx)
         ctx->ssl_ctx = NULL;
     }
 
+    redisSSLSessionCacheRelease(ctx->sessions);
+    ctx->sessions = NULL;
+
     hi_free(ctx);
 }
 
@@ -419,6 +661,48 @@ redisSSLContext *redisCreateSSLContextWithOptions(redisSSLOptions *options, redi
     if (server_name)
         ctx->server_name = hi_strdup(server_name);
 
+    ctx->options = options->options;
+    if (ctx->options & REDIS_SSL_OPT_RELEASE_BUFFERS)
+        SSL_CTX_set_mode(ctx->ssl_ctx, SSL_MODE_RELEASE_BUFFERS);
+
+    if (options->max_send_fragment &&
+        !SSL_CTX_set_max_send_fragment(ctx->ssl_ctx, options->max_send_fragment))
+    {
+        if (error) *error = REDIS_SSL_CTX_INVALID_OPTION;
+        goto error;
+    }
+
+    if (options->read_ahead_len) {
+        if (options->read_ahead_len < 0) {
+            if (error) *error = REDIS_SSL_CTX_INVALID_OPTION;
+            goto error;
+        }
+        SSL_CTX_set_read_ahead(ctx->ssl_ctx, 1);
+#if OPENSSL_VERSION_NUMBER >= OPENSSL_1_1_0
+        SSL_CTX_set_default_read_buffer_len(ctx->ssl_ctx, options->read_ahead_len);
+#endif
+    }
+
+#if HIREDIS_SSL_SUPPORTS_KTLS
+    if (ctx->options & REDIS_SSL_OPT_ENABLE_KTLS)
+        SSL_CTX_set_options(ctx->ssl_ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+    if (options->session_cache_size >= 0) {
+        ctx->sessions = redisSSLSessionCacheCreate(options->session_cache_size ?
+            (size_t)options->session_cache_size : REDIS_SSL_SESSION_CACHE_SIZE);
+        if (ctx->sessions == NULL) {
+            if (error) *error = REDIS_SSL_CTX_CREATE_FAILED;
+            goto error;
+        }
+
+        /* Sessions are kept in our own cache, keyed by endpoint, rather than
+         * in OpenSSL's internal one which is of no use to a client. */
+        SSL_CTX_set_session_cache_mode(ctx->ssl_ctx,
+            SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx->ssl_ctx, redisSSLNewSessionCallback);
+    }
+
     return ctx;
 
 error:
@@ -435,7 +719,38 @@ error:
  */
 
 
-static int redisSSLConnect(redisContext *c, SSL *ssl) {
+/* Once the handshake is complete, check whether OpenSSL handed record
+ * encryption over to the kernel. When it did for the transmit side, switch
+ * the context to plain socket writes so obuf goes straight to send(2) rather
+ * than through SSL_write(). Receiving stays with SSL_read(), which reads
+ * decrypted records straight from the kernel with kTLS, but must still deal
+ * with non-data records such as TLS 1.3 session tickets and key updates. */
+static void redisSSLCheckKTLS(redisContext *c, redisSSL *rssl) {
+    if (!SSL_is_init_finished(rssl->ssl) || rssl->lastLen != 0)
+        return;
+
+    rssl->checkKTLS = 0;
+#if HIREDIS_SSL_SUPPORTS_KTLS
+    if (BIO_get_ktls_send(SSL_get_wbio(rssl->ssl)))
+        c->funcs = &redisContextKTLSFuncs;
+#else
+    (void)c;
+#endif
+}
+
+/* Drop the session cache reference held by a connection. */
+static void redisSSLReleaseSessions(redisSSL *rssl) {
+    if (rssl->sessions == NULL)
+        return;
+
+    SSL_set_app_data(rssl->ssl, NULL);
+    redisSSLSessionCacheRelease(rssl->sessions);
+    sdsfree(rssl->sessionKey);
+    rssl->sessions = NULL;
+    rssl->sessionKey = NULL;
+}
+
+static int redisSSLConnect(redisContext *c, SSL *ssl, redisSSLContext *redis_ssl_ctx) {
     if (c->privctx) {
         __redisSetError(c, REDIS_ERR_OTHER, "redisContext was already associated");
         return REDIS_ERR;
@@ -449,7 +764,26 @@ static int redisSSLConnect(redisContext *c, SSL *ssl) {
 
     rssl->ssl = ssl;
 
-    SSL_set_mode(rssl->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    /* Resume a previous session with this endpoint when we have one. This is
+     * only done for SSL objects we created, as we need their app data. */
+    if (redis_ssl_ctx && redis_ssl_ctx->sessions) {
+        rssl->sessionKey = redisSSLSessionKey(c, redis_ssl_ctx->server_name);
+        if (rssl->sessionKey) {
+            rssl->sessions = redisSSLSessionCacheRetain(redis_ssl_ctx->sessions);
+            redisSSLSessionCacheApply(rssl->sessions, rssl->sessionKey, ssl);
+            SSL_set_app_data(ssl, rssl);
+        }
+    }
+
+    if (redis_ssl_ctx && (redis_ssl_ctx->options & REDIS_SSL_OPT_ENABLE_KTLS))
+        rssl->checkKTLS = 1;
+
+    /* Partial writes let SSL_write() return once some records are sent, so a
+     * large obuf makes progress on a slow socket instead of being retried as
+     * a whole. A retry after WANT_WRITE must still pass the same length, see
+     * lastLen. */
+    SSL_set_mode(rssl->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                            SSL_MODE_ENABLE_PARTIAL_WRITE);
     SSL_set_fd(rssl->ssl, c->fd);
     SSL_set_connect_state(rssl->ssl);
 
@@ -459,6 +793,8 @@ static int redisSSLConnect(redisContext *c, SSL *ssl) {
     if (rv == 1) {
         c->funcs = &redisContextSSLFuncs;
         c->privctx = rssl;
+        if (rssl->checkKTLS)
+            redisSSLCheckKTLS(c, rssl);
         return REDIS_OK;
     }
 
@@ -486,6 +822,7 @@ static int redisSSLConnect(redisContext *c, SSL *ssl) {
         __redisSetError(c, REDIS_ERR_IO, err);
     }
 
+    redisSSLReleaseSessions(rssl);
     hi_free(rssl);
     return REDIS_ERR;
 }
@@ -496,7 +833,7 @@ static int redisSSLConnect(redisContext *c, SSL *ssl) {
  */
 
 int redisInitiateSSL(redisContext *c, SSL *ssl) {
-    return redisSSLConnect(c, ssl);
+    return redisSSLConnect(c, ssl, NULL);
 }
 
 /**
@@ -528,7 +865,7 @@ int redisInitiateSSLWithContext(redisContext *c, redisSSLContext *redis_ssl_ctx)
         }
     }
 
-    if (redisSSLConnect(c, ssl) != REDIS_OK) {
+    if (redisSSLConnect(c, ssl, redis_ssl_ctx) != REDIS_OK) {
         goto error;
     }
 
@@ -565,15 +902,59 @@ static void redisSSLFree(void *privctx){
 
     if (!rsc) return;
     if (rsc->ssl) {
+        /* OpenSSL invalidates the session of a connection freed without a
+         * shutdown. Fatal errors have already invalidated it if needed, so
+         * mark the connection as shut down to keep the session resumable. */
+        if (rsc->sessions)
+            SSL_set_shutdown(rsc->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+        redisSSLReleaseSessions(rsc);
         SSL_free(rsc->ssl);
         rsc->ssl = NULL;
     }
     hi_free(rsc);
 }
 
+/* Return the SSL connection of the context, or NULL if it has none. */
+static redisSSL *redisGetSSL(redisContext *c) {
+    if (c == NULL || c->privctx == NULL)
+        return NULL;
+    if (c->funcs != &redisContextSSLFuncs && c->funcs != &redisContextKTLSFuncs)
+        return NULL;
+    return c->privctx;
+}
+
+int redisIsSSLSessionReused(redisContext *c) {
+    redisSSL *rssl = redisGetSSL(c);
+
+    if (rssl == NULL)
+        return 0;
+
+    return SSL_session_reused(rssl->ssl) ? 1 : 0;
+}
+
+int redisGetSSLKTLSFlags(redisContext *c) {
+    redisSSL *rssl = redisGetSSL(c);
+    int flags = 0;
+
+    if (rssl == NULL)
+        return 0;
+
+#if HIREDIS_SSL_SUPPORTS_KTLS
+    if (BIO_get_ktls_send(SSL_get_wbio(rssl->ssl)))
+        flags |= REDIS_SSL_KTLS_SEND;
+    if (BIO_get_ktls_recv(SSL_get_rbio(rssl->ssl)))
+        flags |= REDIS_SSL_KTLS_RECV;
+#endif
+
+    return flags;
+}
+
 static ssize_t redisSSLRead(redisContext *c, char *buf, size_t bufcap) {
     redisSSL *rssl = c->privctx;
 
+    if (rssl->checkKTLS)
+        redisSSLCheckKTLS(c, rssl);
+
     int nread = SSL_read(rssl->ssl, buf, bufcap);
     if (nread > 0) {
         return nread;
@@ -616,6 +997,12 @@ static ssize_t redisSSLRead(redisContext *c, char *buf, size_t bufcap) {
 static ssize_t redisSSLWrite(redisContext *c) {
     redisSSL *rssl = c->privctx;
 
+    if (rssl->checkKTLS) {
+        redisSSLCheckKTLS(c, rssl);
+        if (c->funcs == &redisContextKTLSFuncs)
+            return redisNetWrite(c);
+    }
+
     size_t len = rssl->lastLen ? rssl->lastLen : sdslen(c->obuf);
     int rv = SSL_write(rssl->ssl, c->obuf, len);
 
@@ -704,3 +1091,14 @@ redisContextFuncs redisContextSSLFuncs = {
     .write = redisSSLWrite
 };
 
+/* Used once the kernel encrypts outgoing records: writes no longer depend on
+ * the SSL state, so they take the plain socket path. */
+redisContextFuncs redisContextKTLSFuncs = {
+    .close = redisNetClose,
+    .free_privctx = redisSSLFree,
+    .async_read = redisSSLAsyncRead,
+    .async_write = redisAsyncWrite,
+    .read = redisSSLRead,
+    .write = redisNetWrite
+};
+
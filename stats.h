@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HIREDIS_STATS_H
+#define __HIREDIS_STATS_H
+
+/* Counters are only updated by the thread using the context, and read by
+ * redisGetStats() from any thread. Updates are a relaxed load and store
+ * rather than an atomic read-modify-write, so they cost no more than plain
+ * increments while readers never see torn values. Other compilers fall back
+ * to plain accesses. */
+#if defined(__GNUC__) || defined(__clang__)
+#define redisStatLoad(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define redisStatStore(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#else
+#define redisStatLoad(p) (*(p))
+#define redisStatStore(p, v) (*(p) = (v))
+#endif
+
+#define redisStatAdd(p, n) redisStatStore((p), redisStatLoad(p) + (n))
+#define redisStatIncr(p) redisStatAdd((p), 1)
+#define redisStatDecr(p) redisStatStore((p), redisStatLoad(p) - 1)
+#define redisStatMax(p, v) do { \
+        if ((v) > redisStatLoad(p)) redisStatStore((p), (v)); \
+    } while (0)
+
+#endif
@@ -6,6 +6,7 @@
 #ifndef _WIN32
 #include <strings.h>
 #include <sys/time.h>
+#include <fcntl.h>
 #endif
 #include <assert.h>
 #include <signal.h>
@@ -15,6 +16,14 @@
 
 #include "hiredis.h"
 #include "async.h"
+#include "cache.h"
+#include "capture.h"
+#include "cluster.h"
+#include "group.h"
+#include "pool.h"
+#include "queue.h"
+#include "ring.h"
+#include "runtime.h"
 #include "adapters/poll.h"
 #ifdef HIREDIS_TEST_SSL
 #include "hiredis_ssl.h"
@@ -25,6 +34,7 @@
 #endif
 #include "net.h"
 #include "win32.h"
+#include "dict.c"
 
 enum connection_type {
     CONN_TCP,
@@ -432,6 +442,164 @@ static void test_tcp_options(struct config cfg) {
     redisFree(c);
 }
 
+static int pool_connect_cb(redisContext *c, void *privdata) {
+    redisReply *reply;
+    int *calls = privdata;
+
+    (*calls)++;
+
+    reply = redisCommand(c, "SELECT 9");
+    if (reply == NULL)
+        return REDIS_ERR;
+    freeReplyObject(reply);
+    return REDIS_OK;
+}
+
+static int pool_ping(redisContext *c) {
+    redisReply *reply = redisCommand(c, "PING");
+    int ok = reply != NULL && reply->type == REDIS_REPLY_STATUS;
+    freeReplyObject(reply);
+    return ok;
+}
+
+static void test_pool(struct config config) {
+    struct timeval zero = {0, 0};
+    redisPoolOptions options = {0};
+    redisContext *a, *b, *c;
+    redisReply *reply;
+    redisPool *pool;
+    int calls = 0;
+
+    REDIS_OPTIONS_SET_TCP(&options.options, config.tcp.host, config.tcp.port);
+    options.min_size = 1;
+    options.max_size = 2;
+    options.idle_timeout = &zero;
+    options.health_check_interval = &zero;
+    options.connect_cb = pool_connect_cb;
+    options.connect_privdata = &calls;
+
+    test("Pool rejects invalid sizes: ");
+    options.max_size = 0;
+    test_cond(redisPoolCreate(&options) == NULL);
+    options.max_size = 2;
+
+    test("Pool rejects non-blocking connections: ");
+    options.options.options |= REDIS_OPT_NONBLOCK;
+    test_cond(redisPoolCreate(&options) == NULL);
+    options.options.options &= ~REDIS_OPT_NONBLOCK;
+
+    test("Pool opens min_size connections on creation: ");
+    pool = redisPoolCreate(&options);
+    test_cond(pool != NULL && redisPoolSize(pool) == 1 && calls == 1);
+
+    test("Pool hands out up to max_size connections: ");
+    a = redisPoolGet(pool);
+    b = redisPoolGet(pool);
+    c = redisPoolGet(pool);
+    test_cond(a != NULL && b != NULL && a != b && c == NULL &&
+              redisPoolSize(pool) == 2 && calls == 2);
+
+    /* Have the server close the other connection behind the pool's back. */
+    reply = redisCommand(b, "CLIENT KILL TYPE normal SKIPME yes");
+    freeReplyObject(reply);
+    redisPoolPut(pool, b);
+    redisPoolPut(pool, a);
+
+    test("Pool reconnects connections that fail their health check: ");
+    a = redisPoolGet(pool);
+    b = redisPoolGet(pool);
+    test_cond(a != NULL && b != NULL && pool_ping(a) && pool_ping(b) && calls == 3);
+
+    test("Pool reconnects connections put back with an error: ");
+    a->err = REDIS_ERR_IO;
+    redisPoolPut(pool, a);
+    a = redisPoolGet(pool);
+    test_cond(a != NULL && a->err == 0 && pool_ping(a) && calls == 4);
+    redisPoolPut(pool, a);
+    redisPoolPut(pool, b);
+
+    test("Pool evicts idle connections down to min_size: ");
+    test_cond(redisPoolEvictIdle(pool) == 1 && redisPoolSize(pool) == 1);
+
+    redisPoolFree(pool);
+}
+
+#ifndef _WIN32
+static int runtime_connect_cb(redisAsyncContext *ac, void *privdata) {
+    __atomic_add_fetch((int *)privdata, 1, __ATOMIC_RELAXED);
+    return redisAsyncCommand(ac, NULL, NULL, "SELECT 9");
+}
+
+static void runtime_cb(redisAsyncContext *ac, void *r, void *privdata) {
+    redisReply *reply = r;
+    (void)ac;
+
+    snprintf(privdata, 32, "%s", reply && reply->str ? reply->str : "(null)");
+}
+
+/* Run the completion queue until n callbacks were called. */
+static int runtime_wait(redisCompletionQueue *cq, int n) {
+    struct pollfd pfd = {redisCompletionQueueGetFd(cq), POLLIN, 0};
+
+    while (n > 0 && poll(&pfd, 1, 1000) == 1)
+        n -= redisCompletionQueueRun(cq);
+    return n <= 0;
+}
+
+static void test_runtime(struct config config) {
+    redisRuntimeOptions options = {0};
+    redisRuntimeStats stats;
+    redisCompletionQueue *cq;
+    redisRuntime *rt;
+    char set[32], get[32];
+    int calls = 0, shard, i;
+
+    REDIS_OPTIONS_SET_TCP(&options.options, config.tcp.host, config.tcp.port);
+    options.threads = 2;
+    options.connections = 2;
+    options.connect_cb = runtime_connect_cb;
+    options.connect_privdata = &calls;
+
+    test("Runtime rejects connections that are not freed on errors: ");
+    options.options.options |= REDIS_OPT_NOAUTOFREE;
+    test_cond(redisRuntimeCreate(&options) == NULL);
+    options.options.options &= ~REDIS_OPT_NOAUTOFREE;
+
+    test("Runtime rejects privdata destructors shared by its connections: ");
+    options.options.free_privdata = free;
+    test_cond(redisRuntimeCreate(&options) == NULL);
+    options.options.free_privdata = NULL;
+
+    test("Runtime delivers replies to the completion queue: ");
+    rt = redisRuntimeCreate(&options);
+    cq = redisCompletionQueueCreate();
+    assert(rt != NULL && cq != NULL);
+    shard = redisRuntimeKeyShard(rt, "runtime:key", 11);
+    assert(redisRuntimeCommand(rt, shard, cq, runtime_cb, set, "SET runtime:key %s", "value") == REDIS_OK);
+    assert(redisRuntimeCommand(rt, shard, cq, runtime_cb, get, "GET runtime:key") == REDIS_OK);
+    test_cond(runtime_wait(cq, 2) && !strcmp(set, "OK") && !strcmp(get, "value"));
+
+    test("Runtime spreads commands over all shards: ");
+    for (i = 0; i < 100; i++)
+        assert(redisRuntimeCommand(rt, -1, cq, NULL, NULL, "PING") == REDIS_OK);
+    assert(runtime_wait(cq, 100));
+    /* Threads count connections at the start of their next iteration. */
+    for (i = 0; i < 100; i++) {
+        redisRuntimeGetStats(rt, -1, &stats);
+        if (stats.connected == 4)
+            break;
+        usleep(10000);
+    }
+    test_cond(stats.threads == 2 && stats.shards == 4 && stats.connected == 4 &&
+              stats.submitted == 102 && __atomic_load_n(&calls, __ATOMIC_RELAXED) == 4);
+
+    assert(redisRuntimeCommand(rt, shard, cq, NULL, NULL, "DEL runtime:key") == REDIS_OK);
+    assert(runtime_wait(cq, 1));
+    redisRuntimeFree(rt);
+    redisCompletionQueueFree(cq);
+}
+#endif
+
 static void test_unix_keepalive(struct config cfg) {
     redisContext *c;
     redisReply *r;
@@ -452,6 +620,7 @@ static void test_unix_keepalive(struct config cfg) {
 
 static void test_reply_reader(void) {
     redisReader *reader;
+    redisPubSubMessage msg;
     void *reply, *root;
     int ret;
     int i;
@@ -951,21 +1120,1629 @@ static void test_reply_reader(void) {
         ((redisReply*)reply)->element[0]->len == 22 &&
         strcmp(((redisReply*)reply)->element[0]->str, "3.14159265358979323846") == 0);
     freeReplyObject(reply);
-    redisReaderFree(reader);
-}
+    redisReaderFree(reader);
+
+    test("Can read pub/sub messages without a reply: ");
+    reader = redisReaderCreate();
+    redisReaderFeed(reader,"*3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$5\r\nhello\r\n"
+                           ">4\r\n$8\r\npmessage\r\n$2\r\nc*\r\n$2\r\nch\r\n$0\r\n\r\n",76);
+    ret = redisReaderGetMessage(reader,0,&msg);
+    assert(ret == 1 && msg.pattern == NULL && msg.channel_len == 2 &&
+           !memcmp(msg.channel,"ch",2) && msg.payload_len == 5 && !memcmp(msg.payload,"hello",5));
+    ret = redisReaderGetMessage(reader,1,&msg);
+    test_cond(ret == 1 && msg.pattern_len == 2 && !memcmp(msg.pattern,"c*",2) &&
+              msg.channel_len == 2 && msg.payload_len == 0 &&
+              redisReaderGetMessage(reader,0,&msg) == -1);
+    redisReaderFree(reader);
+
+    test("Partial messages and other replies are left alone: ");
+    reader = redisReaderCreate();
+    redisReaderFeed(reader,"*3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$5\r\nhel",32);
+    ret = redisReaderGetMessage(reader,0,&msg);
+    redisReaderFeed(reader,"lo\r\n*3\r\n$9\r\nsubscribe\r\n$2\r\nch\r\n:1\r\n",35);
+    assert(ret == -1 && redisReaderGetMessage(reader,1,&msg) == 0);
+    ret = redisReaderGetMessage(reader,0,&msg);
+    test_cond(ret == 1 && msg.payload_len == 5 && redisReaderGetMessage(reader,0,&msg) == 0 &&
+              redisReaderGetReply(reader,&reply) == REDIS_OK && reply != NULL &&
+              ((redisReply*)reply)->elements == 3);
+    freeReplyObject(reply);
+    redisReaderFree(reader);
+}
+
+static void test_free_null(void) {
+    void *redisCtx = NULL;
+    void *reply = NULL;
+
+    test("Don't fail when redisFree is passed a NULL value: ");
+    redisFree(redisCtx);
+    test_cond(redisCtx == NULL);
+
+    test("Don't fail when freeReplyObject is passed a NULL value: ");
+    freeReplyObject(reply);
+    test_cond(reply == NULL);
+}
+
+static void test_cluster_offline(void) {
+    redisClusterContext *cc;
+    redisReply *reply;
+
+    test("Cluster key slots match the server's: ");
+    test_cond(redisClusterKeySlot("foo", 3) == 12182 &&
+              redisClusterKeySlot("123456789", 9) == 0x31c3 &&
+              redisClusterKeySlot("", 0) == 0);
+
+    test("Cluster key slots only hash non-empty hash tags: ");
+    test_cond(redisClusterKeySlot("{user1000}.following", 20) == redisClusterKeySlot("user1000", 8) &&
+              redisClusterKeySlot("{user1000}.followers", 20) == redisClusterKeySlot("user1000", 8) &&
+              redisClusterKeySlot("foo{}{bar}", 10) == redisClusterKeySlot("foo{}{bar}", 10) &&
+              redisClusterKeySlot("foo{}{bar}", 10) != redisClusterKeySlot("bar", 3) &&
+              redisClusterKeySlot("foo{{bar}}zap", 13) == redisClusterKeySlot("{bar", 4) &&
+              redisClusterKeySlot("foo{bar}{zap}", 13) == redisClusterKeySlot("bar", 3));
+
+    test("Cluster connect fails without reachable seeds: ");
+    cc = redisClusterConnect("127.0.0.1:1");
+    test_cond(cc != NULL && cc->err != 0);
+
+    test("Cluster commands fail without a slot map: ");
+    reply = redisClusterCommand(cc, "GET foo");
+    test_cond(reply == NULL && cc->err != 0);
+
+    test("Cluster multi-key commands fail without a slot map: ");
+    reply = redisClusterCommand(cc, "MGET foo bar baz");
+    test_cond(reply == NULL && cc->err != 0);
+
+    test("Cluster pipelines return an error per unroutable command: ");
+    reply = (void*)0x1;
+    test_cond(redisClusterAppendCommand(cc, "GET foo") == REDIS_OK &&
+              redisClusterAppendCommand(cc, "GET bar") == REDIS_OK &&
+              redisClusterGetReply(cc, (void**)&reply) == REDIS_ERR && reply == NULL &&
+              redisClusterGetReply(cc, (void**)&reply) == REDIS_ERR && reply == NULL &&
+              redisClusterGetReply(cc, (void**)&reply) == REDIS_ERR &&
+              strcmp(cc->errstr, "No pending pipelined replies") == 0);
+
+    test("Cluster pipelines reject subscribe commands: ");
+    test_cond(redisClusterAppendCommand(cc, "SUBSCRIBE foo") == REDIS_ERR);
+    redisClusterFree(cc);
+}
+
+#ifndef _WIN32
+/* A fake cluster node: a listening socket, and the server side of the last
+ * connection made to it. Replies are written ahead of the commands, so the
+ * blocking client finds them when it reads. Clients take the replies already
+ * read before sending more commands, so only the replies to the commands
+ * sent at once may be written together. */
+typedef struct clusterTestNode {
+    int lfd;
+    int port;
+    int fd;
+    sds pending; /* Replies written once connected */
+    redisAsyncContext *ac;
+    int reading;
+    int writing;
+} clusterTestNode;
+
+#define CLUSTER_TEST_NODES 3
+static clusterTestNode cluster_nodes[CLUSTER_TEST_NODES];
+
+static void cluster_test_start(void) {
+    struct sockaddr_in sa;
+    socklen_t salen;
+    int i;
+
+    for (i = 0; i < CLUSTER_TEST_NODES; i++) {
+        clusterTestNode *n = &cluster_nodes[i];
+
+        memset(n,0,sizeof(*n));
+        memset(&sa,0,sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        salen = sizeof(sa);
+        n->lfd = socket(AF_INET,SOCK_STREAM,0);
+        assert(n->lfd != -1);
+        assert(bind(n->lfd,(struct sockaddr *)&sa,sizeof(sa)) == 0 && listen(n->lfd,4) == 0);
+        assert(getsockname(n->lfd,(struct sockaddr *)&sa,&salen) == 0);
+        n->port = ntohs(sa.sin_port);
+        n->fd = -1;
+        n->pending = sdsempty();
+    }
+}
+
+static void cluster_test_stop(void) {
+    int i;
+
+    for (i = 0; i < CLUSTER_TEST_NODES; i++) {
+        if (cluster_nodes[i].fd != -1)
+            close(cluster_nodes[i].fd);
+        close(cluster_nodes[i].lfd);
+        sdsfree(cluster_nodes[i].pending);
+    }
+}
+
+/* Send replies to the next commands of a node. */
+static void cluster_test_reply(clusterTestNode *n, const char *fmt, ...) {
+    va_list ap;
+    sds s;
+
+    va_start(ap,fmt);
+    s = sdscatvprintf(sdsempty(),fmt,ap);
+    va_end(ap);
+    if (n->fd != -1)
+        assert(write(n->fd,s,sdslen(s)) == (ssize_t)sdslen(s));
+    else
+        n->pending = sdscatsds(n->pending,s);
+    sdsfree(s);
+}
+
+/* Check the commands a node received since the last call, given as a NULL
+ * terminated list. */
+static int cluster_test_received(clusterTestNode *n, ...) {
+    struct pollfd pfd = {n->fd, POLLIN, 0};
+    sds want = sdsempty();
+    const char *fmt;
+    char buf[1024], *cmd;
+    size_t len = 0;
+    ssize_t nread;
+    va_list ap;
+    int ok;
+
+    va_start(ap,n);
+    while ((fmt = va_arg(ap,const char *)) != NULL) {
+        int cmdlen = redisFormatCommand(&cmd,fmt);
+        want = sdscatlen(want,cmd,cmdlen);
+        redisFreeCommand(cmd);
+    }
+    va_end(ap);
+
+    /* Loopback delivery may be deferred, wait for what is expected. */
+    while (n->fd != -1 && len < sizeof(buf) &&
+           poll(&pfd,1,len < sdslen(want) ? 100 : 0) == 1 &&
+           (nread = read(n->fd,buf + len,sizeof(buf) - len)) > 0)
+        len += nread;
+    ok = len == sdslen(want) && memcmp(buf,want,len) == 0;
+    sdsfree(want);
+    return ok;
+}
+
+/* Accept the connection just made to a node, and send it its replies. */
+static clusterTestNode *cluster_test_accept(int port) {
+    clusterTestNode *n = NULL;
+    int i;
+
+    for (i = 0; i < CLUSTER_TEST_NODES; i++) {
+        if (cluster_nodes[i].port == port)
+            n = &cluster_nodes[i];
+    }
+    if (n == NULL)
+        return NULL;
+
+    if (n->fd != -1)
+        close(n->fd);
+    if ((n->fd = accept(n->lfd,NULL,NULL)) == -1)
+        return NULL;
+    if (sdslen(n->pending) > 0)
+        assert(write(n->fd,n->pending,sdslen(n->pending)) == (ssize_t)sdslen(n->pending));
+    sdsclear(n->pending);
+    return n;
+}
+
+static int cluster_test_connect_cb(redisContext *c, void *privdata) {
+    (void)privdata;
+    return cluster_test_accept(c->tcp.port) ? REDIS_OK : REDIS_ERR;
+}
+
+/* Event loop of the asynchronous connections, driven by
+ * cluster_test_tick(). */
+static void cluster_test_add_read(void *data) { ((clusterTestNode *)data)->reading = 1; }
+static void cluster_test_del_read(void *data) { ((clusterTestNode *)data)->reading = 0; }
+static void cluster_test_add_write(void *data) { ((clusterTestNode *)data)->writing = 1; }
+static void cluster_test_del_write(void *data) { ((clusterTestNode *)data)->writing = 0; }
+
+static void cluster_test_cleanup(void *data) {
+    clusterTestNode *n = data;
+
+    n->ac = NULL;
+    n->reading = n->writing = 0;
+}
+
+static int cluster_test_attach_cb(redisAsyncContext *ac, void *privdata) {
+    clusterTestNode *n = cluster_test_accept(ac->c.tcp.port);
+    (void)privdata;
+
+    if (n == NULL)
+        return REDIS_ERR;
+    n->ac = ac;
+    ac->ev.addRead = cluster_test_add_read;
+    ac->ev.delRead = cluster_test_del_read;
+    ac->ev.addWrite = cluster_test_add_write;
+    ac->ev.delWrite = cluster_test_del_write;
+    ac->ev.cleanup = cluster_test_cleanup;
+    ac->ev.data = n;
+    return REDIS_OK;
+}
+
+static void cluster_test_tick(void) {
+    int i;
+
+    for (i = 0; i < CLUSTER_TEST_NODES; i++) {
+        clusterTestNode *n = &cluster_nodes[i];
+        struct pollfd pfd;
+
+        if (n->ac && n->writing)
+            redisAsyncHandleWrite(n->ac);
+        if (n->ac && n->reading) {
+            pfd.fd = n->ac->c.fd;
+            pfd.events = POLLIN;
+            if (poll(&pfd,1,1) == 1)
+                redisAsyncHandleRead(n->ac);
+        }
+    }
+}
+
+/* Reply to CLUSTER SHARDS with the first node serving the slots up to
+ * split, the second one the others. The first shard lists a failed primary
+ * and a replica before its primary; the second one's endpoint is the node
+ * that replied. */
+static void cluster_test_shards(clusterTestNode *n, int split) {
+    cluster_test_reply(n,
+        "*2\r\n"
+        "*4\r\n$5\r\nslots\r\n*2\r\n:0\r\n:%d\r\n$5\r\nnodes\r\n*3\r\n"
+        "*8\r\n$8\r\nendpoint\r\n$9\r\n127.0.0.1\r\n$4\r\nport\r\n:%d\r\n"
+        "$4\r\nrole\r\n$6\r\nmaster\r\n$6\r\nhealth\r\n$4\r\nfail\r\n"
+        "*8\r\n$8\r\nendpoint\r\n$9\r\n127.0.0.1\r\n$4\r\nport\r\n:%d\r\n"
+        "$4\r\nrole\r\n$7\r\nreplica\r\n$6\r\nhealth\r\n$6\r\nonline\r\n"
+        "*8\r\n$8\r\nendpoint\r\n$9\r\n127.0.0.1\r\n$4\r\nport\r\n:%d\r\n"
+        "$4\r\nrole\r\n$6\r\nmaster\r\n$6\r\nhealth\r\n$6\r\nonline\r\n"
+        "*4\r\n$5\r\nslots\r\n*2\r\n:%d\r\n:16383\r\n$5\r\nnodes\r\n*1\r\n"
+        "*6\r\n$8\r\nendpoint\r\n$1\r\n?\r\n$4\r\nport\r\n:%d\r\n"
+        "$4\r\nrole\r\n$6\r\nmaster\r\n",
+        split,cluster_nodes[1].port,cluster_nodes[1].port,cluster_nodes[0].port,
+        split + 1,cluster_nodes[1].port);
+}
+
+/* Port of the node a slot is routed to. */
+static int cluster_test_slot_port(redisClusterContext *cc, unsigned int slot) {
+    redisContext *c = redisClusterGetContext(cc,slot);
+    return c ? c->tcp.port : -1;
+}
+
+/* Forget the connections of a freed cluster client. */
+static void cluster_test_reset(void) {
+    int i;
+
+    for (i = 0; i < CLUSTER_TEST_NODES; i++) {
+        if (cluster_nodes[i].fd != -1)
+            close(cluster_nodes[i].fd);
+        cluster_nodes[i].fd = -1;
+    }
+}
+
+static const redisClusterOptions *cluster_test_options(void) {
+    static struct timeval tv = {1, 0};
+    static redisClusterOptions options;
+    static const char *seeds[1];
+    static char seed[32];
+
+    snprintf(seed,sizeof(seed),"127.0.0.1:%d",cluster_nodes[0].port);
+    seeds[0] = seed;
+    memset(&options,0,sizeof(options));
+    options.seeds = seeds;
+    options.nseeds = 1;
+    options.connect_timeout = &tv;
+    options.command_timeout = &tv;
+    options.connect_cb = cluster_test_connect_cb;
+    options.attach_cb = cluster_test_attach_cb;
+    return &options;
+}
+
+typedef struct clusterTestState {
+    int calls;
+    int nulls;
+    char last[64];
+} clusterTestState;
+
+static void cluster_test_cb(redisClusterAsyncContext *acc, void *r, void *privdata) {
+    clusterTestState *state = privdata;
+    redisReply *reply = r;
+    size_t i;
+    (void)acc;
+
+    state->calls++;
+    state->last[0] = '\0';
+    if (reply == NULL) {
+        state->nulls++;
+    } else if (reply->type == REDIS_REPLY_ARRAY) {
+        for (i = 0; i < reply->elements; i++)
+            strncat(state->last,reply->element[i]->str,sizeof(state->last) - strlen(state->last) - 1);
+    } else if (reply->type == REDIS_REPLY_INTEGER) {
+        snprintf(state->last,sizeof(state->last),"%lld",reply->integer);
+    } else {
+        snprintf(state->last,sizeof(state->last),"%s",reply->str);
+    }
+}
+
+static void cluster_test_wait(clusterTestState *state, int calls) {
+    int i;
+
+    for (i = 0; i < 1000 && state->calls < calls; i++)
+        cluster_test_tick();
+}
+
+/* Nodes A and B serve the slots up to 8191 and the others. Keys: "bar" 5061
+ * and "baz" 4813 are on A, "foo" 12182 on B. */
+static void test_cluster_routing_offline(void) {
+    clusterTestNode *a = &cluster_nodes[0], *b = &cluster_nodes[1];
+    redisClusterAsyncContext *acc;
+    clusterTestState state = {0};
+    redisClusterContext *cc;
+    redisReply *reply;
+    int ok;
+
+    cluster_test_start();
+
+    test("Cluster slot map is loaded from CLUSTER SHARDS: ");
+    cluster_test_shards(a,8191);
+    cc = redisClusterConnectWithOptions(cluster_test_options());
+    test_cond(cc != NULL && cc->err == 0 && cluster_test_received(a,"CLUSTER SHARDS",NULL) &&
+              cluster_test_slot_port(cc,0) == a->port &&
+              cluster_test_slot_port(cc,8191) == a->port &&
+              cluster_test_slot_port(cc,8192) == b->port &&
+              cluster_test_slot_port(cc,16383) == b->port && cc->map.count == 2);
+
+    test("Cluster commands are routed by key, SPUBLISH by channel, BITOP by destination: ");
+    cluster_test_reply(b,"$1\r\nb\r\n");
+    reply = redisClusterCommand(cc,"GET foo");
+    ok = reply && strcmp(reply->str,"b") == 0;
+    freeReplyObject(reply);
+    cluster_test_reply(a,"$1\r\na\r\n");
+    reply = redisClusterCommand(cc,"GET bar");
+    ok = ok && reply && strcmp(reply->str,"a") == 0;
+    freeReplyObject(reply);
+    cluster_test_reply(b,":0\r\n");
+    reply = redisClusterCommand(cc,"SPUBLISH foo hi");
+    ok = ok && reply && reply->integer == 0;
+    freeReplyObject(reply);
+    cluster_test_reply(b,":3\r\n");
+    reply = redisClusterCommand(cc,"BITOP AND foo bar");
+    ok = ok && reply && reply->integer == 3;
+    freeReplyObject(reply);
+    test_cond(ok && cluster_test_received(a,"GET bar",NULL) &&
+              cluster_test_received(b,"GET foo","SPUBLISH foo hi","BITOP AND foo bar",NULL));
+
+    test("Cluster follows MOVED and reloads the slot map: ");
+    cluster_test_reply(a,"-MOVED 5061 127.0.0.1:%d\r\n",b->port);
+    cluster_test_reply(b,"$1\r\nb\r\n");
+    reply = redisClusterCommand(cc,"GET bar");
+    ok = reply && strcmp(reply->str,"b") == 0 && cc->needRefresh &&
+         cluster_test_received(a,"GET bar",NULL) && cluster_test_received(b,"GET bar",NULL);
+    freeReplyObject(reply);
+    cluster_test_shards(a,5000);
+    cluster_test_reply(b,"$1\r\nb\r\n");
+    reply = redisClusterCommand(cc,"GET bar");
+    test_cond(ok && reply && strcmp(reply->str,"b") == 0 && !cc->needRefresh &&
+              cluster_test_received(a,"CLUSTER SHARDS",NULL) &&
+              cluster_test_received(b,"GET bar",NULL));
+    freeReplyObject(reply);
+
+    test("Cluster follows ASK once, with ASKING: ");
+    cluster_test_reply(a,"-ASK 4813 127.0.0.1:%d\r\n",b->port);
+    cluster_test_reply(b,"+OK\r\n$1\r\nb\r\n");
+    reply = redisClusterCommand(cc,"GET baz");
+    ok = reply && strcmp(reply->str,"b") == 0 && !cc->needRefresh;
+    freeReplyObject(reply);
+    cluster_test_reply(a,"$1\r\na\r\n");
+    reply = redisClusterCommand(cc,"GET baz");
+    test_cond(ok && reply && strcmp(reply->str,"a") == 0 &&
+              cluster_test_received(a,"GET baz","GET baz",NULL) &&
+              cluster_test_received(b,"ASKING","GET baz",NULL));
+    freeReplyObject(reply);
+
+    test("Cluster gives up after too many redirections: ");
+    cluster_test_reply(a,"-MOVED 4813 127.0.0.1:%d\r\n",b->port);
+    cluster_test_reply(b,"-ASK 4813 127.0.0.1:%d\r\n",a->port);
+    cc->options.max_redirects = 1;
+    reply = redisClusterCommand(cc,"GET baz");
+    test_cond(reply == NULL && strcmp(cc->errstr,"Too many cluster redirections") == 0 &&
+              cluster_test_received(a,"GET baz",NULL) && cluster_test_received(b,"GET baz",NULL));
+    redisClusterFree(cc);
+    cluster_test_reset();
+
+    test("Cluster slot map falls back to CLUSTER SLOTS: ");
+    cluster_test_reply(a,"-ERR unknown subcommand\r\n"
+                         "*2\r\n*3\r\n:0\r\n:99\r\n*2\r\n$9\r\n127.0.0.1\r\n:%d\r\n"
+                         "*3\r\n:100\r\n:16383\r\n*2\r\n$0\r\n\r\n:%d\r\n",
+                       a->port,b->port);
+    cc = redisClusterConnectWithOptions(cluster_test_options());
+    test_cond(cc != NULL && cc->err == 0 &&
+              cluster_test_slot_port(cc,99) == a->port &&
+              cluster_test_slot_port(cc,100) == b->port && cc->map.count == 2);
+    redisClusterFree(cc);
+    cluster_test_reset();
+
+    test("Cluster rejects an invalid slot map: ");
+    cluster_test_reply(a,"*1\r\n*3\r\n:0\r\n:16384\r\n*2\r\n$9\r\n127.0.0.1\r\n:%d\r\n",a->port);
+    cc = redisClusterConnectWithOptions(cluster_test_options());
+    test_cond(cc != NULL && cc->err == REDIS_ERR_PROTOCOL &&
+              strcmp(cc->errstr,"Invalid cluster slot map") == 0);
+    redisClusterFree(cc);
+    cluster_test_reset();
+
+    test("Async cluster follows MOVED and reloads the slot map: ");
+    cluster_test_shards(a,8191);
+    acc = redisClusterAsyncConnectWithOptions(cluster_test_options());
+    assert(acc != NULL && acc->err == 0 && cluster_test_received(a,"CLUSTER SHARDS",NULL));
+    cluster_test_reset();
+    cluster_test_reply(a,"-MOVED 5061 127.0.0.1:%d\r\n",b->port);
+    cluster_test_shards(b,5000);
+    cluster_test_reply(b,"$1\r\nb\r\n");
+    assert(redisClusterAsyncCommand(acc,cluster_test_cb,&state,"GET bar") == REDIS_OK);
+    cluster_test_wait(&state,1);
+    ok = state.calls == 1 && strcmp(state.last,"b") == 0 && !acc->refreshing &&
+         cluster_test_received(a,"GET bar",NULL) &&
+         cluster_test_received(b,"CLUSTER SHARDS","GET bar",NULL);
+    cluster_test_reply(b,"$1\r\nc\r\n");
+    assert(redisClusterAsyncCommand(acc,cluster_test_cb,&state,"GET bar") == REDIS_OK);
+    cluster_test_wait(&state,2);
+    test_cond(ok && state.calls == 2 && strcmp(state.last,"c") == 0 &&
+              cluster_test_received(b,"GET bar",NULL));
+
+    test("Async cluster follows ASK once, with ASKING: ");
+    cluster_test_reply(a,"-ASK 4813 127.0.0.1:%d\r\n",b->port);
+    cluster_test_reply(b,"+OK\r\n$1\r\nb\r\n");
+    assert(redisClusterAsyncCommand(acc,cluster_test_cb,&state,"GET baz") == REDIS_OK);
+    cluster_test_wait(&state,3);
+    ok = state.calls == 3 && strcmp(state.last,"b") == 0 && !acc->refreshing;
+    cluster_test_reply(a,"$1\r\na\r\n");
+    assert(redisClusterAsyncCommand(acc,cluster_test_cb,&state,"GET baz") == REDIS_OK);
+    cluster_test_wait(&state,4);
+    test_cond(ok && state.calls == 4 && strcmp(state.last,"a") == 0 &&
+              cluster_test_received(a,"GET baz","GET baz",NULL) &&
+              cluster_test_received(b,"ASKING","GET baz",NULL));
+
+    test("Async cluster callbacks get NULL when the cluster client is freed: ");
+    assert(redisClusterAsyncCommand(acc,cluster_test_cb,&state,"GET foo") == REDIS_OK);
+    cluster_test_tick();
+    redisClusterAsyncFree(acc);
+    test_cond(state.calls == 5 && state.nulls == 1 && a->ac == NULL && b->ac == NULL);
+    cluster_test_reset();
+
+    cluster_test_stop();
+}
+#endif
+
+/* Node C is only known from redirections. */
+static void test_cluster_pipeline_offline(void) {
+    clusterTestNode *a = &cluster_nodes[0], *b = &cluster_nodes[1], *c = &cluster_nodes[2];
+    redisClusterContext *cc;
+    redisReply *replies[4];
+    int i, ok = 1;
+
+    cluster_test_start();
+    cluster_test_shards(a,8191);
+    cc = redisClusterConnectWithOptions(cluster_test_options());
+    assert(cc != NULL && cc->err == 0 && cluster_test_received(a,"CLUSTER SHARDS",NULL));
+
+    test("Cluster pipeline replies are merged in command order: ");
+    cluster_test_reply(a,"$1\r\n1\r\n$1\r\n3\r\n-MOVED 7365 127.0.0.1:%d\r\n",c->port);
+    cluster_test_reply(b,"$1\r\n2\r\n");
+    cluster_test_reply(c,"$1\r\n4\r\n");
+    assert(redisClusterAppendCommand(cc,"GET bar") == REDIS_OK);
+    assert(redisClusterAppendCommand(cc,"GET foo") == REDIS_OK);
+    assert(redisClusterAppendCommand(cc,"GET baz") == REDIS_OK);
+    assert(redisClusterAppendCommand(cc,"GET c") == REDIS_OK);
+    for (i = 0; i < 4; i++) {
+        char expected[2] = {(char)('1' + i), '\0'};
+
+        ok = ok && redisClusterGetReply(cc,(void **)&replies[i]) == REDIS_OK &&
+             replies[i] != NULL && strcmp(replies[i]->str,expected) == 0;
+        freeReplyObject(replies[i]);
+    }
+    test_cond(ok && cluster_test_received(a,"GET bar","GET baz","GET c",NULL) &&
+              cluster_test_received(b,"GET foo",NULL) && cluster_test_received(c,"GET c",NULL));
+
+    test("Cluster pipeline commands of a lost node fail, the others don't: ");
+    cluster_test_shards(a,8191);
+    cluster_test_reply(a,"$1\r\n1\r\n$1\r\n3\r\n");
+    close(b->fd);
+    b->fd = -1;
+    assert(redisClusterAppendCommand(cc,"GET bar") == REDIS_OK);
+    assert(redisClusterAppendCommand(cc,"GET foo") == REDIS_OK);
+    assert(redisClusterAppendCommand(cc,"GET baz") == REDIS_OK);
+    ok = redisClusterGetReply(cc,(void **)&replies[0]) == REDIS_OK &&
+         redisClusterGetReply(cc,(void **)&replies[1]) == REDIS_ERR && replies[1] == NULL &&
+         cc->err != 0 &&
+         redisClusterGetReply(cc,(void **)&replies[2]) == REDIS_OK;
+    test_cond(ok && strcmp(replies[0]->str,"1") == 0 && strcmp(replies[2]->str,"3") == 0 &&
+              cc->needRefresh && cluster_test_received(a,"CLUSTER SHARDS","GET bar","GET baz",NULL));
+    freeReplyObject(replies[0]);
+    freeReplyObject(replies[2]);
+
+    redisClusterFree(cc);
+    cluster_test_stop();
+}
+
+/* "{bar}x" is in the slot of "bar", apart from "baz" on the same node. */
+static void test_cluster_fanout_offline(void) {
+    clusterTestNode *a = &cluster_nodes[0], *b = &cluster_nodes[1];
+    redisClusterAsyncContext *acc;
+    clusterTestState state = {0};
+    redisClusterContext *cc;
+    redisReply *reply;
+
+    cluster_test_start();
+    cluster_test_shards(a,8191);
+    cc = redisClusterConnectWithOptions(cluster_test_options());
+    assert(cc != NULL && cc->err == 0 && cluster_test_received(a,"CLUSTER SHARDS",NULL));
+
+    test("Cluster MGET across slots gets the values in key order: ");
+    cluster_test_reply(a,"*2\r\n$1\r\n1\r\n$1\r\n3\r\n*1\r\n$1\r\n4\r\n");
+    cluster_test_reply(b,"*1\r\n$1\r\n2\r\n");
+    reply = redisClusterCommand(cc,"MGET bar foo {bar}x baz");
+    test_cond(reply && reply->type == REDIS_REPLY_ARRAY && reply->elements == 4 &&
+              strcmp(reply->element[0]->str,"1") == 0 && strcmp(reply->element[1]->str,"2") == 0 &&
+              strcmp(reply->element[2]->str,"3") == 0 && strcmp(reply->element[3]->str,"4") == 0 &&
+              cluster_test_received(a,"MGET bar {bar}x","MGET baz",NULL) &&
+              cluster_test_received(b,"MGET foo",NULL));
+    freeReplyObject(reply);
+
+    test("Cluster DEL across slots sums the counts: ");
+    cluster_test_reply(a,":1\r\n:0\r\n");
+    cluster_test_reply(b,":1\r\n");
+    reply = redisClusterCommand(cc,"DEL bar foo baz");
+    test_cond(reply && reply->type == REDIS_REPLY_INTEGER && reply->integer == 2 &&
+              cluster_test_received(a,"DEL bar","DEL baz",NULL) &&
+              cluster_test_received(b,"DEL foo",NULL));
+    freeReplyObject(reply);
+
+    test("Cluster MSET across slots keeps the pairs together: ");
+    cluster_test_reply(a,"+OK\r\n");
+    cluster_test_reply(b,"+OK\r\n");
+    reply = redisClusterCommand(cc,"MSET bar 1 foo 2");
+    test_cond(reply && reply->type == REDIS_REPLY_STATUS && strcmp(reply->str,"OK") == 0 &&
+              cluster_test_received(a,"MSET bar 1",NULL) &&
+              cluster_test_received(b,"MSET foo 2",NULL));
+    freeReplyObject(reply);
+
+    test("Cluster multi-key commands reply with the first error: ");
+    cluster_test_reply(a,":1\r\n");
+    cluster_test_reply(b,"-ERR failed\r\n");
+    reply = redisClusterCommand(cc,"EXISTS bar foo");
+    test_cond(reply && reply->type == REDIS_REPLY_ERROR && strcmp(reply->str,"ERR failed") == 0);
+    freeReplyObject(reply);
+
+    test("Cluster multi-key commands fail on unexpected replies: ");
+    cluster_test_reply(a,"*1\r\n$1\r\n1\r\n");
+    cluster_test_reply(b,":1\r\n");
+    reply = redisClusterCommand(cc,"MGET bar foo");
+    test_cond(reply == NULL && cc->err == REDIS_ERR_PROTOCOL &&
+              strcmp(cc->errstr,"Unexpected reply to a multi-key command") == 0);
+    redisClusterFree(cc);
+    cluster_test_reset();
+
+    test("Async cluster MGET across slots gets the values in key order: ");
+    cluster_test_shards(a,8191);
+    acc = redisClusterAsyncConnectWithOptions(cluster_test_options());
+    assert(acc != NULL && acc->err == 0 && cluster_test_received(a,"CLUSTER SHARDS",NULL));
+    cluster_test_reset();
+    cluster_test_reply(a,"*2\r\n$1\r\n1\r\n$1\r\n3\r\n*1\r\n$1\r\n4\r\n");
+    cluster_test_reply(b,"*1\r\n$1\r\n2\r\n");
+    assert(redisClusterAsyncCommand(acc,cluster_test_cb,&state,"MGET bar foo {bar}x baz") == REDIS_OK);
+    cluster_test_wait(&state,1);
+    test_cond(state.calls == 1 && strcmp(state.last,"1234") == 0 &&
+              cluster_test_received(a,"MGET bar {bar}x","MGET baz",NULL) &&
+              cluster_test_received(b,"MGET foo",NULL));
+
+    test("Async cluster multi-key commands get NULL when a part is lost: ");
+    cluster_test_reply(a,":1\r\n");
+    close(b->fd);
+    b->fd = -1;
+    assert(redisClusterAsyncCommand(acc,cluster_test_cb,&state,"DEL bar foo") == REDIS_OK);
+    cluster_test_wait(&state,2);
+    test_cond(state.calls == 2 && state.nulls == 1 && b->ac == NULL &&
+              cluster_test_received(a,"DEL bar",NULL));
+    redisClusterAsyncFree(acc);
+
+    cluster_test_stop();
+}
+
+/* Parse a reply from its protocol representation. */
+static redisReply *parse_reply(const char *buf) {
+    redisReader *reader = redisReaderCreate();
+    void *reply = NULL;
+
+    redisReaderFeed(reader,buf,strlen(buf));
+    assert(redisReaderGetReply(reader,&reply) == REDIS_OK && reply != NULL);
+    redisReaderFree(reader);
+    return reply;
+}
+
+/* Cache the reply to a command, formatted from fmt. */
+static int cache_set(redisCache *cache, const char *reply, const char *fmt, ...) {
+    redisReply *r = parse_reply(reply);
+    va_list ap;
+    char *cmd;
+    int len, ret;
+
+    va_start(ap,fmt);
+    len = redisvFormatCommand(&cmd,fmt,ap);
+    va_end(ap);
+    ret = redisCacheSet(cache,cmd,len,r);
+    redisFreeCommand(cmd);
+    freeReplyObject(r);
+    return ret;
+}
+
+/* Returns the string cached for a command, or NULL. */
+static char *cache_get(redisCache *cache, const char *fmt, ...) {
+    static char buf[64];
+    redisReply *r;
+    va_list ap;
+    char *cmd;
+    int len;
+
+    va_start(ap,fmt);
+    len = redisvFormatCommand(&cmd,fmt,ap);
+    va_end(ap);
+    r = redisCacheGet(cache,cmd,len);
+    redisFreeCommand(cmd);
+    if (r == NULL)
+        return NULL;
+    snprintf(buf,sizeof(buf),"%s",r->type == REDIS_REPLY_STRING ? r->str : "?");
+    freeReplyObject(r);
+    return buf;
+}
+
+static void test_cache_offline(void) {
+    redisCacheOptions options = {.max_entries = 2, .policy = REDIS_CACHE_LRU};
+    redisCacheStats stats;
+    redisCache *cache;
+    redisReply *push;
+    char *s;
+
+    test("Cache only stores GET, HGET and HGETALL: ");
+    cache = redisCacheCreate(&options);
+    assert(cache != NULL);
+    test_cond(cache_set(cache,"$1\r\nv\r\n","GET a") == REDIS_OK &&
+              cache_set(cache,"$1\r\nv\r\n","HGET h f") == REDIS_OK &&
+              cache_set(cache,"+OK\r\n","SET a v") == REDIS_ERR &&
+              cache_set(cache,"*0\r\n","MGET a b") == REDIS_ERR &&
+              cache_set(cache,"$1\r\nv\r\n","GET a b") == REDIS_ERR);
+
+    /* Stored replies must answer the command, e.g. not a QUEUED status. */
+    test("Cache only stores replies of the type read by the command: ");
+    test_cond(cache_set(cache,"+QUEUED\r\n","GET a") == REDIS_ERR &&
+              cache_set(cache,"-WRONGTYPE\r\n","HGET h f") == REDIS_ERR &&
+              cache_set(cache,"$1\r\nv\r\n","HGETALL h") == REDIS_ERR &&
+              cache_set(cache,"+QUEUED\r\n","HGETALL h") == REDIS_ERR &&
+              !strcmp(cache_get(cache,"GET a"),"v"));
+
+    test("Cache evicts the least recently used entry: ");
+    s = cache_get(cache,"GET a");
+    assert(s && !strcmp(s,"v"));
+    assert(cache_set(cache,"$1\r\nw\r\n","GET b") == REDIS_OK);
+    redisCacheGetStats(cache,&stats);
+    test_cond(cache_get(cache,"HGET h f") == NULL && cache_get(cache,"GET a") != NULL &&
+              cache_get(cache,"GET b") != NULL && stats.entries == 2 && stats.evictions == 1);
+    redisCacheFree(cache);
+
+    test("Cache evicts the least frequently used entry: ");
+    options.policy = REDIS_CACHE_LFU;
+    cache = redisCacheCreate(&options);
+    assert(cache_set(cache,"$1\r\n1\r\n","GET a") == REDIS_OK);
+    assert(cache_set(cache,"$1\r\n2\r\n","GET b") == REDIS_OK);
+    cache_get(cache,"GET a");
+    cache_get(cache,"GET a");
+    cache_get(cache,"GET b");
+    assert(cache_set(cache,"$1\r\n3\r\n","GET c") == REDIS_OK);
+    assert(cache_get(cache,"GET c") != NULL);
+    assert(cache_set(cache,"$1\r\n4\r\n","GET d") == REDIS_OK);
+    s = cache_get(cache,"GET a");
+    test_cond(s && !strcmp(s,"1") && cache_get(cache,"GET b") == NULL &&
+              cache_get(cache,"GET c") == NULL && cache_get(cache,"GET d") != NULL);
+    redisCacheFree(cache);
+
+    test("Cache invalidates every entry of a key: ");
+    options.max_entries = 0;
+    cache = redisCacheCreate(&options);
+    assert(cache_set(cache,"$1\r\n1\r\n","HGET h f1") == REDIS_OK);
+    assert(cache_set(cache,"$1\r\n2\r\n","HGET h f2") == REDIS_OK);
+    assert(cache_set(cache,"*2\r\n$2\r\nf1\r\n$1\r\n1\r\n","HGETALL h") == REDIS_OK);
+    assert(cache_set(cache,"$1\r\nv\r\n","GET k") == REDIS_OK);
+    push = parse_reply(">2\r\n$10\r\ninvalidate\r\n*1\r\n$1\r\nh\r\n");
+    assert(redisCacheHandlePush(cache,push) == 1);
+    freeReplyObject(push);
+    redisCacheGetStats(cache,&stats);
+    test_cond(stats.entries == 1 && stats.invalidations == 3 &&
+              cache_get(cache,"HGET h f1") == NULL && cache_get(cache,"GET k") != NULL);
+
+    test("Cache is flushed by a NULL invalidation: ");
+    push = parse_reply(">2\r\n$7\r\nmessage\r\n_\r\n");
+    assert(redisCacheHandlePush(cache,push) == 0);
+    freeReplyObject(push);
+    push = parse_reply(">2\r\n$10\r\ninvalidate\r\n_\r\n");
+    assert(redisCacheHandlePush(cache,push) == 1);
+    freeReplyObject(push);
+    redisCacheGetStats(cache,&stats);
+    test_cond(stats.entries == 0 && stats.memory == 0 && cache_get(cache,"GET k") == NULL);
+    redisCacheFree(cache);
+
+    test("Cache stays within its memory limit: ");
+    options.max_memory = 1024;
+    cache = redisCacheCreate(&options);
+    assert(cache_set(cache,"$3\r\nfoo\r\n","GET %d",1) == REDIS_OK);
+    for (int i = 2; i < 100; i++)
+        cache_set(cache,"$3\r\nfoo\r\n","GET %d",i);
+    redisCacheGetStats(cache,&stats);
+    test_cond(stats.memory <= 1024 && stats.entries > 1 && stats.evictions > 0 &&
+              cache_get(cache,"GET %d",99) != NULL && cache_get(cache,"GET %d",1) == NULL);
+    redisCacheFree(cache);
+}
+
+static size_t dict_key_length(const void *key) {
+    return sdslen((const sds)key);
+}
+
+static void dict_key_free(void *privdata, void *key) {
+    (void)privdata;
+    sdsfree(key);
+}
+
+static dictType testDict = {dict_key_length, NULL, NULL, dict_key_free, NULL};
+
+/* Add the keys "key:<i>" with the value i+1, for i from first to last. */
+static void dict_add_keys(dict *d, int first, int last) {
+    int i;
+
+    for (i = first; i <= last; i++)
+        assert(dictReplace(d,sdscatprintf(sdsempty(),"key:%d",i),(void *)(intptr_t)(i+1)) == 1);
+}
+
+static int dict_has_key(dict *d, int i) {
+    char buf[32];
+    int len = snprintf(buf,sizeof(buf),"key:%d",i);
+    dictEntry *de = dictFindBuf(d,buf,len);
+
+    return de != NULL && dictGetEntryVal(de) == (void *)(intptr_t)(i+1);
+}
+
+static void test_dict(void) {
+    int i, n, found, grew = 0, deleted = 0, visits[4096] = {0};
+    dictIterator it;
+    dictEntry *de;
+    char buf[32];
+    sds key;
+    dict *d;
+
+    test("Dicts grow incrementally and keep every entry: ");
+    d = dictCreate(&testDict,NULL);
+    assert(d != NULL);
+    for (i = 0; i < 3000; i++) {
+        dict_add_keys(d,i,i);
+        grew |= dictIsRehashing(d);
+    }
+    for (i = 0, found = 0; i < 3000; i++)
+        found += dict_has_key(d,i);
+    test_cond(grew && dictSize(d) == 3000 && found == 3000 && !dict_has_key(d,3000));
+
+    test("Dicts replace the value of existing keys: ");
+    key = sdsnew("key:7");
+    test_cond(dictReplace(d,key,(void *)1) == 0 && dictSize(d) == 3000 &&
+              dictGetEntryVal(dictFindBuf(d,"key:7",5)) == (void *)1);
+    sdsfree(key);
+    dictRelease(d);
+
+    test("Deleted keys leave slots that lookups probe past: ");
+    d = dictCreate(&testDict,NULL);
+    dict_add_keys(d,0,999);
+    while (dictIsRehashing(d))
+        dictFindBuf(d,"",0);
+    for (i = 0; i < 1000; i += 2) {
+        n = snprintf(buf,sizeof(buf),"key:%d",i);
+        assert(dictDeleteBuf(d,buf,n) == DICT_OK);
+    }
+    for (i = 0, found = 0; i < 1000; i++)
+        found += dict_has_key(d,i);
+    key = sdsnew("key:0");
+    test_cond(found == 500 && dictSize(d) == 500 && dict_has_key(d,999) &&
+              d->ht[0].filled > d->ht[0].used && dictDelete(d,key) == DICT_ERR &&
+              dictDeleteBuf(d,"key:1000",8) == DICT_ERR);
+    sdsfree(key);
+
+    test("Deleted slots are reused by new keys: ");
+    n = d->ht[0].size;
+    dict_add_keys(d,0,0);
+    for (i = 2; i < 1000; i += 2)
+        dict_add_keys(d,i,i);
+    for (i = 0, found = 0; i < 1000; i++)
+        found += dict_has_key(d,i);
+    test_cond(found == 1000 && dictSize(d) == 1000 && (long)d->ht[0].size == n);
+    dictRelease(d);
+
+    test("Entries can be looked up and deleted while iterating a growing dict: ");
+    d = dictCreate(&testDict,NULL);
+    for (n = 0; n < 3073 || !dictIsRehashing(d); n++)
+        dict_add_keys(d,n,n);
+    assert(n < (int)(sizeof(visits)/sizeof(*visits)));
+    dictInitIterator(&it,d);
+    while ((de = dictNext(&it)) != NULL) {
+        i = atoi((char *)dictGetEntryKey(de) + 4);
+        assert(dict_has_key(d,i));
+        if (visits[i]++ == 0 && i % 2 == 0) {
+            dictDelete(d,dictGetEntryKey(de));
+            deleted++;
+        }
+    }
+    grew = dictIsRehashing(d);
+    dictReleaseIterator(&it);
+    for (i = 0, found = 0; i < n; i++)
+        found += visits[i] == 1;
+    test_cond(grew && found == n && (int)dictSize(d) == n - deleted);
+
+    test("Growing resumes once iterators are released: ");
+    for (i = 1, found = 0; i < n; i += 2)
+        found += dict_has_key(d,i);
+    test_cond(!dictIsRehashing(d) && found == n - deleted);
+    dictRelease(d);
+}
+
+static void test_histogram(void) {
+    redisHistogram *h;
+    unsigned long long p50;
+    int i;
+
+    h = redisHistogramCreate();
+    assert(h != NULL);
+
+    test("Empty histograms have no percentiles: ");
+    test_cond(redisHistogramCount(h) == 0 && redisHistogramPercentile(h,50) == 0 &&
+              redisHistogramMean(h) == 0);
+
+    for (i = 1; i <= 1000; i++)
+        assert(redisHistogramRecord(h,i*1000) == REDIS_OK);
+
+    test("Histograms track the count, mean, min and max: ");
+    test_cond(redisHistogramCount(h) == 1000 && redisHistogramMean(h) == 500500 &&
+              redisHistogramMin(h) == 1000 && redisHistogramMax(h) == 1000000);
+
+    test("Histogram percentiles are within 3%% above the value: ");
+    p50 = redisHistogramPercentile(h,50);
+    test_cond(p50 >= 500000 && p50 <= 515000 &&
+              redisHistogramPercentile(h,0) == 1000 &&
+              redisHistogramPercentile(h,99.9) == 1000000 &&
+              redisHistogramPercentile(h,100) == 1000000);
+
+    test("Small values are counted exactly: ");
+    redisHistogramReset(h);
+    for (i = 0; i < 64; i++)
+        assert(redisHistogramRecord(h,i) == REDIS_OK);
+    test_cond(redisHistogramCount(h) == 64 && redisHistogramPercentile(h,50) == 31 &&
+              redisHistogramPercentile(h,100) == 63);
+
+    redisHistogramFree(h);
+}
+
+/* Allocations made through a hiredisAllocator, and not yet freed. */
+static void *count_malloc(void *privdata, size_t size) {
+    ++*(long *)privdata;
+    return malloc(size);
+}
+
+static void *count_calloc(void *privdata, size_t nmemb, size_t size) {
+    ++*(long *)privdata;
+    return calloc(nmemb, size);
+}
+
+static void *count_realloc(void *privdata, void *ptr, size_t size) {
+    if (ptr == NULL)
+        ++*(long *)privdata;
+    return realloc(ptr, size);
+}
+
+static void count_free(void *privdata, void *ptr) {
+    --*(long *)privdata;
+    free(ptr);
+}
+
+#ifndef _WIN32
+typedef struct queueTestState {
+    int calls;
+    int nulls;
+    char last[32];
+} queueTestState;
+
+static void queue_cb(redisAsyncContext *ac, void *r, void *privdata) {
+    queueTestState *state = privdata;
+    redisReply *reply = r;
+    (void)ac;
+
+    state->calls++;
+    if (reply == NULL)
+        state->nulls++;
+    else
+        snprintf(state->last,sizeof(state->last),"%s",reply->str ? reply->str : "");
+}
+
+static void test_queue_offline(void) {
+    redisOptions options = {0};
+    queueTestState loop = {0}, done = {0};
+    redisCompletionQueue *cq;
+    redisAsyncContext *ac;
+    redisAsyncQueue *q;
+    struct pollfd pfd;
+    const char *argv[] = {"GET", "b"}, *s;
+    int fds[2], n;
+
+    assert(socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = fds[0];
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    /* Skip the connection check of the first read event. */
+    ac->c.flags |= REDIS_CONNECTED;
+    q = redisAsyncQueueCreate(ac,NULL,NULL);
+    cq = redisCompletionQueueCreate();
+    assert(q != NULL && cq != NULL);
+
+    test("Queued commands are sent in order when drained: ");
+    assert(redisAsyncQueueCommand(q,cq,queue_cb,&done,"SET a %d",1) == REDIS_OK);
+    assert(redisAsyncQueueCommandArgv(q,NULL,queue_cb,&loop,2,argv,NULL) == REDIS_OK);
+    assert(redisAsyncQueueFormattedCommand(q,cq,queue_cb,&done,"*1\r\n$4\r\nPING\r\n",14) == REDIS_OK);
+    n = redisAsyncQueueDrain(q);
+    test_cond(n == 3 && redisAsyncQueueDrain(q) == 0 &&
+              !strcmp(ac->c.obuf,"*3\r\n$3\r\nSET\r\n$1\r\na\r\n$1\r\n1\r\n"
+                                 "*2\r\n$3\r\nGET\r\n$1\r\nb\r\n"
+                                 "*1\r\n$4\r\nPING\r\n"));
+
+    test("Replies are delivered on the completion queue: ");
+    s = "+OK\r\n$1\r\nv\r\n+PONG\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    pfd.fd = redisCompletionQueueGetFd(cq);
+    pfd.events = POLLIN;
+    assert(poll(&pfd,1,0) == 1);
+    assert(loop.calls == 1 && !strcmp(loop.last,"v") && done.calls == 0);
+    n = redisCompletionQueueRun(cq);
+    test_cond(n == 2 && done.calls == 2 && done.nulls == 0 && !strcmp(done.last,"PONG") &&
+              poll(&pfd,1,0) == 0);
+
+    test("Completion queues reject subscribe commands: ");
+    test_cond(redisAsyncQueueCommand(q,cq,queue_cb,&done,"SUBSCRIBE ch") == REDIS_ERR &&
+              redisAsyncQueueCommand(q,cq,queue_cb,&done,"UNSUBSCRIBE ch") == REDIS_ERR &&
+              redisAsyncQueueCommand(q,cq,queue_cb,&done,"punsubscribe") == REDIS_ERR &&
+              redisAsyncQueueCommand(q,cq,queue_cb,&done,"SUNSUBSCRIBE sh") == REDIS_ERR &&
+              redisAsyncQueueCommand(q,NULL,queue_cb,&loop,"SUBSCRIBE ch") == REDIS_OK);
+    redisAsyncQueueFree(q);
+
+    test("Commands not drained complete with a NULL reply: ");
+    q = redisAsyncQueueCreate(ac,NULL,NULL);
+    assert(redisAsyncQueueCommand(q,cq,queue_cb,&done,"GET a") == REDIS_OK);
+    assert(redisAsyncQueueCommand(q,NULL,queue_cb,&loop,"GET a") == REDIS_OK);
+    redisAsyncQueueFree(q);
+    test_cond(loop.calls == 3 && loop.nulls == 2 && redisCompletionQueueRun(cq) == 1 &&
+              done.calls == 3 && done.nulls == 1);
+
+    redisCompletionQueueFree(cq);
+    redisAsyncFree(ac);
+    close(fds[1]);
+}
+
+static void message_cb(redisAsyncContext *ac, const redisPubSubMessage *msg, void *privdata) {
+    queueTestState *state = privdata;
+    (void)ac;
+
+    state->calls++;
+    snprintf(state->last,sizeof(state->last),"%.*s:%.*s",(int)msg->channel_len,
+             msg->channel,(int)msg->payload_len,msg->payload);
+}
+
+static void test_message_offline(void) {
+    redisOptions options = {0};
+    queueTestState msgs = {0}, pmsgs = {0};
+    redisAsyncContext *ac;
+    const char *s;
+    int fds[2];
+
+    assert(socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = fds[0];
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    /* Skip the connection check of the first read event. */
+    ac->c.flags |= REDIS_CONNECTED;
+    redisAsyncSetMessageCallback(ac,message_cb);
+    assert(redisAsyncCommand(ac,queue_cb,&msgs,"SUBSCRIBE ch") == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&pmsgs,"PSUBSCRIBE p*") == REDIS_OK);
+
+    test("Messages go to the message callback with their privdata: ");
+    s = "*3\r\n$9\r\nsubscribe\r\n$2\r\nch\r\n:1\r\n"
+        "*3\r\n$10\r\npsubscribe\r\n$2\r\np*\r\n:2\r\n"
+        "*3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$2\r\nhi\r\n"
+        "*4\r\n$8\r\npmessage\r\n$2\r\np*\r\n$2\r\npa\r\n$3\r\nbye\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    test_cond(msgs.calls == 2 && !strcmp(msgs.last,"ch:hi") &&
+              pmsgs.calls == 2 && !strcmp(pmsgs.last,"pa:bye"));
+
+    test("Partial messages wait for the rest of the message: ");
+    s = "*3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$5\r\nhel";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    assert(msgs.calls == 2);
+    s = "lo\r\n*3\r\n$7\r\nmessage\r\n$2\r\nxx\r\n$2\r\nhi\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    test_cond(msgs.calls == 3 && !strcmp(msgs.last,"ch:hello"));
+
+    test("Messages go to the subscribe callback without a message callback: ");
+    assert(redisAsyncSetMessageCallback(ac,NULL) == message_cb);
+    s = "*3\r\n$7\r\nmessage\r\n$2\r\nch\r\n$3\r\nraw\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    test_cond(msgs.calls == 4 && msgs.last[0] == '\0');
+
+    redisAsyncFree(ac);
+    close(fds[1]);
+}
+
+static void latency_count_cb(const char *command, const redisHistogram *h, void *privdata) {
+    int *commands = privdata;
+    (void)command;
+    (void)h;
+    (*commands)++;
+}
+
+static void test_latency_offline(void) {
+    redisOptions options = {0};
+    queueTestState state = {0};
+    const redisHistogram *get, *set;
+    redisAsyncContext *ac;
+    char buf[256];
+    const char *s;
+    int fds[2], commands = 0;
+
+    assert(socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = fds[0];
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    /* Skip the connection check of the first read event. */
+    ac->c.flags |= REDIS_CONNECTED;
+
+    test("Latency is only recorded once enabled: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"PING") == REDIS_OK);
+    assert(redisAsyncEnableLatency(ac) == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"get a") == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET b") == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"SET a b") == REDIS_OK);
+    redisAsyncHandleWrite(ac);
+    assert(read(fds[1],buf,sizeof(buf)) > 0);
+    s = "+PONG\r\n$1\r\nx\r\n$-1\r\n+OK\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    assert(state.calls == 4);
+    get = redisAsyncGetLatency(ac,"get");
+    set = redisAsyncGetLatency(ac,"SET");
+    redisAsyncLatencyForEach(ac,latency_count_cb,&commands);
+    test_cond(redisAsyncGetLatency(ac,"PING") == NULL && commands == 2 &&
+              get != NULL && redisHistogramCount(get) == 2 &&
+              set != NULL && redisHistogramCount(set) == 1 &&
+              redisHistogramMax(get) < 1000000);
+
+    test("Resetting latency empties the histograms: ");
+    redisAsyncResetLatency(ac);
+    test_cond(redisAsyncGetLatency(ac,"GET") == get && redisHistogramCount(get) == 0 &&
+              redisHistogramCount(set) == 0);
+
+    redisAsyncFree(ac);
+    close(fds[1]);
+}
+
+/* Send what the context wrote to the peer, and read its answer. */
+static void cache_offline_answer(redisAsyncContext *ac, int fd, const char *reply) {
+    char buf[512];
+
+    redisAsyncHandleWrite(ac);
+    assert(read(fd,buf,sizeof(buf)) > 0);
+    assert(write(fd,reply,strlen(reply)) == (ssize_t)strlen(reply));
+    redisAsyncHandleRead(ac);
+}
+
+static void test_cache_async_offline(void) {
+    redisCacheOptions options = {.max_entries = 100, .policy = REDIS_CACHE_LRU};
+    redisOptions opts = {0};
+    queueTestState state = {0};
+    redisCacheStats stats;
+    redisAsyncContext *ac;
+    redisCache *cache;
+    const char *s;
+    int fds[2];
+
+    assert(socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+    opts.type = REDIS_CONN_USERFD;
+    opts.endpoint.fd = fds[0];
+    ac = redisAsyncConnectWithOptions(&opts);
+    assert(ac != NULL && ac->err == 0);
+    /* Skip the connection check of the first read event. */
+    ac->c.flags |= REDIS_CONNECTED;
+    assert(redisAsyncEnableCache(ac,&options) == REDIS_OK);
+    cache_offline_answer(ac,fds[1],"%1\r\n+server\r\n+redis\r\n+OK\r\n");
+    cache = redisAsyncGetCache(ac);
+
+    test("Async cache answers a read once tracking is enabled: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET k") == REDIS_OK);
+    cache_offline_answer(ac,fds[1],"$1\r\nv\r\n");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET k") == REDIS_OK);
+    test_cond(state.calls == 2 && !strcmp(state.last,"v") && sdslen(ac->c.obuf) == 0);
+
+    /* Once MULTI is answered nothing is pending, yet reads must be queued by
+     * the server, and QUEUED must not be cached. */
+    test("Async cache is bypassed inside a transaction: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"MULTI") == REDIS_OK);
+    cache_offline_answer(ac,fds[1],"+OK\r\n");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET k") == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET n") == REDIS_OK);
+    assert(state.calls == 3 && sdslen(ac->c.obuf) > 0);
+    cache_offline_answer(ac,fds[1],"+QUEUED\r\n+QUEUED\r\n");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"EXEC") == REDIS_OK);
+    cache_offline_answer(ac,fds[1],"*2\r\n$1\r\nw\r\n$1\r\nx\r\n");
+    redisCacheGetStats(cache,&stats);
+    s = cache_get(cache,"GET k");
+    test_cond(state.calls == 6 && stats.entries == 1 && s && !strcmp(s,"v") &&
+              cache_get(cache,"GET n") == NULL);
+
+    test("Async cache is used again after EXEC: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET k") == REDIS_OK);
+    test_cond(state.calls == 7 && !strcmp(state.last,"v") && sdslen(ac->c.obuf) == 0);
+
+    /* The reply to a read sent before SELECT belongs to the previous
+     * database, and must not be cached either. */
+    test("Async cache is emptied by SELECT: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET m") == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"SELECT 1") == REDIS_OK);
+    cache_offline_answer(ac,fds[1],"$1\r\ny\r\n+OK\r\n");
+    redisCacheGetStats(cache,&stats);
+    assert(stats.entries == 0);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET k") == REDIS_OK);
+    assert(state.calls == 9 && sdslen(ac->c.obuf) > 0);
+    cache_offline_answer(ac,fds[1],"$1\r\nz\r\n");
+    s = cache_get(cache,"GET k");
+    test_cond(state.calls == 10 && s && !strcmp(s,"z"));
+
+    test("Async cache is disabled by CLIENT TRACKING: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"CLIENT TRACKING OFF") == REDIS_OK);
+    cache_offline_answer(ac,fds[1],"+OK\r\n");
+    redisCacheGetStats(cache,&stats);
+    assert(stats.entries == 0);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET k") == REDIS_OK);
+    assert(sdslen(ac->c.obuf) > 0);
+    cache_offline_answer(ac,fds[1],"$1\r\nz\r\n");
+    redisCacheGetStats(cache,&stats);
+    test_cond(state.calls == 12 && stats.entries == 0);
+
+    redisAsyncFree(ac);
+    close(fds[1]);
+}
+
+static struct {
+    int disconnects;
+    int status;
+    char errstr[128];
+} reconnect_offline;
+
+static void reconnect_offline_disconnect_cb(const redisAsyncContext *ac, int status) {
+    reconnect_offline.disconnects++;
+    reconnect_offline.status = status;
+    snprintf(reconnect_offline.errstr,sizeof(reconnect_offline.errstr),"%s",ac->errstr);
+}
+
+/* Run the client until its next connection is accepted. */
+static int reconnect_offline_accept(redisAsyncContext *ac, int lfd) {
+    struct pollfd pfd = {lfd, POLLIN, 0};
+    int i;
+
+    for (i = 0; i < 2000 && !reconnect_offline.disconnects; i++) {
+        if (poll(&pfd,1,1) == 1)
+            return accept(lfd,NULL,NULL);
+        redisPollTick(ac,0);
+    }
+    return -1;
+}
+
+/* Run the client until want bytes were received from it, or until it closed
+ * the connection when want is 0. */
+static size_t reconnect_offline_recv(redisAsyncContext *ac, int fd, char *buf, size_t size,
+                                     size_t want)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    size_t len = 0;
+    ssize_t n;
+    int i;
+
+    for (i = 0; i < 2000; i++) {
+        if (poll(&pfd,1,1) == 1) {
+            n = read(fd,buf+len,size-len-1);
+            if (n <= 0)
+                break;
+            len += n;
+            if (want && len >= want)
+                break;
+        }
+        if (!reconnect_offline.disconnects)
+            redisPollTick(ac,0);
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static void test_reconnect_offline(void) {
+    redisAsyncReconnectOptions reconnect = {
+        .min_delay = {.tv_usec = 1000},
+        .max_delay = {.tv_usec = 10000},
+        .max_attempts = 3,
+        .replay = 1
+    };
+    const char *select9 = "*2\r\n$6\r\nSELECT\r\n$1\r\n9\r\n";
+    const char *get = "*2\r\n$3\r\nGET\r\n$3\r\nfoo\r\n";
+    const char *refused = "-ERR DB index is out of range\r\n";
+    struct sockaddr_in sa = {0};
+    socklen_t salen = sizeof(sa);
+    redisOptions options = {0};
+    queueTestState state = {0};
+    redisAsyncContext *ac;
+    char buf[256];
+    size_t len;
+    int lfd, fd, i;
+
+    lfd = socket(AF_INET,SOCK_STREAM,0);
+    assert(lfd != -1);
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(lfd,(struct sockaddr *)&sa,sizeof(sa)) == 0 && listen(lfd,4) == 0);
+    assert(getsockname(lfd,(struct sockaddr *)&sa,&salen) == 0);
+
+    memset(&reconnect_offline,0,sizeof(reconnect_offline));
+    REDIS_OPTIONS_SET_TCP(&options,"127.0.0.1",ntohs(sa.sin_port));
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    assert(redisPollAttach(ac) == REDIS_OK);
+    redisAsyncSetDisconnectCallback(ac,reconnect_offline_disconnect_cb);
+    assert(redisAsyncSetReconnect(ac,&reconnect) == REDIS_OK);
+
+    /* The connection is lost before GET is answered. */
+    assert(redisAsyncCommand(ac,NULL,NULL,"SELECT 9") == REDIS_OK);
+    assert(redisAsyncCommand(ac,NULL,NULL,"SELECT 99") == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET foo") == REDIS_OK);
+    fd = reconnect_offline_accept(ac,lfd);
+    assert(fd != -1);
+    reconnect_offline_recv(ac,fd,buf,sizeof(buf),2 * strlen(select9) + 1 + strlen(get));
+    assert(write(fd,"+OK\r\n",5) == 5);
+    assert(write(fd,refused,strlen(refused)) == (ssize_t)strlen(refused));
+    close(fd);
+
+    test("Async reconnect restores the session state accepted by the server first: ");
+    fd = reconnect_offline_accept(ac,lfd);
+    assert(fd != -1);
+    len = reconnect_offline_recv(ac,fd,buf,sizeof(buf),strlen(select9));
+    test_cond(len == strlen(select9) && strcmp(buf,select9) == 0);
+
+    test("Async reconnect fails the attempt when the session state is refused: ");
+    assert(write(fd,refused,strlen(refused)) == (ssize_t)strlen(refused));
+    len = reconnect_offline_recv(ac,fd,buf,sizeof(buf),0);
+    close(fd);
+    test_cond(len == 0 && state.calls == 0 && reconnect_offline.disconnects == 0);
+
+    test("Async reconnect replays reads once the session state is restored: ");
+    fd = reconnect_offline_accept(ac,lfd);
+    assert(fd != -1);
+    len = reconnect_offline_recv(ac,fd,buf,sizeof(buf),strlen(select9));
+    assert(len == strlen(select9) && strcmp(buf,select9) == 0);
+    assert(write(fd,"+OK\r\n",5) == 5);
+    len = reconnect_offline_recv(ac,fd,buf,sizeof(buf),strlen(get));
+    assert(write(fd,"$3\r\nbar\r\n",9) == 9);
+    for (i = 0; i < 1000 && state.calls == 0; i++)
+        redisPollTick(ac,0.001);
+    test_cond(len == strlen(get) && strcmp(buf,get) == 0 && state.calls == 1 &&
+              strcmp(state.last,"bar") == 0);
+
+    test("Async reconnect gives up when the session state is always refused: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET foo") == REDIS_OK);
+    reconnect_offline_recv(ac,fd,buf,sizeof(buf),strlen(get));
+    close(fd);
+    for (i = 0; i < 3; i++) {
+        fd = reconnect_offline_accept(ac,lfd);
+        assert(fd != -1);
+        reconnect_offline_recv(ac,fd,buf,sizeof(buf),strlen(select9));
+        assert(write(fd,refused,strlen(refused)) == (ssize_t)strlen(refused));
+        len = reconnect_offline_recv(ac,fd,buf,sizeof(buf),0);
+        close(fd);
+    }
+    test_cond(len == 0 && state.calls == 2 && state.nulls == 1 &&
+              reconnect_offline.disconnects == 1 && reconnect_offline.status == REDIS_ERR &&
+              strcmp(reconnect_offline.errstr,"ERR DB index is out of range") == 0);
+
+    close(lfd);
+}
+
+static void shard_cb(redisAsyncContext *ac, void *r, void *privdata) {
+    queueTestState *state = privdata;
+    redisReply *reply = r;
+    (void)ac;
+
+    state->calls++;
+    if (reply == NULL)
+        state->nulls++;
+    else if (reply->element[2]->type == REDIS_REPLY_INTEGER)
+        snprintf(state->last,sizeof(state->last),"%s:%lld",reply->element[0]->str,
+                 reply->element[2]->integer);
+    else
+        snprintf(state->last,sizeof(state->last),"%s:%s",reply->element[0]->str,
+                 reply->element[2]->str);
+}
+
+static void shard_push_cb(redisAsyncContext *ac, void *r) {
+    queueTestState *state = ac->data;
+    (void)r;
+    state->calls++;
+}
+
+static void test_sharded_pubsub_offline(void) {
+    redisOptions options = {0};
+    queueTestState shard = {0}, pushes = {0}, msgs = {0};
+    redisAsyncContext *ac;
+    const char *s;
+    int fds[2];
+
+    assert(socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = fds[0];
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    /* Skip the connection check of the first read event. */
+    ac->c.flags |= REDIS_CONNECTED;
+    ac->data = &pushes;
+    redisAsyncSetPushCallback(ac,shard_push_cb);
+
+    test("Sharded subscriptions get their own replies: ");
+    assert(redisAsyncCommand(ac,shard_cb,&shard,"SSUBSCRIBE sh") == REDIS_OK);
+    s = ">3\r\n$10\r\nssubscribe\r\n$2\r\nsh\r\n:1\r\n"
+        ">3\r\n$8\r\nsmessage\r\n$2\r\nsh\r\n$2\r\nhi\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    test_cond(shard.calls == 2 && !strcmp(shard.last,"smessage:hi") && pushes.calls == 0 &&
+              (ac->c.flags & REDIS_SUBSCRIBED));
+
+    test("A sunsubscribe from the server ends the subscription: ");
+    s = ">3\r\n$12\r\nsunsubscribe\r\n$2\r\nsh\r\n:0\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    test_cond(shard.calls == 3 && !strcmp(shard.last,"sunsubscribe:0") &&
+              !(ac->c.flags & REDIS_SUBSCRIBED));
+
+    test("Shard messages go to the message callback: ");
+    redisAsyncSetMessageCallback(ac,message_cb);
+    assert(redisAsyncCommand(ac,shard_cb,&msgs,"SSUBSCRIBE sh") == REDIS_OK);
+    assert(redisAsyncCommand(ac,shard_cb,&shard,"SUBSCRIBE sh") == REDIS_OK);
+    s = ">3\r\n$10\r\nssubscribe\r\n$2\r\nsh\r\n:1\r\n"
+        ">3\r\n$9\r\nsubscribe\r\n$2\r\nsh\r\n:2\r\n"
+        ">3\r\n$8\r\nsmessage\r\n$2\r\nsh\r\n$3\r\nbye\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    assert(msgs.calls == 2 && !strcmp(msgs.last,"sh:bye") && shard.calls == 4 &&
+           pushes.calls == 0);
+    redisAsyncFree(ac);
+    test_cond(msgs.nulls == 1 && shard.nulls == 1);
+    close(fds[1]);
+}
+
+static void test_context_stats_offline(void) {
+    redisOptions options = {0};
+    queueTestState state = {0};
+    redisContextStats stats;
+    redisAsyncContext *ac;
+    char buf[256];
+    const char *s;
+    int fds[2];
+
+    assert(socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+    assert(fcntl(fds[0],F_SETFL,O_NONBLOCK) == 0);
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = fds[0];
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    /* Skip the connection check of the first read event. */
+    ac->c.flags |= REDIS_CONNECTED;
+
+    test("Context stats count commands waiting for their reply: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET a") == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET b") == REDIS_OK);
+    redisAsyncGetStats(ac,&stats);
+    test_cond(stats.callbacks == 2 && stats.obuf_peak == 2*20 && stats.writes == 0);
+
+    test("Context stats count writes and bytes written: ");
+    redisAsyncHandleWrite(ac);
+    assert(read(fds[1],buf,sizeof(buf)) == 2*20);
+    redisAsyncGetStats(ac,&stats);
+    test_cond(stats.writes == 1 && stats.bytes_written == 2*20 &&
+              stats.partial_writes == 0 && stats.write_again == 0);
+
+    test("Context stats count reads, replies and reader allocations: ");
+    s = "$1\r\nx\r\n*2\r\n:1\r\n+OK\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    redisAsyncGetStats(ac,&stats);
+    test_cond(state.calls == 2 && stats.callbacks == 0 && stats.reads == 1 &&
+              stats.bytes_read == strlen(s) && stats.reader.buf_peak == strlen(s) &&
+              stats.reader.replies[REDIS_REPLY_STRING] == 1 &&
+              stats.reader.replies[REDIS_REPLY_ARRAY] == 1 &&
+              stats.reader.replies[REDIS_REPLY_INTEGER] == 0 &&
+              stats.reader.allocs >= 4);
+
+    test("Context stats count reads that would block: ");
+    redisAsyncHandleRead(ac);
+    redisAsyncGetStats(ac,&stats);
+    test_cond(stats.reads == 2 && stats.read_again == 1 && stats.bytes_read == strlen(s));
+
+    redisAsyncFree(ac);
+    close(fds[1]);
+}
+
+static void test_capture_offline(void) {
+    const char *path = "/tmp/hiredis-test-capture";
+    redisOptions options = {0};
+    redisCaptureRecord record;
+    redisCaptureFile *f;
+    redisContext *c;
+    redisReply *reply;
+    long long start;
+    char buf[256];
+    int fds[2], done;
+
+    assert(socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = fds[0];
+    c = redisConnectWithOptions(&options);
+    assert(c != NULL && c->err == 0);
+
+    test("Capture records what a context writes and reads: ");
+    assert(redisCaptureStart(c,path) == REDIS_OK);
+    assert(redisAppendCommand(c,"GET a") == REDIS_OK);
+    assert(redisBufferWrite(c,&done) == REDIS_OK && done);
+    assert(read(fds[1],buf,sizeof(buf)) == 20);
+    assert(write(fds[1],"+OK\r\n",5) == 5);
+    assert(redisGetReply(c,(void**)&reply) == REDIS_OK);
+    freeReplyObject(reply);
+    redisCaptureStop(c);
+    assert(redisAppendCommand(c,"GET b") == REDIS_OK);
+    assert(redisBufferWrite(c,&done) == REDIS_OK && done);
+    f = redisCaptureOpen(path,&start);
+    test_cond(f != NULL && start > 0 &&
+              redisCaptureNext(f,&record) == 1 && record.type == REDIS_CAPTURE_WRITE &&
+              record.len == 20 && !memcmp(record.buf,"*2\r\n$3\r\nGET\r\n$1\r\na\r\n",20) &&
+              redisCaptureNext(f,&record) == 1 && record.type == REDIS_CAPTURE_READ &&
+              record.len == 5 && !memcmp(record.buf,"+OK\r\n",5) &&
+              redisCaptureNext(f,&record) == 0);
+    redisCaptureClose(f);
+
+    test("Capture files are validated when opened: ");
+    test_cond(redisCaptureOpen("/dev/null",NULL) == NULL);
+
+    unlink(path);
+    redisFree(c);
+    close(fds[1]);
+}
+
+static void test_ring_offline(void) {
+    redisOptions options = {0};
+    queueTestState state = {0};
+    redisAsyncContext *ac;
+    redisContext *c;
+    redisReply *reply;
+    redisRing *ring;
+    struct pollfd pfd;
+    char buf[256];
+
+    ring = redisRingCreate(0);
+    assert(ring != NULL);
+    redisRingSetOptions(ring,&options);
+    c = redisConnectWithOptions(&options);
+    assert(c != NULL && c->err == 0);
+
+    test("Blocking context over a ring: ");
+    assert(redisRingWrite(ring,"+PONG\r\n",7,1) == 7);
+    reply = redisCommand(c,"PING");
+    test_cond(reply != NULL && reply->type == REDIS_REPLY_STATUS &&
+              !strcmp(reply->str,"PONG") &&
+              redisRingRead(ring,buf,sizeof(buf),0) == 14 &&
+              !memcmp(buf,"*1\r\n$4\r\nPING\r\n",14));
+    freeReplyObject(reply);
 
-static void test_free_null(void) {
-    void *redisCtx = NULL;
-    void *reply = NULL;
+    test("Commands fail once the server side of a ring is closed: ");
+    redisRingClose(ring);
+    reply = redisCommand(c,"PING");
+    test_cond(reply == NULL && c->err == REDIS_ERR_EOF);
+    redisFree(c);
 
-    test("Don't fail when redisFree is passed a NULL value: ");
-    redisFree(redisCtx);
-    test_cond(redisCtx == NULL);
+    ring = redisRingCreate(16);
+    assert(ring != NULL);
+    memset(&options,0,sizeof(options));
+    redisRingSetOptions(ring,&options);
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
 
-    test("Don't fail when freeReplyObject is passed a NULL value: ");
-    freeReplyObject(reply);
-    test_cond(reply == NULL);
+    test("Asynchronous context over a ring wakes up on replies: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET %s","key") == REDIS_OK);
+    redisAsyncHandleWrite(ac);
+    redisAsyncHandleWrite(ac);
+    pfd.fd = ac->c.fd;
+    pfd.events = POLLIN;
+    assert(poll(&pfd,1,0) == 0);
+    assert(redisRingRead(ring,buf,sizeof(buf),0) == 16);
+    redisAsyncHandleWrite(ac);
+    assert(redisRingRead(ring,buf + 16,sizeof(buf) - 16,0) == 6 &&
+           !memcmp(buf,"*2\r\n$3\r\nGET\r\n$3\r\nkey\r\n",22));
+    assert(redisRingWrite(ring,"$5\r\nvalue\r\n",11,1) == 11);
+    assert(poll(&pfd,1,0) == 1);
+    redisAsyncHandleRead(ac);
+    test_cond(state.calls == 1 && !strcmp(state.last,"value") && poll(&pfd,1,0) == 0);
+
+    redisAsyncFree(ac);
+    redisRingClose(ring);
+}
+
+static void test_allocator_offline(void) {
+    hiredisAllocator counting = {count_malloc, count_calloc, count_realloc, count_free, NULL};
+    redisOptions options = {0};
+    queueTestState state = {0};
+    redisCompletionQueue *cq;
+    redisAsyncContext *ac;
+    redisAsyncQueue *q;
+    char buf[256];
+    const char *s;
+    long live = 0;
+    int fds[2];
+
+    assert(socketpair(AF_UNIX,SOCK_STREAM,0,fds) == 0);
+    counting.privdata = &live;
+    options.type = REDIS_CONN_USERFD;
+    options.endpoint.fd = fds[0];
+    options.allocator = &counting;
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    ac->c.flags |= REDIS_CONNECTED;
+
+    test("Asynchronous contexts keep callbacks with their own allocator: ");
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET a") == REDIS_OK);
+    assert(redisAsyncCommand(ac,queue_cb,&state,"GET b") == REDIS_OK);
+    test_cond(live == 2);
+
+    test("Asynchronous contexts build replies with their own allocator: ");
+    redisAsyncHandleWrite(ac);
+    assert(read(fds[1],buf,sizeof(buf)) > 0);
+    s = "$1\r\nx\r\n*1\r\n:1\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    test_cond(state.calls == 2 && !strcmp(state.last,"") && live == 0);
+
+    test("Replies taken by a completion queue keep their allocator: ");
+    cq = redisCompletionQueueCreate();
+    q = redisAsyncQueueCreate(ac,NULL,NULL);
+    assert(cq != NULL && q != NULL);
+    assert(redisAsyncQueueCommand(q,cq,queue_cb,&state,"GET a") == REDIS_OK);
+    assert(redisAsyncQueueDrain(q) == 1);
+    redisAsyncHandleWrite(ac);
+    assert(read(fds[1],buf,sizeof(buf)) > 0);
+    s = "$5\r\nhello\r\n";
+    assert(write(fds[1],s,strlen(s)) == (ssize_t)strlen(s));
+    redisAsyncHandleRead(ac);
+    assert(live > 0);
+    test_cond(redisCompletionQueueRun(cq) == 1 && state.calls == 3 &&
+              !strcmp(state.last,"hello") && live == 0);
+    redisAsyncQueueFree(q);
+    redisCompletionQueueFree(cq);
+
+    redisAsyncFree(ac);
+    close(fds[1]);
 }
+#endif
 
 static void *hi_malloc_fail(size_t size) {
     (void)size;
@@ -991,7 +2768,33 @@ static void *hi_realloc_fail(void *ptr, size_t size) {
     return NULL;
 }
 
+static long count_allocs, count_frees;
+
+static void *hi_malloc_count(size_t size) {
+    count_allocs++;
+    return malloc(size);
+}
+
+static void *hi_calloc_count(size_t nmemb, size_t size) {
+    count_allocs++;
+    return calloc(nmemb, size);
+}
+
+static void hi_free_count(void *ptr) {
+    if (ptr != NULL)
+        count_frees++;
+    free(ptr);
+}
+
 static void test_allocator_injection(void) {
+    hiredisAllocator counting = {count_malloc, count_calloc, count_realloc, count_free, NULL};
+    redisAsyncGroupOptions group_options = {0};
+    redisRuntimeOptions runtime_options = {0};
+    redisPoolOptions pool_options = {0};
+    redisOptions options = {0};
+    struct timeval tv = {1, 0};
+    redisReply *reply, *other;
+    long live = 0, allocs, frees;
     void *ptr;
 
     hiredisAllocFuncs ha = {
@@ -1020,8 +2823,80 @@ static void test_allocator_injection(void) {
     ptr = hi_calloc((SIZE_MAX / sizeof(void*)) + 3, sizeof(void*));
     test_cond(ptr == NULL && insecure_calloc_calls == 0);
 
+    /* The connection options are copied, and only the copies freed, when
+     * running out of memory halfway through. */
+    ha.mallocFn = hi_malloc_fail;
+    ha.callocFn = calloc;
+    hiredisSetAllocators(&ha);
+    REDIS_OPTIONS_SET_TCP(&options,"localhost",6379);
+    options.connect_timeout = &tv;
+
+    test("redisPoolCreate keeps the caller's options when out of memory: ");
+    pool_options.options = options;
+    pool_options.max_size = 1;
+    test_cond(redisPoolCreate(&pool_options) == NULL);
+
+    test("redisAsyncGroupCreate keeps the caller's options when out of memory: ");
+    group_options.options = options;
+    group_options.size = 1;
+    test_cond(redisAsyncGroupCreate(&group_options) == NULL);
+
+#ifndef _WIN32
+    test("redisRuntimeCreate keeps the caller's options when out of memory: ");
+    runtime_options.options = options;
+    runtime_options.threads = 1;
+    test_cond(redisRuntimeCreate(&runtime_options) == NULL);
+#endif
+
     // Return allocators to default
     hiredisResetAllocators();
+
+    test("redisReader builds replies with its own allocator: ");
+    counting.privdata = &live;
+    reader = redisReaderCreate();
+    redisReaderSetAllocator(reader,&counting);
+    redisReaderFeed(reader,"*3\r\n$3\r\nfoo\r\n:1\r\n,3.5\r\n",23);
+    assert(redisReaderGetReply(reader,(void**)&reply) == REDIS_OK);
+    /* The array, its elements vector, and each element with its string. */
+    test_cond(reply != NULL && reply->elements == 3 && live == 7 &&
+              !strcmp(reply->element[0]->str,"foo") && reply->element[2]->dval == 3.5);
+
+    test("Replies are freed with the allocator they were built with: ");
+    redisReaderSetAllocator(reader,NULL);
+    freeReplyObject(reply);
+    test_cond(live == 0);
+    redisReaderFree(reader);
+
+#ifndef _WIN32
+    test("Freed reply objects are reused from the object cache: ");
+    ha.mallocFn = hi_malloc_count;
+    ha.callocFn = hi_calloc_count;
+    ha.reallocFn = realloc;
+    ha.freeFn = hi_free_count;
+    hiredisSetAllocators(&ha);
+    hiredisSetObjectCacheLimit(1);
+    reader = redisReaderCreate();
+    redisReaderFeed(reader,":1\r\n:2\r\n:3\r\n",12);
+    assert(redisReaderGetReply(reader,(void**)&reply) == REDIS_OK);
+    freeReplyObject(reply);
+    allocs = count_allocs;
+    assert(redisReaderGetReply(reader,(void**)&reply) == REDIS_OK);
+    test_cond(reply->integer == 2 && count_allocs == allocs);
+
+    test("The object cache keeps up to its limit until flushed: ");
+    assert(redisReaderGetReply(reader,(void**)&other) == REDIS_OK);
+    frees = count_frees;
+    freeReplyObject(reply);
+    freeReplyObject(other);
+    assert(count_frees == frees + 1);
+    hiredisFlushObjectCache();
+    test_cond(count_frees == frees + 2);
+
+    redisReaderFree(reader);
+    hiredisFlushObjectCache();
+    hiredisSetObjectCacheLimit(0);
+    hiredisResetAllocators();
+#endif
 }
 
 #define HIREDIS_BAD_DOMAIN "idontexist-noreally.com"
@@ -2157,6 +4032,245 @@ static void test_monitor(struct config config) {
     /* Verify test checkpoints */
     assert(state.checkpoint == 3);
 }
+
+typedef struct GroupTestState {
+    redisAsyncContext *seen[8];
+    int nseen;
+    int replies;
+    int expected;
+} GroupTestState;
+
+static int group_attach_cb(redisAsyncContext *ac, void *privdata) {
+    (void) privdata;
+    return redisLibeventAttach(ac,base);
+}
+
+/* Expect a PONG, and record the connections replies come from */
+void group_pong_cb(redisAsyncContext *ac, void *r, void *privdata) {
+    redisReply *reply = r;
+    GroupTestState *state = privdata;
+    int i;
+
+    assert(reply != NULL && reply->type == REDIS_REPLY_STATUS);
+    for (i = 0; i < state->nseen && state->seen[i] != ac; i++);
+    if (i == state->nseen)
+        state->seen[state->nseen++] = ac;
+    if (++state->replies == state->expected)
+        event_base_loopbreak(base);
+}
+
+static void test_async_group(struct config config) {
+    GroupTestState state = {.expected = 30};
+    redisAsyncGroup *group;
+    redisContext *c;
+    int i;
+
+    /* Setup event dispatcher with a testcase timeout */
+    base = event_base_new();
+    struct event *timeout = evtimer_new(base, timeout_cb, NULL);
+    assert(timeout != NULL);
+
+    evtimer_assign(timeout,base,timeout_cb,NULL);
+    struct timeval timeout_tv = {.tv_sec = 10};
+    evtimer_add(timeout, &timeout_tv);
+
+    redisAsyncGroupOptions options = {.size = 3, .attach_cb = group_attach_cb};
+    options.options = get_redis_tcp_options(config);
+
+    test("Async group rejects privdata destructors shared by its connections: ");
+    options.options.free_privdata = free;
+    test_cond(redisAsyncGroupCreate(&options) == NULL);
+    options.options.free_privdata = NULL;
+
+    group = redisAsyncGroupCreate(&options);
+    assert(group != NULL);
+
+    test("Async group spreads commands over its connections: ");
+    for (i = 0; i < state.expected; i++)
+        assert(redisAsyncGroupCommand(group,group_pong_cb,&state,"PING") == REDIS_OK);
+    event_base_dispatch(base);
+    test_cond(state.replies == state.expected && state.nseen == 3 &&
+              redisAsyncGroupConnected(group) == 3);
+
+    test("Async group rejects subscribe commands: ");
+    test_cond(redisAsyncGroupCommand(group,NULL,NULL,"SUBSCRIBE mychannel") == REDIS_ERR);
+
+    test("Async group replaces lost connections: ");
+    c = do_connect(config);
+    freeReplyObject(redisCommand(c,"CLIENT KILL TYPE normal SKIPME yes"));
+    disconnect(c, 0);
+    /* Let the group notice and reconnect */
+    for (i = 0; i < 100; i++) {
+        event_base_loop(base,EVLOOP_NONBLOCK);
+        millisleep(10);
+    }
+    memset(&state,0,sizeof(state));
+    state.expected = 30;
+    for (i = 0; i < state.expected; i++)
+        assert(redisAsyncGroupCommand(group,group_pong_cb,&state,"PING") == REDIS_OK);
+    event_base_dispatch(base);
+    test_cond(state.replies == state.expected && redisAsyncGroupConnected(group) == 3);
+
+    redisAsyncGroupFree(group);
+    event_free(timeout);
+    event_base_free(base);
+}
+
+typedef struct ReconnectTestState {
+    redisContext *killer;
+    int connects;
+    int disconnects;
+    int replies;
+} ReconnectTestState;
+
+void reconnect_connect_cb(redisAsyncContext *ac, int status) {
+    ReconnectTestState *state = ac->data;
+    assert(status == REDIS_OK);
+    state->connects++;
+}
+
+void reconnect_disconnect_cb(const redisAsyncContext *ac, int status) {
+    ReconnectTestState *state = ac->data;
+    (void)status;
+    state->disconnects++;
+}
+
+/* Expect the value set in the selected database */
+void reconnect_get_cb(redisAsyncContext *ac, void *r, void *privdata) {
+    redisReply *reply = r;
+    ReconnectTestState *state = privdata;
+
+    assert(reply != NULL && reply->type == REDIS_REPLY_STRING &&
+           strcmp(reply->str,"bar") == 0);
+    if (++state->replies == 2)
+        async_disconnect(ac);
+}
+
+/* Kill our own connection, the GET sent next must be replayed */
+void reconnect_id_cb(redisAsyncContext *ac, void *r, void *privdata) {
+    redisReply *reply = r;
+    ReconnectTestState *state = privdata;
+
+    assert(reply != NULL && reply->type == REDIS_REPLY_INTEGER);
+    freeReplyObject(redisCommand(state->killer,"CLIENT KILL ID %lld",reply->integer));
+    redisAsyncCommand(ac,reconnect_get_cb,state,"GET reconnect:foo");
+}
+
+static void test_async_reconnect(struct config config) {
+    ReconnectTestState state = {0};
+    redisAsyncReconnectOptions reconnect = {
+        .min_delay = {.tv_usec = 10000},
+        .max_delay = {.tv_usec = 100000},
+        .replay = 1
+    };
+    redisOptions options = get_redis_tcp_options(config);
+    redisAsyncContext *ac;
+
+    test("Async reconnect requires a TCP or unix connection: ");
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    ac->c.connection_type = REDIS_CONN_USERFD;
+    test_cond(redisAsyncSetReconnect(ac,&reconnect) == REDIS_ERR);
+    ac->c.connection_type = REDIS_CONN_TCP;
+    redisAsyncFree(ac);
+
+    test("Async reconnect restores the database and replays reads: ");
+    base = event_base_new();
+    struct event *timeout = evtimer_new(base, timeout_cb, NULL);
+    assert(timeout != NULL);
+    struct timeval timeout_tv = {.tv_sec = 10};
+    evtimer_add(timeout, &timeout_tv);
+
+    state.killer = do_connect(config);
+    freeReplyObject(redisCommand(state.killer,"SET reconnect:foo bar"));
+
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    ac->data = &state;
+    redisLibeventAttach(ac,base);
+    redisAsyncSetConnectCallbackNC(ac,reconnect_connect_cb);
+    redisAsyncSetDisconnectCallback(ac,reconnect_disconnect_cb);
+    assert(redisAsyncSetReconnect(ac,&reconnect) == REDIS_OK);
+
+    /* do_connect() selected database 9 */
+    redisAsyncCommand(ac,NULL,NULL,"SELECT 9");
+    redisAsyncCommand(ac,reconnect_get_cb,&state,"GET reconnect:foo");
+    redisAsyncCommand(ac,reconnect_id_cb,&state,"CLIENT ID");
+
+    event_base_dispatch(base);
+    test_cond(state.replies == 2 && state.connects == 2 && state.disconnects == 1);
+
+    disconnect(state.killer, 0);
+    event_free(timeout);
+    event_base_free(base);
+}
+
+typedef struct CacheTestState {
+    redisContext *writer;
+    int checkpoint;
+} CacheTestState;
+
+void cache_get_cb(redisAsyncContext *ac, void *r, void *privdata);
+
+/* Let the invalidation message arrive before reading again */
+void cache_ping_cb(redisAsyncContext *ac, void *r, void *privdata) {
+    (void)r;
+    redisAsyncCommand(ac,cache_get_cb,privdata,"GET cache:foo");
+}
+
+void cache_get_cb(redisAsyncContext *ac, void *r, void *privdata) {
+    redisReply *reply = r;
+    CacheTestState *state = privdata;
+    redisCacheStats stats;
+
+    assert(reply != NULL && reply->type == REDIS_REPLY_STRING);
+    redisCacheGetStats(redisAsyncGetCache(ac),&stats);
+    state->checkpoint++;
+
+    if (state->checkpoint == 1) {
+        /* Filled from the server, then answered from the cache */
+        assert(strcmp(reply->str,"bar") == 0 && stats.entries == 1 && stats.hits == 0);
+        redisAsyncCommand(ac,cache_get_cb,state,"GET cache:foo");
+    } else if (state->checkpoint == 2) {
+        assert(strcmp(reply->str,"bar") == 0 && stats.hits == 1);
+        freeReplyObject(redisCommand(state->writer,"SET cache:foo baz"));
+        redisAsyncCommand(ac,cache_ping_cb,state,"PING");
+    } else {
+        assert(strcmp(reply->str,"baz") == 0 && stats.invalidations == 1);
+        async_disconnect(ac);
+    }
+}
+
+static void test_async_cache(struct config config) {
+    CacheTestState state = {0};
+    redisCacheOptions cache = {.max_entries = 100, .policy = REDIS_CACHE_LRU};
+    redisOptions options = get_redis_tcp_options(config);
+    redisAsyncContext *ac;
+
+    test("Async cache is invalidated by the server: ");
+    base = event_base_new();
+    struct event *timeout = evtimer_new(base, timeout_cb, NULL);
+    assert(timeout != NULL);
+    struct timeval timeout_tv = {.tv_sec = 10};
+    evtimer_add(timeout, &timeout_tv);
+
+    state.writer = do_connect(config);
+    freeReplyObject(redisCommand(state.writer,"SET cache:foo bar"));
+
+    ac = redisAsyncConnectWithOptions(&options);
+    assert(ac != NULL && ac->err == 0);
+    redisLibeventAttach(ac,base);
+    assert(redisAsyncEnableCache(ac,&cache) == REDIS_OK);
+    redisAsyncCommand(ac,NULL,NULL,"SELECT 9");
+    redisAsyncCommand(ac,cache_get_cb,&state,"GET cache:foo");
+
+    event_base_dispatch(base);
+    test_cond(state.checkpoint == 3);
+
+    disconnect(state.writer, 0);
+    event_free(timeout);
+    event_base_free(base);
+}
 #endif /* HIREDIS_TEST_ASYNC */
 
 /* tests for async api using polling adapter, requires no extra libraries*/
@@ -2506,6 +4620,197 @@ static void test_ssl_verify_name(struct config config) {
     test_cond(ssl_ctx == NULL && ssl_error == REDIS_SSL_CTX_VERIFY_NAME_FAILED);
     redisFreeSSLContext(ssl_ctx);
 }
+
+/* Connect and complete a round trip, so TLS 1.3 tickets sent after the
+ * handshake have been received by the time this returns. */
+static redisContext *do_ssl_connect_with_context(struct config config, redisSSLContext *ssl_ctx) {
+    redisContext *c = redisConnect(config.ssl.host, config.ssl.port);
+    assert(c != NULL && c->err == 0);
+    assert(redisInitiateSSLWithContext(c, ssl_ctx) == REDIS_OK);
+    freeReplyObject(redisCommand(c, "PING"));
+    return c;
+}
+
+static void test_ssl_session_resumption(struct config config) {
+    redisSSLContextError ssl_error = REDIS_SSL_CTX_NONE;
+    redisSSLOptions options = {
+        .cacert_filename = config.ssl.ca_cert,
+        .cert_filename = config.ssl.cert,
+        .private_key_filename = config.ssl.key,
+        .verify_mode = REDIS_SSL_VERIFY_PEER,
+    };
+    redisSSLContext *ssl_ctx;
+    redisContext *c, *c2;
+    redisReply *reply;
+
+    ssl_ctx = redisCreateSSLContextWithOptions(&options, &ssl_error);
+    assert(ssl_ctx != NULL);
+
+    test("SSL first connection performs a full handshake: ");
+    c = do_ssl_connect_with_context(config, ssl_ctx);
+    test_cond(c->err == 0 && redisIsSSLSessionReused(c) == 0);
+
+    test("SSL session is resumed after redisReconnect: ");
+    redisReconnect(c);
+    redisInitiateSSLWithContext(c, ssl_ctx);
+    reply = redisCommand(c, "PING");
+    test_cond(c->err == 0 && reply != NULL && reply->type == REDIS_REPLY_STATUS &&
+              redisIsSSLSessionReused(c) == 1);
+    freeReplyObject(reply);
+
+    test("SSL session is resumed by a new context using the same SSL context: ");
+    c2 = do_ssl_connect_with_context(config, ssl_ctx);
+    test_cond(c2->err == 0 && redisIsSSLSessionReused(c2) == 1);
+    redisFree(c2);
+
+    /* The session cache is shared with live connections, so they must keep
+     * working once the SSL context that created them is gone. */
+    test("SSL connections outlive their SSL context: ");
+    redisFreeSSLContext(ssl_ctx);
+    reply = redisCommand(c, "PING");
+    test_cond(c->err == 0 && reply != NULL && reply->type == REDIS_REPLY_STATUS);
+    freeReplyObject(reply);
+    redisFree(c);
+
+    test("SSL session resumption can be disabled: ");
+    options.session_cache_size = -1;
+    ssl_ctx = redisCreateSSLContextWithOptions(&options, &ssl_error);
+    assert(ssl_ctx != NULL);
+    c = do_ssl_connect_with_context(config, ssl_ctx);
+    redisReconnect(c);
+    redisInitiateSSLWithContext(c, ssl_ctx);
+    freeReplyObject(redisCommand(c, "PING"));
+    test_cond(c->err == 0 && redisIsSSLSessionReused(c) == 0);
+    redisFree(c);
+    redisFreeSSLContext(ssl_ctx);
+}
+
+static void test_ssl_low_memory(struct config config) {
+    redisSSLContextError ssl_error = REDIS_SSL_CTX_NONE;
+    redisSSLOptions options = {
+        .cacert_filename = config.ssl.ca_cert,
+        .cert_filename = config.ssl.cert,
+        .private_key_filename = config.ssl.key,
+        .verify_mode = REDIS_SSL_VERIFY_PEER,
+        .options = REDIS_SSL_OPT_RELEASE_BUFFERS,
+        .max_send_fragment = 512,
+        .read_ahead_len = 4096,
+    };
+    redisSSLContext *ssl_ctx;
+    redisContext *c;
+    redisReply *reply;
+    size_t len = 1024 * 1024;
+    char *value;
+
+    test("SSL context rejects an out of range record size: ");
+    options.max_send_fragment = 100;
+    ssl_ctx = redisCreateSSLContextWithOptions(&options, &ssl_error);
+    test_cond(ssl_ctx == NULL && ssl_error == REDIS_SSL_CTX_INVALID_OPTION);
+    options.max_send_fragment = 512;
+
+    ssl_ctx = redisCreateSSLContextWithOptions(&options, &ssl_error);
+    assert(ssl_ctx != NULL);
+    c = do_ssl_connect_with_context(config, ssl_ctx);
+
+    /* A value spanning many small records exercises partial writes. */
+    test("SSL with released buffers and small records round trips large values: ");
+    value = malloc(len);
+    assert(value != NULL);
+    memset(value, 'x', len);
+    freeReplyObject(redisCommand(c, "SET hiredis:ssl:big %b", value, len));
+    reply = redisCommand(c, "GET hiredis:ssl:big");
+    test_cond(c->err == 0 && reply != NULL && reply->type == REDIS_REPLY_STRING &&
+              reply->len == len && memcmp(reply->str, value, len) == 0);
+    freeReplyObject(reply);
+    freeReplyObject(redisCommand(c, "DEL hiredis:ssl:big"));
+    free(value);
+
+    redisFree(c);
+    redisFreeSSLContext(ssl_ctx);
+}
+
+/* kTLS is only used when both OpenSSL and the kernel support it, so these
+ * tests hold either way: with it, writes take the plain socket path; without
+ * it, the option is ignored and the connection stays with OpenSSL. */
+static void test_ssl_ktls(struct config config) {
+    redisSSLContextError ssl_error = REDIS_SSL_CTX_NONE;
+    redisSSLOptions options = {
+        .cacert_filename = config.ssl.ca_cert,
+        .cert_filename = config.ssl.cert,
+        .private_key_filename = config.ssl.key,
+        .verify_mode = REDIS_SSL_VERIFY_PEER,
+    };
+    redisSSLContext *ssl_ctx;
+    redisContext *c;
+    redisReply *reply;
+    size_t len = 1024 * 1024;
+    char *value;
+    int flags;
+
+    test("SSL kTLS flags are 0 for a non SSL connection: ");
+    c = redisConnect(config.ssl.host, config.ssl.port);
+    assert(c != NULL && c->err == 0);
+    test_cond(redisGetSSLKTLSFlags(c) == 0 && redisGetSSLKTLSFlags(NULL) == 0);
+    redisFree(c);
+
+    test("SSL kTLS flags are 0 without REDIS_SSL_OPT_ENABLE_KTLS: ");
+    ssl_ctx = redisCreateSSLContextWithOptions(&options, &ssl_error);
+    assert(ssl_ctx != NULL);
+    c = do_ssl_connect_with_context(config, ssl_ctx);
+    test_cond(c->err == 0 && redisGetSSLKTLSFlags(c) == 0);
+    redisFree(c);
+    redisFreeSSLContext(ssl_ctx);
+
+    test("SSL context accepts REDIS_SSL_OPT_ENABLE_KTLS: ");
+    options.options = REDIS_SSL_OPT_ENABLE_KTLS;
+    ssl_ctx = redisCreateSSLContextWithOptions(&options, &ssl_error);
+    test_cond(ssl_ctx != NULL && ssl_error == REDIS_SSL_CTX_NONE);
+    assert(ssl_ctx != NULL);
+
+    c = do_ssl_connect_with_context(config, ssl_ctx);
+    flags = redisGetSSLKTLSFlags(c);
+
+    test("SSL kTLS flags only report known directions: ");
+    test_cond(c->err == 0 && (flags & ~(REDIS_SSL_KTLS_SEND | REDIS_SSL_KTLS_RECV)) == 0);
+
+    /* A value spanning many records and a pipeline both go through the write
+     * path the connection settled on, kernel or OpenSSL. */
+    test("SSL with REDIS_SSL_OPT_ENABLE_KTLS round trips large values: ");
+    value = malloc(len);
+    assert(value != NULL);
+    memset(value, 'k', len);
+    freeReplyObject(redisCommand(c, "SET hiredis:ssl:ktls %b", value, len));
+    reply = redisCommand(c, "GET hiredis:ssl:ktls");
+    test_cond(c->err == 0 && reply != NULL && reply->type == REDIS_REPLY_STRING &&
+              reply->len == len && memcmp(reply->str, value, len) == 0);
+    freeReplyObject(reply);
+    free(value);
+
+    test("SSL with REDIS_SSL_OPT_ENABLE_KTLS handles pipelined commands: ");
+    freeReplyObject(redisCommand(c, "DEL hiredis:ssl:ktls:n"));
+    for (int i = 0; i < 100; i++)
+        assert(redisAppendCommand(c, "INCR hiredis:ssl:ktls:n") == REDIS_OK);
+    for (int i = 0; i < 100; i++) {
+        assert(redisGetReply(c, (void **)&reply) == REDIS_OK);
+        if (i < 99)
+            freeReplyObject(reply);
+    }
+    test_cond(c->err == 0 && reply->type == REDIS_REPLY_INTEGER && reply->integer == 100);
+    freeReplyObject(reply);
+    freeReplyObject(redisCommand(c, "DEL hiredis:ssl:ktls hiredis:ssl:ktls:n"));
+
+    /* The offload state is per connection and set again after reconnecting. */
+    test("SSL kTLS state is the same after redisReconnect: ");
+    redisReconnect(c);
+    redisInitiateSSLWithContext(c, ssl_ctx);
+    reply = redisCommand(c, "PING");
+    test_cond(c->err == 0 && reply != NULL && reply->type == REDIS_REPLY_STATUS &&
+              redisGetSSLKTLSFlags(c) == flags);
+    freeReplyObject(reply);
+
+    redisFree(c);
+    redisFreeSSLContext(ssl_ctx);
+}
 #endif
 
 int main(int argc, char **argv) {
@@ -2585,6 +4890,25 @@ int main(int argc, char **argv) {
     test_reply_reader();
     test_blocking_connection_errors();
     test_free_null();
+    test_cluster_offline();
+    test_cache_offline();
+    test_dict();
+    test_histogram();
+#ifndef _WIN32
+    test_queue_offline();
+    test_message_offline();
+    test_sharded_pubsub_offline();
+    test_context_stats_offline();
+    test_capture_offline();
+    test_ring_offline();
+    test_allocator_offline();
+    test_latency_offline();
+    test_cache_async_offline();
+    test_reconnect_offline();
+    test_cluster_routing_offline();
+    test_cluster_pipeline_offline();
+    test_cluster_fanout_offline();
+#endif
 
     printf("\nTesting against TCP connection (%s:%d):\n", cfg.tcp.host, cfg.tcp.port);
     cfg.type = CONN_TCP;
@@ -2594,6 +4918,10 @@ int main(int argc, char **argv) {
     test_invalid_timeout_errors(cfg);
     test_append_formatted_commands(cfg);
     test_tcp_options(cfg);
+    test_pool(cfg);
+#ifndef _WIN32
+    test_runtime(cfg);
+#endif
     if (throughput) test_throughput(cfg);
 
     printf("\nTesting against Unix socket connection (%s): ", cfg.unix_sock.path);
@@ -2629,6 +4957,9 @@ int main(int argc, char **argv) {
 
         if (cfg.ssl.verify_name)
             test_ssl_verify_name(cfg);
+        test_ssl_session_resumption(cfg);
+        test_ssl_low_memory(cfg);
+        test_ssl_ktls(cfg);
 
         redisFreeSSLContext(_ssl_ctx);
         _ssl_ctx = NULL;
@@ -2648,9 +4979,12 @@ int main(int argc, char **argv) {
     test_pubsub_handling(cfg);
     test_pubsub_multiple_channels(cfg);
     test_monitor(cfg);
+    test_async_group(cfg);
+    test_async_reconnect(cfg);
     if (major >= 6) {
         test_pubsub_handling_resp3(cfg);
         test_command_timeout_during_pubsub(cfg);
+        test_async_cache(cfg);
     }
 #endif /* HIREDIS_TEST_ASYNC */
 
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2026, Redis Ltd.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __HIREDIS_TRACE_H
+#define __HIREDIS_TRACE_H
+
+/* Static tracepoints (USDT) in the "hiredis" provider, built in with
+ * HIREDIS_USE_USDT (make USE_USDT=1, or cmake -DENABLE_USDT=ON) and
+ * <sys/sdt.h> from SystemTap. An unattached probe is a single nop, so they
+ * can be left enabled in production builds. Without HIREDIS_USE_USDT they
+ * compile to nothing. The probes and their arguments are listed in the
+ * README. */
+#ifdef HIREDIS_USE_USDT
+#include <sys/sdt.h>
+#define redisTrace1(name, a) DTRACE_PROBE1(hiredis, name, a)
+#define redisTrace2(name, a, b) DTRACE_PROBE2(hiredis, name, a, b)
+#define redisTrace3(name, a, b, c) DTRACE_PROBE3(hiredis, name, a, b, c)
+#else
+#define redisTrace1(name, a) ((void)0)
+#define redisTrace2(name, a, b) ((void)0)
+#define redisTrace3(name, a, b, c) ((void)0)
+#endif
+
+#endif